@@ -0,0 +1,674 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "batch.h"
+#include "job.h"
+#include "parallel.h"
+#include "bmpio.h"
+
+/*
+ * batch.c
+ * Author: Simon Hillel
+ * Description: Implementation of the batch mode.
+ * The parent indexes the manifest (file offset of each unit's first line), then forks the
+ * workers, which share the index and a block of counters mapped before the fork. Each worker
+ * gets an equal share of the CPUs for its own filter threads.
+ * A unit is claimed with a one-byte record lock (fcntl) at offset <unit> of the state
+ * directory's claims file. The lock belongs to the worker process, so the kernel releases it
+ * if the worker dies and the unit can be claimed again, by this run or the next one. A
+ * finished unit is recorded as unit-<n>.done: written to a temporary file, flushed to disk,
+ * then renamed, so the record either exists complete or not at all. Workers start at evenly
+ * spaced units and skip units that are done or locked; a worker that skipped a locked unit
+ * passes over the units again until it is done, so the claim of a worker that died is taken
+ * over by one still running. If no worker is left, the parent starts the workers once more
+ * for the units still without a record.
+ * Admission: a worker adds its job's predicted peak to a shared total with a compare-and-swap
+ * that only succeeds while the total stays within the budget (a job runs alone if it exceeds
+ * the budget by itself), and subtracts it when the job ends; the parent returns the
+ * reservation of a worker that died. While a job waits for memory, newly arriving jobs wait
+ * too, so the running total drains and a large job is not overtaken forever by a stream of
+ * smaller ones. The actual peak is the growth of the worker's peak RSS
+ * (VmHWM, reset through /proc/self/clear_refs) over its RSS before the job.
+ * The state directory also records the manifest size and modification time; a run refuses
+ * to resume against a manifest that changed, since the units would no longer match.
+ */
+
+// Counters of one worker, shared with the parent
+typedef struct {
+    atomic_ulong jobs;
+    atomic_ulong failed;
+    atomic_ulong units;
+    atomic_ullong readBytes;      // Image I/O of the worker (bmpio_stats)
+    atomic_ullong readMicros;
+    atomic_ullong writtenBytes;
+    atomic_ullong writeMicros;
+    atomic_ullong reserved;       // Predicted peak of the running job, admitted
+    atomic_int waiting;           // 1 while a job of this worker waits for memory
+    atomic_ulong waits;           // Jobs that waited for memory
+    atomic_ulong measured;        // Jobs with both a prediction and a measured peak
+    atomic_ullong predictedBytes; // Sums over the measured jobs
+    atomic_ullong actualBytes;
+    atomic_ulong overruns;        // Measured jobs above their prediction
+    atomic_ulong worstPermille;   // Highest actual / predicted ratio, in thousandths
+} t_batchCounters;
+
+// Memory admission, shared by the workers
+typedef struct {
+    unsigned long long budget;
+    atomic_ullong admitted;       // Sum of the predicted peaks of the running jobs
+    atomic_int waiting;           // Jobs waiting for memory; newcomers queue behind them
+    atomic_ullong peakAdmitted;
+} t_batchMemory;
+
+// State shared by the parent and the workers
+typedef struct {
+    const char * manifest;
+    char stateDir[1024];
+    off_t * unitOffsets;          // File offset of the first line of each unit
+    int numUnits;
+    t_batchCounters * counters;   // One per worker, in shared memory
+    t_batchMemory * memory;       // In shared memory
+} t_batch;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void unitPath(const t_batch * batch, int unit, const char * suffix, char * path, size_t size) {
+    snprintf(path, size, "%s/unit-%d.done%s", batch->stateDir, unit, suffix);
+}
+
+static int unitDone(const t_batch * batch, int unit) {
+    char path[1100];
+    unitPath(batch, unit, "", path, sizeof(path));
+    return access(path, F_OK) == 0;
+}
+
+/**
+ * Tries to lock (or unlocks) the claim byte of a unit without waiting.
+ * @return 0 on success, -1 if another worker holds it.
+ */
+static int claimUnit(int claimsFd, int unit, int lock) {
+    struct flock claim;
+    memset(&claim, 0, sizeof(claim));
+    claim.l_type = lock ? F_WRLCK : F_UNLCK;
+    claim.l_whence = SEEK_SET;
+    claim.l_start = unit;
+    claim.l_len = 1;
+    return fcntl(claimsFd, F_SETLK, &claim) == 0 ? 0 : -1;
+}
+
+/**
+ * Writes a file durably: temporary file, fsync, rename, fsync of the directory.
+ * @return 0 on success, -1 on failure.
+ */
+static int writeDurably(const char * dir, const char * path, const char * tmpPath, const char * text) {
+    int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    size_t length = strlen(text);
+    int ok = write(fd, text, length) == (ssize_t)length && fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmpPath, path) != 0) {
+        unlink(tmpPath);
+        return -1;
+    }
+    int dirFd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    return 0;
+}
+
+// --- Workers --- //
+
+/**
+ * Publishes the image I/O totals of this worker to the parent.
+ */
+static void publishIo(t_batchCounters * counters) {
+    t_ioStats stats;
+    bmpio_stats(&stats);
+    atomic_store(&counters->readBytes, stats.readBytes);
+    atomic_store(&counters->readMicros, (unsigned long long)(stats.readSeconds * 1e6));
+    atomic_store(&counters->writtenBytes, stats.writtenBytes);
+    atomic_store(&counters->writeMicros, (unsigned long long)(stats.writeSeconds * 1e6));
+}
+
+/**
+ * Returns the memory budget of the running jobs: IMAGE_MEM_BUDGET_MB, or half of the
+ * physical memory.
+ */
+static unsigned long long memoryBudget(void) {
+    const char * env = getenv("IMAGE_MEM_BUDGET_MB");
+    if (env && strtoll(env, NULL, 10) > 0) return (unsigned long long)strtoll(env, NULL, 10) << 20;
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    return pages > 0 && pageSize > 0 ? (unsigned long long)pages * pageSize / 2 : 1ULL << 30;
+}
+
+/**
+ * Waits until a job of the given predicted peak fits in the budget, then reserves it. A job
+ * arriving while others wait for memory waits behind them, even if it would fit.
+ */
+static void admit(t_batch * batch, t_batchCounters * counters, unsigned long long bytes) {
+    t_batchMemory * memory = batch->memory;
+    int waited = 0;
+    unsigned long long admitted = atomic_load(&memory->admitted);
+    for (;;) {
+        int turn = waited || atomic_load(&memory->waiting) == 0;
+        if (turn && (admitted == 0 || admitted + bytes <= memory->budget)) {
+            if (atomic_compare_exchange_weak(&memory->admitted, &admitted, admitted + bytes)) break;
+            continue;
+        }
+        if (!waited) {
+            atomic_fetch_add(&counters->waits, 1);
+            atomic_store(&counters->waiting, 1);
+            atomic_fetch_add(&memory->waiting, 1);
+            waited = 1;
+        }
+        usleep(BATCH_ADMIT_POLL_MS * 1000);
+        admitted = atomic_load(&memory->admitted);
+    }
+    atomic_store(&counters->reserved, bytes);
+    if (atomic_exchange(&counters->waiting, 0)) atomic_fetch_sub(&memory->waiting, 1);
+
+    unsigned long long total = admitted + bytes;
+    unsigned long long peak = atomic_load(&memory->peakAdmitted);
+    while (total > peak && !atomic_compare_exchange_weak(&memory->peakAdmitted, &peak, total)) {}
+}
+
+/**
+ * Returns the reservation of the job that ended, or the reservation and the place in the
+ * queue of a worker that died.
+ */
+static void release(t_batch * batch, t_batchCounters * counters) {
+    atomic_fetch_sub(&batch->memory->admitted, atomic_exchange(&counters->reserved, 0));
+    if (atomic_exchange(&counters->waiting, 0)) atomic_fetch_sub(&batch->memory->waiting, 1);
+}
+
+/**
+ * Returns a field of /proc/self/status in kB ("VmRSS:", "VmHWM:"), or -1.
+ */
+static long statusKb(const char * key) {
+    FILE * file = fopen("/proc/self/status", "r");
+    if (!file) return -1;
+    char line[256];
+    long value = -1;
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, key, strlen(key)) == 0) {
+            value = strtol(line + strlen(key), NULL, 10);
+            break;
+        }
+    }
+    fclose(file);
+    return value;
+}
+
+/**
+ * Resets the peak RSS of this process to its current RSS.
+ * @return 0 on success, -1 if the kernel does not allow it.
+ */
+static int resetPeak(void) {
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd < 0) return -1;
+    int ok = write(fd, "5", 1) == 1;
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+/**
+ * Runs one job line once the memory budget admits it, and records its predicted and
+ * measured peak.
+ * @return 0 on success, -1 with a message on failure.
+ */
+static int runJob(t_batch * batch, t_batchCounters * counters, char * text, char * error, size_t errorSize) {
+    char * input, * output, * chain;
+    if (job_split(text, &input, &output, &chain) != 0) {
+        snprintf(error, errorSize, "expected: <input> <output> [<op>,<op>,...]");
+        return -1;
+    }
+
+    size_t predicted = 0;
+    int known = job_predictPeak(input, output, chain, &predicted) == 0;
+    admit(batch, counters, predicted);
+
+    // Freed blocks the allocator keeps would hide the job's own growth
+    malloc_trim(0);
+    long before = statusKb("VmRSS:");
+    int measuring = before >= 0 && resetPeak() == 0;
+
+    t_jobResult result;
+    int status = job_run(input, output, chain, &result, error, errorSize);
+
+    long peak = measuring ? statusKb("VmHWM:") : -1;
+    release(batch, counters);
+    if (known && predicted > 0 && peak >= 0) {
+        unsigned long long actual = peak > before ? (unsigned long long)(peak - before) << 10 : 0;
+        atomic_fetch_add(&counters->measured, 1);
+        atomic_fetch_add(&counters->predictedBytes, predicted);
+        atomic_fetch_add(&counters->actualBytes, actual);
+        if (actual > predicted) atomic_fetch_add(&counters->overruns, 1);
+        unsigned long permille = (unsigned long)(actual * 1000 / predicted);
+        if (permille > atomic_load(&counters->worstPermille)) atomic_store(&counters->worstPermille, permille);
+    }
+    return status;
+}
+
+/**
+ * Runs the jobs of one unit and records it as done.
+ * @return 0 on success, -1 if the manifest cannot be read or the record cannot be written.
+ */
+static int runUnit(t_batch * batch, FILE * manifest, int unit, t_batchCounters * counters) {
+    if (fseeko(manifest, batch->unitOffsets[unit], SEEK_SET) != 0) return -1;
+
+    // Record: totals line, then one line per failed job
+    size_t recordSize = 256;
+    size_t recordLength = 0;
+    char * failures = (char *)malloc(recordSize);
+    if (!failures) return -1;
+    failures[0] = '\0';
+
+    char * line = NULL;
+    size_t lineCapacity = 0;
+    unsigned long jobs = 0, failed = 0;
+    double start = now();
+    for (int i = 0; i < BATCH_UNIT_LINES; i++) {
+        ssize_t length = getline(&line, &lineCapacity, manifest);
+        if (length < 0) break;
+        line[strcspn(line, "\r\n")] = '\0';
+        char * text = line + strspn(line, " \t");
+        if (text[0] == '\0' || text[0] == '#') continue;
+
+        char error[256];
+        int status = runJob(batch, counters, text, error, sizeof(error));
+        jobs++;
+        atomic_fetch_add(&counters->jobs, 1);
+        publishIo(counters);
+        if (status == 0) continue;
+
+        failed++;
+        atomic_fetch_add(&counters->failed, 1);
+        char entry[512];
+        int entryLength = snprintf(entry, sizeof(entry), "line %d: %s\n",
+                                   unit * BATCH_UNIT_LINES + i + 1, error);
+        if (recordLength + entryLength + 1 > recordSize) {
+            recordSize = (recordLength + entryLength + 1) * 2;
+            char * grown = (char *)realloc(failures, recordSize);
+            if (!grown) continue;
+            failures = grown;
+        }
+        memcpy(failures + recordLength, entry, entryLength + 1);
+        recordLength += entryLength;
+    }
+    free(line);
+
+    char header[128];
+    snprintf(header, sizeof(header), "jobs %lu failed %lu seconds %.3f\n", jobs, failed, now() - start);
+    char * record = (char *)malloc(strlen(header) + recordLength + 1);
+    int status = -1;
+    if (record) {
+        strcpy(record, header);
+        strcat(record, failures);
+        char path[1100], tmpPath[1100];
+        unitPath(batch, unit, "", path, sizeof(path));
+        unitPath(batch, unit, ".tmp", tmpPath, sizeof(tmpPath));
+        status = writeDurably(batch->stateDir, path, tmpPath, record);
+        free(record);
+    }
+    free(failures);
+    if (status == 0) atomic_fetch_add(&counters->units, 1);
+    return status;
+}
+
+/**
+ * Worker process: claims and runs units until none is left, starting at its share. Units
+ * locked by another worker are retried until they are done or their claim is released.
+ */
+static int runWorker(t_batch * batch, int worker, int numWorkers) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus > numWorkers ? (int)(cpus / numWorkers) : 1;
+    parallel_configure(threads, -1, -1);
+
+    char claimsPath[1100];
+    snprintf(claimsPath, sizeof(claimsPath), "%s/claims", batch->stateDir);
+    int claimsFd = open(claimsPath, O_RDWR | O_CREAT, 0644);
+    FILE * manifest = fopen(batch->manifest, "r");
+    if (claimsFd < 0 || !manifest) {
+        printf("Error: Worker %d cannot open the manifest or the claims file\n", worker);
+        if (claimsFd >= 0) close(claimsFd);
+        if (manifest) fclose(manifest);
+        return 1;
+    }
+
+    int status = 0;
+    int first = (int)((long long)batch->numUnits * worker / numWorkers);
+    for (;;) {
+        int locked = 0;
+        for (int k = 0; k < batch->numUnits; k++) {
+            int unit = (first + k) % batch->numUnits;
+            if (unitDone(batch, unit)) continue;
+            if (claimUnit(claimsFd, unit, 1) != 0) {
+                locked++;
+                continue;
+            }
+            // Another worker may have finished the unit between the check and the claim
+            if (!unitDone(batch, unit) && runUnit(batch, manifest, unit, &batch->counters[worker]) != 0) {
+                printf("Error: Worker %d cannot record unit %d\n", worker, unit);
+                status = 1;
+            }
+            claimUnit(claimsFd, unit, 0);
+        }
+        // A unit that cannot be recorded is not retried
+        if (locked == 0 || status != 0) break;
+        usleep(BATCH_CLAIM_POLL_MS * 1000);
+    }
+    fclose(manifest);
+    close(claimsFd);
+    return status;
+}
+
+// --- Parent --- //
+
+/**
+ * Indexes the manifest: offset of the first line of every unit.
+ * @return 0 on success, -1 on failure.
+ */
+static int indexManifest(t_batch * batch) {
+    FILE * file = fopen(batch->manifest, "r");
+    if (!file) {
+        printf("Error: Cannot open manifest %s\n", batch->manifest);
+        return -1;
+    }
+
+    int capacity = 1024;
+    batch->unitOffsets = (off_t *)malloc(capacity * sizeof(off_t));
+    batch->numUnits = 0;
+    long long lines = 0;
+    off_t offset = 0;
+    int c = EOF, atLineStart = 1;
+    while (batch->unitOffsets && (c = getc(file)) != EOF) {
+        if (atLineStart && lines % BATCH_UNIT_LINES == 0) {
+            if (batch->numUnits == capacity) {
+                capacity *= 2;
+                off_t * grown = (off_t *)realloc(batch->unitOffsets, capacity * sizeof(off_t));
+                if (!grown) {
+                    free(batch->unitOffsets);
+                    batch->unitOffsets = NULL;
+                    break;
+                }
+                batch->unitOffsets = grown;
+            }
+            batch->unitOffsets[batch->numUnits++] = offset;
+        }
+        atLineStart = c == '\n';
+        if (atLineStart) lines++;
+        offset++;
+    }
+    fclose(file);
+    if (!batch->unitOffsets) {
+        printf("Error: Memory allocation failed for the manifest index\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Creates the state directory, or checks that it belongs to the same manifest.
+ * @return 0 on success, -1 on failure.
+ */
+static int prepareState(t_batch * batch) {
+    struct stat info;
+    if (stat(batch->manifest, &info) != 0) {
+        printf("Error: Cannot open manifest %s\n", batch->manifest);
+        return -1;
+    }
+    char signature[128];
+    snprintf(signature, sizeof(signature), "size %lld mtime %lld units %d\n", (long long)info.st_size,
+             (long long)info.st_mtime, batch->numUnits);
+
+    if (mkdir(batch->stateDir, 0755) != 0 && errno != EEXIST) {
+        printf("Error: Cannot create state directory %s\n", batch->stateDir);
+        return -1;
+    }
+    char path[1100], tmpPath[1100];
+    snprintf(path, sizeof(path), "%s/manifest", batch->stateDir);
+    snprintf(tmpPath, sizeof(tmpPath), "%s/manifest.tmp", batch->stateDir);
+
+    FILE * file = fopen(path, "r");
+    if (file) {
+        char recorded[128] = "";
+        if (!fgets(recorded, sizeof(recorded), file)) recorded[0] = '\0';
+        fclose(file);
+        if (strcmp(recorded, signature) != 0) {
+            printf("Error: %s changed since the previous run; remove %s to start over\n",
+                   batch->manifest, batch->stateDir);
+            return -1;
+        }
+        return 0;
+    }
+    if (writeDurably(batch->stateDir, path, tmpPath, signature) != 0) {
+        printf("Error: Cannot write to state directory %s\n", batch->stateDir);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Sums the done records of this run and of earlier ones.
+ */
+static void summarize(const t_batch * batch, unsigned long * jobs, unsigned long * failed, int * units) {
+    *jobs = *failed = 0;
+    *units = 0;
+    for (int unit = 0; unit < batch->numUnits; unit++) {
+        char path[1100];
+        unitPath(batch, unit, "", path, sizeof(path));
+        FILE * file = fopen(path, "r");
+        if (!file) continue;
+        unsigned long unitJobs, unitFailed;
+        if (fscanf(file, "jobs %lu failed %lu", &unitJobs, &unitFailed) == 2) {
+            *jobs += unitJobs;
+            *failed += unitFailed;
+            (*units)++;
+        }
+        fclose(file);
+    }
+}
+
+static void reportProgress(const t_batch * batch, int numWorkers, int unitsBefore, double elapsed) {
+    unsigned long jobs = 0, failed = 0, units = 0;
+    for (int i = 0; i < numWorkers; i++) {
+        jobs += atomic_load(&batch->counters[i].jobs);
+        failed += atomic_load(&batch->counters[i].failed);
+        units += atomic_load(&batch->counters[i].units);
+    }
+    printf("[batch] %lu/%d units, %lu jobs (%lu failed) in %.1f s, %.1f jobs/s\n",
+           unitsBefore + units, batch->numUnits, jobs, failed, elapsed, elapsed > 0 ? jobs / elapsed : 0.0);
+    fflush(stdout);
+}
+
+/**
+ * Starts the worker processes and waits for them, reporting progress.
+ * @return The number of workers that did not finish successfully.
+ */
+static int runWorkers(t_batch * batch, int numWorkers, pid_t * pids, int unitsBefore, double start) {
+    int running = 0, crashed = 0;
+    for (int i = 0; i < numWorkers; i++) {
+        pids[i] = 0;
+        pid_t pid = fork();
+        if (pid == 0) {
+            int status = runWorker(batch, i, numWorkers);
+            fflush(stdout);
+            _exit(status);
+        }
+        if (pid < 0) {
+            printf("Error: Cannot start worker %d\n", i);
+            continue;
+        }
+        pids[i] = pid;
+        running++;
+    }
+
+    // Only the workers are waited for: other children belong to the caller
+    double lastReport = now();
+    while (running > 0) {
+        int exited = 0;
+        for (int i = 0; i < numWorkers; i++) {
+            int status = 0;
+            if (pids[i] <= 0) continue;
+            pid_t pid = waitpid(pids[i], &status, WNOHANG);
+            if (pid == 0 || (pid < 0 && errno == EINTR)) continue;
+            pids[i] = 0;
+            running--;
+            exited++;
+            if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) crashed++;
+            // A worker that died in a job leaves its reservation behind
+            release(batch, &batch->counters[i]);
+        }
+        if (exited) continue;
+        usleep(100000);
+        if (now() - lastReport >= BATCH_REPORT_SECONDS) {
+            lastReport = now();
+            reportProgress(batch, numWorkers, unitsBefore, lastReport - start);
+        }
+    }
+    return crashed;
+}
+
+/**
+ * Runs the jobs of a manifest with several worker processes, resuming an interrupted run.
+ * @param manifest The path of the manifest.
+ * @param numWorkers The number of worker processes (0: one per CPU).
+ * @return 0 if every job of the manifest is done and succeeded, 1 otherwise.
+ */
+int batch_run(const char * manifest, int numWorkers) {
+    if (numWorkers <= 0) numWorkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (numWorkers <= 0) numWorkers = 1;
+
+    t_batch batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.manifest = manifest;
+    snprintf(batch.stateDir, sizeof(batch.stateDir), "%s.state", manifest);
+    if (indexManifest(&batch) != 0) return 1;
+    if (prepareState(&batch) != 0) {
+        free(batch.unitOffsets);
+        return 1;
+    }
+
+    unsigned long jobsBefore, failedBefore;
+    int unitsBefore;
+    summarize(&batch, &jobsBefore, &failedBefore, &unitsBefore);
+    if (numWorkers > batch.numUnits - unitsBefore) numWorkers = batch.numUnits - unitsBefore;
+    printf("[batch] %s: %d unit(s) of %d lines, %d already done, %d worker(s)\n",
+           manifest, batch.numUnits, BATCH_UNIT_LINES, unitsBefore, numWorkers);
+    fflush(stdout);
+
+    batch.counters = numWorkers > 0 ? (t_batchCounters *)mmap(NULL, numWorkers * sizeof(t_batchCounters),
+                                                              PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0)
+                                    : NULL;
+    batch.memory = (t_batchMemory *)mmap(NULL, sizeof(t_batchMemory), PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    pid_t * pids = (pid_t *)calloc(numWorkers + 1, sizeof(pid_t));
+    if (batch.counters == MAP_FAILED || batch.memory == MAP_FAILED || !pids) {
+        printf("Error: Cannot map the worker counters\n");
+        if (batch.counters && batch.counters != MAP_FAILED) munmap(batch.counters, numWorkers * sizeof(t_batchCounters));
+        if (batch.memory != MAP_FAILED) munmap(batch.memory, sizeof(t_batchMemory));
+        free(pids);
+        free(batch.unitOffsets);
+        return 1;
+    }
+    batch.memory->budget = memoryBudget();
+    atomic_init(&batch.memory->admitted, 0);
+    atomic_init(&batch.memory->waiting, 0);
+    atomic_init(&batch.memory->peakAdmitted, 0);
+    for (int i = 0; i < numWorkers; i++) {
+        atomic_init(&batch.counters[i].jobs, 0);
+        atomic_init(&batch.counters[i].failed, 0);
+        atomic_init(&batch.counters[i].units, 0);
+        atomic_init(&batch.counters[i].readBytes, 0);
+        atomic_init(&batch.counters[i].readMicros, 0);
+        atomic_init(&batch.counters[i].writtenBytes, 0);
+        atomic_init(&batch.counters[i].writeMicros, 0);
+        atomic_init(&batch.counters[i].reserved, 0);
+        atomic_init(&batch.counters[i].waiting, 0);
+        atomic_init(&batch.counters[i].waits, 0);
+        atomic_init(&batch.counters[i].measured, 0);
+        atomic_init(&batch.counters[i].predictedBytes, 0);
+        atomic_init(&batch.counters[i].actualBytes, 0);
+        atomic_init(&batch.counters[i].overruns, 0);
+        atomic_init(&batch.counters[i].worstPermille, 0);
+    }
+
+    double start = now();
+    int crashed = runWorkers(&batch, numWorkers, pids, unitsBefore, start);
+    unsigned long jobs, failed;
+    int units;
+    summarize(&batch, &jobs, &failed, &units);
+    if (crashed && units < batch.numUnits) {
+        // Every worker left; the claims of those that died are released, so run their units again
+        printf("[batch] %d worker(s) did not finish; running the %d unit(s) left\n", crashed, batch.numUnits - units);
+        fflush(stdout);
+        crashed = runWorkers(&batch, numWorkers, pids, unitsBefore, start);
+    }
+    reportProgress(&batch, numWorkers, unitsBefore, now() - start);
+    for (int i = 0; i < numWorkers; i++) {
+        printf("[batch]   worker %d: %lu units, %lu jobs (%lu failed)\n", i, atomic_load(&batch.counters[i].units),
+               atomic_load(&batch.counters[i].jobs), atomic_load(&batch.counters[i].failed));
+    }
+
+    // Bandwidth per worker: bytes over the time that worker spent in loads or saves
+    unsigned long long readBytes = 0, readMicros = 0, writtenBytes = 0, writeMicros = 0;
+    for (int i = 0; i < numWorkers; i++) {
+        readBytes += atomic_load(&batch.counters[i].readBytes);
+        readMicros += atomic_load(&batch.counters[i].readMicros);
+        writtenBytes += atomic_load(&batch.counters[i].writtenBytes);
+        writeMicros += atomic_load(&batch.counters[i].writeMicros);
+    }
+    printf("[batch] I/O (%s): read %.1f MB at %.0f MB/s, wrote %.1f MB at %.0f MB/s per worker\n",
+           bmpio_modeName(bmpio_mode()), readBytes / 1e6, readMicros ? readBytes / (double)readMicros : 0.0,
+           writtenBytes / 1e6, writeMicros ? writtenBytes / (double)writeMicros : 0.0);
+
+    // Memory: admission, and predicted against measured peaks
+    unsigned long waits = 0, measured = 0, overruns = 0, worstPermille = 0;
+    unsigned long long predictedBytes = 0, actualBytes = 0;
+    for (int i = 0; i < numWorkers; i++) {
+        waits += atomic_load(&batch.counters[i].waits);
+        measured += atomic_load(&batch.counters[i].measured);
+        overruns += atomic_load(&batch.counters[i].overruns);
+        predictedBytes += atomic_load(&batch.counters[i].predictedBytes);
+        actualBytes += atomic_load(&batch.counters[i].actualBytes);
+        if (atomic_load(&batch.counters[i].worstPermille) > worstPermille) {
+            worstPermille = atomic_load(&batch.counters[i].worstPermille);
+        }
+    }
+    printf("[batch] Memory: budget %.0f MB, at most %.1f MB admitted, %lu job(s) waited for memory\n",
+           batch.memory->budget / 1048576.0, atomic_load(&batch.memory->peakAdmitted) / 1048576.0, waits);
+    if (measured > 0) {
+        printf("[batch] Peak per job: predicted %.1f MB, measured %.1f MB (mean of %lu), %lu above prediction, worst %.2fx\n",
+               predictedBytes / 1048576.0 / measured, actualBytes / 1048576.0 / measured, measured, overruns,
+               worstPermille / 1000.0);
+    }
+
+    summarize(&batch, &jobs, &failed, &units);
+    printf("[batch] Total: %d/%d units, %lu jobs, %lu failed (see %s/unit-*.done)\n",
+           units, batch.numUnits, jobs, failed, batch.stateDir);
+    if (crashed && units < batch.numUnits) printf("[batch] %d worker(s) did not finish; run again to resume\n", crashed);
+    else if (crashed) printf("[batch] %d worker(s) did not finish; their units were run by the others\n", crashed);
+
+    if (batch.counters) munmap(batch.counters, numWorkers * sizeof(t_batchCounters));
+    munmap(batch.memory, sizeof(t_batchMemory));
+    free(pids);
+    free(batch.unitOffsets);
+    return units == batch.numUnits && failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,32 @@
+/*
+ * batch.h
+ * Author: Simon Hillel
+ * Description: Header for the batch mode.
+ * A manifest lists one job per line (<input> <output> [<op>,<op>,...], see job.h; blank lines
+ * and lines starting with '#' are skipped). Worker processes claim fixed-size units of
+ * consecutive lines and record each finished unit durably in a state directory next to the
+ * manifest (<manifest>.state), so an interrupted run resumes with the units not yet done. The
+ * units of a worker that dies are run by the others, or by a second round of workers.
+ * Jobs are admitted against a memory budget (IMAGE_MEM_BUDGET_MB, default half of physical
+ * memory): a worker waits until the predicted peaks of the running jobs (job_predictPeak)
+ * leave room for its own, and jobs arriving while another waits queue behind it. The measured
+ * peak of every job is reported against the prediction.
+ */
+#ifndef BATCH_H
+#define BATCH_H
+
+// Manifest lines per work unit (the most work redone after a crash, per worker)
+#define BATCH_UNIT_LINES 256
+// Seconds between progress reports
+#define BATCH_REPORT_SECONDS 5
+// Milliseconds between checks of a worker waiting for memory
+#define BATCH_ADMIT_POLL_MS 10
+// Milliseconds between the passes of a worker over units claimed by other workers
+#define BATCH_CLAIM_POLL_MS 100
+
+/**
+ * Runs a manifest with numWorkers processes (0: one per CPU). Returns 0 if every job succeeded.
+ */
+int batch_run(const char * manifest, int numWorkers);
+
+#endif // BATCH_H
@@ -0,0 +1,482 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bmp1.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * bmp1.c
+ * Author: Simon Hillel
+ * Description: Implementation of 1-bit (bilevel) BMP image handling and processing functions.
+ * Thresholded document scans are stored 8 pixels per byte, which cuts memory, disk and
+ * bandwidth by 8x compared to t_bmp8. Morphology and labelling work on the packed bits.
+ */
+
+// --- Helpers --- //
+
+/**
+ * Reverses the bit order of a byte (movemask yields LSB-first, BMP wants MSB-first).
+ * @param b The byte to reverse.
+ * @return The reversed byte.
+ */
+static unsigned char reverseBits(unsigned int b) {
+    return (unsigned char)((((b * 0x0802u & 0x22110u) | (b * 0x8020u & 0x88440u)) * 0x10101u) >> 16);
+}
+
+/**
+ * Returns the mask of valid pixel bits in the last used byte of a row.
+ * @param width The width of the image in pixels.
+ * @return The mask (0xFF when the width is a multiple of 8).
+ */
+static unsigned char lastByteMask(unsigned int width) {
+    unsigned int rem = width % 8;
+    return rem ? (unsigned char)(0xFF << (8 - rem)) : 0xFF;
+}
+
+// --- Allocation --- //
+
+/**
+ * Allocates a zeroed 1-bit image with a black (0) / white (1) palette.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @return Pointer to the allocated t_bmp1 structure, or NULL on failure.
+ */
+t_bmp1 *bmp1_allocate(unsigned int width, unsigned int height) {
+    if (width == 0 || height == 0) return NULL;
+
+    t_bmp1 *img = (t_bmp1 *)malloc(sizeof(t_bmp1));
+    if (!img) return NULL;
+
+    img->width = width;
+    img->height = height;
+    img->stride = (((width + 7) / 8) + 3) & (~3u);
+    img->data = (unsigned char *)calloc((size_t)img->stride * height, 1);
+    if (!img->data) {
+        printf("Error: Could not allocate memory for 1-bit image data\n");
+        free(img);
+        return NULL;
+    }
+
+    memset(img->colorTable, 0, sizeof(img->colorTable));
+    img->colorTable[4] = 255;
+    img->colorTable[5] = 255;
+    img->colorTable[6] = 255;
+    return img;
+}
+
+/**
+ * Frees a t_bmp1 structure and its packed pixel data.
+ * @param img Pointer to the t_bmp1 structure to free.
+ */
+void bmp1_free(t_bmp1 *img) {
+    if (img) {
+        free(img->data);
+        free(img);
+    }
+}
+
+// --- Conversion --- //
+
+/**
+ * Packs one row of 8-bit values into bits, setting bit x where src[x] >= threshold.
+ * The SSE2 path compares 16 pixels at once and collects the results with movemask.
+ * @param src The 8-bit source row.
+ * @param dst The zeroed packed destination row.
+ * @param width The number of pixels in the row.
+ * @param threshold The threshold value (0-255).
+ */
+static void packRow(const unsigned char *src, unsigned char *dst, unsigned int width, unsigned char threshold) {
+    unsigned int x = 0;
+#ifdef __SSE2__
+    const __m128i t = _mm_set1_epi8((char)threshold);
+    for (; x + 16 <= width; x += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+        // Unsigned v >= t  <=>  max(v, t) == v
+        __m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(v, t), v);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(ge);
+        dst[x / 8] = reverseBits(mask & 0xFF);
+        dst[x / 8 + 1] = reverseBits(mask >> 8);
+    }
+#endif
+    for (; x < width; x++) {
+        if (src[x] >= threshold) dst[x / 8] |= (unsigned char)(0x80 >> (x % 8));
+    }
+}
+
+/**
+ * Thresholds an 8-bit image straight into packed bits, fusing bmp8_threshold with packing.
+ * Indexed images are thresholded on palette luminance, like bmp8_threshold.
+ * @param img Pointer to the source t_bmp8 structure.
+ * @param threshold The threshold value (0-255).
+ * @return Pointer to the new t_bmp1 structure, or NULL on failure.
+ */
+t_bmp1 *bmp1_threshold(const t_bmp8 *img, int threshold) {
+    if (!img || !img->data) return NULL;
+
+    t_bmp1 *out = bmp1_allocate(img->width, img->height);
+    if (!out) return NULL;
+    if (threshold > 255) return out; // Nothing reaches the threshold
+    if (threshold < 0) threshold = 0;
+
+    if (bmp8_isGrayscalePalette(img)) {
+        for (unsigned int y = 0; y < img->height; y++) {
+            packRow(&img->data[y * img->width], &out->data[y * out->stride], img->width, (unsigned char)threshold);
+        }
+        return out;
+    }
+
+    // Indexed colour: decide once per palette entry, then pack through the table
+    unsigned char isSet[BMP8_PALETTE_SIZE];
+    for (int i = 0; i < BMP8_PALETTE_SIZE; i++) {
+        const unsigned char *entry = &img->colorTable[i * 4];
+        int luma = (114 * entry[0] + 587 * entry[1] + 299 * entry[2] + 500) / 1000;
+        isSet[i] = luma >= threshold;
+    }
+    for (unsigned int y = 0; y < img->height; y++) {
+        const unsigned char *src = &img->data[y * img->width];
+        unsigned char *dst = &out->data[y * out->stride];
+        for (unsigned int x = 0; x < img->width; x++) {
+            if (isSet[src[x]]) dst[x / 8] |= (unsigned char)(0x80 >> (x % 8));
+        }
+    }
+    return out;
+}
+
+/**
+ * Expands a 1-bit image to an 8-bit grayscale image through its palette.
+ * @param img Pointer to the source t_bmp1 structure.
+ * @return Pointer to the new t_bmp8 structure, or NULL on failure.
+ */
+t_bmp8 *bmp1_toBmp8(const t_bmp1 *img) {
+    if (!img || !img->data) return NULL;
+
+    t_bmp8 *out = bmp8_allocate(img->width, img->height);
+    if (!out) return NULL;
+
+    unsigned char level[2];
+    for (int i = 0; i < 2; i++) {
+        const unsigned char *entry = &img->colorTable[i * 4];
+        level[i] = (unsigned char)((114 * entry[0] + 587 * entry[1] + 299 * entry[2] + 500) / 1000);
+    }
+    for (unsigned int y = 0; y < img->height; y++) {
+        const unsigned char *src = &img->data[y * img->stride];
+        unsigned char *dst = &out->data[y * img->width];
+        for (unsigned int x = 0; x < img->width; x++) {
+            dst[x] = level[(src[x / 8] >> (7 - x % 8)) & 1];
+        }
+    }
+    return out;
+}
+
+// --- File I/O --- //
+
+/**
+ * Loads a 1-bit BMP image from a file.
+ * @param filename The path to the BMP file.
+ * @return Pointer to the loaded t_bmp1 structure, or NULL on failure.
+ */
+t_bmp1 *bmp1_loadImage(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        printf("Error: Could not open file %s\n", filename);
+        return NULL;
+    }
+
+    unsigned char header[54];
+    if (fread(header, 1, 54, file) != 54 || header[0] != 'B' || header[1] != 'M') {
+        printf("Error: Could not read header\n");
+        fclose(file);
+        return NULL;
+    }
+    if (*(unsigned short *)&header[28] != 1 || *(unsigned int *)&header[30] != 0) {
+        printf("Error: Image is not an uncompressed 1-bit BMP\n");
+        fclose(file);
+        return NULL;
+    }
+
+    unsigned int dataOffset = *(unsigned int *)&header[10];
+    unsigned int infoSize = *(unsigned int *)&header[14];
+    int width = *(int *)&header[18];
+    int height = *(int *)&header[22];
+    if (width <= 0 || height <= 0) {
+        printf("Error: Unsupported 1-bit BMP dimensions (%d x %d)\n", width, height);
+        fclose(file);
+        return NULL;
+    }
+
+    t_bmp1 *img = bmp1_allocate(width, height);
+    if (!img) {
+        fclose(file);
+        return NULL;
+    }
+
+    // File rows are padded to 4 bytes, which is exactly our stride
+    if (fseek(file, 14 + infoSize, SEEK_SET) != 0 || fread(img->colorTable, 4, 2, file) != 2 ||
+        fseek(file, dataOffset, SEEK_SET) != 0 ||
+        fread(img->data, img->stride, img->height, file) != img->height) {
+        printf("Error: Could not read 1-bit image data\n");
+        bmp1_free(img);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    return img;
+}
+
+/**
+ * Saves a 1-bit BMP image to a file.
+ * @param filename The path to the output BMP file.
+ * @param img Pointer to the t_bmp1 structure to save.
+ */
+void bmp1_saveImage(const char *filename, t_bmp1 *img) {
+    if (!img || !img->data) {
+        printf("Error: Cannot save NULL image\n");
+        return;
+    }
+
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        printf("Error: Could not create file %s\n", filename);
+        return;
+    }
+
+    unsigned int dataOffset = 54 + sizeof(img->colorTable);
+    unsigned int dataSize = img->stride * img->height;
+    unsigned char header[54];
+    memset(header, 0, sizeof(header));
+    header[0] = 'B';
+    header[1] = 'M';
+    *(unsigned int *)&header[2] = dataOffset + dataSize;
+    *(unsigned int *)&header[10] = dataOffset;
+    *(unsigned int *)&header[14] = 40;
+    *(unsigned int *)&header[18] = img->width;
+    *(unsigned int *)&header[22] = img->height;
+    *(unsigned short *)&header[26] = 1;
+    *(unsigned short *)&header[28] = 1;
+    *(unsigned int *)&header[34] = dataSize;
+    *(unsigned int *)&header[46] = 2;
+
+    fwrite(header, 1, 54, file);
+    fwrite(img->colorTable, 1, sizeof(img->colorTable), file);
+    if (fwrite(img->data, img->stride, img->height, file) != img->height) {
+        printf("Error: Failed to write 1-bit image data\n");
+    }
+
+    fclose(file);
+}
+
+/**
+ * Returns the value of a pixel.
+ * @param img Pointer to the t_bmp1 structure.
+ * @param x The x-coordinate of the pixel.
+ * @param y The y-coordinate (row index in file order).
+ * @return The bit value (0 or 1).
+ */
+int bmp1_getPixel(const t_bmp1 *img, unsigned int x, unsigned int y) {
+    return (img->data[y * img->stride + x / 8] >> (7 - x % 8)) & 1;
+}
+
+// --- Morphology --- //
+
+/**
+ * Applies a 3x3 square dilation or erosion on packed bits.
+ * Each pass works a byte (8 pixels) at a time: the horizontal step ORs/ANDs the row with
+ * itself shifted by one bit (carrying across bytes), the vertical step combines three rows.
+ * Pixels outside the image are background for dilation and foreground for erosion, so the
+ * border neither grows nor erodes by itself.
+ * @param img Pointer to the t_bmp1 structure.
+ * @param dilate 1 for dilation, 0 for erosion.
+ */
+static void bmp1_morph(t_bmp1 *img, int dilate) {
+    if (!img || !img->data) return;
+
+    unsigned int nbytes = (img->width + 7) / 8;
+    unsigned char tail = lastByteMask(img->width);
+    unsigned char outside = dilate ? 0x00 : 0xFF;
+
+    unsigned char *horiz = (unsigned char *)malloc((size_t)nbytes * img->height);
+    if (!horiz) {
+        printf("Error: Could not allocate memory for morphology buffer\n");
+        return;
+    }
+
+    // Horizontal pass
+    for (unsigned int y = 0; y < img->height; y++) {
+        const unsigned char *row = &img->data[y * img->stride];
+        unsigned char *h = &horiz[y * nbytes];
+        for (unsigned int k = 0; k < nbytes; k++) {
+            unsigned char cur = row[k];
+            unsigned char prev = k > 0 ? row[k - 1] : outside;
+            unsigned char next = k + 1 < nbytes ? row[k + 1] : outside;
+            if (k + 1 == nbytes) {
+                // Bits past the width take the outside value
+                cur = dilate ? (cur & tail) : (cur | (unsigned char)~tail);
+            }
+            if (k + 2 == nbytes) {
+                next = dilate ? (next & tail) : (next | (unsigned char)~tail);
+            }
+            unsigned char left = (unsigned char)((cur >> 1) | (prev << 7));
+            unsigned char right = (unsigned char)((cur << 1) | (next >> 7));
+            h[k] = dilate ? (cur | left | right) : (cur & left & right);
+        }
+    }
+
+    // Vertical pass, written back into the image
+    for (unsigned int y = 0; y < img->height; y++) {
+        const unsigned char *up = y > 0 ? &horiz[(y - 1) * nbytes] : NULL;
+        const unsigned char *mid = &horiz[y * nbytes];
+        const unsigned char *down = y + 1 < img->height ? &horiz[(y + 1) * nbytes] : NULL;
+        unsigned char *dst = &img->data[y * img->stride];
+        for (unsigned int k = 0; k < nbytes; k++) {
+            unsigned char a = up ? up[k] : outside;
+            unsigned char b = down ? down[k] : outside;
+            dst[k] = dilate ? (a | mid[k] | b) : (a & mid[k] & b);
+        }
+        dst[nbytes - 1] &= tail;
+    }
+
+    free(horiz);
+}
+
+/**
+ * Dilates the set bits with a 3x3 square structuring element.
+ * @param img Pointer to the t_bmp1 structure.
+ */
+void bmp1_dilate(t_bmp1 *img) {
+    bmp1_morph(img, 1);
+}
+
+/**
+ * Erodes the set bits with a 3x3 square structuring element.
+ * @param img Pointer to the t_bmp1 structure.
+ */
+void bmp1_erode(t_bmp1 *img) {
+    bmp1_morph(img, 0);
+}
+
+// --- Connected Components --- //
+
+// A horizontal run of set bits within one row
+typedef struct {
+    unsigned int x0;
+    unsigned int x1;
+    unsigned int y;
+    unsigned int parent; // Union-find parent (run index)
+} t_run;
+
+/**
+ * Finds the union-find root of a run, halving the path as it goes.
+ */
+static unsigned int findRoot(t_run *runs, unsigned int i) {
+    while (runs[i].parent != i) {
+        runs[i].parent = runs[runs[i].parent].parent;
+        i = runs[i].parent;
+    }
+    return i;
+}
+
+/**
+ * Labels 8-connected components of set bits.
+ * Rows are scanned for runs a byte at a time (all-zero bytes are skipped), overlapping runs
+ * of consecutive rows are merged with union-find, and the statistics are gathered per root.
+ * @param img Pointer to the t_bmp1 structure.
+ * @param components Receives a malloc'd array of component statistics (may be NULL).
+ * @return The number of components, or -1 on failure.
+ */
+int bmp1_connectedComponents(const t_bmp1 *img, t_bmp1_component **components) {
+    if (components) *components = NULL;
+    if (!img || !img->data) return -1;
+
+    unsigned int capacity = 1024, count = 0;
+    t_run *runs = (t_run *)malloc(capacity * sizeof(t_run));
+    if (!runs) return -1;
+
+    unsigned int prevStart = 0, prevEnd = 0; // Runs of the previous row: [prevStart, prevEnd)
+    for (unsigned int y = 0; y < img->height; y++) {
+        const unsigned char *row = &img->data[y * img->stride];
+        unsigned int rowStart = count;
+        unsigned int x = 0;
+
+        while (x < img->width) {
+            if (x % 8 == 0 && row[x / 8] == 0) { x += 8; continue; }
+            if (!((row[x / 8] >> (7 - x % 8)) & 1)) { x++; continue; }
+
+            unsigned int x0 = x;
+            while (x < img->width) {
+                if (x % 8 == 0 && row[x / 8] == 0xFF && x + 8 <= img->width) { x += 8; continue; }
+                if (!((row[x / 8] >> (7 - x % 8)) & 1)) break;
+                x++;
+            }
+
+            if (count == capacity) {
+                capacity *= 2;
+                t_run *grown = (t_run *)realloc(runs, capacity * sizeof(t_run));
+                if (!grown) {
+                    free(runs);
+                    return -1;
+                }
+                runs = grown;
+            }
+            runs[count].x0 = x0;
+            runs[count].x1 = x - 1;
+            runs[count].y = y;
+            runs[count].parent = count;
+
+            // Merge with runs of the previous row that touch this one (8-connectivity)
+            for (unsigned int p = prevStart; p < prevEnd; p++) {
+                if (runs[p].x1 + 1 < x0) continue;
+                if (runs[p].x0 > x) break;
+                unsigned int a = findRoot(runs, p), b = findRoot(runs, count);
+                if (a != b) runs[a > b ? a : b].parent = a < b ? a : b;
+            }
+            count++;
+        }
+
+        prevStart = rowStart;
+        prevEnd = count;
+    }
+
+    // Number the roots and accumulate statistics
+    unsigned int *label = (unsigned int *)malloc((count ? count : 1) * sizeof(unsigned int));
+    if (!label) {
+        free(runs);
+        return -1;
+    }
+    unsigned int numComponents = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int root = findRoot(runs, i);
+        label[i] = (root == i) ? numComponents++ : label[root];
+    }
+
+    if (components && numComponents > 0) {
+        t_bmp1_component *stats = (t_bmp1_component *)malloc(numComponents * sizeof(t_bmp1_component));
+        if (!stats) {
+            free(label);
+            free(runs);
+            return -1;
+        }
+        for (unsigned int c = 0; c < numComponents; c++) {
+            stats[c].area = 0;
+            stats[c].minX = img->width;
+            stats[c].minY = img->height;
+            stats[c].maxX = 0;
+            stats[c].maxY = 0;
+        }
+        for (unsigned int i = 0; i < count; i++) {
+            t_bmp1_component *c = &stats[label[i]];
+            c->area += runs[i].x1 - runs[i].x0 + 1;
+            if (runs[i].x0 < c->minX) c->minX = runs[i].x0;
+            if (runs[i].x1 > c->maxX) c->maxX = runs[i].x1;
+            if (runs[i].y < c->minY) c->minY = runs[i].y;
+            if (runs[i].y > c->maxY) c->maxY = runs[i].y;
+        }
+        *components = stats;
+    }
+
+    free(label);
+    free(runs);
+    return (int)numComponents;
+}
@@ -0,0 +1,74 @@
+/*
+ * bmp1.h
+ * Author: Simon Hillel
+ * Description: Header for 1-bit (bilevel) BMP image handling and processing functions.
+ * Declares the bit-packed image structure and functions for thresholding, loading, saving,
+ * morphology and connected-component labelling directly on packed bits.
+ */
+#ifndef BMP1_H
+#define BMP1_H
+
+#include "bmp8.h"
+
+// Structure for a 1-bit bilevel BMP image
+// Pixels are packed 8 per byte, leftmost pixel in the most significant bit (BMP order).
+// Rows are kept in file order, like t_bmp8, and padded to a multiple of 4 bytes.
+typedef struct {
+    unsigned char *data;
+    unsigned int width;
+    unsigned int height;
+    unsigned int stride;          // Bytes per row including padding
+    unsigned char colorTable[8];  // Two BGR0 palette entries: bit value 0, bit value 1
+} t_bmp1;
+
+// Statistics for one connected component of set bits
+typedef struct {
+    unsigned int area;
+    unsigned int minX;
+    unsigned int minY;
+    unsigned int maxX;
+    unsigned int maxY;
+} t_bmp1_component;
+
+/**
+ * Allocates a zeroed 1-bit image with a black (0) / white (1) palette.
+ */
+t_bmp1 *bmp1_allocate(unsigned int width, unsigned int height);
+/**
+ * Frees a t_bmp1 structure and its packed pixel data.
+ */
+void bmp1_free(t_bmp1 *img);
+/**
+ * Thresholds an 8-bit image straight into packed bits (bit set where value >= threshold).
+ */
+t_bmp1 *bmp1_threshold(const t_bmp8 *img, int threshold);
+/**
+ * Expands a 1-bit image to an 8-bit grayscale image through its palette.
+ */
+t_bmp8 *bmp1_toBmp8(const t_bmp1 *img);
+/**
+ * Loads a 1-bit BMP image from a file.
+ */
+t_bmp1 *bmp1_loadImage(const char *filename);
+/**
+ * Saves a 1-bit BMP image to a file.
+ */
+void bmp1_saveImage(const char *filename, t_bmp1 *img);
+/**
+ * Returns the value (0 or 1) of the pixel at (x, y).
+ */
+int bmp1_getPixel(const t_bmp1 *img, unsigned int x, unsigned int y);
+/**
+ * Dilates the set bits with a 3x3 square structuring element.
+ */
+void bmp1_dilate(t_bmp1 *img);
+/**
+ * Erodes the set bits with a 3x3 square structuring element.
+ */
+void bmp1_erode(t_bmp1 *img);
+/**
+ * Labels 8-connected components of set bits, working on runs of the packed rows.
+ */
+int bmp1_connectedComponents(const t_bmp1 *img, t_bmp1_component **components);
+
+#endif // BMP1_H
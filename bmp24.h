@@ -9,7 +9,9 @@
 #define BMP24_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdio.h>
+#include "bmp8.h"
 
 // Offsets for the BMP header (matching project description)
 #define BITMAP_MAGIC_OFFSET 0x00 // Corrected name
@@ -113,6 +115,26 @@ t_bmp24 * bmp24_allocate(int width, int height, int colorDepth);
  * Frees a t_bmp24 structure and its associated pixel data.
  */
 void bmp24_free(t_bmp24 * img);
+/**
+ * Returns a deep copy of a 24-bit image (headers and pixels).
+ */
+t_bmp24 * bmp24_copy(const t_bmp24 * img);
+/**
+ * Creates an image whose rows point into an existing BGR buffer (stride < 0: bottom-up rows).
+ */
+t_bmp24 * bmp24_wrap(uint8_t * topRow, int width, int height, ptrdiff_t stride);
+/**
+ * Frees an image created by bmp24_wrap, leaving its pixel buffer untouched.
+ */
+void bmp24_freeView(t_bmp24 * img);
+/**
+ * Returns 1 if the image is stored top-down (negative height in the info header).
+ */
+int bmp24_isTopDown(const t_bmp24 * img);
+/**
+ * Sets the row order written by bmp24_saveImage (1: top row first).
+ */
+void bmp24_setTopDown(t_bmp24 * img, int topDown);
 
 // File I/O Helpers
 /**
@@ -140,9 +162,9 @@ void bmp24_writePixelData(t_bmp24 * image, FILE * file);
  */
 t_bmp24 * bmp24_loadImage(const char * filename);
 /**
- * Saves a 24-bit BMP image to a file.
+ * Saves a 24-bit BMP image to a file. Returns 0, or -1 on failure.
  */
-void bmp24_saveImage(t_bmp24 * img, const char * filename);
+int bmp24_saveImage(t_bmp24 * img, const char * filename);
 /**
  * Prints information about a 24-bit BMP image.
  */
@@ -161,8 +183,24 @@ void bmp24_grayscale(t_bmp24 * img);
  * Adjusts the brightness of a 24-bit BMP image.
  */
 void bmp24_brightness(t_bmp24 * img, int value);
+/**
+ * Applies a sepia tone to a 24-bit BMP image.
+ */
+void bmp24_sepia(t_bmp24 * img);
+/**
+ * Maps every channel of a 24-bit BMP image through its own 256-entry lookup table.
+ */
+void bmp24_applyLUT(t_bmp24 * img, const uint8_t * redLUT, const uint8_t * greenLUT, const uint8_t * blueLUT);
+/**
+ * Extracts the luma of a 24-bit BMP image into a new 8-bit grayscale image.
+ */
+t_bmp8 * bmp24_toLuma(t_bmp24 * img);
 
 // Convolution Filters
+/**
+ * Clamps a float value to the range [0, 255] and rounds it to uint8_t.
+ */
+uint8_t clamp_uint8(float value);
 /**
  * Applies a convolution kernel to a pixel in a 24-bit BMP image.
  */
@@ -171,6 +209,18 @@ t_pixel bmp24_convolution(t_bmp24 * img, t_pixel ** tempData, int x, int y, floa
  * Applies a convolution filter to a 24-bit BMP image using a given kernel.
  */
 void bmp24_applyFilter(t_bmp24 * img, float ** kernel, int kernelSize);
+/**
+ * Enables (1) or disables (0) linear-light convolution in bmp24_applyFilter and the filters built on it.
+ */
+void bmp24_setLinearLight(int enabled);
+/**
+ * Returns 1 if linear-light convolution is enabled.
+ */
+int bmp24_isLinearLight(void);
+/**
+ * Resizes a 24-bit BMP image by area averaging, optionally in linear light.
+ */
+t_bmp24 * bmp24_resize(t_bmp24 * img, int width, int height, int linearLight);
 /**
  * Applies a box blur filter to a 24-bit BMP image.
  */
@@ -1,7 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 #include "bmp8.h"
+#include "stats.h"
+#include "parallel.h"
+#include "dispatch.h"
+#include "pool.h"
+#include "bmpio.h"
 
 /*
  * bmp8.c
@@ -11,12 +17,93 @@
  * It is a core part of the image processing project, supporting grayscale image operations.
  */
 
+// Function declarations
+static void bmp8_updateHeader(t_bmp8 *img);
+static void bmp8_mapPixels(t_bmp8 *img, size_t numPixels, const unsigned char *lut);
+
+// Pixels per task of the parallel per-pixel passes
+#define BMP8_PIXELS_PER_TASK 65536
+
+/**
+ * Sets the size, identity grayscale palette and header of a new image.
+ * @param img Pointer to the t_bmp8 structure.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ */
+static void bmp8_initGray(t_bmp8 *img, unsigned int width, unsigned int height) {
+    img->width = width;
+    img->height = height;
+    img->colorDepth = 8;
+    img->dataSize = ((width + 3) & (~3)) * height;
+    img->numColors = BMP8_PALETTE_SIZE;
+    img->paletteMode = BMP8_PALETTE_AUTO;
+    for (int i = 0; i < BMP8_PALETTE_SIZE; i++) {
+        img->colorTable[i * 4] = i;
+        img->colorTable[i * 4 + 1] = i;
+        img->colorTable[i * 4 + 2] = i;
+    }
+    bmp8_updateHeader(img);
+}
+
+/**
+ * Allocates an 8-bit image with an identity grayscale palette and a filled-in header.
+ * Pixel data is zeroed and stored without padding, as after bmp8_loadImage.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @return Pointer to the allocated t_bmp8 structure, or NULL on failure.
+ */
+t_bmp8 *bmp8_allocate(unsigned int width, unsigned int height) {
+    if (width == 0 || height == 0) return NULL;
+
+    t_bmp8 *img = (t_bmp8 *)calloc(1, sizeof(t_bmp8));
+    if (!img) return NULL;
+
+    img->data = (unsigned char *)calloc((size_t)width * height, 1);
+    if (!img->data) {
+        printf("Error: Could not allocate memory for image data\n");
+        free(img);
+        return NULL;
+    }
+
+    bmp8_initGray(img, width, height);
+    return img;
+}
+
+/**
+ * Creates an 8-bit image over an existing pixel buffer, without copying.
+ * The buffer must hold unpadded rows, bottom row first, as img->data does after a load.
+ * The image gets an identity grayscale palette and a filled-in header.
+ * @param data The pixel buffer (width * height bytes).
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @return Pointer to the view (free with bmp8_freeView), or NULL on failure.
+ */
+t_bmp8 *bmp8_wrap(unsigned char *data, unsigned int width, unsigned int height) {
+    if (!data || width == 0 || height == 0) return NULL;
+
+    t_bmp8 *img = (t_bmp8 *)calloc(1, sizeof(t_bmp8));
+    if (!img) return NULL;
+    img->data = data;
+    bmp8_initGray(img, width, height);
+    return img;
+}
+
+/**
+ * Frees an image created by bmp8_wrap; the pixel buffer itself is left untouched.
+ * @param img Pointer to the view.
+ */
+void bmp8_freeView(t_bmp8 *img) {
+    free(img);
+}
+
 /**
  * Loads an 8-bit grayscale BMP image from a file.
+ * The pixel data is read in the I/O mode (IMAGE_IO_MODE) and counted in the I/O statistics.
  * @param filename The path to the BMP file.
  * @return Pointer to the loaded t_bmp8 structure, or NULL on failure.
  */
 t_bmp8 *bmp8_loadImage(const char *filename) {
+    double start = bmpio_now();
     FILE *file = fopen(filename, "rb");
     if (!file) {
         printf("Error: Could not open file %s\n", filename);
@@ -29,26 +116,19 @@ t_bmp8 *bmp8_loadImage(const char *filename) {
         return NULL;
     }
 
-    // Read header
-    if (fread(img->header, 1, 54, file) != 54) {
+    // Read header and parse it with the shared parser (bmpio_parseHeader)
+    t_bmpFields fields;
+    if (fread(img->header, 1, 54, file) != 54 || bmpio_parseHeader(img->header, 54, &fields) != 0) {
         printf("Error: Could not read header\n");
         free(img);
         fclose(file);
         return NULL;
     }
 
-    // Read color table
-    if (fread(img->colorTable, 1, 1024, file) != 1024) {
-        printf("Error: Could not read color table\n");
-        free(img);
-        fclose(file);
-        return NULL;
-    }
-
     // Extract image information from header
-    img->width = *(unsigned int *)&img->header[18];
-    img->height = *(unsigned int *)&img->header[22];
-    img->colorDepth = *(unsigned int *)&img->header[28];
+    img->width = fields.width;
+    img->height = fields.height;
+    img->colorDepth = fields.bits;
     // Calculate row size with padding
     int row_padded = (img->width + 3) & (~3);
     img->dataSize = row_padded * img->height;
@@ -60,6 +140,39 @@ t_bmp8 *bmp8_loadImage(const char *filename) {
         fclose(file);
         return NULL;
     }
+    if (fields.compression != 0) {
+        printf("Error: Compressed BMP files are not supported\n");
+        free(img);
+        fclose(file);
+        return NULL;
+    }
+
+    // The colour table follows the info header and may hold fewer than 256 entries
+    unsigned int dataOffset = fields.dataOffset;
+    unsigned int infoSize = fields.infoSize;
+    img->numColors = fields.numColors;
+    if (img->numColors == 0 || img->numColors > BMP8_PALETTE_SIZE) {
+        img->numColors = BMP8_PALETTE_SIZE;
+    }
+    img->paletteMode = BMP8_PALETTE_AUTO;
+
+    // Read color table
+    memset(img->colorTable, 0, sizeof(img->colorTable));
+    if (fseek(file, 14 + infoSize, SEEK_SET) != 0 ||
+        fread(img->colorTable, 4, img->numColors, file) != img->numColors) {
+        printf("Error: Could not read color table\n");
+        free(img);
+        fclose(file);
+        return NULL;
+    }
+
+    // Pixel data starts at the offset stored in the file header
+    if (fseek(file, dataOffset, SEEK_SET) != 0) {
+        printf("Error: Could not seek to image data\n");
+        free(img);
+        fclose(file);
+        return NULL;
+    }
 
     // Allocate memory for image data (only pixel data, not padding)
     img->data = (unsigned char *)malloc(img->width * img->height);
@@ -70,36 +183,108 @@ t_bmp8 *bmp8_loadImage(const char *filename) {
         return NULL;
     }
 
-    // Read image data row by row, skipping padding
-    for (unsigned int y = 0; y < img->height; y++) {
-        unsigned char row_buf[row_padded];
-        if (fread(row_buf, 1, row_padded, file) != row_padded) {
-            printf("Error: Could not read image data row\n");
-            free(img->data);
-            free(img);
-            fclose(file);
-            return NULL;
+    // Read the padded rows straight into the image rows (see bmpio_readRows)
+    unsigned char **rows = (unsigned char **)malloc(img->height * sizeof(unsigned char *));
+    if (rows) {
+        for (unsigned int y = 0; y < img->height; y++) {
+            rows[y] = &img->data[y * img->width];
         }
-        memcpy(&img->data[y * img->width], row_buf, img->width);
     }
+    if (!rows || bmpio_readRows(filename, file, dataOffset, rows, img->width, row_padded, img->height) != img->dataSize) {
+        printf("Error: Could not read image data\n");
+        free(rows);
+        free(img->data);
+        free(img);
+        fclose(file);
+        return NULL;
+    }
+    free(rows);
 
     fclose(file);
+    bmpio_record(filename, 0, (size_t)dataOffset + img->dataSize, bmpio_now() - start);
     return img;
 }
 
+/**
+ * Rewrites the header fields that depend on the layout written by bmp8_saveImage:
+ * a 40-byte info header followed by a full 256-entry colour table and padded rows.
+ * @param img Pointer to the t_bmp8 structure.
+ */
+static void bmp8_updateHeader(t_bmp8 *img) {
+    unsigned int row_padded = (img->width + 3) & (~3);
+    unsigned int dataOffset = 54 + BMP8_PALETTE_SIZE * 4;
+
+    img->header[0] = 'B';
+    img->header[1] = 'M';
+    *(unsigned int *)&img->header[2] = dataOffset + row_padded * img->height;
+    *(unsigned int *)&img->header[10] = dataOffset;
+    *(unsigned int *)&img->header[14] = 40;
+    *(unsigned int *)&img->header[18] = img->width;
+    *(unsigned int *)&img->header[22] = img->height;
+    *(unsigned short *)&img->header[26] = 1;
+    *(unsigned short *)&img->header[28] = 8;
+    *(unsigned int *)&img->header[30] = 0;
+    *(unsigned int *)&img->header[34] = row_padded * img->height;
+    *(unsigned int *)&img->header[46] = img->numColors;
+    *(unsigned int *)&img->header[50] = 0;
+}
+
+/**
+ * Saves an 8-bit grayscale BMP image with O_DIRECT (bmpio_writeLayout).
+ * @param filename The path to the output BMP file.
+ * @param img Pointer to the t_bmp8 structure to save (header already updated).
+ * @return 0 on success, -1 on failure.
+ */
+static int bmp8_saveDirect(const char *filename, const t_bmp8 *img) {
+    unsigned char header[54 + 1024];
+    const unsigned char **rows = (const unsigned char **)malloc(img->height * sizeof(unsigned char *));
+    if (!rows) {
+        printf("Error: Could not allocate row table\n");
+        return -1;
+    }
+    memcpy(header, img->header, 54);
+    memcpy(header + 54, img->colorTable, 1024);
+    // The data is already stored bottom-up, as in the file
+    for (unsigned int y = 0; y < img->height; y++) {
+        rows[y] = &img->data[y * img->width];
+    }
+
+    t_fileLayout layout;
+    layout.header = header;
+    layout.headerSize = sizeof(header);
+    layout.rows = rows;
+    layout.rowBytes = img->width;
+    layout.paddedBytes = (img->width + 3) & (~3);
+    layout.numRows = img->height;
+    int status = bmpio_writeLayout(filename, &layout, 0);
+    free(rows);
+    return status;
+}
+
 /**
  * Saves an 8-bit grayscale BMP image to a file.
+ * The file is written in the I/O mode (IMAGE_IO_MODE) and counted in the I/O statistics.
  * @param filename The path to the output BMP file.
  * @param img Pointer to the t_bmp8 structure to save.
+ * @return 0 on success, -1 if the file could not be written completely.
  */
-void bmp8_saveImage(const char *filename, t_bmp8 *img) {
+int bmp8_saveImage(const char *filename, t_bmp8 *img) {
+    double start = bmpio_now();
+    if (bmpio_mode() == BMPIO_MODE_DIRECT) {
+        bmp8_updateHeader(img);
+        int status = bmp8_saveDirect(filename, img);
+        if (status == 0) bmpio_record(filename, 1, *(unsigned int *)&img->header[2], bmpio_now() - start);
+        return status;
+    }
+
     FILE *file = fopen(filename, "wb");
     if (!file) {
         printf("Error: Could not create file %s\n", filename);
-        return;
+        return -1;
     }
 
     // Write header
+    bmp8_updateHeader(img);
     fwrite(img->header, 1, 54, file);
 
     // Write color table
@@ -115,7 +300,15 @@ void bmp8_saveImage(const char *filename, t_bmp8 *img) {
         fwrite(pad, 1, row_padded - img->width, file);
     }
 
-    fclose(file);
+    int status = fflush(file) == 0 && !ferror(file) ? 0 : -1;
+    bmpio_dropCache(fileno(file), 1);
+    if (fclose(file) != 0) status = -1;
+    if (status != 0) {
+        printf("Error: Failed to write %s\n", filename);
+        return -1;
+    }
+    bmpio_record(filename, 1, *(unsigned int *)&img->header[2], bmpio_now() - start);
+    return 0;
 }
 
 /**
@@ -131,6 +324,29 @@ void bmp8_free(t_bmp8 *img) {
     }
 }
 
+/**
+ * Creates a deep copy of an 8-bit image.
+ * @param img Pointer to the t_bmp8 structure to copy.
+ * @return Pointer to the new t_bmp8 structure, or NULL on failure.
+ */
+t_bmp8 *bmp8_copy(const t_bmp8 *img) {
+    if (!img || !img->data) return NULL;
+
+    t_bmp8 *copy = (t_bmp8 *)malloc(sizeof(t_bmp8));
+    if (!copy) return NULL;
+    *copy = *img;
+
+    size_t numPixels = (size_t)img->width * img->height;
+    copy->data = (unsigned char *)malloc(numPixels);
+    if (!copy->data) {
+        printf("Error: Could not allocate memory for image data\n");
+        free(copy);
+        return NULL;
+    }
+    memcpy(copy->data, img->data, numPixels);
+    return copy;
+}
+
 /**
  * Prints information about an 8-bit grayscale BMP image.
  * @param img Pointer to the t_bmp8 structure.
@@ -141,6 +357,134 @@ void bmp8_printInfo(t_bmp8 *img) {
     printf("Height: %u\n", img->height);
     printf("Color Depth: %u\n", img->colorDepth);
     printf("Data Size: %u\n", img->dataSize);
+    if (bmp8_isGrayscalePalette(img)) {
+        printf("Palette: grayscale (identity)\n");
+    } else {
+        printf("Palette: indexed colour (%u entries)\n", img->numColors);
+    }
+
+    t_imageStats stats;
+    if (stats_computeBmp8(img, &stats) == 0) {
+        printf("Pixel Statistics:\n");
+        stats_print(&stats);
+    }
+}
+
+/**
+ * Checks whether the colour table is the identity grayscale ramp.
+ * @param img Pointer to the t_bmp8 structure.
+ * @return 1 if entry i is (i, i, i) for every index, 0 otherwise.
+ */
+int bmp8_isGrayscalePalette(const t_bmp8 *img) {
+    for (int i = 0; i < BMP8_PALETTE_SIZE; i++) {
+        const unsigned char *entry = &img->colorTable[i * 4];
+        if (entry[0] != i || entry[1] != i || entry[2] != i) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Decides whether point operations should rewrite the palette instead of the pixels.
+ * Indexed-colour images always go through the palette, since their pixel values are indices.
+ * @param img Pointer to the t_bmp8 structure.
+ * @return 1 for palette-domain operations, 0 for pixel-domain operations.
+ */
+int bmp8_usesPaletteOps(const t_bmp8 *img) {
+    return img->paletteMode == BMP8_PALETTE_ALWAYS || !bmp8_isGrayscalePalette(img);
+}
+
+/**
+ * Computes the luminance of a colour table entry (ITU-R BT.601 weights).
+ * @param entry Pointer to a 4-byte BGR0 palette entry.
+ * @return The luminance in the range 0-255.
+ */
+static unsigned char bmp8_paletteLuma(const unsigned char *entry) {
+    return (unsigned char)((114 * entry[0] + 587 * entry[1] + 299 * entry[2] + 500) / 1000);
+}
+
+/**
+ * Applies a per-channel lookup table to the B, G and R components of every palette entry.
+ * @param img Pointer to the t_bmp8 structure.
+ * @param lut The 256-entry lookup table.
+ */
+static void bmp8_applyPaletteLUT(t_bmp8 *img, const unsigned char *lut) {
+    for (int i = 0; i < BMP8_PALETTE_SIZE; i++) {
+        unsigned char *entry = &img->colorTable[i * 4];
+        entry[0] = lut[entry[0]];
+        entry[1] = lut[entry[1]];
+        entry[2] = lut[entry[2]];
+    }
+}
+
+/**
+ * Maps every pixel through the palette luminance and restores the identity grayscale palette,
+ * so that pixel-domain operations (convolution, equalization) see actual intensities.
+ * @param img Pointer to the t_bmp8 structure.
+ */
+void bmp8_bakePalette(t_bmp8 *img) {
+    if (!img || !img->data || bmp8_isGrayscalePalette(img)) return;
+
+    unsigned char lut[BMP8_PALETTE_SIZE];
+    for (int i = 0; i < BMP8_PALETTE_SIZE; i++) {
+        lut[i] = bmp8_paletteLuma(&img->colorTable[i * 4]);
+    }
+
+    bmp8_mapPixels(img, (size_t)img->width * img->height, lut);
+
+    for (int i = 0; i < BMP8_PALETTE_SIZE; i++) {
+        img->colorTable[i * 4] = i;
+        img->colorTable[i * 4 + 1] = i;
+        img->colorTable[i * 4 + 2] = i;
+        img->colorTable[i * 4 + 3] = 0;
+    }
+    img->numColors = BMP8_PALETTE_SIZE;
+}
+
+// Shared state of a bmp8_mapPixels pass
+typedef struct {
+    unsigned char *data;
+    size_t numPixels;
+    const unsigned char *lut;
+} t_bmp8_mapState;
+
+static void bmp8_mapRange(int begin, int end, void *ctx) {
+    t_bmp8_mapState *s = (t_bmp8_mapState *)ctx;
+    size_t first = (size_t)begin * BMP8_PIXELS_PER_TASK;
+    size_t last = (size_t)end * BMP8_PIXELS_PER_TASK;
+    if (last > s->numPixels) last = s->numPixels;
+    dispatch_get()->applyLUT8(s->data + first, last - first, s->lut);
+}
+
+/**
+ * Maps the first numPixels pixel values through a lookup table, in parallel.
+ * The range is split in tasks of BMP8_PIXELS_PER_TASK pixels, so that the int range of
+ * parallel_for counts tasks and images of more than 2^31 pixels are covered.
+ * @param img Pointer to the t_bmp8 structure.
+ * @param numPixels The number of pixels to map.
+ * @param lut The 256-entry lookup table.
+ */
+static void bmp8_mapPixels(t_bmp8 *img, size_t numPixels, const unsigned char *lut) {
+    t_bmp8_mapState state = {img->data, numPixels, lut};
+    size_t numTasks = (numPixels + BMP8_PIXELS_PER_TASK - 1) / BMP8_PIXELS_PER_TASK;
+    parallel_for(0, (int)numTasks, 1, bmp8_mapRange, &state);
+}
+
+/**
+ * Maps every intensity through a 256-entry lookup table.
+ * Indexed images (or BMP8_PALETTE_ALWAYS) only have their 256 palette entries mapped,
+ * otherwise every pixel is rewritten.
+ * @param img Pointer to the t_bmp8 structure.
+ * @param lut The 256-entry lookup table.
+ */
+void bmp8_applyLUT(t_bmp8 *img, const unsigned char *lut) {
+    if (!img || !img->data || !lut) return;
+
+    if (bmp8_usesPaletteOps(img)) {
+        bmp8_applyPaletteLUT(img, lut);
+        return;
+    }
+
+    bmp8_mapPixels(img, (size_t)img->width * img->height, lut);
 }
 
 /**
@@ -148,9 +492,11 @@ void bmp8_printInfo(t_bmp8 *img) {
  * @param img Pointer to the t_bmp8 structure.
  */
 void bmp8_negative(t_bmp8 *img) {
-    for (unsigned int i = 0; i < img->dataSize; i++) {
-        img->data[i] = 255 - img->data[i];
+    unsigned char lut[BMP8_PALETTE_SIZE];
+    for (int i = 0; i < BMP8_PALETTE_SIZE; i++) {
+        lut[i] = 255 - i;
     }
+    bmp8_applyLUT(img, lut);
 }
 
 /**
@@ -159,46 +505,55 @@ void bmp8_negative(t_bmp8 *img) {
  * @param value The brightness adjustment value (-255 to 255).
  */
 void bmp8_brightness(t_bmp8 *img, int value) {
-    for (unsigned int i = 0; i < img->dataSize; i++) {
-        int newValue = img->data[i] + value;
+    unsigned char lut[BMP8_PALETTE_SIZE];
+    for (int i = 0; i < BMP8_PALETTE_SIZE; i++) {
+        int newValue = i + value;
         if (newValue > 255) newValue = 255;
         if (newValue < 0) newValue = 0;
-        img->data[i] = (unsigned char)newValue;
+        lut[i] = (unsigned char)newValue;
     }
+    bmp8_applyLUT(img, lut);
 }
 
 /**
  * Applies a threshold filter to an 8-bit grayscale BMP image.
+ * Indexed images (or BMP8_PALETTE_ALWAYS) threshold the luminance of each palette entry,
+ * turning it black or white.
  * @param img Pointer to the t_bmp8 structure.
  * @param threshold The threshold value (0-255).
  */
 void bmp8_threshold(t_bmp8 *img, int threshold) {
-    for (unsigned int i = 0; i < img->dataSize; i++) {
-        img->data[i] = (img->data[i] >= threshold) ? 255 : 0;
-    }
-}
-
-/**
- * Applies a convolution filter to an 8-bit grayscale BMP image using a given kernel.
- * @param img Pointer to the t_bmp8 structure.
- * @param kernel The convolution kernel.
- * @param kernelSize The size of the kernel (must be odd).
- */
-void bmp8_applyFilter(t_bmp8 *img, float **kernel, int kernelSize) {
-    if (!img || !img->data || !kernel || kernelSize % 2 == 0) return;
-
-    int offset = kernelSize / 2;
-    unsigned char *newData = (unsigned char *)malloc(img->width * img->height);
-    if (!newData) {
-        printf("Error: Could not allocate memory for filtered data\n");
+    if (bmp8_usesPaletteOps(img)) {
+        for (int i = 0; i < BMP8_PALETTE_SIZE; i++) {
+            unsigned char *entry = &img->colorTable[i * 4];
+            unsigned char value = (bmp8_paletteLuma(entry) >= threshold) ? 255 : 0;
+            entry[0] = value;
+            entry[1] = value;
+            entry[2] = value;
+        }
         return;
     }
 
-    // Copy original data to new buffer
-    memcpy(newData, img->data, img->width * img->height);
+    unsigned char lut[BMP8_PALETTE_SIZE];
+    for (int i = 0; i < BMP8_PALETTE_SIZE; i++) {
+        lut[i] = (i >= threshold) ? 255 : 0;
+    }
+    bmp8_mapPixels(img, (size_t)img->width * img->height, lut);
+}
 
-    // Apply filter to each pixel (ignore padding, only process pixel data)
-    for (unsigned int y = 0; y < img->height; y++) {
+// Shared state of a bmp8_applyFilter pass
+typedef struct {
+    const t_bmp8 *img;
+    unsigned char *newData;
+    float **kernel;
+    int kernelSize;
+} t_bmp8_filterState;
+
+static void bmp8_filterRows(int begin, int end, void *ctx) {
+    t_bmp8_filterState *s = (t_bmp8_filterState *)ctx;
+    const t_bmp8 *img = s->img;
+    int kernelSize = s->kernelSize;
+    for (int y = begin; y < end; y++) {
         for (unsigned int x = 0; x < img->width; x++) {
             float sum = 0.0f;
             for (int ky = 0; ky < kernelSize; ky++) {
@@ -210,22 +565,69 @@ void bmp8_applyFilter(t_bmp8 *img, float **kernel, int kernelSize) {
                     if (pixelY < 0) pixelY = 0;
                     if (pixelX >= (int)img->width) pixelX = img->width - 1;
                     if (pixelY >= (int)img->height) pixelY = img->height - 1;
-                    sum += img->data[pixelY * img->width + pixelX] * kernel[ky][kx];
+                    sum += img->data[pixelY * img->width + pixelX] * s->kernel[ky][kx];
                 }
             }
             // Clamp and store result
             int result = (int)(sum + 0.5f);
             if (result < 0) result = 0;
             if (result > 255) result = 255;
-            newData[y * img->width + x] = (unsigned char)result;
+            s->newData[y * img->width + x] = (unsigned char)result;
         }
     }
+}
+
+/**
+ * Applies a convolution filter to an 8-bit grayscale BMP image using a given kernel.
+ * @param img Pointer to the t_bmp8 structure.
+ * @param kernel The convolution kernel.
+ * @param kernelSize The size of the kernel (must be odd).
+ */
+void bmp8_applyFilter(t_bmp8 *img, float **kernel, int kernelSize) {
+    if (!img || !img->data || !kernel || kernelSize % 2 == 0) return;
+
+    // Convolution needs intensities, not palette indices
+    bmp8_bakePalette(img);
+
+    int offset = kernelSize / 2;
+    unsigned char *newData = (unsigned char *)malloc(img->width * img->height);
+    if (!newData) {
+        printf("Error: Could not allocate memory for filtered data\n");
+        return;
+    }
+
+    // Copy original data to new buffer
+    memcpy(newData, img->data, img->width * img->height);
+
+    // Apply filter to each pixel (ignore padding, only process pixel data), in bands of rows
+    t_bmp8_filterState state = {img, newData, kernel, kernelSize};
+    parallel_for(0, img->height, 16, bmp8_filterRows, &state);
 
     // Copy filtered data back to image
     memcpy(img->data, newData, img->width * img->height);
     free(newData);
 }
 
+// Shared state of a bmp8_computeHistogram pass
+typedef struct {
+    const unsigned char *data;
+    size_t numPixels;
+    atomic_uint histogram[256];
+} t_bmp8_histogramState;
+
+static void bmp8_histogramRange(int begin, int end, void *ctx) {
+    t_bmp8_histogramState *s = (t_bmp8_histogramState *)ctx;
+    uint32_t local[256] = {0};
+    // Tasks of BMP8_PIXELS_PER_TASK pixels, as in bmp8_mapPixels
+    size_t first = (size_t)begin * BMP8_PIXELS_PER_TASK;
+    size_t last = (size_t)end * BMP8_PIXELS_PER_TASK;
+    if (last > s->numPixels) last = s->numPixels;
+    dispatch_get()->histogram8(s->data + first, last - first, local);
+    for (int i = 0; i < 256; i++) {
+        if (local[i]) atomic_fetch_add_explicit(&s->histogram[i], local[i], memory_order_relaxed);
+    }
+}
+
 /**
  * Computes the histogram of an 8-bit grayscale BMP image.
  * @param img Pointer to the t_bmp8 structure.
@@ -235,9 +637,13 @@ unsigned int *bmp8_computeHistogram(t_bmp8 *img) {
     unsigned int *hist = (unsigned int *)calloc(256, sizeof(unsigned int));
     if (!hist) return NULL;
 
-    for (unsigned int i = 0; i < img->dataSize; i++) {
-        hist[img->data[i]]++;
-    }
+    t_bmp8_histogramState state;
+    state.data = img->data;
+    state.numPixels = (size_t)img->width * img->height;
+    for (int i = 0; i < 256; i++) atomic_init(&state.histogram[i], 0);
+    size_t numTasks = (state.numPixels + BMP8_PIXELS_PER_TASK - 1) / BMP8_PIXELS_PER_TASK;
+    parallel_for(0, (int)numTasks, 1, bmp8_histogramRange, &state);
+    for (int i = 0; i < 256; i++) hist[i] = atomic_load(&state.histogram[i]);
 
     return hist;
 }
@@ -259,13 +665,42 @@ unsigned int *bmp8_computeCDF(unsigned int *hist) {
     return cdf;
 }
 
+/**
+ * Turns a CDF into the equalization map, in place: cdf[i] becomes
+ * (cdf[i] - cdfMin) * 255 / (N - cdfMin), where cdfMin is the first non-zero count and N the
+ * number of pixels, so the darkest level present maps to 0 and the brightest to 255.
+ * An image with a single level has nothing to stretch and gets the identity map.
+ * @param cdf Pointer to the CDF array (256 elements), as returned by bmp8_computeCDF.
+ */
+void bmp8_normalizeCDF(unsigned int *cdf) {
+    unsigned int total = cdf[255];
+    unsigned int cdfMin = 0;
+    for (int i = 0; i < 256 && cdfMin == 0; i++) cdfMin = cdf[i];
+
+    if (total == cdfMin) {
+        for (int i = 0; i < 256; i++) cdf[i] = i;
+        return;
+    }
+    for (int i = 0; i < 256; i++) {
+        if (cdf[i] < cdfMin) {
+            cdf[i] = 0;     // Below the darkest level present, never looked up
+            continue;
+        }
+        uint64_t scaled = (uint64_t)(cdf[i] - cdfMin) * 255 + (total - cdfMin) / 2;
+        cdf[i] = (unsigned int)(scaled / (total - cdfMin));
+    }
+}
+
 /**
  * Applies histogram equalization to an 8-bit grayscale BMP image.
+ * Pixel values are taken as intensities, so an indexed image must be baked first.
  * @param img Pointer to the t_bmp8 structure.
- * @param hist_eq Pointer to the equalized histogram array (256 elements).
+ * @param hist_eq Pointer to the equalization map (256 elements), see bmp8_normalizeCDF.
  */
 void bmp8_equalize(t_bmp8 *img, unsigned int *hist_eq) {
-    for (unsigned int i = 0; i < img->dataSize; i++) {
-        img->data[i] = hist_eq[img->data[i]];
+    unsigned char lut[256];
+    for (int i = 0; i < 256; i++) {
+        lut[i] = (unsigned char)hist_eq[i];
     }
+    bmp8_mapPixels(img, (size_t)img->width * img->height, lut);
 } 
\ No newline at end of file
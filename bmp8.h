@@ -10,6 +10,15 @@
 
 #include <stdint.h>
 
+// Number of entries in an 8-bit BMP colour table (4 bytes each: B, G, R, reserved)
+#define BMP8_PALETTE_SIZE 256
+
+// How point operations (negative, brightness, threshold) treat the colour table
+typedef enum {
+    BMP8_PALETTE_AUTO,  // Rewrite the palette only if it is not an identity grayscale ramp
+    BMP8_PALETTE_ALWAYS // Always rewrite the palette (O(256)) and leave pixel indices untouched
+} t_bmp8_paletteMode;
+
 // Structure for 8-bit grayscale BMP image
 typedef struct {
     unsigned char header[54];
@@ -19,25 +28,47 @@ typedef struct {
     unsigned int height;
     unsigned int colorDepth;
     unsigned int dataSize;
+    unsigned int numColors;           // Palette entries used by the image (1-256)
+    t_bmp8_paletteMode paletteMode;   // Point-operation mode, BMP8_PALETTE_AUTO after load
 } t_bmp8;
 
 // Function prototypes
+/**
+ * Allocates an 8-bit image with an identity grayscale palette and a filled-in header.
+ */
+t_bmp8 *bmp8_allocate(unsigned int width, unsigned int height);
+/**
+ * Creates an image over an existing buffer of unpadded bottom-up rows, without copying.
+ */
+t_bmp8 *bmp8_wrap(unsigned char *data, unsigned int width, unsigned int height);
+/**
+ * Frees an image created by bmp8_wrap, leaving its pixel buffer untouched.
+ */
+void bmp8_freeView(t_bmp8 *img);
 /**
  * Loads an 8-bit grayscale BMP image from a file.
  */
 t_bmp8 *bmp8_loadImage(const char *filename);
 /**
- * Saves an 8-bit grayscale BMP image to a file.
+ * Saves an 8-bit grayscale BMP image to a file. Returns 0, or -1 on failure.
  */
-void bmp8_saveImage(const char *filename, t_bmp8 *img);
+int bmp8_saveImage(const char *filename, t_bmp8 *img);
 /**
  * Frees a t_bmp8 structure and its associated pixel data.
  */
 void bmp8_free(t_bmp8 *img);
+/**
+ * Returns a deep copy of an 8-bit image (header, palette and pixels).
+ */
+t_bmp8 *bmp8_copy(const t_bmp8 *img);
 /**
  * Prints information about an 8-bit grayscale BMP image.
  */
 void bmp8_printInfo(t_bmp8 *img);
+/**
+ * Maps every intensity through a 256-entry lookup table (palette or pixels, see t_bmp8_paletteMode).
+ */
+void bmp8_applyLUT(t_bmp8 *img, const unsigned char *lut);
 /**
  * Applies a negative filter to an 8-bit grayscale BMP image.
  */
@@ -50,6 +81,18 @@ void bmp8_brightness(t_bmp8 *img, int value);
  * Applies a threshold filter to an 8-bit grayscale BMP image.
  */
 void bmp8_threshold(t_bmp8 *img, int threshold);
+/**
+ * Returns 1 if the colour table is the identity grayscale ramp (entry i = (i, i, i)), 0 otherwise.
+ */
+int bmp8_isGrayscalePalette(const t_bmp8 *img);
+/**
+ * Returns 1 if point operations on this image should rewrite the palette instead of the pixels.
+ */
+int bmp8_usesPaletteOps(const t_bmp8 *img);
+/**
+ * Maps every pixel through the palette luminance and restores the identity grayscale palette.
+ */
+void bmp8_bakePalette(t_bmp8 *img);
 /**
  * Applies a convolution filter to an 8-bit grayscale BMP image using a given kernel.
  */
@@ -64,6 +107,10 @@ unsigned int *bmp8_computeHistogram(t_bmp8 *img);
  * Computes the cumulative distribution function (CDF) from a histogram.
  */
 unsigned int *bmp8_computeCDF(unsigned int *hist);
+/**
+ * Turns a CDF into the equalization map (0-255), in place.
+ */
+void bmp8_normalizeCDF(unsigned int *cdf);
 /**
  * Applies histogram equalization to an 8-bit grayscale BMP image.
  */
@@ -0,0 +1,858 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "bmpio.h"
+#include "parallel.h"
+#include "dispatch.h"
+#include "pool.h"
+
+/*
+ * bmpio.c
+ * Author: Simon Hillel
+ * Description: Implementation of parallel file I/O for 24-bit BMP images.
+ * BMP rows are stored bottom-up; a negative height in the header means the rows are stored
+ * top-down instead. Either way, image rows [begin, end) are one contiguous range of the file,
+ * starting at file row height - end (bottom-up) or begin (top-down). Each task packs its rows
+ * with their padding into a private buffer and writes it with a single pwrite; with BMPIO_MMAP
+ * the file is mapped and the rows are copied straight into place. The file is sized with
+ * ftruncate first, so the writes never extend it concurrently.
+ * The loader gives each thread one range of rows and reads it with preadv into the image
+ * rows themselves, in file order, with each row's padding sent to a scratch buffer. The
+ * flip and de-padding thus happen in the read, without an intermediate copy of the data.
+ * I/O modes: nocache keeps the usual paths and tells the kernel to drop the file's pages
+ * once they are consumed (written pages are flushed first, since only clean pages can be
+ * dropped). Direct opens the file with O_DIRECT; the caller's buffers and rows are not
+ * aligned, so threads move aligned chunks through their own aligned bounce buffers: a load
+ * de-pads each chunk straight into the image rows, and a save rounds the last chunk up to the
+ * alignment and truncates the file to its size after.
+ * File systems without O_DIRECT (tmpfs) fall back to nocache.
+ */
+
+// Shared state of a parallel load
+typedef struct {
+    t_bmp24 * img;
+    int fd;
+    size_t rowBytes;
+    size_t paddedBytes;
+    off_t dataOffset;
+    int topDown;
+    atomic_int shortRead;
+} t_loadState;
+
+// Shared state of a parallel save
+typedef struct {
+    const t_bmp24 * img;
+    int fd;
+    uint8_t * map;                // Pixel data in the mapping (BMPIO_MMAP), or NULL
+    size_t rowBytes;
+    size_t paddedBytes;
+    off_t dataOffset;
+    int topDown;
+    int chunkRows;
+    atomic_int failed;
+} t_saveState;
+
+static void put16(uint8_t * p, uint16_t value) {
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+static void put32(uint8_t * p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = (value >> (8 * i)) & 0xFF;
+}
+
+/**
+ * Returns the image row stored at position i of rows [begin, end) in the file.
+ */
+static int rowInFileOrder(int begin, int end, int i, int topDown) {
+    return topDown ? begin + i : end - 1 - i;
+}
+
+/**
+ * Returns the file row at which image rows [begin, end) start.
+ */
+static int firstFileRow(int begin, int end, int height, int topDown) {
+    return topDown ? begin : height - end;
+}
+
+/**
+ * Fills the headers of a 24-bit image, as bmp24_saveImage writes them (40-byte info header,
+ * pixels right after it, no resolution or palette).
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels, negative for top-down row order.
+ * @param header Receives the 54 header bytes.
+ * @return The size of the pixel data in bytes.
+ */
+uint32_t bmpio_header24(int width, int height, uint8_t header[BMP_HEADER_SIZE + BMP_INFOHEADER_SIZE]) {
+    uint32_t rowPadded = ((uint32_t)width * 3 + 3) & (~3u);
+    uint32_t dataSize = rowPadded * (uint32_t)(height < 0 ? -height : height);
+    uint32_t dataOffset = BMP_HEADER_SIZE + BMP_INFOHEADER_SIZE;
+
+    memset(header, 0, BMP_HEADER_SIZE + BMP_INFOHEADER_SIZE);
+    put16(header + BITMAP_MAGIC_OFFSET, BMP_TYPE);
+    put32(header + BITMAP_SIZE_OFFSET, dataOffset + dataSize);
+    put32(header + BITMAP_OFFSET_OFFSET, dataOffset);
+    put32(header + BITMAP_INFO_SIZE_OFFSET, BMP_INFOHEADER_SIZE);
+    put32(header + BITMAP_WIDTH_OFFSET, width);
+    put32(header + BITMAP_HEIGHT_OFFSET, (uint32_t)height);
+    put16(header + BITMAP_PLANES_OFFSET, 1);
+    put16(header + BITMAP_DEPTH_OFFSET, 24);
+    put32(header + BITMAP_SIZE_RAW_OFFSET, dataSize);
+    return dataSize;
+}
+
+static uint16_t get16(const uint8_t * p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t * p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Parses the file and info headers of a BMP file (the first 54 bytes).
+ * Only the magic number is checked; the loaders validate the fields they support.
+ * @param bytes The first bytes of the file.
+ * @param size The number of bytes available.
+ * @param fields Receives the header fields.
+ * @return 0 on success, -1 if the bytes are too short or not a BMP file.
+ */
+int bmpio_parseHeader(const uint8_t * bytes, size_t size, t_bmpFields * fields) {
+    if (!bytes || size < BMP_HEADER_SIZE + BMP_INFOHEADER_SIZE || get16(bytes + BITMAP_MAGIC_OFFSET) != BMP_TYPE) {
+        return -1;
+    }
+    fields->fileSize = get32(bytes + BITMAP_SIZE_OFFSET);
+    fields->dataOffset = get32(bytes + BITMAP_OFFSET_OFFSET);
+    fields->infoSize = get32(bytes + BITMAP_INFO_SIZE_OFFSET);
+    fields->width = (int32_t)get32(bytes + BITMAP_WIDTH_OFFSET);
+    fields->height = (int32_t)get32(bytes + BITMAP_HEIGHT_OFFSET);
+    fields->planes = get16(bytes + BITMAP_PLANES_OFFSET);
+    fields->bits = get16(bytes + BITMAP_DEPTH_OFFSET);
+    fields->compression = get32(bytes + BITMAP_COMPRESSION_OFFSET);
+    fields->imageSize = get32(bytes + BITMAP_SIZE_RAW_OFFSET);
+    fields->numColors = get32(bytes + BITMAP_NCOLORS_OFFSET);
+    return 0;
+}
+
+/**
+ * Reads the headers of a BMP file with a single pread and parses them.
+ * @param filename The path to the BMP file.
+ * @param fields Receives the header fields.
+ * @return 0 on success, -1 if the file cannot be read or is not a BMP file.
+ */
+int bmpio_probe(const char * filename, t_bmpFields * fields) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return -1;
+    uint8_t bytes[BMP_HEADER_SIZE + BMP_INFOHEADER_SIZE];
+    ssize_t got = pread(fd, bytes, sizeof(bytes), 0);
+    close(fd);
+    return got < 0 ? -1 : bmpio_parseHeader(bytes, (size_t)got, fields);
+}
+
+/**
+ * Writes a whole buffer at a file offset, retrying short writes.
+ */
+static int writeAt(int fd, const uint8_t * buffer, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t written = pwrite(fd, buffer, size, offset);
+        if (written <= 0) return -1;
+        buffer += written;
+        size -= written;
+        offset += written;
+    }
+    return 0;
+}
+
+/**
+ * Copies image rows [begin, end) with their padding to dst, in file order.
+ */
+static void packRows(const t_saveState * state, int begin, int end, uint8_t * dst) {
+    size_t padding = state->paddedBytes - state->rowBytes;
+    for (int i = 0; i < end - begin; i++) {
+        memcpy(dst, state->img->data[rowInFileOrder(begin, end, i, state->topDown)], state->rowBytes);
+        memset(dst + state->rowBytes, 0, padding);
+        dst += state->paddedBytes;
+    }
+}
+
+static void saveRows(int begin, int end, void * ctx) {
+    t_saveState * state = (t_saveState *)ctx;
+    int height = state->img->height;
+
+    if (state->map) {
+        packRows(state, begin, end,
+                 state->map + (size_t)firstFileRow(begin, end, height, state->topDown) * state->paddedBytes);
+        return;
+    }
+
+    uint8_t * buffer = (uint8_t *)malloc((size_t)state->chunkRows * state->paddedBytes);
+    if (!buffer) {
+        atomic_store(&state->failed, 1);
+        return;
+    }
+    for (int chunkEnd = end; chunkEnd > begin && !atomic_load(&state->failed); chunkEnd -= state->chunkRows) {
+        int chunkBegin = chunkEnd - state->chunkRows > begin ? chunkEnd - state->chunkRows : begin;
+        packRows(state, chunkBegin, chunkEnd, buffer);
+        off_t offset = state->dataOffset +
+                       (off_t)firstFileRow(chunkBegin, chunkEnd, height, state->topDown) * state->paddedBytes;
+        if (writeAt(state->fd, buffer, (size_t)(chunkEnd - chunkBegin) * state->paddedBytes, offset) != 0) {
+            atomic_store(&state->failed, 1);
+        }
+    }
+    free(buffer);
+}
+
+/**
+ * Saves a 24-bit image with threads writing disjoint row ranges of the file.
+ * @param img Pointer to the t_bmp24 structure.
+ * @param filename The path to the output BMP file.
+ * @param flags BMPIO_FSYNC to flush the file to disk before returning (durable save);
+ *              BMPIO_MMAP to write through a shared mapping instead of pwrite.
+ * @return 0 on success, -1 on failure (the file may be incomplete).
+ */
+int bmpio_save24(const t_bmp24 * img, const char * filename, int flags) {
+    if (!img || !img->data) {
+        printf("Error: Cannot save NULL image\n");
+        return -1;
+    }
+
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("Error: Cannot create file %s\n", filename);
+        return -1;
+    }
+
+    uint8_t header[BMP_HEADER_SIZE + BMP_INFOHEADER_SIZE];
+    uint32_t dataSize = bmpio_header24(img->width, bmp24_isTopDown(img) ? -img->height : img->height, header);
+
+    t_saveState state;
+    state.img = img;
+    state.fd = fd;
+    state.map = NULL;
+    state.rowBytes = (size_t)img->width * sizeof(t_pixel);
+    state.paddedBytes = (state.rowBytes + 3) & ~(size_t)3;
+    state.dataOffset = sizeof(header);
+    state.topDown = bmp24_isTopDown(img);
+    state.chunkRows = BMPIO_CHUNK_BYTES / state.paddedBytes > 0 ? (int)(BMPIO_CHUNK_BYTES / state.paddedBytes) : 1;
+    atomic_init(&state.failed, 0);
+
+    size_t fileSize = sizeof(header) + (size_t)dataSize;
+    uint8_t * map = NULL;
+    int status = ftruncate(fd, fileSize) == 0 && writeAt(fd, header, sizeof(header), 0) == 0 ? 0 : -1;
+    if (status == 0 && (flags & BMPIO_MMAP) && dataSize > 0) {
+        map = (uint8_t *)mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) status = -1;
+        else state.map = map + sizeof(header);
+    }
+
+    if (status == 0) {
+        parallel_for(0, img->height, state.chunkRows, saveRows, &state);
+        if (atomic_load(&state.failed)) status = -1;
+    }
+    if (map && map != MAP_FAILED) {
+        if (status == 0 && (flags & BMPIO_FSYNC) && msync(map, fileSize, MS_SYNC) != 0) status = -1;
+        munmap(map, fileSize);
+    }
+    if (status == 0 && (flags & BMPIO_FSYNC) && fsync(fd) != 0) status = -1;
+    bmpio_dropCache(fd, 1);
+    if (close(fd) != 0) status = -1;
+
+    if (status != 0) printf("Error: Failed to write pixel data to %s\n", filename);
+    return status;
+}
+
+// --- Load --- //
+
+/**
+ * Returns the number of concurrent reads used by bmpio_readPixels24 by default: the
+ * IMAGE_IO_THREADS environment variable, or the number of pool threads.
+ * @return The thread count (at least 1).
+ */
+int bmpio_numThreads(void) {
+    const char * env = getenv("IMAGE_IO_THREADS");
+    int n = env ? (int)strtol(env, NULL, 10) : parallel_numThreads();
+    return n > 0 ? n : 1;
+}
+
+/**
+ * Reads the file rows of image rows [begin, end) in chunks of BMPIO_READ_ROWS rows.
+ * Pixels that could not be read are set to black.
+ */
+static void loadRows(int begin, int end, void * ctx) {
+    t_loadState * state = (t_loadState *)ctx;
+    int height = state->img->height;
+    uint8_t padding[4];
+    struct iovec iov[2 * BMPIO_READ_ROWS];
+    size_t padBytes = state->paddedBytes - state->rowBytes;
+
+    for (int chunkEnd = end; chunkEnd > begin; chunkEnd -= BMPIO_READ_ROWS) {
+        int chunkBegin = chunkEnd - BMPIO_READ_ROWS > begin ? chunkEnd - BMPIO_READ_ROWS : begin;
+        int numIov = 0;
+        for (int i = 0; i < chunkEnd - chunkBegin; i++) {
+            iov[numIov].iov_base = state->img->data[rowInFileOrder(chunkBegin, chunkEnd, i, state->topDown)];
+            iov[numIov++].iov_len = state->rowBytes;
+            if (padBytes > 0) {
+                iov[numIov].iov_base = padding;
+                iov[numIov++].iov_len = padBytes;
+            }
+        }
+
+        size_t total = (size_t)(chunkEnd - chunkBegin) * state->paddedBytes;
+        size_t done = 0;
+        off_t offset = state->dataOffset +
+                       (off_t)firstFileRow(chunkBegin, chunkEnd, height, state->topDown) * state->paddedBytes;
+        struct iovec * next = iov;
+        while (done < total) {
+            ssize_t got = preadv(state->fd, next, numIov, offset + done);
+            if (got <= 0) break;
+            done += got;
+            // Skip the buffers filled, and advance into a partly filled one
+            while (numIov > 0 && (size_t)got >= next->iov_len) {
+                got -= next->iov_len;
+                next++;
+                numIov--;
+            }
+            if (got > 0) {
+                next->iov_base = (uint8_t *)next->iov_base + got;
+                next->iov_len -= got;
+            }
+        }
+        if (done < total) {
+            atomic_store(&state->shortRead, 1);
+            // Keep the bytes read of a partial row, as bmp24_readPixelData does
+            int i = (int)(done / state->paddedBytes);
+            size_t partial = done % state->paddedBytes;
+            if (partial < state->rowBytes) {
+                int y = rowInFileOrder(chunkBegin, chunkEnd, i, state->topDown);
+                memset((uint8_t *)state->img->data[y] + partial, 0, state->rowBytes - partial);
+            }
+            for (i++; i < chunkEnd - chunkBegin; i++) {
+                memset(state->img->data[rowInFileOrder(chunkBegin, chunkEnd, i, state->topDown)], 0, state->rowBytes);
+            }
+        }
+    }
+}
+
+/**
+ * Reads the pixel data of a 24-bit BMP file into an allocated image of the same size.
+ * The rows are split into numThreads ranges, read concurrently with positioned reads, so
+ * the file position of fd is not used or changed.
+ * @param img Pointer to the t_bmp24 structure (headers filled in, rows allocated).
+ * @param fd The file descriptor of the BMP file.
+ * @param numThreads The number of concurrent reads (0: bmpio_numThreads()).
+ * @return 0 on success, -1 if the file is shorter than the pixel data (missing rows are black).
+ */
+int bmpio_readPixels24(t_bmp24 * img, int fd, int numThreads) {
+    if (!img || !img->data || fd < 0) return -1;
+    if (numThreads <= 0) numThreads = bmpio_numThreads();
+
+    t_loadState state;
+    state.img = img;
+    state.fd = fd;
+    state.rowBytes = (size_t)img->width * sizeof(t_pixel);
+    state.paddedBytes = (state.rowBytes + 3) & ~(size_t)3;
+    state.dataOffset = img->header.offset;
+    state.topDown = bmp24_isTopDown(img);
+    atomic_init(&state.shortRead, 0);
+
+    // One range per thread bounds the reads in flight to numThreads
+    int grain = (img->height + numThreads - 1) / numThreads;
+    parallel_for(0, img->height, grain, loadRows, &state);
+
+    if (atomic_load(&state.shortRead)) {
+        printf("Error: Failed to read pixel data. Missing rows are left black\n");
+        return -1;
+    }
+    return 0;
+}
+
+// --- Row Writer --- //
+
+/**
+ * Opens a writer that receives an image row by row, top row first.
+ * A top-down file stores the rows in that order, so they are appended as they come and the
+ * output may be a pipe. A bottom-up file places each row at its offset from the end, which
+ * needs a seekable file.
+ * @param filename The path of the BMP file, or "-" for standard output (top-down only).
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param topDown 1 for a top-down file (negative height), 0 for the default bottom-up order.
+ * @return Pointer to the writer, or NULL on failure.
+ */
+t_bmpWriter * bmpio_openWriter(const char * filename, int width, int height, int topDown) {
+    if (!filename || width <= 0 || height <= 0) return NULL;
+    int toStdout = strcmp(filename, "-") == 0;
+    if (toStdout && !topDown) {
+        printf("Error: Only top-down images can be written to standard output\n");
+        return NULL;
+    }
+
+    t_bmpWriter * writer = (t_bmpWriter *)calloc(1, sizeof(t_bmpWriter));
+    if (!writer) return NULL;
+    writer->file = toStdout ? stdout : fopen(filename, "wb");
+    if (!writer->file) {
+        printf("Error: Cannot create file %s\n", filename);
+        free(writer);
+        return NULL;
+    }
+    writer->width = width;
+    writer->height = height;
+    writer->topDown = topDown;
+    writer->rowBytes = (size_t)width * sizeof(t_pixel);
+    writer->paddedBytes = (writer->rowBytes + 3) & ~(size_t)3;
+
+    uint8_t header[BMP_HEADER_SIZE + BMP_INFOHEADER_SIZE];
+    bmpio_header24(width, topDown ? -height : height, header);
+    if (fwrite(header, 1, sizeof(header), writer->file) != sizeof(header)) writer->failed = 1;
+    return writer;
+}
+
+/**
+ * Writes the next row of the image (rows are given top row first).
+ * @param writer Pointer to the writer.
+ * @param row The row's pixels (width pixels).
+ * @return 0 on success, -1 on failure or if every row was already written.
+ */
+int bmpio_writeRow(t_bmpWriter * writer, const t_pixel * row) {
+    if (!writer || !row || writer->failed || writer->nextRow >= writer->height) return -1;
+
+    static const uint8_t padding[3] = {0, 0, 0};
+    if (!writer->topDown) {
+        long offset = BMP_HEADER_SIZE + BMP_INFOHEADER_SIZE +
+                      (long)(writer->height - 1 - writer->nextRow) * (long)writer->paddedBytes;
+        if (fseek(writer->file, offset, SEEK_SET) != 0) writer->failed = 1;
+    }
+    if (!writer->failed &&
+        (fwrite(row, 1, writer->rowBytes, writer->file) != writer->rowBytes ||
+         fwrite(padding, 1, writer->paddedBytes - writer->rowBytes, writer->file) != writer->paddedBytes - writer->rowBytes)) {
+        writer->failed = 1;
+    }
+    writer->nextRow++;
+    return writer->failed ? -1 : 0;
+}
+
+/**
+ * Closes a row writer.
+ * @param writer Pointer to the writer.
+ * @param flags BMPIO_FSYNC to flush the file to disk before returning.
+ * @return 0 on success, -1 if a write failed or fewer rows than the height were written.
+ */
+int bmpio_closeWriter(t_bmpWriter * writer, int flags) {
+    if (!writer) return -1;
+    int status = writer->failed || writer->nextRow != writer->height ? -1 : 0;
+    if (fflush(writer->file) != 0) status = -1;
+    if (status == 0 && (flags & BMPIO_FSYNC) && writer->file != stdout && fsync(fileno(writer->file)) != 0) {
+        status = -1;
+    }
+    if (writer->file != stdout) fclose(writer->file);
+    if (writer->nextRow != writer->height) {
+        printf("Error: Image closed after %d of %d rows\n", writer->nextRow, writer->height);
+    } else if (status != 0) {
+        printf("Error: Failed to write image rows\n");
+    }
+    free(writer);
+    return status;
+}
+
+// --- I/O Modes --- //
+
+// Mode set by bmpio_setMode (-1: from the environment)
+static atomic_int ioMode = -1;
+
+static atomic_ullong statReadBytes;
+static atomic_ullong statReadNanos;
+static atomic_ullong statWrittenBytes;
+static atomic_ullong statWriteNanos;
+
+static const char * modeNames[] = {"buffered", "nocache", "direct"};
+
+// Shared state of a direct read or write
+typedef struct {
+    int fd;
+    off_t start;                  // Aligned file offset of chunk 0
+    off_t offset;                 // Read: first byte wanted
+    uint8_t * const * rows;       // Read: destination rows, in file order
+    size_t rowBytes;              // Read: bytes of a row without its padding
+    size_t paddedBytes;           // Read: bytes of a row in the file
+    size_t size;                  // Read: bytes wanted; write: file size
+    const t_fileLayout * layout;  // Write: content of the file
+    atomic_int failed;
+} t_directState;
+
+/**
+ * Returns a monotonic time in seconds.
+ * @return The time.
+ */
+double bmpio_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Returns the name of an I/O mode.
+ * @param mode The mode.
+ * @return "buffered", "nocache" or "direct".
+ */
+const char * bmpio_modeName(t_ioMode mode) {
+    return mode >= BMPIO_MODE_BUFFERED && mode <= BMPIO_MODE_DIRECT ? modeNames[mode] : "unknown";
+}
+
+/**
+ * Parses an I/O mode name.
+ * @param name "buffered", "nocache" or "direct".
+ * @param mode Receives the mode.
+ * @return 0 on success, -1 if the name is unknown.
+ */
+int bmpio_parseMode(const char * name, t_ioMode * mode) {
+    for (int i = 0; name && i < (int)(sizeof(modeNames) / sizeof(modeNames[0])); i++) {
+        if (strcmp(name, modeNames[i]) == 0) {
+            *mode = (t_ioMode)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Returns the I/O mode: the one set by bmpio_setMode, else IMAGE_IO_MODE, else buffered.
+ * @return The mode.
+ */
+t_ioMode bmpio_mode(void) {
+    int mode = atomic_load(&ioMode);
+    if (mode >= 0) return (t_ioMode)mode;
+
+    t_ioMode parsed = BMPIO_MODE_BUFFERED;
+    const char * env = getenv("IMAGE_IO_MODE");
+    if (env && bmpio_parseMode(env, &parsed) != 0) {
+        printf("Error: Unknown IMAGE_IO_MODE '%s', using buffered I/O\n", env);
+    }
+    atomic_store(&ioMode, (int)parsed);
+    return parsed;
+}
+
+/**
+ * Sets the I/O mode of the following loads and saves.
+ * @param mode The mode.
+ */
+void bmpio_setMode(t_ioMode mode) {
+    atomic_store(&ioMode, (int)mode);
+}
+
+/**
+ * Releases the cached pages of a file in nocache and direct modes. Written pages are flushed
+ * first, since the kernel only drops clean pages.
+ * @param fd The file descriptor.
+ * @param written 1 if the file was just written, 0 if it was read.
+ */
+void bmpio_dropCache(int fd, int written) {
+    if (fd < 0 || bmpio_mode() == BMPIO_MODE_BUFFERED) return;
+    if (written) fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+static void * alignedChunk(void) {
+    void * buffer = NULL;
+    return posix_memalign(&buffer, BMPIO_DIRECT_ALIGN, BMPIO_DIRECT_CHUNK) == 0 ? buffer : NULL;
+}
+
+/**
+ * Copies the bytes [offset, offset + size) of padded rows to the rows of a read, without the
+ * padding.
+ */
+static void scatterRows(const t_directState * state, size_t offset, const uint8_t * src, size_t size) {
+    while (size > 0) {
+        size_t row = offset / state->paddedBytes;
+        size_t column = offset % state->paddedBytes;
+        size_t n;
+        if (column < state->rowBytes) {
+            n = state->rowBytes - column < size ? state->rowBytes - column : size;
+            memcpy(state->rows[row] + column, src, n);
+        } else {
+            n = state->paddedBytes - column < size ? state->paddedBytes - column : size;
+        }
+        src += n;
+        offset += n;
+        size -= n;
+    }
+}
+
+static void directReadChunks(int begin, int end, void * ctx) {
+    t_directState * state = (t_directState *)ctx;
+    uint8_t * bounce = (uint8_t *)alignedChunk();
+    if (!bounce) {
+        atomic_store(&state->failed, 1);
+        return;
+    }
+
+    for (int chunk = begin; chunk < end; chunk++) {
+        off_t chunkStart = state->start + (off_t)chunk * BMPIO_DIRECT_CHUNK;
+        ssize_t got = pread(state->fd, bounce, BMPIO_DIRECT_CHUNK, chunkStart);
+        if (got < 0) {
+            atomic_store(&state->failed, 1);
+            break;
+        }
+        // De-pad the part of [chunkStart, chunkStart + got) that was asked for into the rows
+        off_t from = chunkStart > state->offset ? chunkStart : state->offset;
+        off_t to = chunkStart + got;
+        if (to > state->offset + (off_t)state->size) to = state->offset + (off_t)state->size;
+        if (to > from) scatterRows(state, from - state->offset, bounce + (from - chunkStart), to - from);
+    }
+    free(bounce);
+}
+
+/**
+ * Reads padded rows with O_DIRECT; each aligned chunk is de-padded straight into the rows.
+ * @return The bytes read, or -1 if O_DIRECT cannot be used.
+ */
+static long long readDirect(const char * filename, off_t offset, uint8_t * const * rows, size_t rowBytes,
+                            size_t paddedBytes, int numRows) {
+    int fd = open(filename, O_RDONLY | O_DIRECT);
+    if (fd < 0) return -1;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    t_directState state;
+    state.fd = fd;
+    state.start = offset & ~(off_t)(BMPIO_DIRECT_ALIGN - 1);
+    state.offset = offset;
+    state.rows = rows;
+    state.rowBytes = rowBytes;
+    state.paddedBytes = paddedBytes;
+    state.size = paddedBytes * numRows;
+    state.layout = NULL;
+    atomic_init(&state.failed, 0);
+    size_t size = state.size;
+    off_t end = offset + (off_t)size;
+    int numChunks = (int)((end - state.start + BMPIO_DIRECT_CHUNK - 1) / BMPIO_DIRECT_CHUNK);
+    parallel_for(0, numChunks, 1, directReadChunks, &state);
+    close(fd);
+
+    if (atomic_load(&state.failed)) return -1;
+    off_t available = info.st_size > offset ? info.st_size - offset : 0;
+    return available < (off_t)size ? available : (long long)size;
+}
+
+/**
+ * Clears the bytes of rows from offset on (padded offset), for data missing from the file.
+ */
+static void clearRows(uint8_t * const * rows, size_t rowBytes, size_t paddedBytes, int numRows, size_t offset) {
+    for (size_t row = offset / paddedBytes; row < (size_t)numRows; row++) {
+        size_t column = row == offset / paddedBytes ? offset % paddedBytes : 0;
+        if (column < rowBytes) memset(rows[row] + column, 0, rowBytes - column);
+    }
+}
+
+/**
+ * Reads padded rows stored one after another in a file into the rows of an image, dropping
+ * the padding. In direct mode each aligned bounce chunk is de-padded straight into the rows,
+ * so no file-sized buffer is needed; the other modes read the data whole through a pooled
+ * buffer and de-pad it (dispatch depadRows). Rows missing from the file are left black.
+ * @param filename The path of the file (opened again with O_DIRECT in direct mode), or NULL.
+ * @param file The open stream of the file, used in the buffered and nocache modes.
+ * @param offset The file offset of the first row.
+ * @param rows The destination rows, in file order.
+ * @param rowBytes The bytes of a row without padding.
+ * @param paddedBytes The bytes of a row in the file.
+ * @param numRows The number of rows.
+ * @return The number of bytes read (paddedBytes * numRows if the file holds every row).
+ */
+size_t bmpio_readRows(const char * filename, FILE * file, off_t offset, uint8_t * const * rows,
+                      size_t rowBytes, size_t paddedBytes, int numRows) {
+    size_t size = paddedBytes * numRows;
+    if (bmpio_mode() == BMPIO_MODE_DIRECT && filename) {
+        long long got = readDirect(filename, offset, rows, rowBytes, paddedBytes, numRows);
+        if (got >= 0) {
+            clearRows(rows, rowBytes, paddedBytes, numRows, (size_t)got);
+            return (size_t)got;
+        }
+    }
+
+    uint8_t * buffer = (uint8_t *)pool_alloc(size);
+    if (!buffer) {
+        printf("Error: Failed to allocate buffer for pixel data\n");
+        return 0;
+    }
+    size_t got = 0;
+    if (fseeko(file, offset, SEEK_SET) == 0) got = fread(buffer, 1, size, file);
+    bmpio_dropCache(fileno(file), 0);
+    memset(buffer + got, 0, size - got);
+    dispatch_get()->depadRows(rows, buffer, rowBytes, paddedBytes, numRows);
+    pool_free(buffer);
+    return got;
+}
+
+/**
+ * Copies the bytes [offset, offset + size) of a file layout to dst.
+ */
+static void fillLayout(const t_fileLayout * layout, size_t offset, size_t size, uint8_t * dst) {
+    while (size > 0) {
+        size_t n;
+        if (offset < layout->headerSize) {
+            n = layout->headerSize - offset < size ? layout->headerSize - offset : size;
+            memcpy(dst, layout->header + offset, n);
+        } else {
+            size_t row = (offset - layout->headerSize) / layout->paddedBytes;
+            size_t column = (offset - layout->headerSize) % layout->paddedBytes;
+            if (row >= (size_t)layout->numRows) {
+                memset(dst, 0, size);
+                return;
+            }
+            if (column < layout->rowBytes) {
+                n = layout->rowBytes - column < size ? layout->rowBytes - column : size;
+                memcpy(dst, layout->rows[row] + column, n);
+            } else {
+                n = layout->paddedBytes - column < size ? layout->paddedBytes - column : size;
+                memset(dst, 0, n);
+            }
+        }
+        dst += n;
+        offset += n;
+        size -= n;
+    }
+}
+
+static void directWriteChunks(int begin, int end, void * ctx) {
+    t_directState * state = (t_directState *)ctx;
+    uint8_t * bounce = (uint8_t *)alignedChunk();
+    if (!bounce) {
+        atomic_store(&state->failed, 1);
+        return;
+    }
+
+    for (int chunk = begin; chunk < end && !atomic_load(&state->failed); chunk++) {
+        size_t chunkStart = (size_t)chunk * BMPIO_DIRECT_CHUNK;
+        size_t length = state->size - chunkStart < BMPIO_DIRECT_CHUNK ? state->size - chunkStart : BMPIO_DIRECT_CHUNK;
+        // The last chunk is rounded up to the alignment; the file is truncated afterwards
+        size_t aligned = (length + BMPIO_DIRECT_ALIGN - 1) & ~(size_t)(BMPIO_DIRECT_ALIGN - 1);
+        fillLayout(state->layout, chunkStart, length, bounce);
+        memset(bounce + length, 0, aligned - length);
+        if (writeAt(state->fd, bounce, aligned, (off_t)chunkStart) != 0) atomic_store(&state->failed, 1);
+    }
+    free(bounce);
+}
+
+static void bufferedWriteChunks(int begin, int end, void * ctx) {
+    t_directState * state = (t_directState *)ctx;
+    uint8_t * buffer = (uint8_t *)malloc(BMPIO_DIRECT_CHUNK);
+    if (!buffer) {
+        atomic_store(&state->failed, 1);
+        return;
+    }
+
+    for (int chunk = begin; chunk < end && !atomic_load(&state->failed); chunk++) {
+        size_t chunkStart = (size_t)chunk * BMPIO_DIRECT_CHUNK;
+        size_t length = state->size - chunkStart < BMPIO_DIRECT_CHUNK ? state->size - chunkStart : BMPIO_DIRECT_CHUNK;
+        fillLayout(state->layout, chunkStart, length, buffer);
+        if (writeAt(state->fd, buffer, length, (off_t)chunkStart) != 0) atomic_store(&state->failed, 1);
+    }
+    free(buffer);
+}
+
+/**
+ * Writes a file in the current I/O mode, in parallel chunks of BMPIO_DIRECT_CHUNK bytes.
+ * In direct mode the file is opened with O_DIRECT (nocache if the file system refuses it).
+ * @param filename The path of the file.
+ * @param layout The content of the file.
+ * @param flags BMPIO_FSYNC to flush the file to disk before returning.
+ * @return 0 on success, -1 on failure.
+ */
+int bmpio_writeLayout(const char * filename, const t_fileLayout * layout, int flags) {
+    if (!filename || !layout) return -1;
+
+    int direct = bmpio_mode() == BMPIO_MODE_DIRECT;
+    int fd = direct ? open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644) : -1;
+    if (fd < 0) {
+        direct = 0;
+        fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd < 0) {
+        printf("Error: Cannot create file %s\n", filename);
+        return -1;
+    }
+
+    t_directState state;
+    state.fd = fd;
+    state.start = 0;
+    state.offset = 0;
+    state.rows = NULL;
+    state.rowBytes = 0;
+    state.paddedBytes = 0;
+    state.size = layout->headerSize + layout->paddedBytes * (size_t)layout->numRows;
+    state.layout = layout;
+    atomic_init(&state.failed, 0);
+    int numChunks = (int)((state.size + BMPIO_DIRECT_CHUNK - 1) / BMPIO_DIRECT_CHUNK);
+    parallel_for(0, numChunks, 1, direct ? directWriteChunks : bufferedWriteChunks, &state);
+
+    int status = atomic_load(&state.failed) ? -1 : 0;
+    if (status == 0 && direct && ftruncate(fd, (off_t)state.size) != 0) status = -1;
+    if (status == 0 && (flags & BMPIO_FSYNC) && fsync(fd) != 0) status = -1;
+    bmpio_dropCache(fd, 1);
+    if (close(fd) != 0) status = -1;
+    if (status != 0) printf("Error: Failed to write %s\n", filename);
+    return status;
+}
+
+// --- Bandwidth --- //
+
+/**
+ * Adds a load or save to the I/O statistics. With IMAGE_IO_REPORT=1 each one is printed.
+ * @param filename The path of the file.
+ * @param written 1 for a save, 0 for a load.
+ * @param bytes The size of the file.
+ * @param seconds The time the load or save took.
+ */
+void bmpio_record(const char * filename, int written, size_t bytes, double seconds) {
+    unsigned long long nanos = (unsigned long long)(seconds * 1e9);
+    if (written) {
+        atomic_fetch_add(&statWrittenBytes, bytes);
+        atomic_fetch_add(&statWriteNanos, nanos);
+    } else {
+        atomic_fetch_add(&statReadBytes, bytes);
+        atomic_fetch_add(&statReadNanos, nanos);
+    }
+
+    const char * env = getenv("IMAGE_IO_REPORT");
+    if (env && strtol(env, NULL, 10) != 0) {
+        printf("[io] %s %s: %.1f MB in %.1f ms, %.0f MB/s (%s)\n", written ? "saved" : "loaded", filename,
+               bytes / 1e6, seconds * 1000.0, seconds > 0 ? bytes / 1e6 / seconds : 0.0,
+               bmpio_modeName(bmpio_mode()));
+    }
+}
+
+/**
+ * Returns the I/O statistics of this process.
+ * @param stats Receives the statistics.
+ */
+void bmpio_stats(t_ioStats * stats) {
+    stats->readBytes = atomic_load(&statReadBytes);
+    stats->readSeconds = atomic_load(&statReadNanos) * 1e-9;
+    stats->writtenBytes = atomic_load(&statWrittenBytes);
+    stats->writeSeconds = atomic_load(&statWriteNanos) * 1e-9;
+}
+
+/**
+ * Prints the I/O statistics of this process.
+ * @param prefix Text printed at the start of the line (e.g. "[batch] ").
+ */
+void bmpio_printStats(const char * prefix) {
+    t_ioStats stats;
+    bmpio_stats(&stats);
+    printf("%sI/O (%s): read %.1f MB in %.2f s (%.0f MB/s), wrote %.1f MB in %.2f s (%.0f MB/s)\n",
+           prefix ? prefix : "", bmpio_modeName(bmpio_mode()),
+           stats.readBytes / 1e6, stats.readSeconds,
+           stats.readSeconds > 0 ? stats.readBytes / 1e6 / stats.readSeconds : 0.0,
+           stats.writtenBytes / 1e6, stats.writeSeconds,
+           stats.writeSeconds > 0 ? stats.writtenBytes / 1e6 / stats.writeSeconds : 0.0);
+}
@@ -0,0 +1,169 @@
+/*
+ * bmpio.h
+ * Author: Simon Hillel
+ * Description: Header for parallel file I/O of 24-bit BMP images.
+ * The file is sized up front and worker threads write disjoint row ranges at their computed
+ * offsets, each padding its own rows, instead of one thread streaming rows through a FILE*.
+ * Loading splits the pixel data into row ranges that threads read concurrently, straight into
+ * the image rows. A row writer lets producers emit an image row by row, top row first; with a
+ * top-down file (negative height) the rows go out in that order, so the output can be a pipe.
+ * The header parser is shared by the loaders and the header-only scans (bmpio_probe).
+ * The I/O mode lets one-shot loads and saves of huge files bypass or release the page cache;
+ * every load and save is counted so the achieved bandwidth can be compared between modes.
+ */
+#ifndef BMPIO_H
+#define BMPIO_H
+
+#include "bmp24.h"
+
+// Flags of bmpio_save24
+#define BMPIO_FSYNC 0x1           // Flush the file to disk before returning
+#define BMPIO_MMAP 0x2            // Copy rows into a shared writable mapping instead of pwrite
+
+// Pixel data size from which bmp24_saveImage and bmp24_loadImage use the parallel paths
+#define BMPIO_PARALLEL_MIN_BYTES ((size_t)4 << 20)
+// Bytes written by one pwrite call (whole rows)
+#define BMPIO_CHUNK_BYTES ((size_t)2 << 20)
+// Rows read by one preadv call (two buffers per row: pixels and padding)
+#define BMPIO_READ_ROWS 256
+// Alignment of O_DIRECT offsets, sizes and buffers, and size of one direct transfer
+#define BMPIO_DIRECT_ALIGN 4096
+#define BMPIO_DIRECT_CHUNK ((size_t)4 << 20)
+
+// How loads and saves use the page cache (IMAGE_IO_MODE=buffered|nocache|direct)
+typedef enum {
+    BMPIO_MODE_BUFFERED,      // Through the page cache
+    BMPIO_MODE_NOCACHE,       // Through the page cache, dropped once consumed (posix_fadvise DONTNEED)
+    BMPIO_MODE_DIRECT         // O_DIRECT with aligned bounce buffers (nocache where unsupported)
+} t_ioMode;
+
+// Bytes moved and time spent by loads and saves since the start of the process
+typedef struct {
+    unsigned long long readBytes;
+    double readSeconds;
+    unsigned long long writtenBytes;
+    double writeSeconds;
+} t_ioStats;
+
+// A BMP file as written: header bytes (with palette), then padded rows in file order
+typedef struct {
+    const uint8_t * header;
+    size_t headerSize;
+    const uint8_t * const * rows;
+    size_t rowBytes;
+    size_t paddedBytes;
+    int numRows;
+} t_fileLayout;
+
+// Fields of the 54-byte file and info headers, as stored (bmpio_parseHeader)
+typedef struct {
+    uint32_t fileSize;
+    uint32_t dataOffset;
+    uint32_t infoSize;
+    int32_t width;
+    int32_t height;           // Negative for top-down row order
+    uint16_t planes;
+    uint16_t bits;
+    uint32_t compression;
+    uint32_t imageSize;
+    uint32_t numColors;
+} t_bmpFields;
+
+// Row-by-row writer (bmpio_openWriter)
+typedef struct {
+    FILE * file;
+    int width;
+    int height;
+    int topDown;              // Rows written in production order; otherwise each row is placed by seeking
+    int nextRow;              // Image row expected next (0 = top)
+    size_t rowBytes;
+    size_t paddedBytes;
+    int failed;
+} t_bmpWriter;
+
+/**
+ * Parses the 54-byte headers of a BMP file. Returns 0, or -1 if too short or not 'BM'.
+ */
+int bmpio_parseHeader(const uint8_t * bytes, size_t size, t_bmpFields * fields);
+/**
+ * Reads and parses the headers of a BMP file with one pread. Returns 0, or -1 on failure.
+ */
+int bmpio_probe(const char * filename, t_bmpFields * fields);
+/**
+ * Fills the 54-byte headers of a 24-bit image (height < 0: top-down); returns the pixel data size.
+ */
+uint32_t bmpio_header24(int width, int height, uint8_t header[BMP_HEADER_SIZE + BMP_INFOHEADER_SIZE]);
+/**
+ * Saves a 24-bit image with parallel positioned writes. Returns 0 on success, -1 on failure.
+ */
+int bmpio_save24(const t_bmp24 * img, const char * filename, int flags);
+/**
+ * Returns the number of concurrent reads of the loader (IMAGE_IO_THREADS, or the pool size).
+ */
+int bmpio_numThreads(void);
+/**
+ * Reads the pixel data at img->header.offset of fd into the image rows with numThreads
+ * concurrent reads (0: bmpio_numThreads). Returns 0, or -1 if the data is short (rest black).
+ */
+int bmpio_readPixels24(t_bmp24 * img, int fd, int numThreads);
+/**
+ * Opens a row writer ("-": standard output, top-down only) and writes the headers.
+ */
+t_bmpWriter * bmpio_openWriter(const char * filename, int width, int height, int topDown);
+/**
+ * Writes the next row, top row first. Returns 0 on success, -1 on failure.
+ */
+int bmpio_writeRow(t_bmpWriter * writer, const t_pixel * row);
+/**
+ * Closes a row writer (BMPIO_FSYNC to flush to disk). Returns -1 if a write failed or rows are missing.
+ */
+int bmpio_closeWriter(t_bmpWriter * writer, int flags);
+
+/**
+ * Returns the I/O mode (bmpio_setMode, or IMAGE_IO_MODE; buffered by default).
+ */
+t_ioMode bmpio_mode(void);
+/**
+ * Sets the I/O mode of the following loads and saves.
+ */
+void bmpio_setMode(t_ioMode mode);
+/**
+ * Returns the name of an I/O mode.
+ */
+const char * bmpio_modeName(t_ioMode mode);
+/**
+ * Parses an I/O mode name. Returns 0, or -1 if the name is unknown.
+ */
+int bmpio_parseMode(const char * name, t_ioMode * mode);
+/**
+ * Reads padded rows at offset into rows (file order) in the current mode, dropping the padding
+ * (file: the open stream, used unless direct). Returns the bytes read; missing rows are black.
+ */
+size_t bmpio_readRows(const char * filename, FILE * file, off_t offset, uint8_t * const * rows,
+                      size_t rowBytes, size_t paddedBytes, int numRows);
+/**
+ * Writes a file in the current mode (flags: BMPIO_FSYNC). Returns 0 on success, -1 on failure.
+ */
+int bmpio_writeLayout(const char * filename, const t_fileLayout * layout, int flags);
+/**
+ * Releases the cached pages of a file just read or written, in nocache and direct modes.
+ */
+void bmpio_dropCache(int fd, int written);
+/**
+ * Adds a load (written = 0) or save to the I/O statistics, and prints it if IMAGE_IO_REPORT=1.
+ */
+void bmpio_record(const char * filename, int written, size_t bytes, double seconds);
+/**
+ * Returns the I/O statistics of this process.
+ */
+void bmpio_stats(t_ioStats * stats);
+/**
+ * Prints the I/O statistics: bytes, time and bandwidth of loads and saves.
+ */
+void bmpio_printStats(const char * prefix);
+/**
+ * Returns a monotonic time in seconds, for timing loads and saves.
+ */
+double bmpio_now(void);
+
+#endif // BMPIO_H
@@ -0,0 +1,331 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdatomic.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "catalog.h"
+#include "bmpio.h"
+#include "parallel.h"
+
+/*
+ * catalog.c
+ * Author: Simon Hillel
+ * Description: Implementation of the image catalog.
+ * The directory walk only collects paths; the files are then handled in parallel tasks that
+ * stat each one and, unless the previous index has an entry with the same size and
+ * modification time, read its headers with one pread (bmpio_probe, the parser of the loaders).
+ * Index layout (host byte order): a t_indexHeader, then one t_indexRecord per entry, sorted by
+ * path, then the paths, NUL-terminated, referenced by offset.
+ */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t pathBytes;
+} t_indexHeader;
+
+typedef struct {
+    uint64_t size;
+    int64_t mtimeNs;
+    uint32_t pathOffset;
+    int32_t width;
+    int32_t height;
+    uint32_t compression;
+    uint16_t depth;
+    uint16_t valid;
+} t_indexRecord;
+
+// State of a parallel scan
+typedef struct {
+    t_catalogEntry * entries;     // Paths filled in by the walk
+    const t_catalog * previous;   // Previous index, or NULL
+    atomic_int reused;
+} t_scanState;
+
+static int compareEntries(const void * a, const void * b) {
+    return strcmp(((const t_catalogEntry *)a)->path, ((const t_catalogEntry *)b)->path);
+}
+
+static int hasBmpExtension(const char * name) {
+    size_t length = strlen(name);
+    return length > 4 && strcasecmp(name + length - 4, ".bmp") == 0;
+}
+
+/**
+ * Appends an entry with the given path to a catalog.
+ * @return 0 on success, -1 if memory is exhausted.
+ */
+static int appendPath(t_catalog * catalog, int * capacity, const char * path) {
+    if (catalog->count == *capacity) {
+        int grown = *capacity ? *capacity * 2 : 256;
+        t_catalogEntry * entries = (t_catalogEntry *)realloc(catalog->entries, grown * sizeof(t_catalogEntry));
+        if (!entries) return -1;
+        catalog->entries = entries;
+        *capacity = grown;
+    }
+    t_catalogEntry * entry = &catalog->entries[catalog->count];
+    memset(entry, 0, sizeof(*entry));
+    entry->path = strdup(path);
+    if (!entry->path) return -1;
+    catalog->count++;
+    return 0;
+}
+
+/**
+ * Collects the paths of the .bmp files under a directory (hidden entries are skipped).
+ * @return 0 on success, -1 on failure.
+ */
+static int walk(const char * dir, t_catalog * catalog, int * capacity) {
+    DIR * handle = opendir(dir);
+    if (!handle) return -1;
+
+    int status = 0;
+    struct dirent * item;
+    char path[4096];
+    while (status == 0 && (item = readdir(handle)) != NULL) {
+        if (item->d_name[0] == '.') continue;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, item->d_name) >= (int)sizeof(path)) continue;
+
+        int isDir = item->d_type == DT_DIR;
+        int isFile = item->d_type == DT_REG;
+        if (item->d_type == DT_UNKNOWN || item->d_type == DT_LNK) {
+            struct stat info;
+            if (stat(path, &info) != 0) continue;
+            isDir = S_ISDIR(info.st_mode);
+            isFile = S_ISREG(info.st_mode);
+        }
+        if (isDir && item->d_type != DT_LNK) {
+            walk(path, catalog, capacity);
+        } else if (isFile && hasBmpExtension(item->d_name)) {
+            status = appendPath(catalog, capacity, path);
+        }
+    }
+    closedir(handle);
+    return status;
+}
+
+/**
+ * Scan task: stats its files and reads the headers of the new or changed ones.
+ */
+static void scanFiles(int begin, int end, void * ctx) {
+    t_scanState * state = (t_scanState *)ctx;
+    for (int i = begin; i < end; i++) {
+        t_catalogEntry * entry = &state->entries[i];
+        struct stat info;
+        if (stat(entry->path, &info) != 0) {
+            entry->valid = -1;    // Removed since the walk
+            continue;
+        }
+        entry->size = (uint64_t)info.st_size;
+        entry->mtimeNs = (int64_t)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+
+        const t_catalogEntry * known = state->previous ? catalog_find(state->previous, entry->path) : NULL;
+        if (known && known->size == entry->size && known->mtimeNs == entry->mtimeNs) {
+            char * path = entry->path;
+            *entry = *known;
+            entry->path = path;
+            atomic_fetch_add(&state->reused, 1);
+            continue;
+        }
+
+        t_bmpFields fields;
+        entry->valid = bmpio_probe(entry->path, &fields) == 0;
+        entry->width = entry->valid ? fields.width : 0;
+        entry->height = entry->valid ? fields.height : 0;
+        entry->depth = entry->valid ? fields.bits : 0;
+        entry->compression = entry->valid ? fields.compression : 0;
+    }
+}
+
+/**
+ * Scans a directory tree for .bmp files and updates its index.
+ * Entries of the previous index whose file kept its size and modification time are reused;
+ * the other files get their headers read. Removed files disappear from the index.
+ * @param dir The directory to scan.
+ * @param indexPath The path of the index, or NULL for <dir>/.catalog.
+ * @return Pointer to the catalog, or NULL on failure.
+ */
+t_catalog * catalog_scan(const char * dir, const char * indexPath) {
+    char defaultPath[4096];
+    if (!indexPath) {
+        snprintf(defaultPath, sizeof(defaultPath), "%s/%s", dir, CATALOG_DEFAULT_INDEX);
+        indexPath = defaultPath;
+    }
+
+    t_catalog * catalog = (t_catalog *)calloc(1, sizeof(t_catalog));
+    if (!catalog) return NULL;
+    int capacity = 0;
+    if (walk(dir, catalog, &capacity) != 0) {
+        printf("Error: Cannot scan directory %s\n", dir);
+        catalog_free(catalog);
+        return NULL;
+    }
+
+    t_scanState state;
+    state.entries = catalog->entries;
+    state.previous = catalog_load(indexPath);
+    atomic_init(&state.reused, 0);
+    parallel_for(0, catalog->count, CATALOG_SCAN_GRAIN, scanFiles, &state);
+    catalog_free((t_catalog *)state.previous);
+
+    // Drop the files that disappeared during the scan, then sort for lookups
+    int kept = 0;
+    for (int i = 0; i < catalog->count; i++) {
+        if (catalog->entries[i].valid < 0) {
+            free(catalog->entries[i].path);
+            continue;
+        }
+        catalog->entries[kept++] = catalog->entries[i];
+    }
+    catalog->count = kept;
+    qsort(catalog->entries, catalog->count, sizeof(t_catalogEntry), compareEntries);
+    catalog->reused = atomic_load(&state.reused);
+    catalog->rescanned = catalog->count - catalog->reused;
+
+    if (catalog_save(catalog, indexPath) != 0) {
+        printf("Error: Cannot write catalog index %s\n", indexPath);
+    }
+    return catalog;
+}
+
+/**
+ * Loads a catalog index.
+ * @param indexPath The path of the index.
+ * @return Pointer to the catalog, or NULL if the index is missing or invalid.
+ */
+t_catalog * catalog_load(const char * indexPath) {
+    FILE * file = fopen(indexPath, "rb");
+    if (!file) return NULL;
+
+    t_indexHeader header;
+    t_indexRecord * records = NULL;
+    char * paths = NULL;
+    t_catalog * catalog = NULL;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != CATALOG_MAGIC ||
+        header.version != CATALOG_VERSION) {
+        fclose(file);
+        return NULL;
+    }
+
+    records = (t_indexRecord *)malloc((size_t)header.count * sizeof(t_indexRecord) + 1);
+    paths = (char *)malloc((size_t)header.pathBytes + 1);
+    catalog = (t_catalog *)calloc(1, sizeof(t_catalog));
+    if (records && paths && catalog &&
+        fread(records, sizeof(t_indexRecord), header.count, file) == header.count &&
+        fread(paths, 1, header.pathBytes, file) == header.pathBytes) {
+        paths[header.pathBytes] = '\0';
+        catalog->entries = (t_catalogEntry *)calloc(header.count + 1, sizeof(t_catalogEntry));
+        for (uint32_t i = 0; catalog->entries && i < header.count; i++) {
+            if (records[i].pathOffset >= header.pathBytes) break;
+            t_catalogEntry * entry = &catalog->entries[catalog->count];
+            entry->path = strdup(paths + records[i].pathOffset);
+            if (!entry->path) break;
+            entry->size = records[i].size;
+            entry->mtimeNs = records[i].mtimeNs;
+            entry->width = records[i].width;
+            entry->height = records[i].height;
+            entry->depth = records[i].depth;
+            entry->compression = records[i].compression;
+            entry->valid = records[i].valid;
+            catalog->count++;
+        }
+    }
+    fclose(file);
+    free(records);
+    free(paths);
+
+    if (catalog && catalog->count != (int)header.count) {
+        catalog_free(catalog);
+        return NULL;
+    }
+    return catalog;
+}
+
+/**
+ * Writes a catalog index to a temporary file, then renames it over the index.
+ * @param catalog Pointer to the catalog (sorted by path).
+ * @param indexPath The path of the index.
+ * @return 0 on success, -1 on failure.
+ */
+int catalog_save(const t_catalog * catalog, const char * indexPath) {
+    if (!catalog || !indexPath) return -1;
+
+    t_indexHeader header;
+    header.magic = CATALOG_MAGIC;
+    header.version = CATALOG_VERSION;
+    header.count = (uint32_t)catalog->count;
+    header.pathBytes = 0;
+    for (int i = 0; i < catalog->count; i++) header.pathBytes += strlen(catalog->entries[i].path) + 1;
+
+    t_indexRecord * records = (t_indexRecord *)calloc(catalog->count + 1, sizeof(t_indexRecord));
+    char * paths = (char *)malloc(header.pathBytes + 1);
+    if (!records || !paths) {
+        free(records);
+        free(paths);
+        return -1;
+    }
+    uint32_t offset = 0;
+    for (int i = 0; i < catalog->count; i++) {
+        const t_catalogEntry * entry = &catalog->entries[i];
+        size_t length = strlen(entry->path) + 1;
+        memcpy(paths + offset, entry->path, length);
+        records[i].size = entry->size;
+        records[i].mtimeNs = entry->mtimeNs;
+        records[i].pathOffset = offset;
+        records[i].width = entry->width;
+        records[i].height = entry->height;
+        records[i].compression = entry->compression;
+        records[i].depth = entry->depth;
+        records[i].valid = (uint16_t)entry->valid;
+        offset += length;
+    }
+
+    char tmpPath[4200];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", indexPath);
+    FILE * file = fopen(tmpPath, "wb");
+    int status = file ? 0 : -1;
+    if (file) {
+        if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+            fwrite(records, sizeof(t_indexRecord), catalog->count, file) != (size_t)catalog->count ||
+            fwrite(paths, 1, header.pathBytes, file) != header.pathBytes) {
+            status = -1;
+        }
+        if (fclose(file) != 0) status = -1;
+        if (status == 0 && rename(tmpPath, indexPath) != 0) status = -1;
+        if (status != 0) unlink(tmpPath);
+    }
+    free(records);
+    free(paths);
+    return status;
+}
+
+/**
+ * Returns the entry of a path (binary search).
+ * @param catalog Pointer to the catalog (sorted by path).
+ * @param path The path, as stored by the scan.
+ * @return Pointer to the entry, or NULL if the path is not in the catalog.
+ */
+const t_catalogEntry * catalog_find(const t_catalog * catalog, const char * path) {
+    if (!catalog || catalog->count == 0) return NULL;
+    t_catalogEntry key;
+    key.path = (char *)path;
+    return (const t_catalogEntry *)bsearch(&key, catalog->entries, catalog->count, sizeof(t_catalogEntry),
+                                           compareEntries);
+}
+
+/**
+ * Frees a catalog and its paths.
+ * @param catalog Pointer to the catalog.
+ */
+void catalog_free(t_catalog * catalog) {
+    if (!catalog) return;
+    for (int i = 0; i < catalog->count; i++) free(catalog->entries[i].path);
+    free(catalog->entries);
+    free(catalog);
+}
@@ -0,0 +1,65 @@
+/*
+ * catalog.h
+ * Author: Simon Hillel
+ * Description: Header for the image catalog.
+ * A catalog lists the BMP files under a directory with their size, modification time and
+ * header fields (dimensions, depth, compression), read without loading any pixel data. It is
+ * stored as a binary index and reused by the next scan, which only reads the headers of the
+ * files whose size or modification time changed.
+ */
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stdint.h>
+
+// Index file format
+#define CATALOG_MAGIC 0x54414342u  // "BCAT"
+#define CATALOG_VERSION 1
+// Name of the index written in the scanned directory when no path is given
+#define CATALOG_DEFAULT_INDEX ".catalog"
+// Files handled by one task of the parallel scan
+#define CATALOG_SCAN_GRAIN 16
+
+// One file of the catalog
+typedef struct {
+    char * path;              // Path as found by the scan (<dir>/...)
+    uint64_t size;            // File size in bytes
+    int64_t mtimeNs;          // Modification time in nanoseconds since the epoch
+    int32_t width;
+    int32_t height;           // Negative for top-down row order
+    uint16_t depth;           // Bits per pixel
+    uint32_t compression;
+    int valid;                // 1 if the headers could be read and parsed
+} t_catalogEntry;
+
+// A catalog, sorted by path
+typedef struct {
+    t_catalogEntry * entries;
+    int count;
+    int rescanned;            // Headers read by the last scan
+    int reused;               // Entries taken unchanged from the previous index
+} t_catalog;
+
+/**
+ * Scans a directory tree for .bmp files, reusing the unchanged entries of the index at
+ * indexPath (NULL: <dir>/.catalog), and writes the updated index. Returns NULL on failure.
+ */
+t_catalog * catalog_scan(const char * dir, const char * indexPath);
+/**
+ * Loads a catalog index. Returns NULL if it is missing or not a valid index.
+ */
+t_catalog * catalog_load(const char * indexPath);
+/**
+ * Writes a catalog index (temporary file, then rename). Returns 0 on success, -1 on failure.
+ */
+int catalog_save(const t_catalog * catalog, const char * indexPath);
+/**
+ * Returns the entry of a path, or NULL.
+ */
+const t_catalogEntry * catalog_find(const t_catalog * catalog, const char * path);
+/**
+ * Frees a catalog.
+ */
+void catalog_free(t_catalog * catalog);
+
+#endif // CATALOG_H
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+ * client.c
+ * Author: Simon Hillel
+ * Description: Command-line client for the daemon mode (image_processing daemon <socket>).
+ * Sends one request given as arguments, or one request per line of standard input, over a
+ * single connection, and prints each reply with the round-trip time seen by the client.
+ * Exits with 0 if every reply is "ok", 1 otherwise.
+ */
+
+/**
+ * Prints the command-line usage.
+ * @param program The program name (argv[0]).
+ */
+static void printUsage(const char * program) {
+    printf("Usage:\n");
+    printf("  %s <socket> <input> <output> [<op>,<op>,...]   Send one request\n", program);
+    printf("  %s <socket> ping|stats|shutdown                  Send a control request\n", program);
+    printf("  %s <socket>                                      Send one request per line of stdin\n", program);
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Sends a request line and prints the reply.
+ * @return 0 if the reply is "ok", 1 otherwise.
+ */
+static int sendRequest(int fd, FILE * replies, const char * request) {
+    double start = now();
+    size_t length = strlen(request);
+    if (send(fd, request, length, MSG_NOSIGNAL) != (ssize_t)length || send(fd, "\n", 1, MSG_NOSIGNAL) != 1) {
+        printf("Error: Connection lost\n");
+        return 1;
+    }
+
+    char line[4096];
+    if (!fgets(line, sizeof(line), replies)) {
+        printf("Error: No reply from the daemon\n");
+        return 1;
+    }
+    line[strcspn(line, "\r\n")] = '\0';
+    printf("%s (round trip %.3f ms)\n", line, (now() - start) * 1000.0);
+    return strncmp(line, "ok", 2) == 0 ? 0 : 1;
+}
+
+int main(int argc, char * argv[]) {
+    if (argc < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(argv[1]) >= sizeof(address.sun_path)) {
+        printf("Error: Socket path too long: %s\n", argv[1]);
+        return 1;
+    }
+    strcpy(address.sun_path, argv[1]);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        printf("Error: Cannot connect to %s\n", argv[1]);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    FILE * replies = fdopen(dup(fd), "r");
+    if (!replies) {
+        close(fd);
+        return 1;
+    }
+
+    int failed = 0;
+    if (argc > 2) {
+        // Join the arguments into one request line
+        char request[4096] = "";
+        for (int i = 2; i < argc; i++) {
+            if (strlen(request) + strlen(argv[i]) + 2 > sizeof(request)) {
+                printf("Error: Request too long\n");
+                fclose(replies);
+                close(fd);
+                return 1;
+            }
+            if (i > 2) strcat(request, " ");
+            strcat(request, argv[i]);
+        }
+        failed = sendRequest(fd, replies, request);
+    } else {
+        char line[4096];
+        while (fgets(line, sizeof(line), stdin)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] == '\0') continue;
+            failed |= sendRequest(fd, replies, line);
+        }
+    }
+
+    fclose(replies);
+    close(fd);
+    return failed;
+}
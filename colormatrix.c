@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "colormatrix.h"
+#include "parallel.h"
+#include "dispatch.h"
+
+/*
+ * colormatrix.c
+ * Author: Simon Hillel
+ * Description: Implementation of the 3x4 colour-matrix engine.
+ * Every per-pixel colour transform of the project is an affine map of (R, G, B), so one
+ * fixed-point kernel serves them all. Chains of transforms are multiplied together first
+ * and cost a single pass over the image.
+ */
+
+// Matrix converted to fixed point
+typedef struct {
+    int32_t coef[3][3];  // Q12 coefficients [output channel][input channel]
+    int32_t offset[3];   // Q12 offsets including the rounding term
+} t_fixedMatrix;
+
+// --- Presets --- //
+
+/**
+ * Returns the identity transform.
+ * @return The colour matrix.
+ */
+t_colorMatrix colorMatrix_identity(void) {
+    t_colorMatrix matrix;
+    memset(&matrix, 0, sizeof(matrix));
+    for (int i = 0; i < 3; i++) {
+        matrix.m[i][i] = 1.0f;
+    }
+    return matrix;
+}
+
+/**
+ * Returns the grayscale transform: every channel becomes the average of the three.
+ * @return The colour matrix.
+ */
+t_colorMatrix colorMatrix_grayscale(void) {
+    t_colorMatrix matrix;
+    memset(&matrix, 0, sizeof(matrix));
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            matrix.m[i][j] = 1.0f / 3.0f;
+        }
+    }
+    return matrix;
+}
+
+/**
+ * Returns the negative transform.
+ * @return The colour matrix.
+ */
+t_colorMatrix colorMatrix_negative(void) {
+    t_colorMatrix matrix;
+    memset(&matrix, 0, sizeof(matrix));
+    for (int i = 0; i < 3; i++) {
+        matrix.m[i][i] = -1.0f;
+        matrix.m[i][3] = 255.0f;
+    }
+    return matrix;
+}
+
+/**
+ * Returns the brightness transform.
+ * @param value The value added to every channel (-255 to 255).
+ * @return The colour matrix.
+ */
+t_colorMatrix colorMatrix_brightness(int value) {
+    t_colorMatrix matrix = colorMatrix_identity();
+    for (int i = 0; i < 3; i++) {
+        matrix.m[i][3] = (float)value;
+    }
+    return matrix;
+}
+
+/**
+ * Returns the classic sepia tone transform.
+ * @return The colour matrix.
+ */
+t_colorMatrix colorMatrix_sepia(void) {
+    t_colorMatrix matrix = {{
+        {0.393f, 0.769f, 0.189f, 0.0f},
+        {0.349f, 0.686f, 0.168f, 0.0f},
+        {0.272f, 0.534f, 0.131f, 0.0f}
+    }};
+    return matrix;
+}
+
+/**
+ * Returns a channel permutation.
+ * @param redSource Input channel copied to red (0 = red, 1 = green, 2 = blue).
+ * @param greenSource Input channel copied to green.
+ * @param blueSource Input channel copied to blue.
+ * @return The colour matrix (identity if a source is out of range).
+ */
+t_colorMatrix colorMatrix_channelSwap(int redSource, int greenSource, int blueSource) {
+    int source[3] = {redSource, greenSource, blueSource};
+    t_colorMatrix matrix;
+    memset(&matrix, 0, sizeof(matrix));
+    for (int i = 0; i < 3; i++) {
+        if (source[i] < 0 || source[i] > 2) return colorMatrix_identity();
+        matrix.m[i][source[i]] = 1.0f;
+    }
+    return matrix;
+}
+
+/**
+ * Returns a saturation transform: interpolates between the BT.601 luma and the input colour.
+ * @param saturation 0 for grayscale, 1 for unchanged, above 1 for more vivid colours.
+ * @return The colour matrix.
+ */
+t_colorMatrix colorMatrix_saturation(float saturation) {
+    const float luma[3] = {0.299f, 0.587f, 0.114f};
+    t_colorMatrix matrix;
+    memset(&matrix, 0, sizeof(matrix));
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            matrix.m[i][j] = (1.0f - saturation) * luma[j] + (i == j ? saturation : 0.0f);
+        }
+    }
+    return matrix;
+}
+
+/**
+ * Returns a white-balance transform.
+ * @param redGain Gain applied to the red channel.
+ * @param greenGain Gain applied to the green channel.
+ * @param blueGain Gain applied to the blue channel.
+ * @return The colour matrix.
+ */
+t_colorMatrix colorMatrix_whiteBalance(float redGain, float greenGain, float blueGain) {
+    t_colorMatrix matrix;
+    memset(&matrix, 0, sizeof(matrix));
+    matrix.m[0][0] = redGain;
+    matrix.m[1][1] = greenGain;
+    matrix.m[2][2] = blueGain;
+    return matrix;
+}
+
+// --- Composition --- //
+
+/**
+ * Returns the transform equivalent to applying first, then second.
+ * Note: applying the matrices one by one clamps to 0-255 after each step, the composed
+ * matrix only clamps at the end. Results differ only where an intermediate value leaves
+ * that range (e.g. brightness +100 followed by brightness -100 on a bright pixel).
+ * @param first The transform applied first.
+ * @param second The transform applied second.
+ * @return The composed colour matrix.
+ */
+t_colorMatrix colorMatrix_multiply(const t_colorMatrix * first, const t_colorMatrix * second) {
+    t_colorMatrix result;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            float sum = (j == 3) ? second->m[i][3] : 0.0f;
+            for (int k = 0; k < 3; k++) {
+                sum += second->m[i][k] * first->m[k][j];
+            }
+            result.m[i][j] = sum;
+        }
+    }
+    return result;
+}
+
+// --- Application --- //
+
+/**
+ * Converts a colour matrix to Q12 fixed point. Coefficients beyond 16 bits are kept as they
+ * are: the SIMD row kernels send such matrices to the 32-bit scalar kernel.
+ * @param matrix The colour matrix.
+ * @param fixed Receives the fixed-point matrix.
+ * @return 0 on success, -1 if a value exceeds COLORMATRIX_MAX_COEF or COLORMATRIX_MAX_OFFSET
+ *         (or is not a number), where the 32-bit channel sums could overflow.
+ */
+static int toFixed(const t_colorMatrix * matrix, t_fixedMatrix * fixed) {
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            float c = matrix->m[i][j];
+            if (!(fabsf(c) <= COLORMATRIX_MAX_COEF)) return -1;
+            fixed->coef[i][j] = (int32_t)lroundf(c * (1 << COLORMATRIX_SHIFT));
+        }
+        float offset = matrix->m[i][3];
+        if (!(fabsf(offset) <= COLORMATRIX_MAX_OFFSET)) return -1;
+        fixed->offset[i] = (int32_t)lroundf(offset * (1 << COLORMATRIX_SHIFT)) + (1 << (COLORMATRIX_SHIFT - 1));
+    }
+    return 0;
+}
+
+// Shared state of a colour-matrix pass
+typedef struct {
+    t_bmp24 * img;
+    t_fixedMatrix fixed;
+} t_matrixState;
+
+/**
+ * Applies the matrix to a band of rows with the dispatched row kernel (SIMD variants use
+ * 16-bit multiply-adds when the coefficients fit and fall back to 32-bit scalar otherwise).
+ */
+static void applyRows(int begin, int end, void * ctx) {
+    t_matrixState * s = (t_matrixState *)ctx;
+    const t_dispatchTable * kernels = dispatch_get();
+    int width = s->img->width;
+    int paddedWidth = (width + DISPATCH_ROW_ALIGN - 1) & ~(DISPATCH_ROW_ALIGN - 1);
+
+    int16_t * scratch = (int16_t *)malloc((size_t)paddedWidth * (4 * sizeof(int16_t) + 3));
+    if (!scratch) {
+        printf("Error: Failed to allocate row buffer for colour matrix\n");
+        return;
+    }
+    for (int y = begin; y < end; y++) {
+        kernels->colorMatrixRow((uint8_t *)s->img->data[y], width, s->fixed.coef, s->fixed.offset,
+                                COLORMATRIX_SHIFT, scratch, paddedWidth);
+    }
+    free(scratch);
+}
+
+/**
+ * Applies a colour matrix to every pixel of a 24-bit image in one pass.
+ * Results are rounded to nearest and clamped to 0-255.
+ * @param img Pointer to the t_bmp24 structure.
+ * @param matrix The colour matrix.
+ * @return 0 on success, -1 if the matrix is out of range (the image is left unchanged).
+ */
+int colorMatrix_apply(t_bmp24 * img, const t_colorMatrix * matrix) {
+    if (!img || !img->data || !matrix) return -1;
+
+    t_matrixState state;
+    state.img = img;
+    if (toFixed(matrix, &state.fixed) != 0) {
+        printf("Error: Colour matrix values must stay within +/-%.0f (offsets +/-%.0f)\n",
+               COLORMATRIX_MAX_COEF, COLORMATRIX_MAX_OFFSET);
+        return -1;
+    }
+    parallel_for(0, img->height, 16, applyRows, &state);
+    return 0;
+}
+
+/**
+ * Composes a chain of colour matrices into one and applies it in a single pass.
+ * See colorMatrix_multiply for how this differs from clamping after every step.
+ * @param img Pointer to the t_bmp24 structure.
+ * @param chain The matrices, in the order they should be applied.
+ * @param count The number of matrices.
+ * @return 0 on success, -1 if the composed matrix is out of range (the image is left unchanged).
+ */
+int colorMatrix_applyChain(t_bmp24 * img, const t_colorMatrix * chain, int count) {
+    if (!chain || count <= 0) return -1;
+
+    t_colorMatrix composed = chain[0];
+    for (int i = 1; i < count; i++) {
+        composed = colorMatrix_multiply(&composed, &chain[i]);
+    }
+    return colorMatrix_apply(img, &composed);
+}
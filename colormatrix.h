@@ -0,0 +1,78 @@
+/*
+ * colormatrix.h
+ * Author: Simon Hillel
+ * Description: Header for the 3x4 colour-matrix engine.
+ * Declares affine colour transforms (grayscale, negative, brightness, sepia, channel mixing,
+ * saturation, white balance), their composition, and their application to 24-bit images.
+ */
+#ifndef COLORMATRIX_H
+#define COLORMATRIX_H
+
+#include "bmp24.h"
+
+// Fixed-point precision used when applying a matrix (Q12: 4096 = 1.0)
+#define COLORMATRIX_SHIFT 12
+// Largest coefficient and offset magnitudes that can be applied: a Q12 channel sum
+// (3 * 512 * 255 + 65535) * 4096 stays within 32 bits
+#define COLORMATRIX_MAX_COEF 512.0f
+#define COLORMATRIX_MAX_OFFSET 65535.0f
+// Largest white-balance gain accepted from jobs and the menu, in percent
+#define COLORMATRIX_MAX_GAIN 1000
+
+// Affine colour transform:
+//   out[row] = m[row][0] * red + m[row][1] * green + m[row][2] * blue + m[row][3]
+// Rows and columns 0, 1, 2 are red, green, blue; column 3 is an offset in 0-255 units.
+typedef struct {
+    float m[3][4];
+} t_colorMatrix;
+
+// Presets
+/**
+ * Returns the identity transform.
+ */
+t_colorMatrix colorMatrix_identity(void);
+/**
+ * Returns the grayscale transform (average of the three channels).
+ */
+t_colorMatrix colorMatrix_grayscale(void);
+/**
+ * Returns the negative transform (255 - value on every channel).
+ */
+t_colorMatrix colorMatrix_negative(void);
+/**
+ * Returns the brightness transform (value added to every channel).
+ */
+t_colorMatrix colorMatrix_brightness(int value);
+/**
+ * Returns the classic sepia tone transform.
+ */
+t_colorMatrix colorMatrix_sepia(void);
+/**
+ * Returns a channel permutation: output channel i takes input channel source[i] (0=R, 1=G, 2=B).
+ */
+t_colorMatrix colorMatrix_channelSwap(int redSource, int greenSource, int blueSource);
+/**
+ * Returns a saturation transform around BT.601 luma (0 = gray, 1 = unchanged).
+ */
+t_colorMatrix colorMatrix_saturation(float saturation);
+/**
+ * Returns a white-balance transform (per-channel gains).
+ */
+t_colorMatrix colorMatrix_whiteBalance(float redGain, float greenGain, float blueGain);
+
+// Composition and application
+/**
+ * Returns the transform equivalent to applying first, then second (without intermediate clamping).
+ */
+t_colorMatrix colorMatrix_multiply(const t_colorMatrix * first, const t_colorMatrix * second);
+/**
+ * Applies a colour matrix to every pixel of a 24-bit image in one fixed-point pass.
+ * Returns 0, or -1 (image unchanged) if a coefficient or offset exceeds the limits above.
+ */
+int colorMatrix_apply(t_bmp24 * img, const t_colorMatrix * matrix);
+/**
+ * Composes a chain of colour matrices into one and applies it in a single pass. Returns 0, or -1.
+ */
+int colorMatrix_applyChain(t_bmp24 * img, const t_colorMatrix * chain, int count);
+
+#endif // COLORMATRIX_H
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "daemon.h"
+#include "parallel.h"
+#include "dispatch.h"
+#include "pool.h"
+#include "job.h"
+#include "bmpio.h"
+
+/*
+ * daemon.c
+ * Author: Simon Hillel
+ * Description: Implementation of the daemon mode.
+ * DAEMON_CONNECTION_THREADS threads block in accept() on the same listening socket and serve
+ * one connection each, request by request. The filters themselves run on the process-wide
+ * worker pool, which is started before the first request, as is the CPU dispatch table; the
+ * loaders' file-sized buffers come from the buffer pool, so a steady stream of similar
+ * requests reuses memory that is already mapped.
+ * Each request is timed from the moment its line is read until the output is written; the
+ * latency is returned to the client and logged with the load / filter / save split.
+ * A shutdown request closes the listening socket, which wakes the threads blocked in accept,
+ * and shuts down the reading side of every open connection, which wakes the threads blocked
+ * reading an idle client; a request that is running still finishes and gets its reply.
+ * Shared-memory inputs are mapped for the duration of one request and filtered in place (or in
+ * the output segment), so a producer holding decoded frames pays no file or pixel copy.
+ */
+
+// Daemon-wide state
+typedef struct {
+    int listenFd;
+    pthread_mutex_t lock;         // Guards stopping transitions and connectionFds
+    int connectionFds[DAEMON_CONNECTION_THREADS];   // Connection served by each thread, or -1
+    atomic_int stopping;
+    atomic_ulong requests;
+    atomic_ulong failures;
+    atomic_ulong totalMicros;
+} t_daemon;
+
+// Argument of a connection thread
+typedef struct {
+    t_daemon * daemon;
+    int slot;                     // Index in connectionFds
+} t_connectionThread;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Sends a formatted reply line. Errors (client gone) are ignored.
+ */
+static void reply(int fd, const char * format, ...) {
+    char line[DAEMON_LINE_MAX];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if (length < 0) return;
+    if (length > (int)sizeof(line) - 2) length = sizeof(line) - 2;
+    line[length++] = '\n';
+    send(fd, line, length, MSG_NOSIGNAL);
+}
+
+/**
+ * Runs one filter request and replies to the client.
+ * @return 0 on success, -1 on failure.
+ */
+static int runRequest(int fd, char * line, double start) {
+    char * input, * output, * chain;
+    if (job_split(line, &input, &output, &chain) != 0) {
+        reply(fd, "error expected: <input> <output> [<op>,<op>,...]");
+        return -1;
+    }
+
+    t_jobResult result;
+    char error[256];
+    if (job_run(input, output, chain, &result, error, sizeof(error)) != 0) {
+        reply(fd, "error %s", error);
+        return -1;
+    }
+    double saved = now();
+    printf("[daemon] %s -> %s: %d op(s), load %.1f ms, filters %.1f ms, save %.1f ms, total %.1f ms\n",
+           input, output, result.numOps, result.load * 1000.0, result.filters * 1000.0,
+           result.save * 1000.0, (saved - start) * 1000.0);
+    fflush(stdout);
+    reply(fd, "ok %.3f ms", (saved - start) * 1000.0);
+    return 0;
+}
+
+/**
+ * Stops the daemon: no more connections are accepted and the open ones stop reading.
+ */
+static void stopDaemon(t_daemon * daemon) {
+    pthread_mutex_lock(&daemon->lock);
+    atomic_store(&daemon->stopping, 1);
+    shutdown(daemon->listenFd, SHUT_RDWR);
+    for (int i = 0; i < DAEMON_CONNECTION_THREADS; i++) {
+        if (daemon->connectionFds[i] >= 0) shutdown(daemon->connectionFds[i], SHUT_RD);
+    }
+    pthread_mutex_unlock(&daemon->lock);
+}
+
+/**
+ * Records the connection served by a thread (-1 when it is done), so that a shutdown can wake it.
+ * @return 0, or -1 if the daemon is already stopping.
+ */
+static int setConnection(t_daemon * daemon, int slot, int fd) {
+    pthread_mutex_lock(&daemon->lock);
+    int stopping = atomic_load(&daemon->stopping);
+    daemon->connectionFds[slot] = fd >= 0 && stopping ? -1 : fd;
+    pthread_mutex_unlock(&daemon->lock);
+    return fd >= 0 && stopping ? -1 : 0;
+}
+
+/**
+ * Serves the requests of one connection until the client closes it or the daemon stops.
+ * The caller closes fd.
+ */
+static void serveConnection(t_daemon * daemon, int fd) {
+    FILE * in = fdopen(dup(fd), "r");
+    if (!in) return;
+
+    char line[DAEMON_LINE_MAX];
+    while (fgets(line, sizeof(line), in)) {
+        double start = now();
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
+
+        if (strcmp(line, "ping") == 0) {
+            reply(fd, "ok pong");
+        } else if (strcmp(line, "stats") == 0) {
+            size_t retained;
+            unsigned long hits, misses;
+            pool_stats(&retained, &hits, &misses);
+            t_ioStats io;
+            bmpio_stats(&io);
+            unsigned long requests = atomic_load(&daemon->requests);
+            reply(fd, "ok requests=%lu failed=%lu mean_ms=%.3f threads=%d cpu=%s pool_hits=%lu pool_misses=%lu pool_kept_mb=%.1f "
+                  "io=%s read_mb_s=%.0f write_mb_s=%.0f",
+                  requests, atomic_load(&daemon->failures),
+                  requests ? atomic_load(&daemon->totalMicros) / 1000.0 / requests : 0.0,
+                  parallel_numThreads(), dispatch_levelName(dispatch_get()->level),
+                  hits, misses, retained / (1024.0 * 1024.0), bmpio_modeName(bmpio_mode()),
+                  io.readSeconds > 0 ? io.readBytes / 1e6 / io.readSeconds : 0.0,
+                  io.writeSeconds > 0 ? io.writtenBytes / 1e6 / io.writeSeconds : 0.0);
+        } else if (strcmp(line, "shutdown") == 0) {
+            reply(fd, "ok shutting down");
+            stopDaemon(daemon);
+            break;
+        } else {
+            int status = runRequest(fd, line, start);
+            atomic_fetch_add(&daemon->requests, 1);
+            atomic_fetch_add(&daemon->totalMicros, (unsigned long)((now() - start) * 1e6));
+            if (status != 0) atomic_fetch_add(&daemon->failures, 1);
+        }
+    }
+    fclose(in);
+}
+
+static void * connectionThread(void * arg) {
+    t_connectionThread * thread = (t_connectionThread *)arg;
+    t_daemon * daemon = thread->daemon;
+    while (!atomic_load(&daemon->stopping)) {
+        int fd = accept(daemon->listenFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        if (setConnection(daemon, thread->slot, fd) != 0) {
+            close(fd);
+            break;
+        }
+        serveConnection(daemon, fd);
+        setConnection(daemon, thread->slot, -1);
+        close(fd);
+    }
+    return NULL;
+}
+
+/**
+ * Serves requests on a Unix domain socket until a client sends "shutdown".
+ * An existing socket file at the path is replaced.
+ * @param socketPath The path of the socket.
+ * @return 0 after a shutdown request, 1 if the socket cannot be set up.
+ */
+int daemon_run(const char * socketPath) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        printf("Error: Socket path too long: %s\n", socketPath);
+        return 1;
+    }
+    strcpy(address.sun_path, socketPath);
+
+    t_daemon daemon;
+    daemon.listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (daemon.listenFd < 0) {
+        printf("Error: Cannot create socket\n");
+        return 1;
+    }
+    unlink(socketPath);
+    if (bind(daemon.listenFd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(daemon.listenFd, 64) != 0) {
+        printf("Error: Cannot listen on %s (%s)\n", socketPath, strerror(errno));
+        close(daemon.listenFd);
+        return 1;
+    }
+    pthread_mutex_init(&daemon.lock, NULL);
+    for (int i = 0; i < DAEMON_CONNECTION_THREADS; i++) daemon.connectionFds[i] = -1;
+    atomic_init(&daemon.stopping, 0);
+    atomic_init(&daemon.requests, 0);
+    atomic_init(&daemon.failures, 0);
+    atomic_init(&daemon.totalMicros, 0);
+
+    // Warm up before the first request: worker pool, CPU dispatch, buffer pool
+    pool_configure(DAEMON_POOL_BYTES);
+    int threads = parallel_numThreads();
+    printf("[daemon] Listening on %s (%d worker thread(s), %s kernels)\n",
+           socketPath, threads, dispatch_levelName(dispatch_get()->level));
+    fflush(stdout);
+
+    pthread_t connectionThreads[DAEMON_CONNECTION_THREADS];
+    t_connectionThread threadArgs[DAEMON_CONNECTION_THREADS];
+    int started = 0;
+    for (int i = 0; i < DAEMON_CONNECTION_THREADS; i++) {
+        threadArgs[started].daemon = &daemon;
+        threadArgs[started].slot = started;
+        if (pthread_create(&connectionThreads[started], NULL, connectionThread, &threadArgs[started]) == 0) started++;
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(connectionThreads[i], NULL);
+    }
+
+    close(daemon.listenFd);
+    pthread_mutex_destroy(&daemon.lock);
+    unlink(socketPath);
+    pool_configure(0);
+    printf("[daemon] Stopped after %lu request(s)\n", atomic_load(&daemon.requests));
+    return started ? 0 : 1;
+}
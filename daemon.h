@@ -0,0 +1,41 @@
+/*
+ * daemon.h
+ * Author: Simon Hillel
+ * Description: Header for the daemon mode.
+ * The daemon listens on a Unix domain socket and runs filter chains for clients, keeping the
+ * worker pool, the CPU dispatch table and the loader buffers warm between requests.
+ *
+ * Protocol: one request per line, one reply line per request.
+ *   <input> <output> [<op>,<op>,...]   Load input, apply the ops in order, save to output
+ *   ping                               Check that the daemon is alive
+ *   stats                              Request count, mean latency and buffer pool usage
+ *   shutdown                           Stop accepting connections, end the idle ones and exit once
+ *                                      the running requests have replied
+ * Ops: negative, brightness=<v>, bw[=<threshold>] (grayscale on colour images, threshold on
+ * 8-bit images, default 128), boxblur, gaussian, sharpen, outline, emboss, equalize,
+ * autolevels; colour images also take autowb, sepia, swap[=<order>], saturation=<percent>, wb=<red>:<green>:<blue>,
+ * unsharp[=<amount %>:<radius>:<threshold>].
+ * Inputs and outputs may be shared-memory segments (see shmimage.h), written shm:<handle>:
+ *   shm:/name - <ops>                  Filter the segment in place
+ *   shm:/in shm:/out <ops>             Copy into the output segment (same format and size), filter there
+ *   shm:/in out.bmp <ops>              Filter a copy and save it; the segment is left untouched
+ *   in.bmp shm:/out <ops>              Load the file into the output segment, filter there
+ * A memfd is passed as /proc/<pid>/fd/<n> while its owner keeps it open.
+ * Replies: "ok <latency ms> ms ..." or "error <message>". Paths may not contain spaces.
+ */
+#ifndef DAEMON_H
+#define DAEMON_H
+
+// Threads accepting and serving connections (requests run on the shared worker pool)
+#define DAEMON_CONNECTION_THREADS 4
+// Longest request line
+#define DAEMON_LINE_MAX 4096
+// Loader buffers kept between requests
+#define DAEMON_POOL_BYTES ((size_t)1 << 30)
+
+/**
+ * Serves requests on a Unix domain socket until a shutdown request. Returns 0, or 1 on failure.
+ */
+int daemon_run(const char * socketPath);
+
+#endif // DAEMON_H
@@ -0,0 +1,621 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "dispatch.h"
+
+/*
+ * dispatch.c
+ * Author: Simon Hillel
+ * Description: Implementation of runtime CPU-feature dispatch.
+ * Every kernel has a portable scalar version; x86 variants are compiled with per-function
+ * target attributes, so the rest of the program needs no special compiler flags and the binary
+ * still starts on CPUs without the extensions. The table is filled once, from the level found
+ * by CPUID or forced with IMAGE_CPU_LEVEL (scalar, sse2, sse4.2, avx2, avx512; a level above
+ * what the CPU supports is refused). Levels without a faster variant of a kernel keep the
+ * variant of the level below.
+ *
+ * All variants of a kernel give bit-identical results: convolutions accumulate in the same
+ * order without fused multiply-add and round half away from zero like clamp_uint8; the
+ * unsharp mask clamps, adds 0.5 and truncates in every variant.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DISPATCH_X86 1
+#include <immintrin.h>
+#endif
+
+static t_dispatchTable table;
+static pthread_once_t tableOnce = PTHREAD_ONCE_INIT;
+
+// --- Scalar Kernels --- //
+
+/**
+ * Clamps to 0-255 and rounds half away from zero (as clamp_uint8).
+ */
+static inline uint8_t roundClamp(float v) {
+    if (v > 255.0f) return 255;
+    if (v < 0.0f) return 0;
+    int t = (int)v;
+    return (uint8_t)(t + (v - (float)t >= 0.5f));
+}
+
+static void convolveRowScalar(uint8_t * dst, const uint8_t * const * rows, int size, int channels,
+                              int begin, int end, const float * weights) {
+    int n = size / 2;
+    for (int i = begin; i < end; i++) {
+        float sum = 0.0f;
+        for (int ky = 0; ky < size; ky++) {
+            const uint8_t * src = rows[ky] + i - n * channels;
+            for (int kx = 0; kx < size; kx++) {
+                sum += src[kx * channels] * weights[ky * size + kx];
+            }
+        }
+        dst[i] = roundClamp(sum);
+    }
+}
+
+static void applyLUT8Scalar(uint8_t * data, size_t n, const uint8_t * lut) {
+    for (size_t i = 0; i < n; i++) {
+        data[i] = lut[data[i]];
+    }
+}
+
+static void applyLUT24Scalar(uint8_t * data, size_t n, const uint8_t * lut) {
+    for (size_t i = 0; i < n; i++) {
+        uint8_t * p = data + 3 * i;
+        p[0] = lut[p[0]];
+        p[1] = lut[256 + p[1]];
+        p[2] = lut[512 + p[2]];
+    }
+}
+
+/**
+ * Four interleaved sub-histograms keep consecutive increments of the same bin from waiting
+ * on each other. No vector variant beats this on current CPUs, so every level uses it.
+ */
+static void histogram8Scalar(const uint8_t * data, size_t n, uint32_t * hist) {
+    uint32_t local[4][256];
+    memset(local, 0, sizeof(local));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        local[0][data[i]]++;
+        local[1][data[i + 1]]++;
+        local[2][data[i + 2]]++;
+        local[3][data[i + 3]]++;
+    }
+    for (; i < n; i++) {
+        local[0][data[i]]++;
+    }
+    for (int v = 0; v < 256; v++) {
+        hist[v] += local[0][v] + local[1][v] + local[2][v] + local[3][v];
+    }
+}
+
+static void histogram24Scalar(const uint8_t * const * rows, int numRows, int width, uint32_t hist[3][256]) {
+    uint32_t local[3][4][256];
+    memset(local, 0, sizeof(local));
+    for (int y = 0; y < numRows; y++) {
+        const uint8_t * p = rows[y];
+        for (int x = 0; x < width; x++, p += 3) {
+            local[0][x & 3][p[0]]++;
+            local[1][x & 3][p[1]]++;
+            local[2][x & 3][p[2]]++;
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        for (int v = 0; v < 256; v++) {
+            hist[c][v] += local[c][0][v] + local[c][1][v] + local[c][2][v] + local[c][3][v];
+        }
+    }
+}
+
+static void colorMatrixRowScalar(uint8_t * bgr, int width, const int32_t coef[3][3], const int32_t offset[3],
+                                 int shift, int16_t * scratch, int paddedWidth) {
+    (void)scratch;
+    (void)paddedWidth;
+    for (int x = 0; x < width; x++, bgr += 3) {
+        int32_t in[3] = {bgr[2], bgr[1], bgr[0]};
+        for (int c = 0; c < 3; c++) {
+            int32_t v = (coef[c][0] * in[0] + coef[c][1] * in[1] + coef[c][2] * in[2] + offset[c]) >> shift;
+            bgr[2 - c] = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+        }
+    }
+}
+
+/**
+ * Clamps to 0-255, adds 0.5 and truncates (the rounding of the unsharp-mask kernels).
+ */
+static inline uint8_t truncClamp(float v) {
+    v = v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+    return (uint8_t)(v + 0.5f);
+}
+
+static void unsharpRowScalar(uint8_t * out, const float * orig, const float * const * rows, const float * weights,
+                             int size, int begin, int end, float amount, float threshold) {
+    for (int i = begin; i < end; i++) {
+        float blur = 0.0f;
+        for (int k = 0; k < size; k++) {
+            blur += rows[k][i] * weights[k];
+        }
+        float diff = orig[i] - blur;
+        float result = (diff < 0.0f ? -diff : diff) >= threshold ? orig[i] + amount * diff : orig[i];
+        out[i] = truncClamp(result);
+    }
+}
+
+/**
+ * glibc's memcpy is already dispatched per CPU, so it is the best copy on every level.
+ */
+static void depadRowsScalar(uint8_t * const * dstRows, const uint8_t * src, size_t rowBytes, size_t srcStride,
+                            int numRows) {
+    for (int y = 0; y < numRows; y++) {
+        memcpy(dstRows[y], src + (size_t)y * srcStride, rowBytes);
+    }
+}
+
+#ifdef DISPATCH_X86
+
+// --- SSE2 / SSE4.2 Kernels --- //
+
+__attribute__((target("sse2")))
+static inline __m128i roundClampSSE2(__m128 v) {
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+    __m128i t = _mm_cvttps_epi32(v);
+    __m128 frac = _mm_sub_ps(v, _mm_cvtepi32_ps(t));
+    return _mm_sub_epi32(t, _mm_castps_si128(_mm_cmpge_ps(frac, _mm_set1_ps(0.5f))));
+}
+
+__attribute__((target("sse2")))
+static void convolveRowSSE2(uint8_t * dst, const uint8_t * const * rows, int size, int channels,
+                            int begin, int end, const float * weights) {
+    int n = size / 2;
+    int i = begin;
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= end; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (int ky = 0; ky < size; ky++) {
+            const uint8_t * src = rows[ky] + i - n * channels;
+            for (int kx = 0; kx < size; kx++) {
+                int32_t bytes;
+                memcpy(&bytes, src + kx * channels, 4);
+                __m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(weights[ky * size + kx])));
+            }
+        }
+        __m128i r = roundClampSSE2(sum);
+        r = _mm_packs_epi32(r, r);
+        int32_t out = _mm_cvtsi128_si32(_mm_packus_epi16(r, r));
+        memcpy(dst + i, &out, 4);
+    }
+    convolveRowScalar(dst, rows, size, channels, i, end, weights);
+}
+
+__attribute__((target("sse4.2")))
+static void convolveRowSSE42(uint8_t * dst, const uint8_t * const * rows, int size, int channels,
+                             int begin, int end, const float * weights) {
+    int n = size / 2;
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (int ky = 0; ky < size; ky++) {
+            const uint8_t * src = rows[ky] + i - n * channels;
+            for (int kx = 0; kx < size; kx++) {
+                int32_t bytes;
+                memcpy(&bytes, src + kx * channels, 4);
+                __m128i v = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes));
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(weights[ky * size + kx])));
+            }
+        }
+        __m128i r = roundClampSSE2(sum);
+        r = _mm_packus_epi32(r, r);
+        int32_t out = _mm_cvtsi128_si32(_mm_packus_epi16(r, r));
+        memcpy(dst + i, &out, 4);
+    }
+    convolveRowScalar(dst, rows, size, channels, i, end, weights);
+}
+
+__attribute__((target("sse2")))
+static void unsharpRowSSE2(uint8_t * out, const float * orig, const float * const * rows, const float * weights,
+                           int size, int begin, int end, float amount, float threshold) {
+    const __m128 amountV = _mm_set1_ps(amount);
+    const __m128 thresholdV = _mm_set1_ps(threshold);
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    int i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 blur = _mm_setzero_ps();
+        for (int k = 0; k < size; k++) {
+            blur = _mm_add_ps(blur, _mm_mul_ps(_mm_loadu_ps(rows[k] + i), _mm_set1_ps(weights[k])));
+        }
+        __m128 o = _mm_loadu_ps(orig + i);
+        __m128 diff = _mm_sub_ps(o, blur);
+        __m128 apply = _mm_cmpge_ps(_mm_and_ps(diff, signMask), thresholdV);
+        __m128 result = _mm_add_ps(o, _mm_and_ps(apply, _mm_mul_ps(amountV, diff)));
+        result = _mm_min_ps(_mm_max_ps(result, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+        __m128i r = _mm_cvttps_epi32(_mm_add_ps(result, _mm_set1_ps(0.5f)));
+        r = _mm_packs_epi32(r, r);
+        int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(r, r));
+        memcpy(out + i, &bytes, 4);
+    }
+    unsharpRowScalar(out, orig, rows, weights, size, i, end, amount, threshold);
+}
+
+/**
+ * Returns 1 if every coefficient fits the 16-bit multiply-add of the vector variants.
+ */
+static int coefFitsInt16(const int32_t coef[3][3]) {
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 3; k++) {
+            if (coef[c][k] > 32767 || coef[c][k] < -32768) return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Splits pixels into (R, G) and (B, 0) 16-bit pairs so that madd computes two products and
+ * their sum per 32-bit lane.
+ */
+static void splitPairs(const uint8_t * bgr, int width, int16_t * rg, int16_t * b0, int paddedWidth) {
+    for (int x = 0; x < width; x++, bgr += 3) {
+        rg[2 * x] = bgr[2];
+        rg[2 * x + 1] = bgr[1];
+        b0[2 * x] = bgr[0];
+        b0[2 * x + 1] = 0;
+    }
+    for (int x = width; x < paddedWidth; x++) {
+        rg[2 * x] = rg[2 * x + 1] = b0[2 * x] = b0[2 * x + 1] = 0;
+    }
+}
+
+static void mergePlanes(uint8_t * bgr, int width, const uint8_t * planes, int paddedWidth) {
+    for (int x = 0; x < width; x++, bgr += 3) {
+        bgr[2] = planes[x];
+        bgr[1] = planes[paddedWidth + x];
+        bgr[0] = planes[2 * paddedWidth + x];
+    }
+}
+
+/**
+ * 8 pixels per iteration; saturating packs perform the final clamp.
+ */
+__attribute__((target("sse2")))
+static void colorMatrixRowSSE2(uint8_t * bgr, int width, const int32_t coef[3][3], const int32_t offset[3],
+                               int shift, int16_t * scratch, int paddedWidth) {
+    if (!coefFitsInt16(coef)) {
+        colorMatrixRowScalar(bgr, width, coef, offset, shift, scratch, paddedWidth);
+        return;
+    }
+    int16_t * rg = scratch;
+    int16_t * b0 = scratch + 2 * paddedWidth;
+    uint8_t * planes = (uint8_t *)(scratch + 4 * paddedWidth);
+    splitPairs(bgr, width, rg, b0, paddedWidth);
+
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    for (int c = 0; c < 3; c++) {
+        const __m128i coefRG = _mm_set1_epi32((int)(((uint32_t)(uint16_t)coef[c][1] << 16) | (uint16_t)coef[c][0]));
+        const __m128i coefB = _mm_set1_epi32((uint16_t)coef[c][2]);
+        const __m128i off = _mm_set1_epi32(offset[c]);
+        uint8_t * plane = planes + c * paddedWidth;
+
+        for (int x = 0; x < paddedWidth; x += 8) {
+            __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i *)(rg + 2 * x)), coefRG),
+                                       _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(b0 + 2 * x)), coefB));
+            __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i *)(rg + 2 * x + 8)), coefRG),
+                                       _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(b0 + 2 * x + 8)), coefB));
+            lo = _mm_sra_epi32(_mm_add_epi32(lo, off), count);
+            hi = _mm_sra_epi32(_mm_add_epi32(hi, off), count);
+            __m128i packed = _mm_packs_epi32(lo, hi);
+            _mm_storel_epi64((__m128i *)(plane + x), _mm_packus_epi16(packed, packed));
+        }
+    }
+    mergePlanes(bgr, width, planes, paddedWidth);
+}
+
+// --- AVX2 Kernels --- //
+
+__attribute__((target("avx2")))
+static inline __m256i roundClampAVX2(__m256 v) {
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+    __m256i t = _mm256_cvttps_epi32(v);
+    __m256 frac = _mm256_sub_ps(v, _mm256_cvtepi32_ps(t));
+    return _mm256_sub_epi32(t, _mm256_castps_si256(_mm256_cmp_ps(frac, _mm256_set1_ps(0.5f), _CMP_GE_OQ)));
+}
+
+/**
+ * Stores the low byte of each of 8 32-bit lanes (values 0-255).
+ */
+__attribute__((target("avx2")))
+static inline void storeBytes8AVX2(uint8_t * dst, __m256i v) {
+    __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    _mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(words, words));
+}
+
+__attribute__((target("avx2")))
+static void convolveRowAVX2(uint8_t * dst, const uint8_t * const * rows, int size, int channels,
+                            int begin, int end, const float * weights) {
+    int n = size / 2;
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 sum = _mm256_setzero_ps();
+        for (int ky = 0; ky < size; ky++) {
+            const uint8_t * src = rows[ky] + i - n * channels;
+            for (int kx = 0; kx < size; kx++) {
+                __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + kx * channels)));
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_cvtepi32_ps(v), _mm256_set1_ps(weights[ky * size + kx])));
+            }
+        }
+        storeBytes8AVX2(dst + i, roundClampAVX2(sum));
+    }
+    convolveRowScalar(dst, rows, size, channels, i, end, weights);
+}
+
+__attribute__((target("avx2")))
+static void applyLUT8AVX2(uint8_t * data, size_t n, const uint8_t * lut) {
+    uint32_t wide[256];
+    for (int i = 0; i < 256; i++) wide[i] = lut[i];
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(data + i)));
+        storeBytes8AVX2(data + i, _mm256_i32gather_epi32((const int *)wide, index, 4));
+    }
+    applyLUT8Scalar(data + i, n - i, lut);
+}
+
+/**
+ * Gathers from one 768-entry table; the channel of each byte selects its 256-entry block.
+ */
+__attribute__((target("avx2")))
+static void applyLUT24AVX2(uint8_t * data, size_t n, const uint8_t * lut) {
+    uint32_t wide[768];
+    for (int i = 0; i < 768; i++) wide[i] = lut[i];
+
+    // Block offsets of 8 consecutive bytes, for a first byte of channel 0, 1 or 2
+    __m256i blocks[3];
+    for (int phase = 0; phase < 3; phase++) {
+        int32_t offsets[8];
+        for (int j = 0; j < 8; j++) offsets[j] = ((phase + j) % 3) * 256;
+        blocks[phase] = _mm256_loadu_si256((const __m256i *)offsets);
+    }
+
+    size_t numBytes = 3 * n, i = 0;
+    int phase = 0;
+    for (; i + 8 <= numBytes; i += 8, phase = (phase + 2) % 3) {
+        __m256i index = _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(data + i))),
+                                         blocks[phase]);
+        storeBytes8AVX2(data + i, _mm256_i32gather_epi32((const int *)wide, index, 4));
+    }
+    for (; i < numBytes; i++) {
+        data[i] = lut[(i % 3) * 256 + data[i]];
+    }
+}
+
+/**
+ * 16 pixels per iteration with 256-bit multiply-adds.
+ */
+__attribute__((target("avx2")))
+static void colorMatrixRowAVX2(uint8_t * bgr, int width, const int32_t coef[3][3], const int32_t offset[3],
+                               int shift, int16_t * scratch, int paddedWidth) {
+    if (!coefFitsInt16(coef)) {
+        colorMatrixRowScalar(bgr, width, coef, offset, shift, scratch, paddedWidth);
+        return;
+    }
+    int16_t * rg = scratch;
+    int16_t * b0 = scratch + 2 * paddedWidth;
+    uint8_t * planes = (uint8_t *)(scratch + 4 * paddedWidth);
+    splitPairs(bgr, width, rg, b0, paddedWidth);
+
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    for (int c = 0; c < 3; c++) {
+        const __m256i coefRG = _mm256_set1_epi32((int)(((uint32_t)(uint16_t)coef[c][1] << 16) | (uint16_t)coef[c][0]));
+        const __m256i coefB = _mm256_set1_epi32((uint16_t)coef[c][2]);
+        const __m256i off = _mm256_set1_epi32(offset[c]);
+        uint8_t * plane = planes + c * paddedWidth;
+
+        for (int x = 0; x < paddedWidth; x += 16) {
+            __m256i lo = _mm256_add_epi32(
+                _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(rg + 2 * x)), coefRG),
+                _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(b0 + 2 * x)), coefB));
+            __m256i hi = _mm256_add_epi32(
+                _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(rg + 2 * x + 16)), coefRG),
+                _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(b0 + 2 * x + 16)), coefB));
+            lo = _mm256_sra_epi32(_mm256_add_epi32(lo, off), count);
+            hi = _mm256_sra_epi32(_mm256_add_epi32(hi, off), count);
+            // packs works within 128-bit lanes; restore pixel order before the final pack
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+            _mm_storeu_si128((__m128i *)(plane + x),
+                             _mm_packus_epi16(_mm256_castsi256_si128(packed), _mm256_extracti128_si256(packed, 1)));
+        }
+    }
+    mergePlanes(bgr, width, planes, paddedWidth);
+}
+
+__attribute__((target("avx2")))
+static void unsharpRowAVX2(uint8_t * out, const float * orig, const float * const * rows, const float * weights,
+                           int size, int begin, int end, float amount, float threshold) {
+    const __m256 amountV = _mm256_set1_ps(amount);
+    const __m256 thresholdV = _mm256_set1_ps(threshold);
+    const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 blur = _mm256_setzero_ps();
+        for (int k = 0; k < size; k++) {
+            blur = _mm256_add_ps(blur, _mm256_mul_ps(_mm256_loadu_ps(rows[k] + i), _mm256_set1_ps(weights[k])));
+        }
+        __m256 o = _mm256_loadu_ps(orig + i);
+        __m256 diff = _mm256_sub_ps(o, blur);
+        __m256 apply = _mm256_cmp_ps(_mm256_and_ps(diff, signMask), thresholdV, _CMP_GE_OQ);
+        __m256 result = _mm256_add_ps(o, _mm256_and_ps(apply, _mm256_mul_ps(amountV, diff)));
+        result = _mm256_min_ps(_mm256_max_ps(result, _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+        storeBytes8AVX2(out + i, _mm256_cvttps_epi32(_mm256_add_ps(result, _mm256_set1_ps(0.5f))));
+    }
+    unsharpRowScalar(out, orig, rows, weights, size, i, end, amount, threshold);
+}
+
+// --- AVX-512 Kernels --- //
+
+__attribute__((target("avx512f")))
+static inline __m512i roundClampAVX512(__m512 v) {
+    v = _mm512_min_ps(_mm512_max_ps(v, _mm512_setzero_ps()), _mm512_set1_ps(255.0f));
+    __m512i t = _mm512_cvttps_epi32(v);
+    __m512 frac = _mm512_sub_ps(v, _mm512_cvtepi32_ps(t));
+    __mmask16 up = _mm512_cmp_ps_mask(frac, _mm512_set1_ps(0.5f), _CMP_GE_OQ);
+    return _mm512_mask_add_epi32(t, up, t, _mm512_set1_epi32(1));
+}
+
+__attribute__((target("avx512f")))
+static void convolveRowAVX512(uint8_t * dst, const uint8_t * const * rows, int size, int channels,
+                              int begin, int end, const float * weights) {
+    int n = size / 2;
+    int i = begin;
+    for (; i + 16 <= end; i += 16) {
+        __m512 sum = _mm512_setzero_ps();
+        for (int ky = 0; ky < size; ky++) {
+            const uint8_t * src = rows[ky] + i - n * channels;
+            for (int kx = 0; kx < size; kx++) {
+                __m512i v = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(src + kx * channels)));
+                sum = _mm512_add_ps(sum, _mm512_mul_ps(_mm512_cvtepi32_ps(v), _mm512_set1_ps(weights[ky * size + kx])));
+            }
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), _mm512_cvtepi32_epi8(roundClampAVX512(sum)));
+    }
+    convolveRowAVX2(dst, rows, size, channels, i, end, weights);
+}
+
+__attribute__((target("avx512f")))
+static void applyLUT8AVX512(uint8_t * data, size_t n, const uint8_t * lut) {
+    uint32_t wide[256];
+    for (int i = 0; i < 256; i++) wide[i] = lut[i];
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i index = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(data + i)));
+        _mm_storeu_si128((__m128i *)(data + i), _mm512_cvtepi32_epi8(_mm512_i32gather_epi32(index, wide, 4)));
+    }
+    applyLUT8Scalar(data + i, n - i, lut);
+}
+
+__attribute__((target("avx512f")))
+static void applyLUT24AVX512(uint8_t * data, size_t n, const uint8_t * lut) {
+    uint32_t wide[768];
+    for (int i = 0; i < 768; i++) wide[i] = lut[i];
+
+    __m512i blocks[3];
+    for (int phase = 0; phase < 3; phase++) {
+        int32_t offsets[16];
+        for (int j = 0; j < 16; j++) offsets[j] = ((phase + j) % 3) * 256;
+        blocks[phase] = _mm512_loadu_si512(offsets);
+    }
+
+    size_t numBytes = 3 * n, i = 0;
+    int phase = 0;
+    for (; i + 16 <= numBytes; i += 16, phase = (phase + 1) % 3) {
+        __m512i index = _mm512_add_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(data + i))),
+                                         blocks[phase]);
+        _mm_storeu_si128((__m128i *)(data + i), _mm512_cvtepi32_epi8(_mm512_i32gather_epi32(index, wide, 4)));
+    }
+    for (; i < numBytes; i++) {
+        data[i] = lut[(i % 3) * 256 + data[i]];
+    }
+}
+
+#endif // DISPATCH_X86
+
+// --- Level Selection --- //
+
+static const char * levelNames[] = {"scalar", "sse2", "sse4.2", "avx2", "avx512"};
+
+/**
+ * Returns the name of an instruction set level.
+ * @param level The level.
+ * @return The name, as accepted by IMAGE_CPU_LEVEL.
+ */
+const char * dispatch_levelName(t_cpuLevel level) {
+    if (level < CPU_LEVEL_SCALAR || level > CPU_LEVEL_AVX512) return "unknown";
+    return levelNames[level];
+}
+
+/**
+ * Probes the CPU (and OS support for the wider registers) for the highest usable level.
+ * @return The detected level.
+ */
+t_cpuLevel dispatch_detectLevel(void) {
+#ifdef DISPATCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return CPU_LEVEL_AVX512;
+    if (__builtin_cpu_supports("avx2")) return CPU_LEVEL_AVX2;
+    if (__builtin_cpu_supports("sse4.2")) return CPU_LEVEL_SSE42;
+    if (__builtin_cpu_supports("sse2")) return CPU_LEVEL_SSE2;
+#endif
+    return CPU_LEVEL_SCALAR;
+}
+
+/**
+ * Picks the level: the detected one, or IMAGE_CPU_LEVEL if the CPU supports it.
+ */
+static t_cpuLevel selectLevel(void) {
+    t_cpuLevel detected = dispatch_detectLevel();
+    const char * env = getenv("IMAGE_CPU_LEVEL");
+    if (!env || !*env) return detected;
+
+    for (int level = CPU_LEVEL_SCALAR; level <= CPU_LEVEL_AVX512; level++) {
+        if (strcmp(env, levelNames[level]) == 0) {
+            if (level > (int)detected) {
+                printf("Warning: IMAGE_CPU_LEVEL=%s is not supported by this CPU, using %s\n",
+                       env, levelNames[detected]);
+                return detected;
+            }
+            return (t_cpuLevel)level;
+        }
+    }
+    printf("Warning: Unknown IMAGE_CPU_LEVEL '%s', using %s\n", env, levelNames[detected]);
+    return detected;
+}
+
+static void bindKernels(void) {
+    t_cpuLevel level = selectLevel();
+
+    table.level = level;
+    table.convolveRow = convolveRowScalar;
+    table.applyLUT8 = applyLUT8Scalar;
+    table.applyLUT24 = applyLUT24Scalar;
+    table.histogram8 = histogram8Scalar;
+    table.histogram24 = histogram24Scalar;
+    table.colorMatrixRow = colorMatrixRowScalar;
+    table.unsharpRow = unsharpRowScalar;
+    table.depadRows = depadRowsScalar;
+
+#ifdef DISPATCH_X86
+    if (level >= CPU_LEVEL_SSE2) {
+        table.convolveRow = convolveRowSSE2;
+        table.colorMatrixRow = colorMatrixRowSSE2;
+        table.unsharpRow = unsharpRowSSE2;
+    }
+    if (level >= CPU_LEVEL_SSE42) {
+        table.convolveRow = convolveRowSSE42;
+    }
+    if (level >= CPU_LEVEL_AVX2) {
+        table.convolveRow = convolveRowAVX2;
+        table.applyLUT8 = applyLUT8AVX2;
+        table.applyLUT24 = applyLUT24AVX2;
+        table.colorMatrixRow = colorMatrixRowAVX2;
+        table.unsharpRow = unsharpRowAVX2;
+    }
+    if (level >= CPU_LEVEL_AVX512) {
+        table.convolveRow = convolveRowAVX512;
+        table.applyLUT8 = applyLUT8AVX512;
+        table.applyLUT24 = applyLUT24AVX512;
+    }
+#endif
+}
+
+/**
+ * Returns the kernel table. The CPU is probed and the pointers are bound on the first call;
+ * later calls only return the table.
+ * @return Pointer to the kernel table.
+ */
+const t_dispatchTable * dispatch_get(void) {
+    pthread_once(&tableOnce, bindKernels);
+    return &table;
+}
@@ -0,0 +1,88 @@
+/*
+ * dispatch.h
+ * Author: Simon Hillel
+ * Description: Header for runtime CPU-feature dispatch of the hot pixel kernels.
+ * The CPU is probed once and every kernel is bound to its best variant through a table of
+ * function pointers, so one binary uses AVX-512 or AVX2 where available and still runs on
+ * plain SSE2 machines. IMAGE_CPU_LEVEL forces a lower level to test every variant.
+ */
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Instruction set levels, in increasing order
+typedef enum {
+    CPU_LEVEL_SCALAR,
+    CPU_LEVEL_SSE2,
+    CPU_LEVEL_SSE42,
+    CPU_LEVEL_AVX2,
+    CPU_LEVEL_AVX512
+} t_cpuLevel;
+
+// Widths passed to colorMatrixRow must be padded to a multiple of this
+#define DISPATCH_ROW_ALIGN 16
+
+// Kernels bound to the selected level
+typedef struct {
+    t_cpuLevel level;
+    /**
+     * Convolves bytes [begin, end) of one row of interleaved samples:
+     * dst[i] = round(sum of weights[ky * size + kx] * rows[ky][i + (kx - size / 2) * channels]),
+     * clamped to 0-255. rows holds the size source rows centred on the output row.
+     */
+    void (*convolveRow)(uint8_t * dst, const uint8_t * const * rows, int size, int channels,
+                        int begin, int end, const float * weights);
+    /**
+     * Maps n bytes through a 256-entry table in place.
+     */
+    void (*applyLUT8)(uint8_t * data, size_t n, const uint8_t * lut);
+    /**
+     * Maps n BGR pixels in place; lut holds the blue, green and red tables (3 x 256 entries).
+     */
+    void (*applyLUT24)(uint8_t * data, size_t n, const uint8_t * lut);
+    /**
+     * Adds the values of n bytes to hist.
+     */
+    void (*histogram8)(const uint8_t * data, size_t n, uint32_t * hist);
+    /**
+     * Adds numRows rows of width BGR pixels to hist[0] (blue), hist[1] (green) and hist[2] (red).
+     */
+    void (*histogram24)(const uint8_t * const * rows, int numRows, int width, uint32_t hist[3][256]);
+    /**
+     * Applies a fixed-point 3x3 matrix plus offsets to width BGR pixels in place.
+     * coef is [output][input] in (R, G, B) order; scratch holds 4 * paddedWidth int16 values plus
+     * 3 * paddedWidth bytes, with paddedWidth a multiple of DISPATCH_ROW_ALIGN.
+     */
+    void (*colorMatrixRow)(uint8_t * bgr, int width, const int32_t coef[3][3], const int32_t offset[3],
+                           int shift, int16_t * scratch, int paddedWidth);
+    /**
+     * Unsharp-mask step for samples [begin, end) of one channel row:
+     * blur = sum of weights[k] * rows[k][i] (k in order), diff = orig[i] - blur,
+     * out[i] = orig[i] + amount * diff where |diff| >= threshold (orig[i] elsewhere),
+     * clamped to 0-255, then rounded by adding 0.5 and truncating.
+     */
+    void (*unsharpRow)(uint8_t * out, const float * orig, const float * const * rows, const float * weights,
+                       int size, int begin, int end, float amount, float threshold);
+    /**
+     * Copies numRows rows of rowBytes bytes, srcStride apart in src, to the rows of dstRows.
+     */
+    void (*depadRows)(uint8_t * const * dstRows, const uint8_t * src, size_t rowBytes, size_t srcStride,
+                      int numRows);
+} t_dispatchTable;
+
+/**
+ * Returns the kernel table, probing the CPU on the first call.
+ */
+const t_dispatchTable * dispatch_get(void);
+/**
+ * Returns the highest level supported by the CPU (ignoring IMAGE_CPU_LEVEL).
+ */
+t_cpuLevel dispatch_detectLevel(void);
+/**
+ * Returns the name of a level ("scalar", "sse2", "sse4.2", "avx2", "avx512").
+ */
+const char * dispatch_levelName(t_cpuLevel level);
+
+#endif // DISPATCH_H
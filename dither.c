@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include "dither.h"
+#include "parallel.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * dither.c
+ * Author: Simon Hillel
+ * Description: Implementation of dithering functions for label-printer output.
+ * Error diffusion is inherently serial along a row, so rows are processed as a wavefront:
+ * each row trails the one above it by a few pixels and the threads spin on per-row progress.
+ * Ordered dithering has no dependencies and uses SSE2 compares.
+ */
+
+// Pixels processed between two progress updates in the error-diffusion wavefront
+#define DITHER_PUBLISH_INTERVAL 32
+
+// 8x8 Bayer index matrix (values 0-63)
+static const unsigned char bayer8[8][8] = {
+    { 0, 32,  8, 40,  2, 34, 10, 42},
+    {48, 16, 56, 24, 50, 18, 58, 26},
+    {12, 44,  4, 36, 14, 46,  6, 38},
+    {60, 28, 52, 20, 62, 30, 54, 22},
+    { 3, 35, 11, 43,  1, 33,  9, 41},
+    {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47,  7, 39, 13, 45,  5, 37},
+    {63, 31, 55, 23, 61, 29, 53, 21}
+};
+
+// --- Helpers --- //
+
+/**
+ * Builds the intensity of every pixel value: the value itself for grayscale palettes,
+ * the palette luminance for indexed images.
+ * @param img Pointer to the t_bmp8 structure.
+ * @param intensity Receives the 256-entry table.
+ */
+static void buildIntensityTable(const t_bmp8 *img, unsigned char *intensity) {
+    for (int i = 0; i < BMP8_PALETTE_SIZE; i++) {
+        const unsigned char *entry = &img->colorTable[i * 4];
+        intensity[i] = (unsigned char)((114 * entry[0] + 587 * entry[1] + 299 * entry[2] + 500) / 1000);
+    }
+}
+
+/**
+ * Rounds an intensity to the nearest of `levels` evenly spaced gray levels.
+ * @param value The intensity (any integer, clamped to 0-255).
+ * @param levels The number of gray levels (2-256).
+ * @return The quantized intensity.
+ */
+static int quantize(int value, int levels) {
+    if (value < 0) value = 0;
+    if (value > 255) value = 255;
+    int q = (value * (levels - 1) + 127) / 255;
+    return q * 255 / (levels - 1);
+}
+
+/**
+ * Reverses the bit order of a byte (movemask yields LSB-first, BMP wants MSB-first).
+ */
+static unsigned char reverseBits(unsigned int b) {
+    return (unsigned char)((((b * 0x0802u & 0x22110u) | (b * 0x8020u & 0x88440u)) * 0x10101u) >> 16);
+}
+
+// --- Error Diffusion --- //
+
+// Shared state of a wavefront error-diffusion run
+typedef struct {
+    t_bmp8 *dst;
+    int *work;               // Intensities plus diffused error, in 1/16 units
+    int width;
+    int height;
+    int levels;
+    int lag;                 // Pixels a row must trail the row above it
+    t_dither_kernel kernel;
+    atomic_int nextRow;      // Next row to claim (rows are claimed top to bottom)
+    atomic_int *progress;    // Pixels finished per row
+} t_diffusionState;
+
+/**
+ * Adds a share of the quantization error to a pixel if it lies inside the image.
+ */
+static void diffuse(t_diffusionState *s, int x, int r, int amount) {
+    if (x < 0 || x >= s->width || r >= s->height) return;
+    s->work[(s->height - 1 - r) * s->width + x] += amount;
+}
+
+/**
+ * Wavefront worker: claims rows in order and processes each pixel once the row above
+ * has moved far enough ahead that none of its error writes can touch this pixel's
+ * neighbourhood. Rows are claimed in increasing order by running threads, so the row
+ * being waited on is always in progress and the wavefront cannot deadlock.
+ * The result is identical to a serial run.
+ * @param arg Pointer to the t_diffusionState.
+ */
+static void diffusionWorker(void *arg) {
+    t_diffusionState *s = (t_diffusionState *)arg;
+    int w = s->width;
+
+    for (;;) {
+        int r = atomic_fetch_add(&s->nextRow, 1);
+        if (r >= s->height) break;
+
+        int *row = &s->work[(s->height - 1 - r) * w];
+        unsigned char *out = &s->dst->data[(s->height - 1 - r) * w];
+        int ready = (r == 0) ? w : 0; // Pixels of the row above known to be finished
+
+        for (int x = 0; x < w; x++) {
+            int needed = x + s->lag < w ? x + s->lag : w;
+            while (ready < needed) {
+                ready = atomic_load_explicit(&s->progress[r - 1], memory_order_acquire);
+                if (ready < needed) sched_yield();
+            }
+
+            int value16 = row[x];
+            int value = (value16 + 8) >> 4;
+            int q = quantize(value, s->levels);
+            int err = value16 - q * 16;
+            out[x] = (unsigned char)q;
+
+            if (s->kernel == DITHER_FLOYD_STEINBERG) {
+                diffuse(s, x + 1, r, err * 7 / 16);
+                diffuse(s, x - 1, r + 1, err * 3 / 16);
+                diffuse(s, x, r + 1, err * 5 / 16);
+                diffuse(s, x + 1, r + 1, err / 16);
+            } else {
+                int share = err / 8;
+                diffuse(s, x + 1, r, share);
+                diffuse(s, x + 2, r, share);
+                diffuse(s, x - 1, r + 1, share);
+                diffuse(s, x, r + 1, share);
+                diffuse(s, x + 1, r + 1, share);
+                diffuse(s, x, r + 2, share);
+            }
+
+            if ((x + 1) % DITHER_PUBLISH_INTERVAL == 0 || x + 1 == w) {
+                atomic_store_explicit(&s->progress[r], x + 1, memory_order_release);
+            }
+        }
+    }
+}
+
+/**
+ * Dithers an 8-bit image to evenly spaced gray levels by error diffusion.
+ * Rows are processed top to bottom (as displayed) with wavefront parallelism across rows.
+ * @param img Pointer to the source t_bmp8 structure (not modified).
+ * @param kernel DITHER_FLOYD_STEINBERG or DITHER_ATKINSON.
+ * @param levels Number of output gray levels (2-256); 2 gives black and white.
+ * @return Pointer to the new t_bmp8 structure, or NULL on failure.
+ */
+t_bmp8 *dither_errorDiffusion(const t_bmp8 *img, t_dither_kernel kernel, int levels) {
+    if (!img || !img->data || levels < 2 || levels > 256) return NULL;
+
+    int w = img->width, h = img->height;
+    t_bmp8 *dst = bmp8_allocate(w, h);
+    int *work = (int *)malloc((size_t)w * h * sizeof(int));
+    atomic_int *progress = (atomic_int *)malloc(h * sizeof(atomic_int));
+    if (!dst || !work || !progress) {
+        printf("Error: Could not allocate memory for dithering\n");
+        bmp8_free(dst);
+        free(work);
+        free(progress);
+        return NULL;
+    }
+
+    unsigned char intensity[BMP8_PALETTE_SIZE];
+    buildIntensityTable(img, intensity);
+    for (size_t i = 0; i < (size_t)w * h; i++) {
+        work[i] = intensity[img->data[i]] * 16;
+    }
+    for (int r = 0; r < h; r++) {
+        atomic_init(&progress[r], 0);
+    }
+
+    t_diffusionState state;
+    state.dst = dst;
+    state.work = work;
+    state.width = w;
+    state.height = h;
+    state.levels = levels;
+    // Floyd-Steinberg reaches one pixel right in the row below, Atkinson two in its own row
+    state.lag = (kernel == DITHER_ATKINSON) ? 4 : 3;
+    state.kernel = kernel;
+    atomic_init(&state.nextRow, 0);
+    state.progress = progress;
+    parallel_run(diffusionWorker, &state);
+
+    free(work);
+    free(progress);
+    return dst;
+}
+
+// --- Ordered Dithering --- //
+
+// Shared state of an ordered-dither run
+typedef struct {
+    const t_bmp8 *src;
+    t_bmp8 *dst;
+    t_bmp1 *dst1;
+    const unsigned char *intensity;
+    int levels;
+} t_orderedState;
+
+/**
+ * Returns the 2-level Bayer thresholds for one row, repeated to 16 bytes.
+ * A pixel becomes white when its intensity is >= the returned value.
+ */
+static void bayerRowThresholds(int y, unsigned char *thresholds) {
+    for (int i = 0; i < 16; i++) {
+        // (index + 0.5) / 64 of the full range, plus one for a strict comparison
+        thresholds[i] = (unsigned char)(bayer8[y % 8][i % 8] * 4 + 3);
+    }
+}
+
+static void orderedRows(int begin, int end, void *ctx) {
+    t_orderedState *s = (t_orderedState *)ctx;
+    int w = s->src->width;
+    int isGray = bmp8_isGrayscalePalette(s->src);
+
+    for (int y = begin; y < end; y++) {
+        const unsigned char *src = &s->src->data[y * w];
+        unsigned char *out = &s->dst->data[y * w];
+
+        if (s->levels == 2) {
+            unsigned char thresholds[16];
+            bayerRowThresholds(y, thresholds);
+            int x = 0;
+#ifdef __SSE2__
+            if (isGray) {
+                const __m128i t = _mm_loadu_si128((const __m128i *)thresholds);
+                for (; x + 16 <= w; x += 16) {
+                    __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+                    __m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(v, t), v);
+                    _mm_storeu_si128((__m128i *)(out + x), ge);
+                }
+            }
+#endif
+            for (; x < w; x++) {
+                out[x] = (s->intensity[src[x]] >= thresholds[x % 16]) ? 255 : 0;
+            }
+            continue;
+        }
+
+        // Several levels: offset by the Bayer value within one quantization step
+        int step = 255 / (s->levels - 1);
+        for (int x = 0; x < w; x++) {
+            int offset = (bayer8[y % 8][x % 8] * 2 + 1) * step / 128 - step / 2;
+            out[x] = (unsigned char)quantize(s->intensity[src[x]] + offset, s->levels);
+        }
+    }
+}
+
+/**
+ * Dithers an 8-bit image to evenly spaced gray levels with an 8x8 Bayer matrix.
+ * The 2-level case on grayscale images runs 16 pixels per SSE2 compare.
+ * @param img Pointer to the source t_bmp8 structure (not modified).
+ * @param levels Number of output gray levels (2-256).
+ * @return Pointer to the new t_bmp8 structure, or NULL on failure.
+ */
+t_bmp8 *dither_ordered(const t_bmp8 *img, int levels) {
+    if (!img || !img->data || levels < 2 || levels > 256) return NULL;
+
+    t_bmp8 *dst = bmp8_allocate(img->width, img->height);
+    if (!dst) return NULL;
+
+    unsigned char intensity[BMP8_PALETTE_SIZE];
+    buildIntensityTable(img, intensity);
+    t_orderedState state = {img, dst, NULL, intensity, levels};
+    parallel_for(0, img->height, 16, orderedRows, &state);
+    return dst;
+}
+
+static void orderedPackRows(int begin, int end, void *ctx) {
+    t_orderedState *s = (t_orderedState *)ctx;
+    int w = s->src->width;
+    int isGray = bmp8_isGrayscalePalette(s->src);
+
+    for (int y = begin; y < end; y++) {
+        const unsigned char *src = &s->src->data[y * w];
+        unsigned char *out = &s->dst1->data[y * s->dst1->stride];
+        unsigned char thresholds[16];
+        bayerRowThresholds(y, thresholds);
+        int x = 0;
+#ifdef __SSE2__
+        if (isGray) {
+            const __m128i t = _mm_loadu_si128((const __m128i *)thresholds);
+            for (; x + 16 <= w; x += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+                unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, t), v));
+                out[x / 8] = reverseBits(mask & 0xFF);
+                out[x / 8 + 1] = reverseBits(mask >> 8);
+            }
+        }
+#endif
+        for (; x < w; x++) {
+            if (s->intensity[src[x]] >= thresholds[x % 16]) out[x / 8] |= (unsigned char)(0x80 >> (x % 8));
+        }
+    }
+}
+
+/**
+ * Dithers an 8-bit image straight into a packed 1-bit image with an 8x8 Bayer matrix.
+ * Compare and bit packing are fused: 16 pixels per SSE2 compare + movemask.
+ * @param img Pointer to the source t_bmp8 structure (not modified).
+ * @return Pointer to the new t_bmp1 structure, or NULL on failure.
+ */
+t_bmp1 *dither_orderedBmp1(const t_bmp8 *img) {
+    if (!img || !img->data) return NULL;
+
+    t_bmp1 *dst = bmp1_allocate(img->width, img->height);
+    if (!dst) return NULL;
+
+    unsigned char intensity[BMP8_PALETTE_SIZE];
+    buildIntensityTable(img, intensity);
+    t_orderedState state = {img, NULL, dst, intensity, 2};
+    parallel_for(0, img->height, 16, orderedPackRows, &state);
+    return dst;
+}
@@ -0,0 +1,33 @@
+/*
+ * dither.h
+ * Author: Simon Hillel
+ * Description: Header for dithering functions.
+ * Declares error-diffusion (Floyd-Steinberg, Atkinson) and ordered (Bayer) dithering of
+ * 8-bit images down to a few gray levels or straight to packed 1-bit images.
+ */
+#ifndef DITHER_H
+#define DITHER_H
+
+#include "bmp8.h"
+#include "bmp1.h"
+
+// Error-diffusion kernels
+typedef enum {
+    DITHER_FLOYD_STEINBERG,
+    DITHER_ATKINSON
+} t_dither_kernel;
+
+/**
+ * Dithers an 8-bit image to evenly spaced gray levels by error diffusion (wavefront-parallel).
+ */
+t_bmp8 *dither_errorDiffusion(const t_bmp8 *img, t_dither_kernel kernel, int levels);
+/**
+ * Dithers an 8-bit image to evenly spaced gray levels with an 8x8 Bayer matrix.
+ */
+t_bmp8 *dither_ordered(const t_bmp8 *img, int levels);
+/**
+ * Dithers an 8-bit image straight into a packed 1-bit image with an 8x8 Bayer matrix.
+ */
+t_bmp1 *dither_orderedBmp1(const t_bmp8 *img);
+
+#endif // DITHER_H
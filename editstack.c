@@ -0,0 +1,736 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "editstack.h"
+#include "kernel.h"
+#include "planar.h"
+#include "unsharp.h"
+#include "levels.h"
+
+/*
+ * editstack.c
+ * Author: Simon Hillel
+ * Description: Implementation of the non-destructive edit stack.
+ * The stack owns one working image. Checkpoint 0 is a snapshot of the original and is never
+ * evicted; checkpoint i is a snapshot of the result after the first i steps, sharing every
+ * tile its step left unchanged with checkpoint i - 1. Every result computed while replaying
+ * is snapshotted, and the least recently used intermediates are dropped once the tiles exceed
+ * the budget. The original and the current result are pinned, so the budget is a soft limit.
+ * Editing step k invalidates checkpoints k + 1 and above; the next render restores the
+ * highest cached checkpoint at or below the edit into the working image and replays from it.
+ * Restoring only copies the tiles that differ from the snapshot the working image holds, so
+ * undo and redo cost O(tiles) plus the tiles the step changed.
+ * A stack over a reduced proxy (kernelScale < 1) applies scaled convolution kernels, and a
+ * deferred stack only records edits until its result is requested.
+ * Adjacent colour-matrix steps (negative, brightness, grayscale, sepia, channel swap,
+ * saturation, white balance) are replayed as one composed matrix. Adjacent convolution steps
+ * are replayed as one composed kernel when no step clamps before the last, and in linear-light
+ * mode share one conversion to a 16-bit linear-light buffer. Runs are
+ * counted from the first step and a replay always starts at the end of a run, so the result
+ * is that of editStack_applyOps24 on all steps, whatever the edit history.
+ */
+
+// --- Steps --- //
+
+/**
+ * Returns the display name of a step type.
+ * @param type The step type.
+ * @return The name.
+ */
+const char * editStack_opName(t_editOpType type) {
+    switch (type) {
+        case EDIT_NEGATIVE: return "Negative";
+        case EDIT_BRIGHTNESS: return "Brightness";
+        case EDIT_BLACK_WHITE: return "Black and white";
+        case EDIT_BOX_BLUR: return "Box blur";
+        case EDIT_GAUSSIAN_BLUR: return "Gaussian blur";
+        case EDIT_SHARPEN: return "Sharpness";
+        case EDIT_OUTLINE: return "Outline";
+        case EDIT_EMBOSS: return "Emboss";
+        case EDIT_EQUALIZE: return "Histogram equalization";
+        case EDIT_SEPIA: return "Sepia";
+        case EDIT_CHANNEL_SWAP: return "Channel swap";
+        case EDIT_SATURATION: return "Saturation";
+        case EDIT_WHITE_BALANCE: return "White balance";
+        case EDIT_UNSHARP: return "Unsharp mask";
+        case EDIT_AUTO_LEVELS: return "Auto levels";
+        case EDIT_AUTO_WHITE_BALANCE: return "Auto white balance";
+    }
+    return "Unknown";
+}
+
+/**
+ * Checks whether a step can be applied to an image type.
+ * 8-bit images only support point operations.
+ * @param isColor 1 for a 24-bit image, 0 for an 8-bit image.
+ * @param op The step.
+ * @return 1 if supported, 0 otherwise.
+ */
+int editStack_supportsType(int isColor, t_editOp op) {
+    if (isColor) return 1;
+    return op.type == EDIT_NEGATIVE || op.type == EDIT_BRIGHTNESS || op.type == EDIT_BLACK_WHITE ||
+           op.type == EDIT_EQUALIZE || op.type == EDIT_AUTO_LEVELS;
+}
+
+/**
+ * Checks whether a step can be applied to the stack's image type.
+ * @param stack Pointer to the stack.
+ * @param op The step.
+ * @return 1 if supported, 0 otherwise.
+ */
+int editStack_supports(const t_editStack * stack, t_editOp op) {
+    return editStack_supportsType(stack->isColor, op);
+}
+
+static int isConvolution(t_editOpType type) {
+    return type == EDIT_BOX_BLUR || type == EDIT_GAUSSIAN_BLUR || type == EDIT_SHARPEN ||
+           type == EDIT_OUTLINE || type == EDIT_EMBOSS;
+}
+
+/**
+ * Returns the 3x3 kernel of a convolution step, scaled to a proxy image when kernelScale < 1.
+ * @return The kernel (free with freeKernel), or NULL if the step is not a convolution.
+ */
+static float ** opKernel(t_editOpType type, float kernelScale) {
+    float ** (*create)(void);
+    switch (type) {
+        case EDIT_BOX_BLUR: create = createBoxBlurKernel; break;
+        case EDIT_GAUSSIAN_BLUR: create = createGaussianBlurKernel; break;
+        case EDIT_SHARPEN: create = createSharpenKernel; break;
+        case EDIT_OUTLINE: create = createOutlineKernel; break;
+        case EDIT_EMBOSS: create = createEmbossKernel; break;
+        default: return NULL;
+    }
+    float ** kernel = create();
+    if (!kernel || kernelScale >= 1.0f) return kernel;
+    float ** scaled = kernel_scale(kernel, 3, kernelScale);
+    freeKernel(kernel, 3);
+    return scaled;
+}
+
+/**
+ * Applies a run of convolution steps. In linear-light mode the image is converted to a 16-bit
+ * linear-light buffer once, every kernel runs on it, and it is re-encoded once. Otherwise the
+ * kernels are composed into one (see kernel_applyChain) when no step before the last can
+ * leave 0-255 (blurs only); a chain with sharpen, outline or emboss before its last step would
+ * clamp in between, so it is applied step by step. A composed kernel is larger than each step
+ * and leaves a wider border unchanged, and rounds once instead of per step.
+ */
+static void applyConvolutionRun(t_bmp24 * img, const t_editOp * ops, int count, float kernelScale) {
+    float *** kernels = (float ***)calloc(count, sizeof(float **));
+    int * sizes = (int *)malloc(count * sizeof(int));
+    int ready = kernels && sizes;
+    for (int i = 0; ready && i < count; i++) {
+        kernels[i] = opKernel(ops[i].type, kernelScale);
+        sizes[i] = 3;
+        ready = kernels[i] != NULL;
+    }
+
+    t_planar16 * planar = NULL;
+    if (ready && bmp24_isLinearLight() && (planar = planar_fromBmp24(img, 1)) != NULL) {
+        for (int i = 0; i < count; i++) planar_applyFilter(planar, kernels[i], sizes[i]);
+        planar_store(planar, img);
+        planar_free(planar);
+    } else if (ready && !bmp24_isLinearLight() && kernel_chainIsExact(kernels, sizes, count)) {
+        kernel_applyChain(img, kernels, sizes, count);
+    } else {
+        for (int i = 0; i < count; i++) editStack_applyOp24(img, ops[i], kernelScale);
+    }
+
+    for (int i = 0; kernels && i < count; i++) {
+        if (kernels[i]) freeKernel(kernels[i], 3);
+    }
+    free(kernels);
+    free(sizes);
+}
+
+/**
+ * Returns the colour matrix of a step on a colour image.
+ * @param op The step.
+ * @param matrix Receives the matrix.
+ * @return 1 if the step is a colour matrix, 0 otherwise.
+ */
+int editStack_colorMatrix(t_editOp op, t_colorMatrix * matrix) {
+    switch (op.type) {
+        case EDIT_NEGATIVE: *matrix = colorMatrix_negative(); return 1;
+        case EDIT_BRIGHTNESS: *matrix = colorMatrix_brightness(op.param); return 1;
+        case EDIT_BLACK_WHITE: *matrix = colorMatrix_grayscale(); return 1;
+        case EDIT_SEPIA: *matrix = colorMatrix_sepia(); return 1;
+        case EDIT_CHANNEL_SWAP:
+            *matrix = colorMatrix_channelSwap(op.values[0], op.values[1], op.values[2]);
+            return 1;
+        case EDIT_SATURATION: *matrix = colorMatrix_saturation(op.param / 100.0f); return 1;
+        case EDIT_WHITE_BALANCE:
+            *matrix = colorMatrix_whiteBalance(op.values[0] / 100.0f, op.values[1] / 100.0f, op.values[2] / 100.0f);
+            return 1;
+        default: return 0;
+    }
+}
+
+/**
+ * Returns the number of leading steps of a colour image applied together: the run of
+ * colour-matrix steps or the run of convolution steps at the start of ops, otherwise 1.
+ * @param ops The steps.
+ * @param count The number of steps (at least 1).
+ * @return The length of the run.
+ */
+int editStack_runLength(const t_editOp * ops, int count) {
+    t_colorMatrix matrix;
+    int run = 0;
+    if (editStack_colorMatrix(ops[0], &matrix)) {
+        while (run < count && editStack_colorMatrix(ops[run], &matrix)) run++;
+    } else {
+        while (run < count && isConvolution(ops[run].type)) run++;
+    }
+    return run ? run : 1;
+}
+
+/**
+ * Applies one step to a colour image.
+ * @param img Pointer to the t_bmp24 structure.
+ * @param op The step.
+ * @param kernelScale Scale of img relative to the full image (1 at full resolution).
+ */
+void editStack_applyOp24(t_bmp24 * img, t_editOp op, float kernelScale) {
+    float ** kernel = kernelScale < 1.0f ? opKernel(op.type, kernelScale) : NULL;
+    if (kernel) {
+        bmp24_applyFilter(img, kernel, 3);
+        freeKernel(kernel, 3);
+        return;
+    }
+    switch (op.type) {
+        case EDIT_NEGATIVE: bmp24_negative(img); break;
+        case EDIT_BRIGHTNESS: bmp24_brightness(img, op.param); break;
+        case EDIT_BLACK_WHITE: bmp24_grayscale(img); break;
+        case EDIT_BOX_BLUR: bmp24_boxBlur(img); break;
+        case EDIT_GAUSSIAN_BLUR: bmp24_gaussianBlur(img); break;
+        case EDIT_SHARPEN: bmp24_sharpen(img); break;
+        case EDIT_OUTLINE: bmp24_outline(img); break;
+        case EDIT_EMBOSS: bmp24_emboss(img); break;
+        case EDIT_EQUALIZE: bmp24_equalize(img); break;
+        case EDIT_UNSHARP:
+            // The blur radius shrinks with a proxy, like the 3x3 kernels
+            unsharp_mask(img, op.values[0] / 100.0f, op.values[1] / 10.0f * kernelScale, op.values[2]);
+            break;
+        case EDIT_AUTO_LEVELS: levels_autoLevels24(img, LEVELS_DEFAULT_CLIP); break;
+        case EDIT_AUTO_WHITE_BALANCE: levels_autoWhiteBalance24(img); break;
+        case EDIT_SEPIA:
+        case EDIT_CHANNEL_SWAP:
+        case EDIT_SATURATION:
+        case EDIT_WHITE_BALANCE: {
+            t_colorMatrix matrix;
+            editStack_colorMatrix(op, &matrix);
+            colorMatrix_apply(img, &matrix);
+            break;
+        }
+    }
+}
+
+/**
+ * Applies steps to a colour image in order. Each run of adjacent colour-matrix steps is
+ * composed into one matrix (see colorMatrix_applyChain) and costs a single pass. Each run of
+ * convolution steps is composed into one kernel when no step clamps before the last, or in
+ * linear-light mode is converted to linear light only once (see applyConvolutionRun).
+ * @param img Pointer to the t_bmp24 structure.
+ * @param ops The steps.
+ * @param count The number of steps.
+ * @param kernelScale Scale of img relative to the full image (1 at full resolution).
+ */
+void editStack_applyOps24(t_bmp24 * img, const t_editOp * ops, int count, float kernelScale) {
+    if (count <= 0) return;
+    t_colorMatrix * chain = (t_colorMatrix *)malloc(count * sizeof(t_colorMatrix));
+    for (int i = 0; i < count;) {
+        int run = chain ? editStack_runLength(&ops[i], count - i) : 1;
+        t_colorMatrix matrix;
+        if (run == 1) {
+            editStack_applyOp24(img, ops[i], kernelScale);
+        } else if (!editStack_colorMatrix(ops[i], &matrix)) {
+            applyConvolutionRun(img, &ops[i], run, kernelScale);
+        } else {
+            for (int k = 0; k < run; k++) editStack_colorMatrix(ops[i + k], &chain[k]);
+            // A composed matrix out of range is applied step by step instead
+            if (colorMatrix_applyChain(img, chain, run) != 0) {
+                for (int k = 0; k < run; k++) editStack_applyOp24(img, ops[i + k], kernelScale);
+            }
+        }
+        i += run;
+    }
+    free(chain);
+}
+
+/**
+ * Applies one step to an 8-bit image.
+ * @param img Pointer to the t_bmp8 structure.
+ * @param op The step.
+ */
+void editStack_applyOp8(t_bmp8 * img, t_editOp op) {
+    switch (op.type) {
+        case EDIT_NEGATIVE: bmp8_negative(img); break;
+        case EDIT_BRIGHTNESS: bmp8_brightness(img, op.param); break;
+        case EDIT_BLACK_WHITE: bmp8_threshold(img, op.param); break;
+        case EDIT_EQUALIZE: {
+            bmp8_bakePalette(img);     // The histogram must count intensities, not palette indices
+            unsigned int * hist = bmp8_computeHistogram(img);
+            unsigned int * hist_eq = hist ? bmp8_computeCDF(hist) : NULL;
+            if (hist_eq) {
+                bmp8_normalizeCDF(hist_eq);
+                bmp8_equalize(img, hist_eq);
+            }
+            free(hist);
+            free(hist_eq);
+            break;
+        }
+        case EDIT_AUTO_LEVELS: levels_autoLevels8(img, LEVELS_DEFAULT_CLIP); break;
+        default: break;
+    }
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// --- Checkpoint Cache --- //
+
+static void dropCheckpoint(t_editStack * stack, int index) {
+    t_editCheckpoint * cp = &stack->checkpoints[index];
+    stack->cacheBytes -= tiles_free(cp->snap);
+    cp->snap = NULL;
+    if (stack->workIndex == index) stack->workIndex = -1;
+}
+
+/**
+ * Evicts least recently used intermediates until the snapshots fit their budget.
+ * The original (0) and the current result (numOps) are never evicted.
+ */
+static void evict(t_editStack * stack) {
+    while (stack->cacheBytes > stack->budgetBytes) {
+        int victim = -1;
+        for (int i = 1; i < stack->numOps; i++) {
+            if (stack->checkpoints[i].snap &&
+                (victim < 0 || stack->checkpoints[i].lastUsed < stack->checkpoints[victim].lastUsed)) {
+                victim = i;
+            }
+        }
+        if (victim < 0) return;
+        dropCheckpoint(stack, victim);
+    }
+}
+
+/**
+ * Snapshots the working image as checkpoint index, sharing unchanged tiles with prev.
+ * @return 0 on success, -1 on failure.
+ */
+static int storeCheckpoint(t_editStack * stack, int index, const t_tileSnapshot * prev) {
+    size_t newBytes = 0;
+    t_tileSnapshot * snap = stack->isColor ? tiles_snapshot24(stack->work24, prev, &newBytes)
+                                           : tiles_snapshot8(stack->work8, prev, &newBytes);
+    if (!snap) return -1;
+
+    t_editCheckpoint * cp = &stack->checkpoints[index];
+    if (cp->snap) dropCheckpoint(stack, index);
+    cp->snap = snap;
+    cp->lastUsed = ++stack->tick;
+    stack->cacheBytes += newBytes;
+    return 0;
+}
+
+/**
+ * Loads a snapshot into the working image, copying only the tiles that differ from the
+ * snapshot the working image currently holds.
+ */
+static void loadWork(t_editStack * stack, const t_tileSnapshot * snap) {
+    const t_tileSnapshot * current = stack->workIndex >= 0 ? stack->checkpoints[stack->workIndex].snap : NULL;
+    if (current == snap) return;
+    if (stack->isColor) tiles_restore24(snap, stack->work24, current);
+    else tiles_restore8(snap, stack->work8, current);
+}
+
+/**
+ * Drops the checkpoints that depend on step index and later steps.
+ */
+static void invalidateFrom(t_editStack * stack, int index) {
+    for (int i = index + 1; i <= stack->numOps; i++) {
+        if (stack->checkpoints[i].snap) dropCheckpoint(stack, i);
+    }
+}
+
+/**
+ * Drops the undone steps; called whenever the history changes.
+ */
+static void clearRedo(t_editStack * stack) {
+    for (int i = 0; i < stack->numRedo; i++) {
+        stack->cacheBytes -= tiles_free(stack->redoSnaps[i]);
+    }
+    stack->numRedo = 0;
+}
+
+/**
+ * Returns the highest cached checkpoint that ends a run of steps applied together (see
+ * editStack_runLength), counting runs from the first step. A checkpoint inside a run is never replayed
+ * from: applying the rest of the run on its own would clamp between steps where a replay of
+ * all steps does not, so the result would depend on the edit history.
+ */
+static int cachedBase(const t_editStack * stack) {
+    int base = 0;
+    for (int i = 0; i < stack->numOps;) {
+        i += stack->isColor ? editStack_runLength(&stack->ops[i], stack->numOps - i) : 1;
+        if (stack->checkpoints[i].snap) base = i;
+    }
+    return base;
+}
+
+/**
+ * Computes the result of all steps in the working image, replaying from the highest cached
+ * checkpoint that ends a run. Each intermediate result is snapshotted on the way.
+ * @return 0 on success, -1 on failure.
+ */
+static int render(t_editStack * stack) {
+    int top = stack->numOps;
+    if (stack->workIndex == top && stack->checkpoints[top].snap) {
+        stack->checkpoints[top].lastUsed = ++stack->tick;
+        return 0;
+    }
+
+    int start = cachedBase(stack);
+    loadWork(stack, stack->checkpoints[start].snap);
+    stack->workIndex = start;
+    stack->checkpoints[start].lastUsed = ++stack->tick;
+
+    for (int i = start; i < top;) {
+        // A run of colour-matrix or convolution steps is applied at once and shares its duration
+        int run = stack->isColor ? editStack_runLength(&stack->ops[i], top - i) : 1;
+        double begin = now();
+        if (stack->isColor) editStack_applyOps24(stack->work24, &stack->ops[i], run, stack->kernelScale);
+        else editStack_applyOp8(stack->work8, stack->ops[i]);
+        double seconds = (now() - begin) / run;
+        for (int k = i; k < i + run; k++) stack->ops[k].seconds = seconds;
+        stack->workIndex = -1;
+        if (storeCheckpoint(stack, i + run, stack->checkpoints[i].snap) != 0) return -1;
+        i += run;
+        stack->workIndex = i;
+    }
+
+    evict(stack);
+    return 0;
+}
+
+// --- Stack --- //
+
+/**
+ * Grows the step and checkpoint arrays to hold at least numOps steps.
+ * @return 0 on success, -1 on failure.
+ */
+static int reserve(t_editStack * stack, int numOps) {
+    if (numOps <= stack->capacity) return 0;
+
+    int capacity = stack->capacity ? stack->capacity * 2 : 8;
+    t_editOp * ops = (t_editOp *)realloc(stack->ops, capacity * sizeof(t_editOp));
+    if (!ops) return -1;
+    stack->ops = ops;
+    t_editCheckpoint * checkpoints = (t_editCheckpoint *)realloc(stack->checkpoints,
+                                                                 (capacity + 1) * sizeof(t_editCheckpoint));
+    if (!checkpoints) return -1;
+    stack->checkpoints = checkpoints;
+    stack->capacity = capacity;
+    return 0;
+}
+
+static t_editStack * createStack(t_bmp24 * original24, t_bmp8 * original8, size_t budget) {
+    if (!original24 && !original8) return NULL;
+
+    t_editStack * stack = (t_editStack *)calloc(1, sizeof(t_editStack));
+    if (!stack) return NULL;
+    stack->checkpoints = (t_editCheckpoint *)calloc(1, sizeof(t_editCheckpoint));
+    if (!stack->checkpoints) {
+        printf("Error: Failed to allocate edit stack\n");
+        free(stack);
+        return NULL;
+    }
+
+    if (budget == 0) {
+        const char * env = getenv("IMAGE_EDIT_CACHE_MB");
+        budget = env ? (size_t)strtoul(env, NULL, 10) << 20 : EDITSTACK_DEFAULT_BUDGET;
+    }
+    stack->budgetBytes = budget;
+    stack->isColor = original24 != NULL;
+    stack->kernelScale = 1.0f;
+    stack->work24 = original24;
+    stack->work8 = original8;
+    stack->workIndex = -1;
+    if (storeCheckpoint(stack, 0, NULL) != 0) {
+        free(stack->checkpoints);
+        free(stack);
+        return NULL;
+    }
+    stack->workIndex = 0;
+    return stack;
+}
+
+/**
+ * Creates an edit stack over a colour image.
+ * @param original The original image; the stack takes ownership and uses it as working image.
+ * @param budget Cache budget in bytes (0: IMAGE_EDIT_CACHE_MB or EDITSTACK_DEFAULT_BUDGET).
+ * @return Pointer to the stack, or NULL on failure.
+ */
+t_editStack * editStack_create24(t_bmp24 * original, size_t budget) {
+    return createStack(original, NULL, budget);
+}
+
+/**
+ * Creates an edit stack over an 8-bit image.
+ * @param original The original image; the stack takes ownership and uses it as working image.
+ * @param budget Cache budget in bytes (0: IMAGE_EDIT_CACHE_MB or EDITSTACK_DEFAULT_BUDGET).
+ * @return Pointer to the stack, or NULL on failure.
+ */
+t_editStack * editStack_create8(t_bmp8 * original, size_t budget) {
+    return createStack(NULL, original, budget);
+}
+
+/**
+ * Frees an edit stack with its working image and snapshots.
+ * @param stack Pointer to the stack.
+ */
+void editStack_free(t_editStack * stack) {
+    if (!stack) return;
+    for (int i = 0; i <= stack->numOps; i++) {
+        tiles_free(stack->checkpoints[i].snap);
+    }
+    clearRedo(stack);
+    bmp24_free(stack->work24);
+    bmp8_free(stack->work8);
+    free(stack->checkpoints);
+    free(stack->ops);
+    free(stack->redoOps);
+    free(stack->redoSnaps);
+    free(stack);
+}
+
+/**
+ * Appends a step and computes the new result from the previous one.
+ * Clears the undone steps.
+ * @param stack Pointer to the stack.
+ * @param op The step.
+ * @return 0 on success, -1 on failure.
+ */
+int editStack_push(t_editStack * stack, t_editOp op) {
+    if (!stack || !editStack_supports(stack, op)) return -1;
+    if (reserve(stack, stack->numOps + 1) != 0) return -1;
+
+    clearRedo(stack);
+    stack->ops[stack->numOps] = op;
+    stack->numOps++;
+    stack->checkpoints[stack->numOps].snap = NULL;
+    return stack->deferred ? 0 : render(stack);
+}
+
+/**
+ * Replaces a step; results after it are recomputed from the nearest cached checkpoint.
+ * Clears the undone steps.
+ * @param stack Pointer to the stack.
+ * @param index Index of the step (0-based).
+ * @param op The new step.
+ * @return 0 on success, -1 on failure.
+ */
+int editStack_replace(t_editStack * stack, int index, t_editOp op) {
+    if (!stack || index < 0 || index >= stack->numOps || !editStack_supports(stack, op)) return -1;
+
+    clearRedo(stack);
+    invalidateFrom(stack, index);
+    stack->ops[index] = op;
+    return stack->deferred ? 0 : render(stack);
+}
+
+/**
+ * Removes a step; results after it are recomputed from the nearest cached checkpoint.
+ * Clears the undone steps.
+ * @param stack Pointer to the stack.
+ * @param index Index of the step (0-based).
+ * @return 0 on success, -1 on failure.
+ */
+int editStack_remove(t_editStack * stack, int index) {
+    if (!stack || index < 0 || index >= stack->numOps) return -1;
+
+    clearRedo(stack);
+    invalidateFrom(stack, index);
+    memmove(&stack->ops[index], &stack->ops[index + 1], (stack->numOps - index - 1) * sizeof(t_editOp));
+    stack->numOps--;
+    return stack->deferred ? 0 : render(stack);
+}
+
+/**
+ * Undoes the last step. Its snapshot (if any) is kept for redo, and the previous result is
+ * restored from its checkpoint (or recomputed if it was evicted).
+ * @param stack Pointer to the stack.
+ * @return 0 on success, -1 if there is nothing to undo or on failure.
+ */
+int editStack_undo(t_editStack * stack) {
+    if (!stack || stack->numOps == 0) return -1;
+    if (!stack->deferred && render(stack) != 0) return -1;
+
+    if (stack->numRedo == stack->redoCapacity) {
+        int capacity = stack->redoCapacity ? stack->redoCapacity * 2 : 8;
+        t_editOp * ops = (t_editOp *)realloc(stack->redoOps, capacity * sizeof(t_editOp));
+        if (!ops) return -1;
+        stack->redoOps = ops;
+        t_tileSnapshot ** snaps = (t_tileSnapshot **)realloc(stack->redoSnaps, capacity * sizeof(t_tileSnapshot *));
+        if (!snaps) return -1;
+        stack->redoSnaps = snaps;
+        stack->redoCapacity = capacity;
+    }
+
+    // If the working image holds the top snapshot, restore the one below it before moving it away
+    int top = stack->numOps;
+    if (stack->workIndex == top) {
+        if (stack->checkpoints[top - 1].snap) {
+            loadWork(stack, stack->checkpoints[top - 1].snap);
+            stack->workIndex = top - 1;
+        } else {
+            stack->workIndex = -1;
+        }
+    }
+
+    stack->redoOps[stack->numRedo] = stack->ops[top - 1];
+    stack->redoSnaps[stack->numRedo] = stack->checkpoints[top].snap;
+    stack->numRedo++;
+    stack->checkpoints[top].snap = NULL;
+    stack->numOps--;
+    return stack->deferred ? 0 : render(stack);
+}
+
+/**
+ * Reapplies the last undone step by restoring its snapshot (recomputed if it had none).
+ * @param stack Pointer to the stack.
+ * @return 0 on success, -1 if there is nothing to redo or on failure.
+ */
+int editStack_redo(t_editStack * stack) {
+    if (!stack || stack->numRedo == 0) return -1;
+    if (!stack->deferred && render(stack) != 0) return -1;
+    if (reserve(stack, stack->numOps + 1) != 0) return -1;
+
+    stack->numRedo--;
+    stack->ops[stack->numOps] = stack->redoOps[stack->numRedo];
+    stack->numOps++;
+
+    t_editCheckpoint * cp = &stack->checkpoints[stack->numOps];
+    cp->snap = stack->redoSnaps[stack->numRedo];
+    if (!cp->snap) return stack->deferred ? 0 : render(stack);
+
+    cp->lastUsed = ++stack->tick;
+    if (!stack->deferred) {
+        loadWork(stack, cp->snap);
+        stack->workIndex = stack->numOps;
+    }
+    evict(stack);
+    return 0;
+}
+
+/**
+ * Sets the scale of the stack's image relative to the full image. Convolution steps use
+ * kernels scaled to match (see kernel_scale); cached results of earlier scales are dropped.
+ * @param stack Pointer to the stack.
+ * @param kernelScale The scale (1 at full resolution).
+ */
+void editStack_setKernelScale(t_editStack * stack, float kernelScale) {
+    if (!stack || stack->kernelScale == kernelScale) return;
+    clearRedo(stack);
+    invalidateFrom(stack, 0);
+    stack->kernelScale = kernelScale;
+}
+
+/**
+ * Enables or disables deferred rendering. A deferred stack records edits without applying
+ * them; the steps are applied when the result is requested.
+ * @param stack Pointer to the stack.
+ * @param deferred 1 to defer, 0 to render on every edit.
+ */
+void editStack_setDeferred(t_editStack * stack, int deferred) {
+    if (stack) stack->deferred = deferred;
+}
+
+/**
+ * Returns a copy of the highest cached result of a colour stack that ends a run of steps, so
+ * the remaining steps can be applied elsewhere (e.g. in a background thread) with
+ * editStack_applyOps24, grouped as the stack groups them.
+ * @param stack Pointer to the stack.
+ * @param first Receives the index of the first step still to apply.
+ * @return The new image, or NULL on failure.
+ */
+t_bmp24 * editStack_base24(t_editStack * stack, int * first) {
+    if (!stack || !stack->isColor) return NULL;
+    int index = cachedBase(stack);
+    *first = index;
+    return tiles_toBmp24(stack->checkpoints[index].snap);
+}
+
+/**
+ * Returns a copy of the highest cached result of an 8-bit stack.
+ * @param stack Pointer to the stack.
+ * @param first Receives the index of the first step still to apply.
+ * @return The new image, or NULL on failure.
+ */
+t_bmp8 * editStack_base8(t_editStack * stack, int * first) {
+    if (!stack || stack->isColor) return NULL;
+    int index = cachedBase(stack);
+    *first = index;
+    return tiles_toBmp8(stack->checkpoints[index].snap);
+}
+
+/**
+ * Returns the sum of the last measured durations of all steps.
+ * @param stack Pointer to the stack.
+ * @return The duration in seconds.
+ */
+double editStack_seconds(const t_editStack * stack) {
+    double seconds = 0.0;
+    for (int i = 0; i < stack->numOps; i++) seconds += stack->ops[i].seconds;
+    return seconds;
+}
+
+/**
+ * Returns the result of all steps of a colour stack.
+ * @param stack Pointer to the stack.
+ * @return The image (owned by the stack), or NULL for an 8-bit stack or on failure.
+ */
+t_bmp24 * editStack_current24(t_editStack * stack) {
+    if (!stack || !stack->isColor || render(stack) != 0) return NULL;
+    return stack->work24;
+}
+
+/**
+ * Returns the result of all steps of an 8-bit stack.
+ * @param stack Pointer to the stack.
+ * @return The image (owned by the stack), or NULL for a colour stack or on failure.
+ */
+t_bmp8 * editStack_current8(t_editStack * stack) {
+    if (!stack || stack->isColor || render(stack) != 0) return NULL;
+    return stack->work8;
+}
+
+/**
+ * Lists the steps of the stack. Steps whose result is cached are marked with '*'.
+ * @param stack Pointer to the stack.
+ */
+void editStack_print(const t_editStack * stack) {
+    printf("Edit history (* = cached, %.1f MB of tiles, %d step(s) to redo):\n",
+           stack->cacheBytes / (1024.0 * 1024.0), stack->numRedo);
+    printf("  0. Original *\n");
+    for (int i = 0; i < stack->numOps; i++) {
+        const t_editOp * op = &stack->ops[i];
+        printf("  %d. %s", i + 1, editStack_opName(op->type));
+        if (op->type == EDIT_BRIGHTNESS || (op->type == EDIT_BLACK_WHITE && !stack->isColor)) {
+            printf(" (%d)", op->param);
+        } else if (op->type == EDIT_SATURATION) {
+            printf(" (%d%%)", op->param);
+        } else if (op->type == EDIT_CHANNEL_SWAP) {
+            printf(" (%c%c%c)", "RGB"[op->values[0]], "RGB"[op->values[1]], "RGB"[op->values[2]]);
+        } else if (op->type == EDIT_WHITE_BALANCE) {
+            printf(" (%d%%, %d%%, %d%%)", op->values[0], op->values[1], op->values[2]);
+        } else if (op->type == EDIT_UNSHARP) {
+            printf(" (%d%%, radius %.1f, threshold %d)", op->values[0], op->values[1] / 10.0, op->values[2]);
+        }
+        printf("%s\n", stack->checkpoints[i + 1].snap ? " *" : "");
+    }
+}
@@ -0,0 +1,177 @@
+/*
+ * editstack.h
+ * Author: Simon Hillel
+ * Description: Header for the non-destructive edit stack of the interactive mode.
+ * Declares an ordered list of filter steps applied to a kept original, with cached results
+ * (checkpoints) so that changing or removing a step only recomputes from the nearest cached
+ * result before it. Checkpoints are copy-on-write tile snapshots, so each one only stores the
+ * tiles its step changed; they are evicted least-recently-used beyond a memory budget.
+ * Undone steps keep their snapshot until the history changes, so redo is a restore as well.
+ */
+#ifndef EDITSTACK_H
+#define EDITSTACK_H
+
+#include <stddef.h>
+#include "bmp8.h"
+#include "bmp24.h"
+#include "tiles.h"
+#include "colormatrix.h"
+
+// Default cache budget (override with IMAGE_EDIT_CACHE_MB)
+#define EDITSTACK_DEFAULT_BUDGET ((size_t)256 << 20)
+
+// Filter steps available in the interactive menu
+typedef enum {
+    EDIT_NEGATIVE,
+    EDIT_BRIGHTNESS,      // param: brightness offset (-255 to 255)
+    EDIT_BLACK_WHITE,     // Grayscale for colour images, threshold (param) for 8-bit images
+    EDIT_BOX_BLUR,
+    EDIT_GAUSSIAN_BLUR,
+    EDIT_SHARPEN,
+    EDIT_OUTLINE,
+    EDIT_EMBOSS,
+    EDIT_EQUALIZE,
+    EDIT_SEPIA,           // Colour images only, like the steps below
+    EDIT_CHANNEL_SWAP,    // values: input channel copied to red, green and blue (0 = R, 1 = G, 2 = B)
+    EDIT_SATURATION,      // param: saturation in percent (0 = gray, 100 = unchanged)
+    EDIT_WHITE_BALANCE,   // values: red, green and blue gains in percent
+    EDIT_UNSHARP,         // values: amount in percent, radius in tenths of a pixel, threshold
+    EDIT_AUTO_LEVELS,     // Percentile contrast stretch (LEVELS_DEFAULT_CLIP), also on 8-bit images
+    EDIT_AUTO_WHITE_BALANCE   // Gray-world white balance
+} t_editOpType;
+
+// One step of the stack
+typedef struct {
+    t_editOpType type;
+    int param;
+    int values[3];        // Per-channel settings (channel swap, white balance), unsharp-mask settings
+    double seconds;       // Duration of the last application (0 until applied)
+} t_editOp;
+
+// Result after a number of steps; snap is NULL when not cached
+typedef struct {
+    t_tileSnapshot * snap;
+    unsigned long lastUsed;   // Tick of the last use, for LRU eviction
+} t_editCheckpoint;
+
+typedef struct {
+    int isColor;
+    t_editOp * ops;
+    int numOps;
+    int capacity;
+    t_editCheckpoint * checkpoints;   // numOps + 1 entries; entry i is the result after i steps
+    t_bmp24 * work24;                 // Working image (colour stacks)
+    t_bmp8 * work8;                   // Working image (8-bit stacks)
+    int workIndex;                    // Checkpoint the working image holds, -1 if none
+    t_editOp * redoOps;               // Undone steps, most recent last
+    t_tileSnapshot ** redoSnaps;      // Result of each undone step
+    int numRedo;
+    int redoCapacity;
+    size_t cacheBytes;                // Bytes of the distinct tiles of all snapshots
+    float kernelScale;                // Scale of a proxy image; convolution kernels are scaled to match
+    int deferred;                     // 1: edits do not render until the result is requested
+    size_t budgetBytes;
+    unsigned long tick;
+} t_editStack;
+
+/**
+ * Creates a stack over a colour image (the stack takes ownership). budget 0 uses the default.
+ */
+t_editStack * editStack_create24(t_bmp24 * original, size_t budget);
+/**
+ * Creates a stack over an 8-bit image (the stack takes ownership). budget 0 uses the default.
+ */
+t_editStack * editStack_create8(t_bmp8 * original, size_t budget);
+/**
+ * Frees the stack, its working image and every snapshot.
+ */
+void editStack_free(t_editStack * stack);
+/**
+ * Applies one step to a colour image; kernelScale < 1 scales convolution kernels for a proxy.
+ */
+void editStack_applyOp24(t_bmp24 * img, t_editOp op, float kernelScale);
+/**
+ * Applies steps to a colour image in order; each run of adjacent colour-matrix steps is
+ * composed into one matrix and applied in a single pass, and each run of convolution steps is
+ * composed into one kernel when no step clamps before the last (in linear-light mode, it is
+ * converted to linear light once instead).
+ */
+void editStack_applyOps24(t_bmp24 * img, const t_editOp * ops, int count, float kernelScale);
+/**
+ * Returns the number of leading colour-image steps that editStack_applyOps24 applies together.
+ */
+int editStack_runLength(const t_editOp * ops, int count);
+/**
+ * Returns 1 and fills matrix if the step is a colour matrix on colour images, 0 otherwise.
+ */
+int editStack_colorMatrix(t_editOp op, t_colorMatrix * matrix);
+/**
+ * Applies one step to an 8-bit image.
+ */
+void editStack_applyOp8(t_bmp8 * img, t_editOp op);
+/**
+ * Sets the proxy scale of the stack's image (1 for full resolution) and invalidates its results.
+ */
+void editStack_setKernelScale(t_editStack * stack, float kernelScale);
+/**
+ * Enables (1) or disables (0) deferred rendering: edits only render on editStack_current*.
+ */
+void editStack_setDeferred(t_editStack * stack, int deferred);
+/**
+ * Returns a copy of the highest cached result ending a run; *first receives the next step to apply.
+ */
+t_bmp24 * editStack_base24(t_editStack * stack, int * first);
+/**
+ * Returns a copy of the highest cached result of an 8-bit stack (see editStack_base24).
+ */
+t_bmp8 * editStack_base8(t_editStack * stack, int * first);
+/**
+ * Returns the sum of the last measured durations of all steps, in seconds.
+ */
+double editStack_seconds(const t_editStack * stack);
+/**
+ * Returns 1 if the step can be applied to a 24-bit (isColor) or 8-bit image.
+ */
+int editStack_supportsType(int isColor, t_editOp op);
+/**
+ * Returns 1 if the step can be applied to the stack's image type.
+ */
+int editStack_supports(const t_editStack * stack, t_editOp op);
+/**
+ * Appends a step and computes its result. Returns 0 on success, -1 on failure.
+ */
+int editStack_push(t_editStack * stack, t_editOp op);
+/**
+ * Replaces step index (0-based). Returns 0 on success, -1 on failure.
+ */
+int editStack_replace(t_editStack * stack, int index, t_editOp op);
+/**
+ * Removes step index (0-based). Returns 0 on success, -1 on failure.
+ */
+int editStack_remove(t_editStack * stack, int index);
+/**
+ * Undoes the last step, keeping it for redo. Returns 0 on success, -1 if there is nothing to undo.
+ */
+int editStack_undo(t_editStack * stack);
+/**
+ * Reapplies the last undone step. Returns 0 on success, -1 if there is nothing to redo.
+ */
+int editStack_redo(t_editStack * stack);
+/**
+ * Returns the result of all steps (owned by the stack, valid until the next change).
+ */
+t_bmp24 * editStack_current24(t_editStack * stack);
+/**
+ * Returns the result of all steps of an 8-bit stack (owned by the stack).
+ */
+t_bmp8 * editStack_current8(t_editStack * stack);
+/**
+ * Returns the display name of a step type.
+ */
+const char * editStack_opName(t_editOpType type);
+/**
+ * Lists the steps, marking those whose result is cached.
+ */
+void editStack_print(const t_editStack * stack);
+
+#endif // EDITSTACK_H
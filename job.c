@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include "job.h"
+#include "shmimage.h"
+#include "bmpio.h"
+#include "parallel.h"
+#include "planar.h"
+#include "unsharp.h"
+
+/*
+ * job.c
+ * Author: Simon Hillel
+ * Description: Implementation of filter jobs.
+ * The source is a shared segment used in place or a loaded BMP file; the ops then run on the
+ * input segment itself (output "-"), on the output segment after copying the source into it,
+ * or on a private image that is saved to the output file. The source segment is only modified
+ * by in-place jobs.
+ */
+
+// Op names, in t_editOpType order
+static const char * opNames[] = {
+    "negative", "brightness", "bw", "boxblur", "gaussian", "sharpen", "outline", "emboss", "equalize",
+    "sepia", "swap", "saturation", "wb", "unsharp", "autolevels", "autowb"
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Parses the channel order of a swap op ("bgr": red takes blue, green stays, blue takes red).
+ * @return 0 on success, -1 if the order is not three of r, g and b.
+ */
+static int parseChannels(const char * text, int * sources) {
+    if (strlen(text) != 3) return -1;
+    for (int i = 0; i < 3; i++) {
+        const char * channel = strchr("rgb", text[i]);
+        if (!channel) return -1;
+        sources[i] = (int)(channel - "rgb");
+    }
+    return 0;
+}
+
+/**
+ * Parses the settings of an unsharp mask ("<amount %>:<radius>:<threshold>").
+ * @return 0 on success, -1 if a setting is missing or out of range.
+ */
+static int parseUnsharp(const char * text, int * values) {
+    float radius;
+    char end;
+    if (sscanf(text, "%d:%f:%d%c", &values[0], &radius, &values[2], &end) != 3) return -1;
+    values[1] = (int)(radius * 10.0f + 0.5f);
+    if (values[0] < 0 || values[0] > UNSHARP_MAX_AMOUNT || values[1] < 1 ||
+        values[1] > UNSHARP_MAX_RADIUS * 10 || values[2] < 0 || values[2] > 255) {
+        printf("Error: Unsharp mask needs an amount of 0-%d%%, a radius of 0.1-%d and a threshold of 0-255\n",
+               UNSHARP_MAX_AMOUNT, UNSHARP_MAX_RADIUS);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Parses the gains of a white balance ("<red>:<green>:<blue>", in percent).
+ * @return 0 on success, -1 if a gain is missing or out of range.
+ */
+static int parseGains(const char * text, int * values) {
+    char end;
+    if (sscanf(text, "%d:%d:%d%c", &values[0], &values[1], &values[2], &end) != 3) return -1;
+    for (int i = 0; i < 3; i++) {
+        if (values[i] < 0 || values[i] > COLORMATRIX_MAX_GAIN) {
+            printf("Error: White balance needs gains of 0-%d%%\n", COLORMATRIX_MAX_GAIN);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Parses one op ("name" or "name=value"; white balance takes "wb=<red>:<green>:<blue>", the
+ * unsharp mask "unsharp=<amount %>:<radius>:<threshold>", by default 100:1.0:0).
+ * @param text The op text.
+ * @param op Receives the op.
+ * @return 0 on success, -1 if the op is unknown or its value is missing or invalid.
+ */
+int job_parseOp(const char * text, t_editOp * op) {
+    const char * value = strchr(text, '=');
+    size_t nameLength = value ? (size_t)(value - text) : strlen(text);
+
+    for (int i = 0; i < (int)(sizeof(opNames) / sizeof(opNames[0])); i++) {
+        if (strlen(opNames[i]) == nameLength && strncmp(text, opNames[i], nameLength) == 0) {
+            memset(op, 0, sizeof(*op));
+            op->type = (t_editOpType)i;
+            op->param = value ? atoi(value + 1) : (op->type == EDIT_BLACK_WHITE ? 128 : 0);
+            if ((op->type == EDIT_BRIGHTNESS || op->type == EDIT_SATURATION) && !value) return -1;
+            if (op->type == EDIT_CHANNEL_SWAP) return parseChannels(value ? value + 1 : "bgr", op->values);
+            if (op->type == EDIT_UNSHARP) return parseUnsharp(value ? value + 1 : "100:1.0:0", op->values);
+            if (op->type == EDIT_WHITE_BALANCE) return value ? parseGains(value + 1, op->values) : -1;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Returns the job name of an op type.
+ * @param type The op type.
+ * @return The name used in job lines.
+ */
+const char * job_opName(t_editOpType type) {
+    if ((int)type < 0 || (int)type >= (int)(sizeof(opNames) / sizeof(opNames[0]))) return "unknown";
+    return opNames[type];
+}
+
+/**
+ * Splits a job line in place.
+ * @param line The line (without its newline); separators are replaced by '\\0'.
+ * @param input Receives the input.
+ * @param output Receives the output.
+ * @param chain Receives the comma-separated ops, or NULL if there are none.
+ * @return 0 on success, -1 if the line does not have two or three fields.
+ */
+int job_split(char * line, char ** input, char ** output, char ** chain) {
+    char * save = NULL;
+    *input = strtok_r(line, " \t", &save);
+    *output = strtok_r(NULL, " \t", &save);
+    *chain = strtok_r(NULL, " \t", &save);
+    if (!*input || !*output || strtok_r(NULL, " \t", &save)) return -1;
+    return 0;
+}
+
+/**
+ * Reads the colour depth of a BMP file (0 if it cannot be read).
+ */
+static int readDepth(const char * filename) {
+    t_bmpFields fields;
+    return bmpio_probe(filename, &fields) == 0 ? fields.bits : 0;
+}
+
+/**
+ * Runs a job.
+ * @param input A BMP file or shm:<handle>.
+ * @param output A BMP file, shm:<handle>, or "-" to filter a shm: input in place.
+ * @param chain The comma-separated ops (split in place), or NULL.
+ * @param result Receives the op count and the load / filter / save times.
+ * @param error Receives the error message on failure.
+ * @param errorSize The size of the error buffer.
+ * @return 0 on success, -1 on failure.
+ */
+int job_run(const char * input, const char * output, char * chain, t_jobResult * result,
+            char * error, size_t errorSize) {
+    double start = now();
+    result->numOps = 0;
+    result->load = result->filters = result->save = 0.0;
+    error[0] = '\0';
+
+    t_editOp ops[JOB_MAX_OPS];
+    int numOps = 0;
+    if (chain) {
+        char * opSave = NULL;
+        for (char * text = strtok_r(chain, ",", &opSave); text; text = strtok_r(NULL, ",", &opSave)) {
+            if (numOps == JOB_MAX_OPS || job_parseOp(text, &ops[numOps]) != 0) {
+                snprintf(error, errorSize, "invalid op '%s'", text);
+                return -1;
+            }
+            numOps++;
+        }
+    }
+    result->numOps = numOps;
+
+    // Source image: a shared segment used in place, or a BMP file
+    t_shmImage * shmIn = NULL;
+    t_bmp24 * loaded24 = NULL;
+    t_bmp8 * loaded8 = NULL;
+    if (strncmp(input, JOB_SHM_PREFIX, strlen(JOB_SHM_PREFIX)) == 0) {
+        shmIn = shmImage_open(input + strlen(JOB_SHM_PREFIX));
+        if (!shmIn) {
+            snprintf(error, errorSize, "cannot map %s", input);
+            return -1;
+        }
+    } else {
+        int depth = readDepth(input);
+        if (depth != 8 && depth != 24) {
+            snprintf(error, errorSize, "cannot read a 8-bit or 24-bit BMP from %s", input);
+            return -1;
+        }
+        loaded24 = depth == 24 ? bmp24_loadImage(input) : NULL;
+        loaded8 = depth == 8 ? bmp8_loadImage(input) : NULL;
+        if (!loaded24 && !loaded8) {
+            snprintf(error, errorSize, "cannot load %s", input);
+            return -1;
+        }
+    }
+    t_bmp24 * source24 = shmIn ? shmIn->img24 : loaded24;
+    t_bmp8 * source8 = shmIn ? shmIn->img8 : loaded8;
+
+    // Working image: the input segment itself ("-"), the output segment, or a private image
+    t_shmImage * shmOut = NULL;
+    t_bmp24 * img24 = NULL;
+    t_bmp8 * img8 = NULL;
+    if (strcmp(output, "-") == 0) {
+        if (!shmIn) snprintf(error, errorSize, "in-place output needs a shm: input");
+        img24 = source24;
+        img8 = source8;
+    } else if (strncmp(output, JOB_SHM_PREFIX, strlen(JOB_SHM_PREFIX)) == 0) {
+        shmOut = shmImage_open(output + strlen(JOB_SHM_PREFIX));
+        if (!shmOut) snprintf(error, errorSize, "cannot map %s", output);
+        else if (source24 ? shmImage_store24(shmOut, source24) : shmImage_store8(shmOut, source8)) {
+            snprintf(error, errorSize, "%s does not match the input format and size", output);
+        } else {
+            img24 = shmOut->img24;
+            img8 = shmOut->img8;
+        }
+    } else if (shmIn) {
+        // Leave the input segment untouched when writing a file
+        img24 = source24 ? bmp24_copy(source24) : NULL;
+        img8 = source8 ? bmp8_copy(source8) : NULL;
+        if (!img24 && !img8) snprintf(error, errorSize, "out of memory");
+    } else {
+        img24 = loaded24;
+        img8 = loaded8;
+    }
+    for (int i = 0; i < numOps && !error[0]; i++) {
+        if (img8 && !editStack_supportsType(0, ops[i])) {
+            snprintf(error, errorSize, "%s is not available for 8-bit images", job_opName(ops[i].type));
+        }
+    }
+    double ready = now();
+    result->load = ready - start;
+
+    if (!error[0]) {
+        if (img24) editStack_applyOps24(img24, ops, numOps, 1.0f);
+        else for (int i = 0; i < numOps; i++) editStack_applyOp8(img8, ops[i]);
+    }
+    double filtered = now();
+    result->filters = filtered - ready;
+
+    if (!error[0] && !shmOut && strcmp(output, "-") != 0) {
+        int status = img24 ? bmp24_saveImage(img24, output) : bmp8_saveImage(output, img8);
+        if (status != 0) snprintf(error, errorSize, "cannot write %s", output);
+    }
+    if (shmIn && !shmOut && strcmp(output, "-") != 0) {
+        bmp24_free(img24);
+        bmp8_free(img8);
+    }
+    bmp24_free(loaded24);
+    bmp8_free(loaded8);
+    // Closing a segment writes a copied 8-bit view back
+    shmImage_close(shmOut);
+    shmImage_close(shmIn);
+    result->save = now() - filtered;
+
+    return error[0] ? -1 : 0;
+}
+
+// --- Memory Model --- //
+
+// Bookkeeping malloc adds to every block
+#define JOB_MALLOC_OVERHEAD 16
+
+/**
+ * Returns the bytes of a loaded image: one block per row for colour images, one block for
+ * 8-bit images.
+ * @param width The width in pixels.
+ * @param height The height in pixels.
+ * @param depth The colour depth (8 or 24).
+ * @return The bytes of the pixels and the row table.
+ */
+size_t job_imageBytes(int width, int height, int depth) {
+    if (depth == 8) return (size_t)width * height + JOB_MALLOC_OVERHEAD;
+    return (size_t)height * ((size_t)width * sizeof(t_pixel) + JOB_MALLOC_OVERHEAD + sizeof(t_pixel *));
+}
+
+/**
+ * Returns the temporary bytes an op allocates: convolutions copy the image
+ * (bmp24_applyFilter), or in linear-light mode convert it to three 16-bit planes and copy one
+ * plane at a time (planar_applyFilter); colour equalization keeps a t_yuv per pixel (8 times
+ * the image); the unsharp mask copies the rows around each band and keeps a ring of blurred
+ * rows per thread (unsharp_mask); the other ops work in place.
+ * @param op The op.
+ * @param width The width in pixels.
+ * @param height The height in pixels.
+ * @param depth The colour depth (8 or 24).
+ * @return The bytes allocated by the op while it runs.
+ */
+size_t job_opBytes(t_editOp op, int width, int height, int depth) {
+    if (depth != 24) return 0;
+    switch (op.type) {
+        case EDIT_BOX_BLUR:
+        case EDIT_GAUSSIAN_BLUR:
+        case EDIT_SHARPEN:
+        case EDIT_OUTLINE:
+        case EDIT_EMBOSS:
+            if (bmp24_isLinearLight()) {
+                size_t plane = (size_t)width * height * sizeof(uint16_t) + JOB_MALLOC_OVERHEAD;
+                return sizeof(t_planar16) + 4 * plane;
+            }
+            return job_imageBytes(width, height, depth);
+        case EDIT_EQUALIZE:
+            return (size_t)height * ((size_t)width * sizeof(t_yuv) + JOB_MALLOC_OVERHEAD + sizeof(t_yuv *));
+        case EDIT_UNSHARP: {
+            size_t n = (size_t)ceilf(3.0f * op.values[1] / 10.0f);
+            size_t bands = ((size_t)height + UNSHARP_BAND_ROWS - 1) / UNSHARP_BAND_ROWS;
+            size_t threads = (size_t)parallel_numThreads() < bands ? (size_t)parallel_numThreads() : bands;
+            size_t rowFloats = (size_t)width * 3;
+            size_t ring = ((2 * n + 1) * rowFloats + width + 2 * n + rowFloats) * sizeof(float) + rowFloats;
+            return bands * 2 * n * width * sizeof(t_pixel) + threads * (ring + 5 * JOB_MALLOC_OVERHEAD);
+        }
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Returns the bytes of the buffers used while loading or saving an image file.
+ */
+static size_t ioBytes(int width, int height, int depth, int save) {
+    size_t padded = depth == 8 ? ((size_t)width + 3) & ~(size_t)3 : ((size_t)width * 3 + 3) & ~(size_t)3;
+    size_t dataBytes = padded * height;
+    size_t threads = (size_t)parallel_numThreads();
+    if (bmpio_mode() == BMPIO_MODE_DIRECT) {
+        // Every transfer goes through a bounce buffer, de-padded straight into the rows on load
+        size_t rowTable = save ? 0 : (size_t)height * sizeof(uint8_t *);
+        return rowTable + threads * BMPIO_DIRECT_CHUNK;
+    }
+    if (depth == 8) return save ? 0 : dataBytes;
+    // Large colour images are read straight into the rows and saved in chunks per thread
+    if (dataBytes >= BMPIO_PARALLEL_MIN_BYTES) return save ? threads * BMPIO_CHUNK_BYTES : 0;
+    return save ? 0 : dataBytes + (size_t)height * sizeof(uint8_t *);
+}
+
+/**
+ * Predicts the peak memory of a job: the image, plus the largest of the load buffers, the
+ * temporaries of each op and the save buffers, which are never allocated at the same time.
+ * Shared-memory inputs and outputs are not predicted (the segments are not private memory).
+ * @param input The input of the job.
+ * @param output The output of the job.
+ * @param chain The comma-separated ops, or NULL.
+ * @param bytes Receives the predicted peak in bytes.
+ * @return 0 on success, -1 if the input is not a BMP file that can be read or an op is unknown.
+ */
+int job_predictPeak(const char * input, const char * output, const char * chain, size_t * bytes) {
+    t_bmpFields fields;
+    *bytes = 0;
+    if (strncmp(input, JOB_SHM_PREFIX, strlen(JOB_SHM_PREFIX)) == 0 || bmpio_probe(input, &fields) != 0) {
+        return -1;
+    }
+    int width = fields.width;
+    int height = fields.height < 0 ? -fields.height : fields.height;
+    int depth = fields.bits;
+    if (width <= 0 || (depth != 8 && depth != 24)) return -1;
+
+    size_t transient = ioBytes(width, height, depth, 0);
+    if (strcmp(output, "-") != 0 && strncmp(output, JOB_SHM_PREFIX, strlen(JOB_SHM_PREFIX)) != 0) {
+        size_t save = ioBytes(width, height, depth, 1);
+        if (save > transient) transient = save;
+    }
+    for (const char * text = chain; text && *text; ) {
+        const char * comma = strchr(text, ',');
+        size_t length = comma ? (size_t)(comma - text) : strlen(text);
+        char opText[64];
+        t_editOp op;
+        if (length >= sizeof(opText)) return -1;
+        memcpy(opText, text, length);
+        opText[length] = '\0';
+        if (job_parseOp(opText, &op) != 0) return -1;
+        size_t temporary = job_opBytes(op, width, height, depth);
+        if (temporary > transient) transient = temporary;
+        text = comma ? comma + 1 : text + length;
+    }
+    *bytes = job_imageBytes(width, height, depth) + transient;
+    return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * job.h
+ * Author: Simon Hillel
+ * Description: Header for filter jobs, the unit of work of the daemon and batch modes.
+ * A job is one text line: <input> <output> [<op>,<op>,...]. Inputs and outputs are BMP files
+ * or shared-memory segments written shm:<handle> (see daemon.h for the forms accepted).
+ * Ops: negative, brightness=<v>, bw[=<threshold>], boxblur, gaussian, sharpen, outline,
+ * emboss, equalize, autolevels, and on colour images autowb, sepia, swap[=<order, e.g. bgr>], saturation=<percent>,
+ * wb=<red>:<green>:<blue> (gains in percent, 0 to COLORMATRIX_MAX_GAIN), unsharp[=<amount %>:<radius>:<threshold>].
+ * Adjacent colour-matrix ops run as one pass.
+ * The memory model predicts the peak heap use of a job from the input's header: the image,
+ * plus the largest of the load buffers, the temporaries of each op and the save buffers.
+ */
+#ifndef JOB_H
+#define JOB_H
+
+#include <stddef.h>
+#include "editstack.h"
+
+// Most ops in one job
+#define JOB_MAX_OPS 64
+// Prefix of a shared-memory segment handle
+#define JOB_SHM_PREFIX "shm:"
+
+// Outcome of a job; times are in seconds
+typedef struct {
+    int numOps;
+    double load;
+    double filters;
+    double save;
+} t_jobResult;
+
+/**
+ * Parses one op ("name" or "name=value"). Returns 0, or -1 if the op is unknown.
+ */
+int job_parseOp(const char * text, t_editOp * op);
+/**
+ * Returns the job name of an op type.
+ */
+const char * job_opName(t_editOpType type);
+/**
+ * Splits a job line in place into input, output and op chain (NULL if none). Returns 0 or -1.
+ */
+int job_split(char * line, char ** input, char ** output, char ** chain);
+/**
+ * Runs a job: load, apply the op chain (split in place), save. Returns 0, or -1 with a message.
+ */
+int job_run(const char * input, const char * output, char * chain, t_jobResult * result,
+            char * error, size_t errorSize);
+
+/**
+ * Returns the bytes of a loaded image (pixels and row table).
+ */
+size_t job_imageBytes(int width, int height, int depth);
+/**
+ * Returns the temporary bytes an op allocates on an image of the given size.
+ */
+size_t job_opBytes(t_editOp op, int width, int height, int depth);
+/**
+ * Predicts the peak memory of a job line's fields from the input's header (chain unchanged).
+ * Returns 0, or -1 if the input is not a readable BMP file or an op is unknown.
+ */
+int job_predictPeak(const char * input, const char * output, const char * chain, size_t * bytes);
+
+#endif // JOB_H
@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "kernel.h"
+#include "parallel.h"
+
+/*
+ * kernel.c
+ * Author: Simon Hillel
+ * Description: Implementation of convolution kernel algebra.
+ * Chaining N linear filters costs N full-image passes and N temporary copies. Since the
+ * filters are linear, the chain equals one filter whose kernel is the convolution of all
+ * kernels; that kernel is applied once, through two 1-D passes when it is separable
+ * (e.g. repeated Gaussian or box blurs).
+ *
+ * Where composition changes results:
+ *  - Clamping: each step of a chain clamps to 0-255 and rounds. If an intermediate kernel has
+ *    negative weights or weights summing above 1 (sharpen, outline, emboss), intermediate
+ *    values can leave that range and the composed result differs. kernel_chainIsExact tells
+ *    whether a chain is affected; rounding alone still causes differences of +-1.
+ *  - Borders: pixels closer than kernelSize / 2 to the border are left unchanged, and the
+ *    composed kernel is larger than each step, so a wider border stays untouched.
+ */
+
+// Relative tolerance for the separability test
+#define KERNEL_SEPARABLE_EPSILON 1e-5f
+
+// --- Kernel Algebra --- //
+
+/**
+ * Allocates a zeroed size x size kernel.
+ * @param size The kernel size.
+ * @return Pointer to the allocated kernel, or NULL on failure.
+ */
+float ** kernel_allocate(int size) {
+    if (size <= 0) return NULL;
+    float ** kernel = (float **)malloc(size * sizeof(float *));
+    if (!kernel) {
+        printf("Error: Kernel allocation failed (rows)\n");
+        return NULL;
+    }
+    for (int i = 0; i < size; i++) {
+        kernel[i] = (float *)calloc(size, sizeof(float));
+        if (!kernel[i]) {
+            printf("Error: Kernel allocation failed (row %d)\n", i);
+            freeKernel(kernel, i);
+            return NULL;
+        }
+    }
+    return kernel;
+}
+
+/**
+ * Returns the kernel equivalent to filtering with first, then second.
+ * bmp24_applyFilter correlates, and a correlation followed by a correlation is a correlation
+ * with the full 2-D convolution of the two kernels.
+ * @param first The kernel applied first.
+ * @param sizeFirst Its size (odd).
+ * @param second The kernel applied second.
+ * @param sizeSecond Its size (odd).
+ * @param sizeOut Receives the size of the composed kernel.
+ * @return Pointer to the composed kernel, or NULL on failure.
+ */
+float ** kernel_compose(float ** first, int sizeFirst, float ** second, int sizeSecond, int * sizeOut) {
+    if (!first || !second || sizeFirst % 2 == 0 || sizeSecond % 2 == 0) return NULL;
+
+    int size = sizeFirst + sizeSecond - 1;
+    float ** result = kernel_allocate(size);
+    if (!result) return NULL;
+
+    for (int i1 = 0; i1 < sizeFirst; i1++) {
+        for (int j1 = 0; j1 < sizeFirst; j1++) {
+            float a = first[i1][j1];
+            if (a == 0.0f) continue;
+            for (int i2 = 0; i2 < sizeSecond; i2++) {
+                for (int j2 = 0; j2 < sizeSecond; j2++) {
+                    result[i1 + i2][j1 + j2] += a * second[i2][j2];
+                }
+            }
+        }
+    }
+    if (sizeOut) *sizeOut = size;
+    return result;
+}
+
+/**
+ * Composes a chain of kernels into one kernel.
+ * @param kernels The kernels, in the order they would be applied.
+ * @param sizes Their sizes.
+ * @param count The number of kernels.
+ * @param sizeOut Receives the size of the composed kernel.
+ * @return Pointer to the composed kernel (a copy even for a single kernel), or NULL on failure.
+ */
+float ** kernel_composeChain(float *** kernels, const int * sizes, int count, int * sizeOut) {
+    if (!kernels || !sizes || count <= 0) return NULL;
+
+    // Start from the 1x1 identity so the result is always a fresh allocation
+    float ** composed = kernel_allocate(1);
+    if (!composed) return NULL;
+    composed[0][0] = 1.0f;
+    int size = 1;
+
+    for (int i = 0; i < count; i++) {
+        int newSize;
+        float ** next = kernel_compose(composed, size, kernels[i], sizes[i], &newSize);
+        freeKernel(composed, size);
+        if (!next) return NULL;
+        composed = next;
+        size = newSize;
+    }
+    if (sizeOut) *sizeOut = size;
+    return composed;
+}
+
+/**
+ * Checks whether a kernel keeps outputs within the input range: all weights are
+ * non-negative and sum to at most 1, so no clamping ever happens.
+ * @param kernel The kernel.
+ * @param size Its size.
+ * @return 1 if range preserving, 0 otherwise.
+ */
+int kernel_isRangePreserving(float ** kernel, int size) {
+    float sum = 0.0f;
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            if (kernel[i][j] < 0.0f) return 0;
+            sum += kernel[i][j];
+        }
+    }
+    return sum <= 1.0f + KERNEL_SEPARABLE_EPSILON;
+}
+
+/**
+ * Checks whether applying a chain step by step clamps anywhere before the last step.
+ * @param kernels The kernels, in application order.
+ * @param sizes Their sizes.
+ * @param count The number of kernels.
+ * @return 1 if the composed kernel matches the chain up to rounding, 0 otherwise.
+ */
+int kernel_chainIsExact(float *** kernels, const int * sizes, int count) {
+    for (int i = 0; i + 1 < count; i++) {
+        if (!kernel_isRangePreserving(kernels[i], sizes[i])) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Splits a rank-1 kernel: kernel[i][j] = column[i] * row[j].
+ * @param kernel The kernel.
+ * @param size Its size.
+ * @param column Receives size column weights.
+ * @param row Receives size row weights.
+ * @return 1 if the kernel is separable, 0 otherwise.
+ */
+int kernel_separate(float ** kernel, int size, float * column, float * row) {
+    // Pivot on the largest weight for numerical stability
+    int pi = 0, pj = 0;
+    float maxAbs = 0.0f;
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            if (fabsf(kernel[i][j]) > maxAbs) {
+                maxAbs = fabsf(kernel[i][j]);
+                pi = i;
+                pj = j;
+            }
+        }
+    }
+    if (maxAbs == 0.0f) return 0;
+
+    for (int i = 0; i < size; i++) {
+        column[i] = kernel[i][pj];
+        row[i] = kernel[pi][i] / kernel[pi][pj];
+    }
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            if (fabsf(column[i] * row[j] - kernel[i][j]) > KERNEL_SEPARABLE_EPSILON * maxAbs) return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Returns the kernel that has on an image downscaled by scale (0 < scale <= 1) the effect the
+ * given kernel has at full resolution, for previews on a reduced proxy.
+ * A kernel is split into its sum S (times the identity) and a zero-sum detail part D. At low
+ * frequencies the odd (antisymmetric) half of D acts as a first derivative and the even half
+ * as a second derivative, so shrinking the image by scale shrinks their responses by scale and
+ * scale^2: the result is S * identity + scale * D_odd + scale^2 * D_even, with the same size.
+ * @param kernel The kernel.
+ * @param size Its size (odd).
+ * @param scale The proxy scale.
+ * @return Pointer to the scaled kernel, or NULL on failure.
+ */
+float ** kernel_scale(float ** kernel, int size, float scale) {
+    if (!kernel || size % 2 == 0) return NULL;
+
+    float ** result = kernel_allocate(size);
+    if (!result) return NULL;
+
+    int c = size / 2;
+    float sum = 0.0f;
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) sum += kernel[i][j];
+    }
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            float identity = (i == c && j == c) ? sum : 0.0f;
+            float detail = kernel[i][j] - identity;
+            float mirrored = kernel[size - 1 - i][size - 1 - j] - identity;
+            float even = 0.5f * (detail + mirrored);
+            float odd = 0.5f * (detail - mirrored);
+            result[i][j] = identity + scale * odd + scale * scale * even;
+        }
+    }
+    return result;
+}
+
+// --- Separable Application --- //
+
+// Shared state of a separable filter pass
+typedef struct {
+    t_bmp24 * img;
+    t_pixel ** source;   // Copy of the original pixels
+    const float * column;
+    const float * row;
+    int n;
+} t_separableState;
+
+/**
+ * Filters a band of rows. Each band keeps a ring of kernelSize horizontally filtered rows,
+ * so every source row is filtered horizontally once per band.
+ */
+static void separableRows(int begin, int end, void * ctx) {
+    t_separableState * s = (t_separableState *)ctx;
+    int width = s->img->width, height = s->img->height, n = s->n, size = 2 * n + 1;
+    if (begin < n) begin = n;
+    if (end > height - n) end = height - n;
+    if (begin >= end) return;
+
+    float * ring = (float *)malloc((size_t)size * width * 3 * sizeof(float));
+    if (!ring) {
+        printf("Error: Failed to allocate row buffer for separable filtering\n");
+        return;
+    }
+
+    for (int y = begin - n; y < end + n; y++) {
+        // Horizontal pass of source row y into its ring slot
+        float * h = ring + (size_t)(y % size) * width * 3;
+        const t_pixel * src = s->source[y];
+        for (int x = n; x < width - n; x++) {
+            float r = 0.0f, g = 0.0f, b = 0.0f;
+            for (int k = -n; k <= n; k++) {
+                float w = s->row[k + n];
+                r += src[x + k].red * w;
+                g += src[x + k].green * w;
+                b += src[x + k].blue * w;
+            }
+            h[3 * x] = r;
+            h[3 * x + 1] = g;
+            h[3 * x + 2] = b;
+        }
+
+        // Vertical pass once the ring holds rows out - n .. out + n
+        int out = y - n;
+        if (out < begin) continue;
+        t_pixel * dst = s->img->data[out];
+        for (int x = n; x < width - n; x++) {
+            float r = 0.0f, g = 0.0f, b = 0.0f;
+            for (int k = -n; k <= n; k++) {
+                const float * v = ring + (size_t)((out + k) % size) * width * 3 + 3 * x;
+                float w = s->column[k + n];
+                r += v[0] * w;
+                g += v[1] * w;
+                b += v[2] * w;
+            }
+            dst[x].red = clamp_uint8(r);
+            dst[x].green = clamp_uint8(g);
+            dst[x].blue = clamp_uint8(b);
+        }
+    }
+    free(ring);
+}
+
+/**
+ * Applies a kernel to a 24-bit image. Separable kernels run as a horizontal and a vertical
+ * 1-D pass (2k instead of k*k multiplications per pixel); others go to bmp24_applyFilter.
+ * In linear-light mode every kernel goes to bmp24_applyFilter too, which converts the image to
+ * a 16-bit linear-light planar buffer and runs the full 2-D kernel there (planar_applyFilter);
+ * the separable path is not used, as it works on the encoded bytes.
+ * Border handling matches bmp24_applyFilter.
+ * @param img Pointer to the t_bmp24 structure.
+ * @param kernel The convolution kernel.
+ * @param kernelSize The size of the kernel (must be odd).
+ */
+void kernel_apply(t_bmp24 * img, float ** kernel, int kernelSize) {
+    if (!img || !img->data || !kernel || kernelSize % 2 == 0) {
+        printf("Error: Invalid parameters for filter application\n");
+        return;
+    }
+
+    // The separable path works on the encoded bytes; bmp24_applyFilter converts to linear light
+    if (bmp24_isLinearLight()) {
+        bmp24_applyFilter(img, kernel, kernelSize);
+        return;
+    }
+
+    float * column = (float *)malloc(kernelSize * sizeof(float));
+    float * row = (float *)malloc(kernelSize * sizeof(float));
+    if (kernelSize == 1 || !column || !row || !kernel_separate(kernel, kernelSize, column, row)) {
+        free(column);
+        free(row);
+        bmp24_applyFilter(img, kernel, kernelSize);
+        return;
+    }
+
+    t_pixel ** source = bmp24_allocateDataPixels(img->width, img->height);
+    if (!source) {
+        printf("Error: Failed to allocate temporary buffer for filtering\n");
+        free(column);
+        free(row);
+        return;
+    }
+    for (int y = 0; y < img->height; y++) {
+        memcpy(source[y], img->data[y], img->width * sizeof(t_pixel));
+    }
+
+    t_separableState state = {img, source, column, row, kernelSize / 2};
+    parallel_for(0, img->height, 64, separableRows, &state);
+
+    bmp24_freeDataPixels(source, img->height);
+    free(column);
+    free(row);
+}
+
+/**
+ * Applies a chain of kernels as one composed kernel in a single pass.
+ * See the notes at the top of this file for where the result differs from step-by-step
+ * filtering; callers that must match it check kernel_chainIsExact first.
+ * @param img Pointer to the t_bmp24 structure.
+ * @param kernels The kernels, in application order.
+ * @param sizes Their sizes.
+ * @param count The number of kernels.
+ */
+void kernel_applyChain(t_bmp24 * img, float *** kernels, const int * sizes, int count) {
+    int size;
+    float ** composed = kernel_composeChain(kernels, sizes, count, &size);
+    if (!composed) return;
+
+    kernel_apply(img, composed, size);
+    freeKernel(composed, size);
+}
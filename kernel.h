@@ -0,0 +1,50 @@
+/*
+ * kernel.h
+ * Author: Simon Hillel
+ * Description: Header for convolution kernel algebra.
+ * Declares composition of chained linear filters into one equivalent kernel, separability
+ * detection, and a filter entry point that picks the separable path when it qualifies.
+ */
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include "bmp24.h"
+
+/**
+ * Allocates a zeroed size x size kernel (free with freeKernel).
+ */
+float ** kernel_allocate(int size);
+/**
+ * Returns the kernel equivalent to convolving with first, then second (size sizeA + sizeB - 1).
+ */
+float ** kernel_compose(float ** first, int sizeFirst, float ** second, int sizeSecond, int * sizeOut);
+/**
+ * Composes a chain of kernels, in application order, into one kernel.
+ */
+float ** kernel_composeChain(float *** kernels, const int * sizes, int count, int * sizeOut);
+/**
+ * Returns 1 if the kernel never produces values outside the input range (no clamping needed).
+ */
+int kernel_isRangePreserving(float ** kernel, int size);
+/**
+ * Returns 1 if a chain gives the same result as its composed kernel (no intermediate clamping).
+ */
+int kernel_chainIsExact(float *** kernels, const int * sizes, int count);
+/**
+ * Splits a rank-1 kernel into a column and a row vector; returns 1 if the kernel is separable.
+ */
+int kernel_separate(float ** kernel, int size, float * column, float * row);
+/**
+ * Returns the equivalent of a kernel on an image downscaled by scale (0 < scale <= 1).
+ */
+float ** kernel_scale(float ** kernel, int size, float scale);
+/**
+ * Applies a kernel to a 24-bit image, using two 1-D passes when the kernel is separable.
+ */
+void kernel_apply(t_bmp24 * img, float ** kernel, int kernelSize);
+/**
+ * Applies a chain of kernels as one composed kernel in a single pass.
+ */
+void kernel_applyChain(t_bmp24 * img, float *** kernels, const int * sizes, int count);
+
+#endif // KERNEL_H
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "levels.h"
+
+/*
+ * levels.c
+ * Author: Simon Hillel
+ * Description: Implementation of automatic tone correction.
+ * Both operations take exactly two streaming passes: the fused statistics pass for the
+ * histograms, then one lookup-table pass that rewrites the pixels in place.
+ */
+
+/**
+ * Builds a contrast-stretch lookup table from a channel histogram.
+ * @param channel The channel statistics (histogram).
+ * @param numPixels The number of pixels counted in the histogram.
+ * @param clip The fraction of pixels clipped at each end (e.g. 0.005 for 0.5%).
+ * @param lut Receives the 256-entry table.
+ */
+void levels_stretchLUT(const t_channelStats * channel, uint64_t numPixels, double clip, uint8_t * lut) {
+    if (clip < 0.0) clip = 0.0;
+    if (clip > 0.49) clip = 0.49;
+    uint64_t limit = (uint64_t)(clip * numPixels);
+
+    // Lowest value with more than `limit` pixels at or below it, and symmetrically from the top
+    int low = 0, high = 255;
+    uint64_t count = 0;
+    for (low = 0; low < 255; low++) {
+        count += channel->histogram[low];
+        if (count > limit) break;
+    }
+    count = 0;
+    for (high = 255; high > 0; high--) {
+        count += channel->histogram[high];
+        if (count > limit) break;
+    }
+
+    for (int v = 0; v < 256; v++) {
+        if (high <= low) {
+            lut[v] = (uint8_t)v; // Flat channel: nothing to stretch
+        } else if (v <= low) {
+            lut[v] = 0;
+        } else if (v >= high) {
+            lut[v] = 255;
+        } else {
+            lut[v] = (uint8_t)(((v - low) * 255 + (high - low) / 2) / (high - low));
+        }
+    }
+}
+
+/**
+ * Stretches every channel of a 24-bit image between its clip percentiles.
+ * @param img Pointer to the t_bmp24 structure.
+ * @param clip The fraction of pixels clipped at each end (LEVELS_DEFAULT_CLIP for 0.5%).
+ */
+void levels_autoLevels24(t_bmp24 * img, double clip) {
+    t_imageStats stats;
+    if (stats_computeBmp24(img, &stats) != 0) return;
+
+    uint8_t lut[3][256];
+    for (int c = 0; c < 3; c++) {
+        levels_stretchLUT(&stats.channels[c], stats.numPixels, clip, lut[c]);
+    }
+    bmp24_applyLUT(img, lut[0], lut[1], lut[2]);
+}
+
+/**
+ * Stretches the intensities of an 8-bit image between their clip percentiles.
+ * Indexed images are stretched through their palette.
+ * @param img Pointer to the t_bmp8 structure.
+ * @param clip The fraction of pixels clipped at each end.
+ */
+void levels_autoLevels8(t_bmp8 * img, double clip) {
+    t_imageStats stats;
+    if (stats_computeBmp8(img, &stats) != 0) return;
+
+    uint8_t lut[256];
+    levels_stretchLUT(&stats.channels[0], stats.numPixels, clip, lut);
+    bmp8_applyLUT(img, lut);
+}
+
+/**
+ * Gray-world white balance: scales each channel so that its mean equals the mean of the
+ * three channel means.
+ * @param img Pointer to the t_bmp24 structure.
+ */
+void levels_autoWhiteBalance24(t_bmp24 * img) {
+    t_imageStats stats;
+    if (stats_computeBmp24(img, &stats) != 0) return;
+
+    double gray = (stats.channels[0].mean + stats.channels[1].mean + stats.channels[2].mean) / 3.0;
+    uint8_t lut[3][256];
+    for (int c = 0; c < 3; c++) {
+        double gain = stats.channels[c].mean > 0.0 ? gray / stats.channels[c].mean : 1.0;
+        for (int v = 0; v < 256; v++) {
+            double value = v * gain + 0.5;
+            lut[c][v] = (uint8_t)(value > 255.0 ? 255 : value);
+        }
+    }
+    bmp24_applyLUT(img, lut[0], lut[1], lut[2]);
+}
@@ -0,0 +1,36 @@
+/*
+ * levels.h
+ * Author: Simon Hillel
+ * Description: Header for automatic tone correction functions.
+ * Declares auto-levels (percentile contrast stretch) and auto white balance, which derive
+ * per-channel lookup tables from one histogram pass and apply them in a second pass.
+ */
+#ifndef LEVELS_H
+#define LEVELS_H
+
+#include <stdint.h>
+#include "bmp8.h"
+#include "bmp24.h"
+#include "stats.h"
+
+// Default fraction of pixels clipped at each end by auto-levels (0.5%)
+#define LEVELS_DEFAULT_CLIP 0.005
+
+/**
+ * Builds a contrast-stretch table mapping the clip and 1 - clip percentiles of a histogram to 0 and 255.
+ */
+void levels_stretchLUT(const t_channelStats * channel, uint64_t numPixels, double clip, uint8_t * lut);
+/**
+ * Stretches every channel of a 24-bit image between its clip percentiles (two passes, no temporaries).
+ */
+void levels_autoLevels24(t_bmp24 * img, double clip);
+/**
+ * Stretches the intensities of an 8-bit image between their clip percentiles.
+ */
+void levels_autoLevels8(t_bmp8 * img, double clip);
+/**
+ * Scales the channels of a 24-bit image so their means match (gray-world white balance).
+ */
+void levels_autoWhiteBalance24(t_bmp24 * img);
+
+#endif // LEVELS_H
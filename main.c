@@ -4,6 +4,16 @@
 #include <ctype.h>
 #include "bmp8.h"
 #include "bmp24.h"
+#include "stats.h"
+#include "editstack.h"
+#include "preview.h"
+#include "daemon.h"
+#include "shmimage.h"
+#include "batch.h"
+#include "bmpio.h"
+#include "catalog.h"
+#include "phash.h"
+#include "unsharp.h"
 
 /*
  * main.c
@@ -22,41 +32,23 @@ typedef enum {
 
 /**
  * Checks the BMP type (8-bit or 24-bit) of a file without fully loading it.
+ * The headers are read with a single pread (bmpio_probe).
  * @param filename The path to the BMP file.
  * @return IMAGE_TYPE_BMP8, IMAGE_TYPE_BMP24, or IMAGE_TYPE_NONE.
  */
 ImageType check_bmp_type(const char * filename) {
-    FILE * file = fopen(filename, "rb");
-    if (!file) {
-        printf("Error: Cannot open file %s to check type.\n", filename);
+    t_bmpFields fields;
+    if (bmpio_probe(filename, &fields) != 0) {
+        printf("Error: Cannot read a BMP header from %s\n", filename);
         return IMAGE_TYPE_NONE;
     }
 
-    uint16_t type_magic;
-    uint16_t depth;
-
-    // Check magic number
-    if (fread(&type_magic, sizeof(uint16_t), 1, file) != 1 || type_magic != BMP_TYPE) {
-        printf("Error: Invalid BMP magic number in %s\n", filename);
-        fclose(file);
-        return IMAGE_TYPE_NONE;
-    }
-
-    // Check color depth (offset 28)
-    if (fseek(file, BITMAP_DEPTH_OFFSET, SEEK_SET) != 0 || fread(&depth, sizeof(uint16_t), 1, file) != 1) {
-        printf("Error: Could not read color depth from %s\n", filename);
-        fclose(file);
-        return IMAGE_TYPE_NONE;
-    }
-
-    fclose(file);
-
-    if (depth == 8) {
+    if (fields.bits == 8) {
         return IMAGE_TYPE_BMP8;
-    } else if (depth == 24) {
+    } else if (fields.bits == 24) {
         return IMAGE_TYPE_BMP24;
     } else {
-        printf("Error: Unsupported BMP color depth (%u) in %s\n", depth, filename);
+        printf("Error: Unsupported BMP color depth (%u) in %s\n", fields.bits, filename);
         return IMAGE_TYPE_NONE;
     }
 }
@@ -78,7 +70,12 @@ void displayMenu() {
     printf("2. Save an image\n");
     printf("3. Apply a filter\n");
     printf("4. Display image information\n");
-    printf("5. Quit\n");
+    printf("5. Edit history\n");
+    printf("6. Undo\n");
+    printf("7. Redo\n");
+    printf("8. Preview mode (on/off)\n");
+    printf("9. Cancel background save\n");
+    printf("10. Quit\n");
     printf(">>> Your choice: ");
 }
 
@@ -95,181 +92,668 @@ void displayFilterMenu() {
     printf("6. Sharpness\n");
     printf("7. Outline\n");
     printf("8. Emboss\n");
-    printf("9. Return to the previous menu\n");
+    printf("9. Histogram equalization\n");
+    printf("10. Sepia\n");
+    printf("11. Channel swap\n");
+    printf("12. Saturation\n");
+    printf("13. White balance\n");
+    printf("14. Unsharp mask\n");
+    printf("15. Auto levels\n");
+    printf("16. Auto white balance\n");
+    printf("17. Return to the previous menu\n");
+    printf(">>> Your choice: ");
+}
+
+/**
+ * Writes a string as a JSON string literal, escaping quotes, backslashes and control characters.
+ * @param out The output stream.
+ * @param text The string to write.
+ */
+void printJSONString(FILE * out, const char * text) {
+    fputc('"', out);
+    for (const unsigned char * c = (const unsigned char *)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * Command-line mode: prints the dimensions and pixel statistics of an image as JSON.
+ * @param filename The path to the BMP file.
+ * @return 0 on success, 1 on failure.
+ */
+int runStatsCommand(const char * filename) {
+    ImageType type = check_bmp_type(filename);
+    t_imageStats stats;
+    int width, height, depth;
+
+    if (type == IMAGE_TYPE_BMP24) {
+        t_bmp24 * img = bmp24_loadImage(filename);
+        if (!img) return 1;
+        width = img->width;
+        height = img->height;
+        depth = 24;
+        stats_computeBmp24(img, &stats);
+        bmp24_free(img);
+    } else if (type == IMAGE_TYPE_BMP8) {
+        t_bmp8 * img = bmp8_loadImage(filename);
+        if (!img) return 1;
+        width = img->width;
+        height = img->height;
+        depth = 8;
+        stats_computeBmp8(img, &stats);
+        bmp8_free(img);
+    } else {
+        return 1;
+    }
+
+    printf("{\"file\": ");
+    printJSONString(stdout, filename);
+    printf(", \"width\": %d, \"height\": %d, \"colorDepth\": %d, \"stats\": ", width, height, depth);
+    stats_printJSON(&stats, stdout);
+    printf("}\n");
+    return 0;
+}
+
+/**
+ * Command-line mode: copies a BMP file into a new POSIX shared-memory segment, for the
+ * daemon's shm: inputs. The segment stays until shm-import or shm_unlink removes it.
+ * @param filename The path to the BMP file.
+ * @param name The segment name ("/name").
+ * @return 0 on success, 1 on failure.
+ */
+int runShmExportCommand(const char * filename, const char * name) {
+    ImageType type = check_bmp_type(filename);
+    t_shmImage * shm = NULL;
+    int status = -1;
+
+    if (type == IMAGE_TYPE_BMP24) {
+        t_bmp24 * img = bmp24_loadImage(filename);
+        if (!img) return 1;
+        shm = shmImage_create(name, SHM_FORMAT_BGR24, img->width, img->height);
+        if (shm) status = shmImage_store24(shm, img);
+        bmp24_free(img);
+    } else if (type == IMAGE_TYPE_BMP8) {
+        t_bmp8 * img = bmp8_loadImage(filename);
+        if (!img) return 1;
+        shm = shmImage_create(name, SHM_FORMAT_GRAY8, img->width, img->height);
+        if (shm) status = shmImage_store8(shm, img);
+        bmp8_free(img);
+    }
+    if (!shm) return 1;
+
+    printf("%s: %ux%u, %u-bit, stride %d\n", shm->handle, shm->descriptor.width, shm->descriptor.height,
+           shm->descriptor.format, shm->descriptor.stride);
+    shmImage_close(shm);
+    return status == 0 ? 0 : 1;
+}
+
+/**
+ * Command-line mode: saves a shared-memory segment as a BMP file and unlinks it.
+ * @param name The segment name ("/name").
+ * @param filename The path of the BMP file to write.
+ * @return 0 on success, 1 on failure.
+ */
+int runShmImportCommand(const char * name, const char * filename) {
+    t_shmImage * shm = shmImage_open(name);
+    if (!shm) return 1;
+
+    int status = shm->img24 ? bmp24_saveImage(shm->img24, filename) : bmp8_saveImage(filename, shm->img8);
+    shmImage_close(shm);
+    if (status != 0) return 1;
+    shmImage_unlink(name);
+    return 0;
+}
+
+/**
+ * Command-line mode: rewrites a colour image as a top-down BMP, streaming its rows top row
+ * first through the row writer, so the output can go to a pipe.
+ * @param input The path to the 24-bit BMP file.
+ * @param output The path of the file to write, or "-" for standard output.
+ * @return 0 on success, 1 on failure.
+ */
+int runTopDownCommand(const char * input, const char * output) {
+    t_bmp24 * img = bmp24_loadImage(input);
+    if (!img) return 1;
+
+    t_bmpWriter * writer = bmpio_openWriter(output, img->width, img->height, 1);
+    for (int y = 0; writer && y < img->height; y++) {
+        if (bmpio_writeRow(writer, img->data[y]) != 0) break;
+    }
+    int status = writer ? bmpio_closeWriter(writer, 0) : -1;
+    bmp24_free(img);
+    return status == 0 ? 0 : 1;
+}
+
+/**
+ * Command-line mode: loads and saves an image in each I/O mode (buffered, nocache, direct)
+ * and prints the bandwidth achieved, to compare them on the same file system.
+ * @param input The path to the BMP file.
+ * @param output The path of the copy to write (left in place).
+ * @param rounds The number of load and save rounds per mode.
+ * @return 0 on success, 1 on failure.
+ */
+int runIoBenchCommand(const char * input, const char * output, int rounds) {
+    ImageType type = check_bmp_type(input);
+    if (type != IMAGE_TYPE_BMP24 && type != IMAGE_TYPE_BMP8) return 1;
+    if (rounds <= 0) rounds = 3;
+
+    for (int mode = BMPIO_MODE_BUFFERED; mode <= BMPIO_MODE_DIRECT; mode++) {
+        bmpio_setMode((t_ioMode)mode);
+        t_ioStats before, after;
+        bmpio_stats(&before);
+        for (int i = 0; i < rounds; i++) {
+            if (type == IMAGE_TYPE_BMP24) {
+                t_bmp24 * img = bmp24_loadImage(input);
+                if (!img) return 1;
+                bmp24_saveImage(img, output);
+                bmp24_free(img);
+            } else {
+                t_bmp8 * img = bmp8_loadImage(input);
+                if (!img) return 1;
+                bmp8_saveImage(output, img);
+                bmp8_free(img);
+            }
+        }
+        bmpio_stats(&after);
+
+        double readSeconds = after.readSeconds - before.readSeconds;
+        double writeSeconds = after.writeSeconds - before.writeSeconds;
+        unsigned long long readBytes = after.readBytes - before.readBytes;
+        unsigned long long writtenBytes = after.writtenBytes - before.writtenBytes;
+        printf("%-8s  load %7.0f MB/s  save %7.0f MB/s  (%d round(s), %.1f MB each)\n",
+               bmpio_modeName((t_ioMode)mode),
+               readSeconds > 0 ? readBytes / 1e6 / readSeconds : 0.0,
+               writeSeconds > 0 ? writtenBytes / 1e6 / writeSeconds : 0.0,
+               rounds, readBytes / 1e6 / rounds);
+    }
+    return 0;
+}
+
+/**
+ * Command-line mode: scans a directory tree for BMP files and prints their header fields,
+ * reusing the index of the previous scan for the files that did not change.
+ * @param dir The directory to scan.
+ * @param indexPath The path of the index, or NULL for <dir>/.catalog.
+ * @return 0 on success, 1 on failure.
+ */
+int runCatalogCommand(const char * dir, const char * indexPath) {
+    double start = bmpio_now();
+    t_catalog * catalog = catalog_scan(dir, indexPath);
+    if (!catalog) return 1;
+    double elapsed = bmpio_now() - start;
+
+    int invalid = 0;
+    for (int i = 0; i < catalog->count; i++) {
+        const t_catalogEntry * entry = &catalog->entries[i];
+        if (!entry->valid) {
+            printf("%s  (not a BMP file)\n", entry->path);
+            invalid++;
+            continue;
+        }
+        printf("%s  %dx%d  %u-bit%s%s  %llu bytes\n", entry->path, entry->width,
+               entry->height < 0 ? -entry->height : entry->height, entry->depth,
+               entry->height < 0 ? "  top-down" : "", entry->compression ? "  compressed" : "",
+               (unsigned long long)entry->size);
+    }
+    printf("[catalog] %d file(s), %d header(s) read, %d unchanged, %d invalid, %.1f ms\n",
+           catalog->count, catalog->rescanned, catalog->reused, invalid, elapsed * 1000.0);
+    catalog_free(catalog);
+    return 0;
+}
+
+/**
+ * Command-line mode: prints the perceptual hashes of BMP files, computed from their rows as
+ * they are read.
+ * @param argc The number of files.
+ * @param files The paths of the files.
+ * @return 0 if every file was hashed, 1 otherwise.
+ */
+int runHashCommand(int argc, char * files[]) {
+    int status = 0;
+    for (int i = 0; i < argc; i++) {
+        t_imageHash hash;
+        if (phash_file(files[i], &hash) != 0) {
+            printf("Error: Cannot hash %s\n", files[i]);
+            status = 1;
+            continue;
+        }
+        printf("%016llx %016llx %s\n", (unsigned long long)hash.phash, (unsigned long long)hash.dhash, files[i]);
+    }
+    return status;
+}
+
+/**
+ * Prints the command-line usage.
+ * @param program The program name (argv[0]).
+ */
+void printUsage(const char * program) {
+    printf("Usage:\n");
+    printf("  %s                 Interactive menu\n", program);
+    printf("  %s stats <file>    Print pixel statistics as JSON\n", program);
+    printf("  %s daemon <socket> Serve filter requests on a Unix domain socket (see image_client)\n", program);
+    printf("  %s batch <manifest> [workers]  Run the jobs of a manifest with worker processes (resumable)\n", program);
+    printf("  %s topdown <file> <out|->  Rewrite a colour image top-down, rows streamed in order\n", program);
+    printf("  %s shm-export <file> <name>  Copy an image into the shared-memory segment <name>\n", program);
+    printf("  %s shm-import <name> <file>  Save the segment <name> as a BMP file and remove it\n", program);
+    printf("  %s catalog <dir> [index]  List the BMP headers under a directory (incremental index)\n", program);
+    printf("  %s hash <file>...  Print the pHash and dHash of BMP files\n", program);
+    printf("  %s dedup <dir> [distance]  Group the near-duplicate BMP files under a directory\n", program);
+    printf("  %s iobench <file> <out> [rounds]  Compare load/save bandwidth of the I/O modes\n", program);
+}
+
+/**
+ * Dispatches a command-line invocation.
+ * @param argc The argument count.
+ * @param argv The arguments.
+ * @return The process exit code.
+ */
+int runCommand(int argc, char * argv[]) {
+    if (strcmp(argv[1], "stats") == 0 && argc == 3) {
+        return runStatsCommand(argv[2]);
+    }
+    if (strcmp(argv[1], "daemon") == 0 && argc == 3) {
+        return daemon_run(argv[2]);
+    }
+    if (strcmp(argv[1], "batch") == 0 && (argc == 3 || argc == 4)) {
+        return batch_run(argv[2], argc == 4 ? atoi(argv[3]) : 0);
+    }
+    if (strcmp(argv[1], "topdown") == 0 && argc == 4) {
+        return runTopDownCommand(argv[2], argv[3]);
+    }
+    if (strcmp(argv[1], "shm-export") == 0 && argc == 4) {
+        return runShmExportCommand(argv[2], argv[3]);
+    }
+    if (strcmp(argv[1], "shm-import") == 0 && argc == 4) {
+        return runShmImportCommand(argv[2], argv[3]);
+    }
+    if (strcmp(argv[1], "catalog") == 0 && (argc == 3 || argc == 4)) {
+        return runCatalogCommand(argv[2], argc == 4 ? argv[3] : NULL);
+    }
+    if (strcmp(argv[1], "hash") == 0 && argc >= 3) {
+        return runHashCommand(argc - 2, argv + 2);
+    }
+    if (strcmp(argv[1], "dedup") == 0 && (argc == 3 || argc == 4)) {
+        return phash_findDuplicates(argv[2], argc == 4 ? atoi(argv[3]) : -1) == 0 ? 0 : 1;
+    }
+    if (strcmp(argv[1], "iobench") == 0 && (argc == 4 || argc == 5)) {
+        return runIoBenchCommand(argv[2], argv[3], argc == 5 ? atoi(argv[4]) : 0);
+    }
+    printUsage(argv[0]);
+    return 1;
+}
+
+/**
+ * Reads a step from the filter menu.
+ * @param isColor 1 for a colour image, 0 for an 8-bit image.
+ * @param op Receives the step.
+ * @return 1 if a step was chosen, 0 otherwise (return to menu or invalid input).
+ */
+int readFilterOp(int isColor, t_editOp * op) {
+    int filterChoice;
+
+    displayFilterMenu();
+    if (scanf("%d", &filterChoice) != 1) {
+        printf("Invalid input. Please enter a number.\n");
+        clear_input_buffer();
+        return 0;
+    }
+    clear_input_buffer();
+
+    memset(op, 0, sizeof(*op));
+    switch (filterChoice) {
+        case 1: op->type = EDIT_NEGATIVE; break;
+        case 2:
+            op->type = EDIT_BRIGHTNESS;
+            printf("Enter brightness value (-255 to 255): ");
+            if (scanf("%d", &op->param) != 1) {
+                printf("Invalid input.\n");
+                clear_input_buffer();
+                return 0;
+            }
+            clear_input_buffer();
+            break;
+        case 3:
+            op->type = EDIT_BLACK_WHITE;
+            if (!isColor) op->param = 128; // Default threshold
+            break;
+        case 4: op->type = EDIT_BOX_BLUR; break;
+        case 5: op->type = EDIT_GAUSSIAN_BLUR; break;
+        case 6: op->type = EDIT_SHARPEN; break;
+        case 7: op->type = EDIT_OUTLINE; break;
+        case 8: op->type = EDIT_EMBOSS; break;
+        case 9: op->type = EDIT_EQUALIZE; break;
+        case 10: op->type = EDIT_SEPIA; break;
+        case 11: {
+            char order[8];
+            op->type = EDIT_CHANNEL_SWAP;
+            printf("Enter the new channel order (e.g. bgr swaps red and blue): ");
+            if (scanf("%7s", order) != 1 || strlen(order) != 3 || !strchr("rgb", order[0]) ||
+                !strchr("rgb", order[1]) || !strchr("rgb", order[2])) {
+                printf("Invalid input.\n");
+                clear_input_buffer();
+                return 0;
+            }
+            clear_input_buffer();
+            for (int i = 0; i < 3; i++) op->values[i] = (int)(strchr("rgb", order[i]) - "rgb");
+            break;
+        }
+        case 12:
+            op->type = EDIT_SATURATION;
+            printf("Enter saturation in percent (0 = gray, 100 = unchanged): ");
+            if (scanf("%d", &op->param) != 1) {
+                printf("Invalid input.\n");
+                clear_input_buffer();
+                return 0;
+            }
+            clear_input_buffer();
+            break;
+        case 13:
+            op->type = EDIT_WHITE_BALANCE;
+            printf("Enter red, green and blue gains in percent, 0 to %d (e.g. 110 100 90): ", COLORMATRIX_MAX_GAIN);
+            if (scanf("%d %d %d", &op->values[0], &op->values[1], &op->values[2]) != 3 ||
+                op->values[0] < 0 || op->values[0] > COLORMATRIX_MAX_GAIN || op->values[1] < 0 ||
+                op->values[1] > COLORMATRIX_MAX_GAIN || op->values[2] < 0 || op->values[2] > COLORMATRIX_MAX_GAIN) {
+                printf("Invalid input.\n");
+                clear_input_buffer();
+                return 0;
+            }
+            clear_input_buffer();
+            break;
+        case 14: {
+            float radius;
+            op->type = EDIT_UNSHARP;
+            printf("Enter amount in percent, radius in pixels and threshold (e.g. 150 1.0 4): ");
+            if (scanf("%d %f %d", &op->values[0], &radius, &op->values[2]) != 3 || radius < 0.1f ||
+                radius > UNSHARP_MAX_RADIUS || op->values[0] < 0 || op->values[0] > UNSHARP_MAX_AMOUNT || op->values[2] < 0 || op->values[2] > 255) {
+                printf("Invalid input.\n");
+                clear_input_buffer();
+                return 0;
+            }
+            clear_input_buffer();
+            op->values[1] = (int)(radius * 10.0f + 0.5f);
+            break;
+        }
+        case 15: op->type = EDIT_AUTO_LEVELS; break;
+        case 16: op->type = EDIT_AUTO_WHITE_BALANCE; break;
+        case 17: return 0;
+        default:
+            printf("Invalid filter choice.\n");
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * Edit history menu: lists the applied steps and lets the user change the value of a step
+ * or remove it. Only the steps after the edited one are recomputed.
+ * @param stack The edit stack of the current image.
+ * @param proxy The edit stack of the preview, kept in step with stack (NULL outside preview mode).
+ */
+void editHistoryMenu(t_editStack * stack, t_editStack * proxy) {
+    int action, step, value;
+
+    editStack_print(proxy ? proxy : stack);
+    if (stack->numOps == 0) return;
+
+    printf("\n1. Change a step value\n");
+    printf("2. Remove a step\n");
+    printf("3. Return to the previous menu\n");
     printf(">>> Your choice: ");
+    if (scanf("%d", &action) != 1 || action < 1 || action > 2) {
+        clear_input_buffer();
+        return;
+    }
+    printf("Step number: ");
+    if (scanf("%d", &step) != 1 || step < 1 || step > stack->numOps) {
+        printf("Invalid step.\n");
+        clear_input_buffer();
+        return;
+    }
+    clear_input_buffer();
+
+    if (action == 2) {
+        if (proxy) editStack_remove(proxy, step - 1);
+        if (editStack_remove(stack, step - 1) == 0) printf("Step removed.\n");
+        return;
+    }
+
+    t_editOp op = stack->ops[step - 1];
+    if (op.type == EDIT_BRIGHTNESS) {
+        printf("Enter brightness value (-255 to 255): ");
+    } else if (op.type == EDIT_SATURATION) {
+        printf("Enter saturation in percent (0 = gray, 100 = unchanged): ");
+    } else if (op.type == EDIT_BLACK_WHITE && !stack->isColor) {
+        printf("Enter threshold (0 to 255): ");
+    } else {
+        printf("This step has no value to change.\n");
+        return;
+    }
+    if (scanf("%d", &value) != 1) {
+        printf("Invalid input.\n");
+        clear_input_buffer();
+        return;
+    }
+    clear_input_buffer();
+    op.param = value;
+    op.seconds = 0.0;
+    if (proxy) editStack_replace(proxy, step - 1, op);
+    if (editStack_replace(stack, step - 1, op) == 0) printf("Step updated.\n");
+}
+
+/**
+ * Waits for a background save, releases it and reports how it ended.
+ * @param job The job pointer; set to NULL.
+ */
+void finishSaveJob(t_saveJob ** job) {
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s", (*job)->filename);
+    t_saveJobState state = preview_finishSave(*job);
+    if (state == SAVE_JOB_DONE) {
+        printf("Background save of %s finished.\n", filename);
+    } else if (state == SAVE_JOB_FAILED) {
+        printf("Error: Background save of %s failed.\n", filename);
+    } else {
+        printf("Background save of %s cancelled.\n", filename);
+    }
+    *job = NULL;
+}
+
+/**
+ * Reports a background save that has ended and releases it.
+ * @param job The job pointer; set to NULL once the job has ended.
+ */
+void checkSaveJob(t_saveJob ** job) {
+    if (!*job || preview_saveState(*job) == SAVE_JOB_RUNNING) return;
+    finishSaveJob(job);
 }
 
 /**
  * Main entry point for the image processing program.
- * Handles user interaction, image loading/saving, and filter application.
+ * Without arguments, handles user interaction, image loading/saving, and filter application
+ * through the menu; with arguments, runs a single command.
+ * Filters are recorded on an edit stack over the loaded image, so earlier steps can be
+ * changed or removed later without reloading. In preview mode they are shown on a reduced
+ * proxy, and the full-resolution image is only rendered when saving, in the background.
  */
-int main() {
-    ImageType currentImageType = IMAGE_TYPE_NONE;
-    t_bmp8 * currentImage8 = NULL;
-    t_bmp24 * currentImage24 = NULL;
+int main(int argc, char * argv[]) {
+    // IMAGE_LINEAR_LIGHT=1 convolves in linear light (see bmp24_setLinearLight)
+    const char * linearEnv = getenv("IMAGE_LINEAR_LIGHT");
+    if (linearEnv && strtol(linearEnv, NULL, 10) != 0) bmp24_setLinearLight(1);
+
+    if (argc > 1) {
+        return runCommand(argc, argv);
+    }
+
+    t_editStack * stack = NULL;
+    t_preview * preview = NULL;
+    t_saveJob * saveJob = NULL;
+    int previewMode = 0;
+    t_editOp op;
 
     char filename[256];
-    int choice, filterChoice, brightness;
-    int isColor = 0;  // 0 for grayscale, 1 for color
+    int choice;
 
     while (1) {
+        checkSaveJob(&saveJob);
         displayMenu();
         scanf("%d", &choice);
+        checkSaveJob(&saveJob);
 
         switch (choice) {
-            case 1:  // Open image
-                // Free previously loaded images to prevent memory leaks
-                if (currentImage24) { bmp24_free(currentImage24); currentImage24 = NULL; }
-                if (currentImage8) { bmp8_free(currentImage8); currentImage8 = NULL; }
+            case 1: {  // Open image
+                // Free the previous image and its history to prevent memory leaks
+                preview_free(preview, stack);
+                preview = NULL;
+                editStack_free(stack);
+                stack = NULL;
                 printf("File path: ");
                 scanf("%255s", filename);
                 clear_input_buffer();
                 // Try to load as color image first
-                currentImage24 = bmp24_loadImage(filename);
-                if (currentImage24) {
-                    isColor = 1;
-                    currentImageType = IMAGE_TYPE_BMP24;
+                t_bmp24 * image24 = bmp24_loadImage(filename);
+                if (image24) {
+                    stack = editStack_create24(image24, 0);
                     printf("Color image loaded successfully!\n");
                 } else {
                     // If color loading fails, try grayscale
-                    currentImage8 = bmp8_loadImage(filename);
-                    if (currentImage8) {
-                        isColor = 0;
-                        currentImageType = IMAGE_TYPE_BMP8;
+                    t_bmp8 * image8 = bmp8_loadImage(filename);
+                    if (image8) {
+                        stack = editStack_create8(image8, 0);
                         printf("Grayscale image loaded successfully!\n");
                     } else {
                         printf("Error: Could not load image. Please check the file path and format.\n");
                     }
                 }
+                if (stack && previewMode) preview = preview_create(stack);
                 break;
+            }
 
             case 2:  // Save image
                 printf("File path: ");
                 scanf("%255s", filename);
                 clear_input_buffer();
-                if (isColor && currentImage24) {
-                    bmp24_saveImage(currentImage24, filename);
-                    printf("Color image saved successfully!\n");
-                } else if (!isColor && currentImage8) {
-                    bmp8_saveImage(filename, currentImage8);
-                    printf("Grayscale image saved successfully!\n");
-                } else {
+                if (!stack) {
                     printf("Error: No image loaded. Please open an image first.\n");
+                } else if (preview) {
+                    // Render the full-resolution image in the background
+                    if (saveJob) {
+                        printf("Error: A background save is already running.\n");
+                    } else {
+                        saveJob = preview_startSave(stack, filename);
+                        if (saveJob) printf("Saving %s in the background.\n", filename);
+                    }
+                } else if (stack->isColor) {
+                    if (bmp24_saveImage(editStack_current24(stack), filename) == 0) {
+                        printf("Color image saved successfully!\n");
+                    }
+                } else {
+                    if (bmp8_saveImage(filename, editStack_current8(stack)) == 0) {
+                        printf("Grayscale image saved successfully!\n");
+                    }
                 }
                 break;
 
             case 3:  // Apply filter
                 // Ensure an image is loaded before applying a filter
-                if ((!isColor && !currentImage8) || (isColor && !currentImage24)) {
+                if (!stack) {
                     printf("Error: No image loaded. Please open an image first.\n");
                     break;
                 }
+                if (!readFilterOp(stack->isColor, &op)) continue;
+                if (!editStack_supports(stack, op)) {
+                    printf("Error: %s is not available for grayscale images.\n", editStack_opName(op.type));
+                    break;
+                }
+                if (preview) editStack_push(preview->proxy, op);
+                if (editStack_push(stack, op) == 0) {
+                    printf("Filter applied successfully!\n");
+                }
+                if (preview) preview_report(preview);
+                break;
+
+            case 4:  // Display image information
+                if (preview) {
+                    preview_printInfo(preview);
+                } else if (stack && stack->isColor) {
+                    bmp24_printInfo(editStack_current24(stack));
+                } else if (stack) {
+                    bmp8_printInfo(editStack_current8(stack));
+                } else {
+                    printf("Error: No image loaded. Please open an image first.\n");
+                }
+                break;
 
-                displayFilterMenu();
-                if (scanf("%d", &filterChoice) != 1) {
-                    printf("Invalid input. Please enter a number.\n");
-                    clear_input_buffer();
+            case 5:  // Edit history
+                if (!stack) {
+                    printf("Error: No image loaded. Please open an image first.\n");
                     break;
                 }
-                clear_input_buffer();
+                editHistoryMenu(stack, preview ? preview->proxy : NULL);
+                break;
 
-                // Apply the selected filter based on image type
-                if (isColor) {
-                    switch (filterChoice) {
-                        case 1:
-                            bmp24_negative(currentImage24);
-                            break;
-                        case 2:
-                            printf("Enter brightness value (-255 to 255): ");
-                            if (scanf("%d", &brightness) != 1) {
-                                printf("Invalid input.\n");
-                                clear_input_buffer();
-                                break;
-                            }
-                            clear_input_buffer();
-                            bmp24_brightness(currentImage24, brightness);
-                            break;
-                        case 3:
-                            bmp24_grayscale(currentImage24);
-                            break;
-                        case 4:
-                            bmp24_boxBlur(currentImage24);
-                            break;
-                        case 5:
-                            bmp24_gaussianBlur(currentImage24);
-                            break;
-                        case 6:
-                            bmp24_sharpen(currentImage24);
-                            break;
-                        case 7:
-                            bmp24_outline(currentImage24);
-                            break;
-                        case 8:
-                            bmp24_emboss(currentImage24);
-                            break;
-                        case 9:
-                            continue;
-                        default:
-                            printf("Invalid filter choice.\n");
-                            continue;
-                    }
+            case 6:  // Undo
+                if (!stack) {
+                    printf("Error: No image loaded. Please open an image first.\n");
+                } else if (editStack_undo(stack) == 0) {
+                    if (preview) editStack_undo(preview->proxy);
+                    printf("Undone.\n");
                 } else {
-                    switch (filterChoice) {
-                        case 1:
-                            bmp8_negative(currentImage8);
-                            break;
-                        case 2:
-                            printf("Enter brightness value (-255 to 255): ");
-                            if (scanf("%d", &brightness) != 1) {
-                                printf("Invalid input.\n");
-                                clear_input_buffer();
-                                break;
-                            }
-                            clear_input_buffer();
-                            bmp8_brightness(currentImage8, brightness);
-                            break;
-                        case 3:
-                            bmp8_threshold(currentImage8, 128); // Example threshold
-                            break;
-                        case 4:
-                            // Add box blur for grayscale if implemented
-                            break;
-                        case 5:
-                            // Add gaussian blur for grayscale if implemented
-                            break;
-                        case 6:
-                            // Add sharpen for grayscale if implemented
-                            break;
-                        case 7:
-                            // Add outline for grayscale if implemented
-                            break;
-                        case 8:
-                            // Add emboss for grayscale if implemented
-                            break;
-                        case 9:
-                            continue;
-                        default:
-                            printf("Invalid filter choice.\n");
-                            continue;
+                    printf("Nothing to undo.\n");
+                }
+                break;
+
+            case 7:  // Redo
+                if (!stack) {
+                    printf("Error: No image loaded. Please open an image first.\n");
+                } else if (editStack_redo(stack) == 0) {
+                    // The proxy has no redo history for steps undone before preview mode was enabled
+                    if (preview && editStack_redo(preview->proxy) != 0) {
+                        editStack_push(preview->proxy, stack->ops[stack->numOps - 1]);
                     }
+                    printf("Redone.\n");
+                } else {
+                    printf("Nothing to redo.\n");
                 }
-                printf("Filter applied successfully!\n");
                 break;
 
-            case 4:  // Display image information
-                if (isColor && currentImage24) {
-                    bmp24_printInfo(currentImage24);
-                } else if (!isColor && currentImage8) {
-                    bmp8_printInfo(currentImage8);
+            case 8:  // Preview mode
+                previewMode = !previewMode;
+                if (previewMode) {
+                    if (stack) preview = preview_create(stack);
+                    printf("Preview mode on: filters are shown on a reduced copy, the full image is rendered on save.\n");
+                    if (preview) preview_report(preview);
                 } else {
-                    printf("Error: No image loaded. Please open an image first.\n");
+                    preview_free(preview, stack);
+                    preview = NULL;
+                    printf("Preview mode off.\n");
+                }
+                break;
+
+            case 9:  // Cancel background save
+                if (saveJob) {
+                    preview_cancelSave(saveJob);
+                    printf("Cancelling the background save...\n");
+                    finishSaveJob(&saveJob);
+                } else {
+                    printf("No background save is running.\n");
                 }
                 break;
 
-            case 5:  // Quit
-                // Free any loaded images before exiting
-                if (currentImage24) bmp24_free(currentImage24);
-                if (currentImage8) bmp8_free(currentImage8);
+            case 10:  // Quit
+                // Let a background save finish, then free the image and its history before exiting
+                if (saveJob) {
+                    printf("Waiting for the background save to finish...\n");
+                    finishSaveJob(&saveJob);
+                }
+                preview_free(preview, stack);
+                editStack_free(stack);
                 printf("Goodbye!\n");
                 return 0;
 
@@ -279,4 +763,4 @@ int main() {
         }
     }
     return 0;
-} 
\ No newline at end of file
+}
@@ -0,0 +1,413 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "parallel.h"
+
+/*
+ * parallel.c
+ * Author: Simon Hillel
+ * Description: Implementation of the process-wide work-stealing scheduler.
+ * A pool of worker threads is started on first use and shared by every operation, so a chain
+ * such as blur -> equalize -> save does not create threads per step. Each worker owns a deque:
+ * it pushes and pops at the bottom (most recent, cache-warm work first) and idle workers steal
+ * from the top of other deques (the oldest, largest ranges). Threads that are not workers
+ * (e.g. the main thread) share deque 0. A thread waiting for its parallel_for runs queued tasks
+ * instead of blocking, so nested parallel_for calls cannot starve the pool.
+ *
+ * Configuration (parallel_configure or environment, read when the pool starts):
+ *  - IMAGE_THREADS: number of threads, the calling thread included (default: online CPUs)
+ *  - IMAGE_PIN_THREADS=1: pin worker i to CPU i modulo the CPU count
+ *  - IMAGE_SERIAL=1: run everything on the calling thread, in index order
+ */
+
+// Upper bound on worker threads, to keep the per-worker arrays static
+#define PARALLEL_MAX_THREADS 64
+// Initial capacity of each deque (grows on demand)
+#define PARALLEL_DEQUE_CAPACITY 64
+// How long a waiting thread sleeps before looking for stealable work again
+#define PARALLEL_WAIT_NS 1000000
+
+// Completion tracking of one parallel_for call
+typedef struct {
+    atomic_int pending;       // Tasks not finished yet; only reaches 0 under lock
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+} t_taskGroup;
+
+// A range of a parallel_for; split in halves until it is at most grain wide
+typedef struct {
+    void (*body)(int begin, int end, void *ctx);
+    void *ctx;
+    int begin;
+    int end;
+    int grain;
+    t_taskGroup *group;
+} t_task;
+
+// Double-ended task queue of one worker (a ring buffer under a lock)
+typedef struct {
+    pthread_mutex_t lock;
+    t_task *tasks;
+    int capacity;
+    int head;                 // Oldest task (steal end)
+    int count;
+} t_deque;
+
+// Pool state
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int poolRunning = 0;
+static int poolThreads = 1;
+static int poolSerial = 0;
+static t_deque deques[PARALLEL_MAX_THREADS];
+static pthread_t workers[PARALLEL_MAX_THREADS];
+static int workerStarted[PARALLEL_MAX_THREADS];
+static int exitHandlerRegistered = 0;
+
+// Idle workers sleep until a task is queued or the pool stops
+static pthread_mutex_t idleLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idleCond = PTHREAD_COND_INITIALIZER;
+static atomic_int queuedTasks = 0;
+static int stopping = 0;
+
+// Settings from parallel_configure (-1 or 0: use the environment)
+static int configThreads = 0;
+static int configPin = -1;
+static int configSerial = -1;
+
+// Deque owned by the current thread (0 for threads outside the pool)
+static _Thread_local int workerIndex = 0;
+
+static int envFlag(const char *name) {
+    const char *env = getenv(name);
+    return env && strtol(env, NULL, 10) != 0;
+}
+
+static int settingThreads(void) {
+    long n = configThreads;
+    if (n <= 0) {
+        const char *env = getenv("IMAGE_THREADS");
+        n = env ? strtol(env, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (n < 1) return 1;
+    if (n > PARALLEL_MAX_THREADS) return PARALLEL_MAX_THREADS;
+    return (int)n;
+}
+
+static int settingSerial(void) {
+    return configSerial >= 0 ? configSerial : envFlag("IMAGE_SERIAL");
+}
+
+static int settingPin(void) {
+    return configPin >= 0 ? configPin : envFlag("IMAGE_PIN_THREADS");
+}
+
+// --- Deques --- //
+
+static int dequePush(t_deque *d, const t_task *task) {
+    pthread_mutex_lock(&d->lock);
+    if (d->count == d->capacity) {
+        int capacity = d->capacity ? d->capacity * 2 : PARALLEL_DEQUE_CAPACITY;
+        t_task *tasks = (t_task *)malloc(capacity * sizeof(t_task));
+        if (!tasks) {
+            pthread_mutex_unlock(&d->lock);
+            return 0;
+        }
+        for (int i = 0; i < d->count; i++) {
+            tasks[i] = d->tasks[(d->head + i) % d->capacity];
+        }
+        free(d->tasks);
+        d->tasks = tasks;
+        d->capacity = capacity;
+        d->head = 0;
+    }
+    d->tasks[(d->head + d->count) % d->capacity] = *task;
+    d->count++;
+    pthread_mutex_unlock(&d->lock);
+    return 1;
+}
+
+static int dequePopBottom(t_deque *d, t_task *task) {
+    int found = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->count > 0) {
+        d->count--;
+        *task = d->tasks[(d->head + d->count) % d->capacity];
+        found = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+static int dequeStealTop(t_deque *d, t_task *task) {
+    int found = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->count > 0) {
+        *task = d->tasks[d->head];
+        d->head = (d->head + 1) % d->capacity;
+        d->count--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+// --- Tasks --- //
+
+/**
+ * Takes a task: from the bottom of the own deque first, then from the top of the others.
+ */
+static int findTask(int self, t_task *task) {
+    int found = dequePopBottom(&deques[self], task);
+    for (int i = 1; !found && i < poolThreads; i++) {
+        found = dequeStealTop(&deques[(self + i) % poolThreads], task);
+    }
+    if (found) atomic_fetch_sub(&queuedTasks, 1);
+    return found;
+}
+
+static void runTask(int self, t_task task);
+
+static void submitTask(int self, const t_task *task) {
+    if (!dequePush(&deques[self], task)) {
+        // Out of memory: run the range inline rather than lose it
+        runTask(self, *task);
+        return;
+    }
+    atomic_fetch_add(&queuedTasks, 1);
+    pthread_mutex_lock(&idleLock);
+    pthread_cond_signal(&idleCond);
+    pthread_mutex_unlock(&idleLock);
+}
+
+/**
+ * Runs a task. While the range is wider than grain, the upper half is queued for stealing;
+ * split points stay on multiples of grain from the original begin, so the chunks passed to
+ * body are the same however the work is distributed.
+ */
+static void runTask(int self, t_task task) {
+    while (task.end - task.begin > task.grain) {
+        int chunks = (task.end - task.begin + task.grain - 1) / task.grain;
+        t_task upper = task;
+        upper.begin = task.begin + (chunks / 2) * task.grain;
+        task.end = upper.begin;
+        atomic_fetch_add(&task.group->pending, 1);
+        submitTask(self, &upper);
+    }
+    task.body(task.begin, task.end, task.ctx);
+
+    // The waiter only returns after seeing 0 under the lock, so the group outlives this unlock
+    pthread_mutex_lock(&task.group->lock);
+    if (atomic_fetch_sub(&task.group->pending, 1) == 1) {
+        pthread_cond_broadcast(&task.group->done);
+    }
+    pthread_mutex_unlock(&task.group->lock);
+}
+
+static void *workerMain(void *arg) {
+    int self = (int)(size_t)arg;
+    workerIndex = self;
+
+    for (;;) {
+        t_task task;
+        if (findTask(self, &task)) {
+            runTask(self, task);
+            continue;
+        }
+        pthread_mutex_lock(&idleLock);
+        while (atomic_load(&queuedTasks) <= 0 && !stopping) {
+            pthread_cond_wait(&idleCond, &idleLock);
+        }
+        int stop = stopping && atomic_load(&queuedTasks) <= 0;
+        pthread_mutex_unlock(&idleLock);
+        if (stop) break;
+    }
+    return NULL;
+}
+
+// --- Pool --- //
+
+/**
+ * Starts the worker threads if the pool is not running.
+ * If a worker cannot be created, its deque is still stolen from, so work is never lost.
+ */
+static void ensurePool(void) {
+    if (atomic_load(&poolRunning)) return;
+
+    pthread_mutex_lock(&poolLock);
+    if (!atomic_load(&poolRunning)) {
+        poolThreads = settingThreads();
+        poolSerial = settingSerial();
+        int pin = settingPin();
+        long numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+
+        for (int i = 0; i < poolThreads; i++) {
+            pthread_mutex_init(&deques[i].lock, NULL);
+            deques[i].tasks = NULL;
+            deques[i].capacity = 0;
+            deques[i].head = 0;
+            deques[i].count = 0;
+        }
+        atomic_store(&queuedTasks, 0);
+        stopping = 0;
+
+        for (int i = 1; i < poolThreads && !poolSerial; i++) {
+            workerStarted[i] = pthread_create(&workers[i], NULL, workerMain, (void *)(size_t)i) == 0;
+            if (!workerStarted[i]) {
+                printf("Error: Failed to start worker thread %d\n", i);
+                continue;
+            }
+            if (pin && numCPUs > 0) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(i % numCPUs, &set);
+                pthread_setaffinity_np(workers[i], sizeof(set), &set);
+            }
+        }
+
+        if (!exitHandlerRegistered) {
+            atexit(parallel_shutdown);
+            exitHandlerRegistered = 1;
+        }
+        atomic_store(&poolRunning, 1);
+    }
+    pthread_mutex_unlock(&poolLock);
+}
+
+/**
+ * Stops and joins the worker threads. The pool restarts on the next parallel call.
+ * Must not be called while parallel work is running.
+ */
+void parallel_shutdown(void) {
+    pthread_mutex_lock(&poolLock);
+    if (atomic_load(&poolRunning)) {
+        pthread_mutex_lock(&idleLock);
+        stopping = 1;
+        pthread_cond_broadcast(&idleCond);
+        pthread_mutex_unlock(&idleLock);
+
+        for (int i = 1; i < poolThreads && !poolSerial; i++) {
+            if (workerStarted[i]) pthread_join(workers[i], NULL);
+        }
+        for (int i = 0; i < poolThreads; i++) {
+            free(deques[i].tasks);
+            pthread_mutex_destroy(&deques[i].lock);
+        }
+        atomic_store(&poolRunning, 0);
+    }
+    pthread_mutex_unlock(&poolLock);
+}
+
+/**
+ * Configures the scheduler, restarting the pool if it is running.
+ * Must not be called while parallel work is running.
+ * @param numThreads Number of threads including the caller (0: IMAGE_THREADS or online CPUs).
+ * @param pinThreads 1 to pin workers to CPUs, 0 not to, -1 for IMAGE_PIN_THREADS.
+ * @param serial 1 to run everything on the calling thread in order, 0 not to, -1 for IMAGE_SERIAL.
+ */
+void parallel_configure(int numThreads, int pinThreads, int serial) {
+    parallel_shutdown();
+    pthread_mutex_lock(&poolLock);
+    configThreads = numThreads;
+    configPin = pinThreads;
+    configSerial = serial;
+    pthread_mutex_unlock(&poolLock);
+}
+
+/**
+ * Returns the number of threads that run parallel work (1 in serial mode).
+ * @return The thread count, in [1, PARALLEL_MAX_THREADS].
+ */
+int parallel_numThreads(void) {
+    ensurePool();
+    return poolSerial ? 1 : poolThreads;
+}
+
+// --- Parallel Primitives --- //
+
+/**
+ * Splits [begin, end) into chunks and processes them on the pool.
+ * Chunk boundaries only depend on begin, end and grain, so per-chunk partial results can be
+ * reduced deterministically by the caller. In serial mode chunks run in increasing order.
+ * @param begin First index of the range.
+ * @param end One past the last index of the range.
+ * @param grain Number of indices per chunk (at least 1).
+ * @param body The function called for each chunk.
+ * @param ctx The context passed to body.
+ */
+void parallel_for(int begin, int end, int grain, void (*body)(int begin, int end, void *ctx), void *ctx) {
+    if (end <= begin) return;
+    if (grain < 1) grain = 1;
+
+    if (end - begin <= grain || parallel_numThreads() == 1) {
+        for (int i = begin; i < end; i += grain) {
+            body(i, i + grain < end ? i + grain : end, ctx);
+        }
+        return;
+    }
+
+    t_taskGroup group;
+    atomic_init(&group.pending, 1);
+    pthread_mutex_init(&group.lock, NULL);
+    pthread_cond_init(&group.done, NULL);
+
+    int self = workerIndex;
+    t_task root = {body, ctx, begin, end, grain, &group};
+    runTask(self, root);
+
+    // Help with queued work (of this or any other call) until every chunk is done
+    for (;;) {
+        t_task task;
+        if (findTask(self, &task)) {
+            runTask(self, task);
+            continue;
+        }
+        pthread_mutex_lock(&group.lock);
+        int finished = atomic_load(&group.pending) == 0;
+        if (!finished && atomic_load(&queuedTasks) <= 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += PARALLEL_WAIT_NS;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&group.done, &group.lock, &deadline);
+        }
+        pthread_mutex_unlock(&group.lock);
+        if (finished) break;
+    }
+
+    pthread_cond_destroy(&group.done);
+    pthread_mutex_destroy(&group.lock);
+}
+
+// Arguments of parallel_run, shared by its tasks
+typedef struct {
+    void (*fn)(void *ctx);
+    void *ctx;
+} t_runArgs;
+
+static void runBody(int begin, int end, void *ctx) {
+    t_runArgs *args = (t_runArgs *)ctx;
+    for (int i = begin; i < end; i++) {
+        args->fn(args->ctx);
+    }
+}
+
+/**
+ * Runs a function once per scheduler thread, as tasks on the pool, and waits for all of them.
+ * The calls are not guaranteed to overlap (a busy pool may run them one after another), so fn
+ * must claim work dynamically rather than assume a fixed number of concurrent callers.
+ * @param fn The function to run.
+ * @param ctx The context passed to fn.
+ */
+void parallel_run(void (*fn)(void *ctx), void *ctx) {
+    t_runArgs args = {fn, ctx};
+    parallel_for(0, parallel_numThreads(), 1, runBody, &args);
+}
@@ -0,0 +1,32 @@
+/*
+ * parallel.h
+ * Author: Simon Hillel
+ * Description: Header for the process-wide work-stealing scheduler shared by the image processing modules.
+ * Declares a range-splitting parallel-for, a helper that runs one function per scheduler thread,
+ * and the scheduler configuration (thread count, CPU pinning, serial mode).
+ */
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/**
+ * Returns the number of threads used by parallel operations (at least 1; 1 in serial mode).
+ */
+int parallel_numThreads(void);
+/**
+ * Sets thread count (0: default), CPU pinning and serial mode (-1: from the environment); restarts the pool.
+ */
+void parallel_configure(int numThreads, int pinThreads, int serial);
+/**
+ * Stops the worker threads; the pool restarts on the next parallel call.
+ */
+void parallel_shutdown(void);
+/**
+ * Runs fn(ctx) once per scheduler thread as pool tasks and waits for all (calls may not overlap).
+ */
+void parallel_run(void (*fn)(void *ctx), void *ctx);
+/**
+ * Splits [begin, end) into chunks of about grain items and calls body(chunkBegin, chunkEnd, ctx) in parallel.
+ */
+void parallel_for(int begin, int end, int grain, void (*body)(int begin, int end, void *ctx), void *ctx);
+
+#endif // PARALLEL_H
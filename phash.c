@@ -0,0 +1,577 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "phash.h"
+#include "bmpio.h"
+#include "catalog.h"
+#include "parallel.h"
+
+/*
+ * phash.c
+ * Author: Simon Hillel
+ * Description: Implementation of perceptual hashing and near-duplicate search.
+ * Every image pixel falls into one cell of each thumbnail (cell = coordinate * cells / size),
+ * so a row is summed into per-cell partial sums and added to the two grids; a cell's mean is
+ * its sum over the pixels that fell into it. Luma uses the integer BT.601 weights of
+ * bmp24_toLuma, kept in thousandths until the means are taken.
+ * The duplicate search hashes the files of a catalog scan in parallel, builds a BK-tree of the
+ * pHashes, queries it for every file in parallel (each task only writes its own files'
+ * matches), then joins the matches into groups with a union-find.
+ */
+
+// Integer BT.601 luma, in thousandths (as bmp24_toLuma before rounding)
+#define LUMA_1000(r, g, b) (299u * (r) + 587u * (g) + 114u * (b))
+
+// --- Hashing --- //
+
+/**
+ * Prepares an accumulator for an image of the given size.
+ * @param acc The accumulator.
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @return 0 on success, -1 on failure.
+ */
+int phash_begin(t_hashAccumulator * acc, int width, int height) {
+    memset(acc, 0, sizeof(*acc));
+    if (width <= 0 || height <= 0) return -1;
+    acc->width = width;
+    acc->height = height;
+    acc->columnDct = (int *)malloc(width * sizeof(int));
+    acc->columnDiff = (int *)malloc(width * sizeof(int));
+    if (!acc->columnDct || !acc->columnDiff) {
+        free(acc->columnDct);
+        free(acc->columnDiff);
+        return -1;
+    }
+    for (int x = 0; x < width; x++) {
+        acc->columnDct[x] = (int)((long long)x * PHASH_DCT_SIZE / width);
+        acc->columnDiff[x] = (int)((long long)x * PHASH_DHASH_WIDTH / width);
+    }
+    return 0;
+}
+
+/**
+ * Adds one row of luma sums (in thousandths) to both grids.
+ */
+static void addRowSums(t_hashAccumulator * acc, const uint64_t * rowDct, const uint64_t * rowDiff, int y) {
+    uint64_t * dct = &acc->sumDct[(int)((long long)y * PHASH_DCT_SIZE / acc->height) * PHASH_DCT_SIZE];
+    uint64_t * diff = &acc->sumDiff[(int)((long long)y * PHASH_DHASH_HEIGHT / acc->height) * PHASH_DHASH_WIDTH];
+    for (int c = 0; c < PHASH_DCT_SIZE; c++) dct[c] += rowDct[c];
+    for (int c = 0; c < PHASH_DHASH_WIDTH; c++) diff[c] += rowDiff[c];
+}
+
+/**
+ * Adds image row y of a colour image.
+ * @param acc The accumulator.
+ * @param row The pixels of the row.
+ * @param y The index of the row, 0 being the top row.
+ */
+void phash_addRow24(t_hashAccumulator * acc, const t_pixel * row, int y) {
+    uint64_t rowDct[PHASH_DCT_SIZE] = {0};
+    uint64_t rowDiff[PHASH_DHASH_WIDTH] = {0};
+    for (int x = 0; x < acc->width; x++) {
+        uint32_t luma = LUMA_1000(row[x].red, row[x].green, row[x].blue);
+        rowDct[acc->columnDct[x]] += luma;
+        rowDiff[acc->columnDiff[x]] += luma;
+    }
+    addRowSums(acc, rowDct, rowDiff, y);
+}
+
+/**
+ * Adds image row y given as luma values (0-255).
+ * @param acc The accumulator.
+ * @param luma The luma of the row.
+ * @param y The index of the row, 0 being the top row.
+ */
+void phash_addRowLuma(t_hashAccumulator * acc, const uint8_t * luma, int y) {
+    uint64_t rowDct[PHASH_DCT_SIZE] = {0};
+    uint64_t rowDiff[PHASH_DHASH_WIDTH] = {0};
+    for (int x = 0; x < acc->width; x++) {
+        rowDct[acc->columnDct[x]] += luma[x] * 1000u;
+        rowDiff[acc->columnDiff[x]] += luma[x] * 1000u;
+    }
+    addRowSums(acc, rowDct, rowDiff, y);
+}
+
+/**
+ * Turns the sums of a grid into means. Cells no pixel fell into (images smaller than the
+ * grid) take the value of the cell to their left, or above for a whole empty row.
+ */
+static void gridMeans(const uint64_t * sums, int cellsX, int cellsY, int width, int height, double * means) {
+    int columns[PHASH_DCT_SIZE] = {0};
+    int rows[PHASH_DCT_SIZE] = {0};
+    for (int x = 0; x < width; x++) columns[(int)((long long)x * cellsX / width)]++;
+    for (int y = 0; y < height; y++) rows[(int)((long long)y * cellsY / height)]++;
+
+    for (int cy = 0; cy < cellsY; cy++) {
+        for (int cx = 0; cx < cellsX; cx++) {
+            long long count = (long long)rows[cy] * columns[cx];
+            double * cell = &means[cy * cellsX + cx];
+            if (count > 0) *cell = sums[cy * cellsX + cx] / (count * 1000.0);
+            else if (rows[cy] == 0 && cy > 0) *cell = cell[-cellsX];
+            else *cell = cx > 0 ? cell[-1] : 0.0;
+        }
+    }
+}
+
+static int compareDoubles(const void * a, const void * b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Computes the hashes from the accumulated rows and releases the accumulator.
+ * pHash: DCT-II of the 32x32 thumbnail, computed separably for the 8x8 lowest frequencies;
+ * a bit is set where the coefficient exceeds the median of the 63 AC coefficients.
+ * dHash: a bit is set where a cell of the 9x8 thumbnail is brighter than its right neighbour.
+ * @param acc The accumulator.
+ * @param hash Receives the hashes.
+ */
+void phash_finish(t_hashAccumulator * acc, t_imageHash * hash) {
+    double dct[PHASH_DCT_SIZE * PHASH_DCT_SIZE];
+    double diff[PHASH_DHASH_WIDTH * PHASH_DHASH_HEIGHT];
+    gridMeans(acc->sumDct, PHASH_DCT_SIZE, PHASH_DCT_SIZE, acc->width, acc->height, dct);
+    gridMeans(acc->sumDiff, PHASH_DHASH_WIDTH, PHASH_DHASH_HEIGHT, acc->width, acc->height, diff);
+    free(acc->columnDct);
+    free(acc->columnDiff);
+    acc->columnDct = acc->columnDiff = NULL;
+
+    double basis[PHASH_LOW_SIZE][PHASH_DCT_SIZE];
+    for (int u = 0; u < PHASH_LOW_SIZE; u++) {
+        for (int x = 0; x < PHASH_DCT_SIZE; x++) {
+            basis[u][x] = cos((2 * x + 1) * u * M_PI / (2.0 * PHASH_DCT_SIZE));
+        }
+    }
+    double rowsDone[PHASH_DCT_SIZE][PHASH_LOW_SIZE];
+    for (int y = 0; y < PHASH_DCT_SIZE; y++) {
+        for (int v = 0; v < PHASH_LOW_SIZE; v++) {
+            double sum = 0.0;
+            for (int x = 0; x < PHASH_DCT_SIZE; x++) sum += dct[y * PHASH_DCT_SIZE + x] * basis[v][x];
+            rowsDone[y][v] = sum;
+        }
+    }
+    double low[PHASH_LOW_SIZE * PHASH_LOW_SIZE];
+    for (int u = 0; u < PHASH_LOW_SIZE; u++) {
+        for (int v = 0; v < PHASH_LOW_SIZE; v++) {
+            double sum = 0.0;
+            for (int y = 0; y < PHASH_DCT_SIZE; y++) sum += basis[u][y] * rowsDone[y][v];
+            low[u * PHASH_LOW_SIZE + v] = sum;
+        }
+    }
+    double sorted[PHASH_LOW_SIZE * PHASH_LOW_SIZE - 1];
+    memcpy(sorted, low + 1, sizeof(sorted));
+    qsort(sorted, PHASH_LOW_SIZE * PHASH_LOW_SIZE - 1, sizeof(double), compareDoubles);
+    double median = sorted[(PHASH_LOW_SIZE * PHASH_LOW_SIZE - 1) / 2];
+
+    hash->phash = 0;
+    for (int i = 0; i < PHASH_LOW_SIZE * PHASH_LOW_SIZE; i++) {
+        if (low[i] > median) hash->phash |= 1ULL << i;
+    }
+    hash->dhash = 0;
+    for (int y = 0; y < PHASH_DHASH_HEIGHT; y++) {
+        for (int x = 0; x < PHASH_DHASH_WIDTH - 1; x++) {
+            if (diff[y * PHASH_DHASH_WIDTH + x] > diff[y * PHASH_DHASH_WIDTH + x + 1]) {
+                hash->dhash |= 1ULL << (y * (PHASH_DHASH_WIDTH - 1) + x);
+            }
+        }
+    }
+}
+
+/**
+ * Hashes a colour image.
+ * @param img Pointer to the t_bmp24 structure.
+ * @param hash Receives the hashes.
+ * @return 0 on success, -1 on failure.
+ */
+int phash_image24(const t_bmp24 * img, t_imageHash * hash) {
+    t_hashAccumulator acc;
+    if (!img || !img->data || phash_begin(&acc, img->width, img->height) != 0) return -1;
+    for (int y = 0; y < img->height; y++) phash_addRow24(&acc, img->data[y], y);
+    phash_finish(&acc, hash);
+    return 0;
+}
+
+/**
+ * Fills the luma of every palette entry (BGRA entries).
+ */
+static void paletteLuma(const uint8_t * colorTable, uint8_t luma[256]) {
+    for (int i = 0; i < 256; i++) {
+        const uint8_t * entry = colorTable + 4 * i;
+        luma[i] = (uint8_t)((LUMA_1000(entry[2], entry[1], entry[0]) + 500) / 1000);
+    }
+}
+
+/**
+ * Hashes an 8-bit image, taking the luma of each pixel's palette entry.
+ * @param img Pointer to the t_bmp8 structure.
+ * @param hash Receives the hashes.
+ * @return 0 on success, -1 on failure.
+ */
+int phash_image8(const t_bmp8 * img, t_imageHash * hash) {
+    t_hashAccumulator acc;
+    if (!img || !img->data || phash_begin(&acc, img->width, img->height) != 0) return -1;
+    uint8_t * row = (uint8_t *)malloc(img->width);
+    if (!row) {
+        phash_finish(&acc, hash);
+        return -1;
+    }
+    uint8_t luma[256];
+    paletteLuma(img->colorTable, luma);
+    // t_bmp8 keeps rows bottom-up
+    for (unsigned int y = 0; y < img->height; y++) {
+        const unsigned char * src = &img->data[(img->height - 1 - y) * img->width];
+        for (unsigned int x = 0; x < img->width; x++) row[x] = luma[src[x]];
+        phash_addRowLuma(&acc, row, (int)y);
+    }
+    free(row);
+    phash_finish(&acc, hash);
+    return 0;
+}
+
+/**
+ * Hashes a BMP file from its pixel data, read in blocks of PHASH_READ_BYTES and added row by
+ * row in file order; the image itself is never held in memory.
+ * @param filename The path to the BMP file (8 or 24-bit, uncompressed).
+ * @param hash Receives the hashes.
+ * @return 0 on success, -1 if the file cannot be read or is not supported.
+ */
+int phash_file(const char * filename, t_imageHash * hash) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return -1;
+
+    uint8_t header[BMP_HEADER_SIZE + BMP_INFOHEADER_SIZE];
+    t_bmpFields fields;
+    ssize_t got = pread(fd, header, sizeof(header), 0);
+    if (got < 0 || bmpio_parseHeader(header, (size_t)got, &fields) != 0 || fields.compression != 0 ||
+        (fields.bits != 8 && fields.bits != 24) || fields.width <= 0 || fields.height == 0) {
+        close(fd);
+        return -1;
+    }
+    int width = fields.width;
+    int height = fields.height < 0 ? -fields.height : fields.height;
+    int topDown = fields.height < 0;
+
+    // 8-bit files: luma of the palette entries (entries the file omits stay gray levels)
+    uint8_t luma[256];
+    if (fields.bits == 8) {
+        uint8_t colorTable[1024];
+        for (int i = 0; i < 256; i++) {
+            colorTable[4 * i] = colorTable[4 * i + 1] = colorTable[4 * i + 2] = (uint8_t)i;
+            colorTable[4 * i + 3] = 0;
+        }
+        uint32_t numColors = fields.numColors == 0 || fields.numColors > 256 ? 256 : fields.numColors;
+        if (pread(fd, colorTable, 4 * numColors, BMP_HEADER_SIZE + fields.infoSize) != (ssize_t)(4 * numColors)) {
+            close(fd);
+            return -1;
+        }
+        paletteLuma(colorTable, luma);
+    }
+
+    size_t rowBytes = (size_t)width * (fields.bits / 8);
+    size_t paddedBytes = (rowBytes + 3) & ~(size_t)3;
+    int blockRows = PHASH_READ_BYTES / paddedBytes > 0 ? (int)(PHASH_READ_BYTES / paddedBytes) : 1;
+    if (blockRows > height) blockRows = height;
+    uint8_t * block = (uint8_t *)malloc((size_t)blockRows * paddedBytes);
+    uint8_t * row = fields.bits == 8 ? (uint8_t *)malloc(width) : NULL;
+    t_hashAccumulator acc;
+    int status = block && (fields.bits == 24 || row) && phash_begin(&acc, width, height) == 0 ? 0 : -1;
+
+    for (int first = 0; status == 0 && first < height; first += blockRows) {
+        int numRows = height - first < blockRows ? height - first : blockRows;
+        size_t size = (size_t)numRows * paddedBytes;
+        if (pread(fd, block, size, (off_t)fields.dataOffset + (off_t)first * paddedBytes) != (ssize_t)size) {
+            status = -1;
+            break;
+        }
+        for (int i = 0; i < numRows; i++) {
+            int fileRow = first + i;
+            int y = topDown ? fileRow : height - 1 - fileRow;
+            const uint8_t * src = block + (size_t)i * paddedBytes;
+            if (fields.bits == 24) {
+                phash_addRow24(&acc, (const t_pixel *)src, y);
+            } else {
+                for (int x = 0; x < width; x++) row[x] = luma[src[x]];
+                phash_addRowLuma(&acc, row, y);
+            }
+        }
+    }
+    if (acc.columnDct) phash_finish(&acc, hash);
+    free(block);
+    free(row);
+    close(fd);
+    return status;
+}
+
+/**
+ * Returns the Hamming distance between two hashes.
+ * @param a The first hash.
+ * @param b The second hash.
+ * @return The number of differing bits (0-64).
+ */
+int phash_distance(uint64_t a, uint64_t b) {
+    return __builtin_popcountll(a ^ b);
+}
+
+// --- BK-Tree --- //
+
+/**
+ * Adds a hash to a BK-tree: from the root, it descends into the child at the same distance as
+ * itself, and becomes a new child where there is none.
+ * @param tree The tree.
+ * @param hash The hash.
+ * @param item The caller's index of the image.
+ * @return 0 on success, -1 if memory is exhausted.
+ */
+int bktree_insert(t_bkTree * tree, uint64_t hash, int item) {
+    if (tree->count == tree->capacity) {
+        int grown = tree->capacity ? tree->capacity * 2 : 256;
+        t_bkNode * nodes = (t_bkNode *)realloc(tree->nodes, grown * sizeof(t_bkNode));
+        if (!nodes) return -1;
+        tree->nodes = nodes;
+        tree->capacity = grown;
+    }
+    int index = tree->count++;
+    t_bkNode * node = &tree->nodes[index];
+    node->hash = hash;
+    node->item = item;
+    node->distance = 0;
+    node->firstChild = -1;
+    node->nextSibling = -1;
+    if (index == 0) return 0;
+
+    int current = 0;
+    for (;;) {
+        int distance = phash_distance(hash, tree->nodes[current].hash);
+        int child = tree->nodes[current].firstChild;
+        while (child >= 0 && tree->nodes[child].distance != distance) child = tree->nodes[child].nextSibling;
+        if (child < 0) {
+            node->distance = distance;
+            node->nextSibling = tree->nodes[current].firstChild;
+            tree->nodes[current].firstChild = index;
+            return 0;
+        }
+        current = child;
+    }
+}
+
+/**
+ * Finds the hashes within maxDistance of a hash. By the triangle inequality, a match below a
+ * node at distance d from the query hangs from a child whose distance to the node lies in
+ * [d - maxDistance, d + maxDistance], so only those subtrees are visited.
+ * @param tree The tree.
+ * @param hash The query.
+ * @param maxDistance The largest Hamming distance of a match.
+ * @param found Called with the item and distance of each match.
+ * @param ctx Passed to found.
+ * @return The number of nodes compared with the query.
+ */
+int bktree_search(const t_bkTree * tree, uint64_t hash, int maxDistance,
+                  void (*found)(int item, int distance, void * ctx), void * ctx) {
+    if (tree->count == 0) return 0;
+    int * stack = (int *)malloc(tree->count * sizeof(int));
+    if (!stack) return 0;
+
+    int compared = 0;
+    int depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        const t_bkNode * node = &tree->nodes[stack[--depth]];
+        int distance = phash_distance(hash, node->hash);
+        compared++;
+        if (distance <= maxDistance) found(node->item, distance, ctx);
+        for (int child = node->firstChild; child >= 0; child = tree->nodes[child].nextSibling) {
+            int edge = tree->nodes[child].distance;
+            if (edge >= distance - maxDistance && edge <= distance + maxDistance) stack[depth++] = child;
+        }
+    }
+    free(stack);
+    return compared;
+}
+
+/**
+ * Frees the nodes of a BK-tree.
+ * @param tree The tree.
+ */
+void bktree_free(t_bkTree * tree) {
+    free(tree->nodes);
+    tree->nodes = NULL;
+    tree->count = tree->capacity = 0;
+}
+
+// --- Duplicate Search --- //
+
+// Matches of one file with files of higher index
+typedef struct {
+    int * items;
+    int count;
+    int capacity;
+} t_matchList;
+
+// State of a parallel hashing or query pass
+typedef struct {
+    const t_catalog * catalog;
+    const int * files;            // Catalog indices of the files to hash
+    t_imageHash * hashes;
+    int * hashed;                 // 1 if the file was hashed
+    const t_bkTree * tree;
+    int maxDistance;
+    t_matchList * matches;
+    atomic_llong compared;
+} t_dedupState;
+
+// Query context: the file being matched
+typedef struct {
+    int self;
+    t_matchList * list;
+} t_query;
+
+static void hashFiles(int begin, int end, void * ctx) {
+    t_dedupState * state = (t_dedupState *)ctx;
+    for (int i = begin; i < end; i++) {
+        const char * path = state->catalog->entries[state->files[i]].path;
+        state->hashed[i] = phash_file(path, &state->hashes[i]) == 0;
+    }
+}
+
+static void addMatch(int item, int distance, void * ctx) {
+    t_query * query = (t_query *)ctx;
+    (void)distance;
+    if (item <= query->self) return;
+    t_matchList * list = query->list;
+    if (list->count == list->capacity) {
+        int grown = list->capacity ? list->capacity * 2 : 4;
+        int * items = (int *)realloc(list->items, grown * sizeof(int));
+        if (!items) return;
+        list->items = items;
+        list->capacity = grown;
+    }
+    list->items[list->count++] = item;
+}
+
+static void queryFiles(int begin, int end, void * ctx) {
+    t_dedupState * state = (t_dedupState *)ctx;
+    long long compared = 0;
+    for (int i = begin; i < end; i++) {
+        if (!state->hashed[i]) continue;
+        t_query query = {i, &state->matches[i]};
+        compared += bktree_search(state->tree, state->hashes[i].phash, state->maxDistance, addMatch, &query);
+    }
+    atomic_fetch_add(&state->compared, compared);
+}
+
+static int findRoot(int * parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/**
+ * Hashes the BMP files under a directory and prints the groups of near-duplicates.
+ * Files are listed by a catalog scan (which updates <dir>/.catalog), hashed from their rows
+ * in parallel, and matched through a BK-tree of their pHashes.
+ * @param dir The directory to scan.
+ * @param maxDistance The largest pHash distance between near-duplicates (< 0: default).
+ * @return 0 on success, -1 on failure.
+ */
+int phash_findDuplicates(const char * dir, int maxDistance) {
+    if (maxDistance < 0) maxDistance = PHASH_DEFAULT_DISTANCE;
+    double start = bmpio_now();
+    t_catalog * catalog = catalog_scan(dir, NULL);
+    if (!catalog) return -1;
+
+    int numFiles = 0;
+    int * files = (int *)malloc((catalog->count + 1) * sizeof(int));
+    for (int i = 0; files && i < catalog->count; i++) {
+        const t_catalogEntry * entry = &catalog->entries[i];
+        if (entry->valid && entry->compression == 0 && (entry->depth == 8 || entry->depth == 24)) {
+            files[numFiles++] = i;
+        }
+    }
+
+    t_dedupState state;
+    memset(&state, 0, sizeof(state));
+    state.catalog = catalog;
+    state.files = files;
+    state.hashes = (t_imageHash *)calloc(numFiles + 1, sizeof(t_imageHash));
+    state.hashed = (int *)calloc(numFiles + 1, sizeof(int));
+    state.matches = (t_matchList *)calloc(numFiles + 1, sizeof(t_matchList));
+    state.maxDistance = maxDistance;
+    atomic_init(&state.compared, 0);
+    int * parent = (int *)malloc((numFiles + 1) * sizeof(int));
+    t_bkTree tree = {NULL, 0, 0};
+    int status = files && state.hashes && state.hashed && state.matches && parent ? 0 : -1;
+
+    if (status == 0) {
+        parallel_for(0, numFiles, 4, hashFiles, &state);
+        for (int i = 0; status == 0 && i < numFiles; i++) {
+            if (state.hashed[i] && bktree_insert(&tree, state.hashes[i].phash, i) != 0) status = -1;
+        }
+    }
+    double hashed = bmpio_now();
+    if (status == 0) {
+        state.tree = &tree;
+        parallel_for(0, numFiles, 16, queryFiles, &state);
+    }
+
+    // Groups: union of the matched pairs, bucketed by root (their first file) for printing
+    int groups = 0, duplicates = 0, failed = 0;
+    int * order = status == 0 ? (int *)malloc((numFiles + 1) * sizeof(int)) : NULL;
+    int * first = status == 0 ? (int *)calloc(numFiles + 2, sizeof(int)) : NULL;
+    if (status == 0 && (!order || !first)) status = -1;
+    if (status == 0) {
+        for (int i = 0; i < numFiles; i++) parent[i] = i;
+        for (int i = 0; i < numFiles; i++) {
+            for (int k = 0; k < state.matches[i].count; k++) {
+                int a = findRoot(parent, i), b = findRoot(parent, state.matches[i].items[k]);
+                if (a != b) parent[a > b ? a : b] = a < b ? a : b;
+            }
+        }
+        for (int i = 0; i < numFiles; i++) first[findRoot(parent, i) + 1]++;
+        for (int r = 0; r < numFiles; r++) first[r + 1] += first[r];
+        for (int i = 0; i < numFiles; i++) order[first[findRoot(parent, i)]++] = i;
+        for (int r = numFiles; r > 0; r--) first[r] = first[r - 1];
+        first[0] = 0;
+
+        for (int r = 0; r < numFiles; r++) {
+            if (!state.hashed[r]) failed++;
+            int members = first[r + 1] - first[r] - 1;
+            if (members <= 0) continue;
+            groups++;
+            duplicates += members;
+            printf("Group %d: %s (phash %016llx)\n", groups, catalog->entries[files[r]].path,
+                   (unsigned long long)state.hashes[r].phash);
+            for (int k = first[r] + 1; k < first[r + 1]; k++) {
+                int j = order[k];
+                printf("  %s  phash distance %d, dhash distance %d\n", catalog->entries[files[j]].path,
+                       phash_distance(state.hashes[r].phash, state.hashes[j].phash),
+                       phash_distance(state.hashes[r].dhash, state.hashes[j].dhash));
+            }
+        }
+        long long pairs = (long long)(numFiles - failed) * (numFiles - failed - 1) / 2;
+        printf("[dedup] %d file(s) hashed in %.1f ms (%d unreadable), %d group(s), %d duplicate(s), "
+               "%lld hash comparisons (all pairs: %lld), distance <= %d\n",
+               numFiles - failed, (hashed - start) * 1000.0, failed, groups, duplicates,
+               (long long)atomic_load(&state.compared), pairs, maxDistance);
+    } else {
+        printf("Error: Out of memory while indexing %s\n", dir);
+    }
+
+    for (int i = 0; state.matches && i < numFiles; i++) free(state.matches[i].items);
+    bktree_free(&tree);
+    free(state.matches);
+    free(state.hashed);
+    free(state.hashes);
+    free(parent);
+    free(order);
+    free(first);
+    free(files);
+    catalog_free(catalog);
+    return status;
+}
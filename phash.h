@@ -0,0 +1,114 @@
+/*
+ * phash.h
+ * Author: Simon Hillel
+ * Description: Header for perceptual hashing and near-duplicate search.
+ * dHash compares neighbouring cells of a 9x8 luma thumbnail; pHash thresholds the low
+ * frequencies of the DCT of a 32x32 luma thumbnail at their median. Both thumbnails are
+ * accumulated in one pass over the rows, which are converted to luma and summed into their
+ * cells on the fly, so no full-resolution grayscale image is made; a file can be hashed from
+ * its rows as they are read, without loading the image.
+ * Near-duplicates are found with a BK-tree over the 64-bit hashes (Hamming distance), which
+ * only visits the subtrees whose distance band can hold a match.
+ */
+#ifndef PHASH_H
+#define PHASH_H
+
+#include <stdint.h>
+#include "bmp24.h"
+
+// Thumbnail sizes
+#define PHASH_DCT_SIZE 32         // pHash thumbnail (32x32), of which the 8x8 lowest frequencies are kept
+#define PHASH_LOW_SIZE 8
+#define PHASH_DHASH_WIDTH 9       // dHash thumbnail (9x8)
+#define PHASH_DHASH_HEIGHT 8
+// Largest Hamming distance between near-duplicates, unless given
+#define PHASH_DEFAULT_DISTANCE 8
+// Bytes of pixel data read at once by phash_file
+#define PHASH_READ_BYTES ((size_t)1 << 20)
+
+// Hashes of one image
+typedef struct {
+    uint64_t dhash;
+    uint64_t phash;
+} t_imageHash;
+
+// Luma sums of the two thumbnails, filled row by row
+typedef struct {
+    int width;
+    int height;
+    int * columnDct;          // Cell column of each image column, for both thumbnails
+    int * columnDiff;
+    uint64_t sumDct[PHASH_DCT_SIZE * PHASH_DCT_SIZE];   // Luma sums, in thousandths
+    uint64_t sumDiff[PHASH_DHASH_WIDTH * PHASH_DHASH_HEIGHT];
+} t_hashAccumulator;
+
+// One node of a BK-tree; children are linked as siblings
+typedef struct {
+    uint64_t hash;
+    int item;                 // Caller's index of the hashed image
+    int distance;             // Distance to the parent
+    int firstChild;
+    int nextSibling;
+} t_bkNode;
+
+typedef struct {
+    t_bkNode * nodes;
+    int count;
+    int capacity;
+} t_bkTree;
+
+/**
+ * Prepares an accumulator for an image of the given size. Returns 0, or -1 on failure.
+ */
+int phash_begin(t_hashAccumulator * acc, int width, int height);
+/**
+ * Adds image row y (0 = top) of a colour image.
+ */
+void phash_addRow24(t_hashAccumulator * acc, const t_pixel * row, int y);
+/**
+ * Adds image row y (0 = top) given as luma values.
+ */
+void phash_addRowLuma(t_hashAccumulator * acc, const uint8_t * luma, int y);
+/**
+ * Computes the hashes from the accumulated rows and releases the accumulator.
+ */
+void phash_finish(t_hashAccumulator * acc, t_imageHash * hash);
+/**
+ * Hashes a colour image. Returns 0, or -1 on failure.
+ */
+int phash_image24(const t_bmp24 * img, t_imageHash * hash);
+/**
+ * Hashes an 8-bit image through its palette. Returns 0, or -1 on failure.
+ */
+int phash_image8(const t_bmp8 * img, t_imageHash * hash);
+/**
+ * Hashes a BMP file (8 or 24-bit) from its rows as they are read. Returns 0, or -1 on failure.
+ */
+int phash_file(const char * filename, t_imageHash * hash);
+/**
+ * Returns the Hamming distance between two hashes.
+ */
+int phash_distance(uint64_t a, uint64_t b);
+
+/**
+ * Adds a hash to a BK-tree. Returns 0, or -1 if memory is exhausted.
+ */
+int bktree_insert(t_bkTree * tree, uint64_t hash, int item);
+/**
+ * Calls found(item, distance, ctx) for every hash within maxDistance of hash.
+ * Returns the number of nodes compared.
+ */
+int bktree_search(const t_bkTree * tree, uint64_t hash, int maxDistance,
+                  void (*found)(int item, int distance, void * ctx), void * ctx);
+/**
+ * Frees the nodes of a BK-tree.
+ */
+void bktree_free(t_bkTree * tree);
+
+/**
+ * Hashes the BMP files under a directory in parallel and prints the groups of
+ * near-duplicates (pHash distance <= maxDistance). Returns 0, or -1 on failure.
+ */
+int phash_findDuplicates(const char * dir, int maxDistance);
+
+#endif // PHASH_H
@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "planar.h"
+#include "parallel.h"
+
+/*
+ * planar.c
+ * Author: Simon Hillel
+ * Description: Implementation of 16-bit planar images and linear-light processing.
+ * Blurring and resampling in gamma-encoded sRGB darkens edges and fine detail. These paths
+ * decode to linear light once through a 256-entry table, keep 16 bits per sample so the
+ * dark end survives, and encode back through a 65536-entry table at the end of the chain.
+ */
+
+// --- Transfer Function Tables --- //
+
+static uint16_t srgbToLinearTable[256];
+static uint8_t linearToSrgbTable[65536];
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Fills both transfer tables from the sRGB definition (IEC 61966-2-1).
+ */
+static void initTables(void) {
+    for (int i = 0; i < 256; i++) {
+        double c = i / 255.0;
+        double linear = (c <= 0.04045) ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+        srgbToLinearTable[i] = (uint16_t)lround(linear * 65535.0);
+    }
+    for (int i = 0; i < 65536; i++) {
+        double linear = i / 65535.0;
+        double c = (linear <= 0.0031308) ? linear * 12.92 : 1.055 * pow(linear, 1.0 / 2.4) - 0.055;
+        linearToSrgbTable[i] = (uint8_t)lround(c * 255.0);
+    }
+}
+
+/**
+ * Converts an sRGB-encoded 8-bit value to 16-bit linear light.
+ * @param value The sRGB value (0-255).
+ * @return The linear-light value (0-65535).
+ */
+uint16_t planar_srgbToLinear(uint8_t value) {
+    pthread_once(&tablesOnce, initTables);
+    return srgbToLinearTable[value];
+}
+
+/**
+ * Converts a 16-bit linear-light value to an sRGB-encoded 8-bit value.
+ * @param value The linear-light value (0-65535).
+ * @return The sRGB value (0-255).
+ */
+uint8_t planar_linearToSrgb(uint16_t value) {
+    pthread_once(&tablesOnce, initTables);
+    return linearToSrgbTable[value];
+}
+
+// --- Allocation and Conversion --- //
+
+/**
+ * Allocates an uninitialised planar image.
+ * @param width The width in pixels.
+ * @param height The height in pixels.
+ * @param linearLight 1 if the planes will hold linear light, 0 for gamma-encoded values.
+ * @return Pointer to the allocated t_planar16 structure, or NULL on failure.
+ */
+t_planar16 * planar_allocate(int width, int height, int linearLight) {
+    if (width <= 0 || height <= 0) return NULL;
+
+    t_planar16 * img = (t_planar16 *)calloc(1, sizeof(t_planar16));
+    if (!img) return NULL;
+    img->width = width;
+    img->height = height;
+    img->linearLight = linearLight;
+    for (int c = 0; c < 3; c++) {
+        img->planes[c] = (uint16_t *)malloc((size_t)width * height * sizeof(uint16_t));
+        if (!img->planes[c]) {
+            printf("Error: Memory allocation failed for 16-bit plane\n");
+            planar_free(img);
+            return NULL;
+        }
+    }
+    return img;
+}
+
+/**
+ * Frees a planar image and its planes.
+ * @param img Pointer to the t_planar16 structure.
+ */
+void planar_free(t_planar16 * img) {
+    if (!img) return;
+    for (int c = 0; c < 3; c++) {
+        free(img->planes[c]);
+    }
+    free(img);
+}
+
+// Source and destination of a conversion pass
+typedef struct {
+    t_bmp24 * bmp;
+    t_planar16 * planar;
+    const t_planar16 * constPlanar;
+} t_convertState;
+
+static void fromBmp24Rows(int begin, int end, void * ctx) {
+    t_convertState * s = (t_convertState *)ctx;
+    int width = s->planar->width;
+    for (int y = begin; y < end; y++) {
+        const t_pixel * row = s->bmp->data[y];
+        uint16_t * red = s->planar->planes[0] + (size_t)y * width;
+        uint16_t * green = s->planar->planes[1] + (size_t)y * width;
+        uint16_t * blue = s->planar->planes[2] + (size_t)y * width;
+        if (s->planar->linearLight) {
+            for (int x = 0; x < width; x++) {
+                red[x] = srgbToLinearTable[row[x].red];
+                green[x] = srgbToLinearTable[row[x].green];
+                blue[x] = srgbToLinearTable[row[x].blue];
+            }
+        } else {
+            for (int x = 0; x < width; x++) {
+                red[x] = (uint16_t)(row[x].red * 257);
+                green[x] = (uint16_t)(row[x].green * 257);
+                blue[x] = (uint16_t)(row[x].blue * 257);
+            }
+        }
+    }
+}
+
+/**
+ * Converts a 24-bit image to a 16-bit planar image.
+ * @param img Pointer to the t_bmp24 structure.
+ * @param linearLight 1 to decode sRGB to linear light, 0 to keep gamma-encoded values.
+ * @return Pointer to the new t_planar16 structure, or NULL on failure.
+ */
+t_planar16 * planar_fromBmp24(t_bmp24 * img, int linearLight) {
+    if (!img || !img->data) return NULL;
+    pthread_once(&tablesOnce, initTables);
+
+    t_planar16 * planar = planar_allocate(img->width, img->height, linearLight);
+    if (!planar) return NULL;
+
+    t_convertState state = {img, planar, NULL};
+    parallel_for(0, img->height, 16, fromBmp24Rows, &state);
+    return planar;
+}
+
+static void storeRows(int begin, int end, void * ctx) {
+    t_convertState * s = (t_convertState *)ctx;
+    const t_planar16 * p = s->constPlanar;
+    for (int y = begin; y < end; y++) {
+        t_pixel * row = s->bmp->data[y];
+        const uint16_t * red = p->planes[0] + (size_t)y * p->width;
+        const uint16_t * green = p->planes[1] + (size_t)y * p->width;
+        const uint16_t * blue = p->planes[2] + (size_t)y * p->width;
+        if (p->linearLight) {
+            for (int x = 0; x < p->width; x++) {
+                row[x].red = linearToSrgbTable[red[x]];
+                row[x].green = linearToSrgbTable[green[x]];
+                row[x].blue = linearToSrgbTable[blue[x]];
+            }
+        } else {
+            for (int x = 0; x < p->width; x++) {
+                row[x].red = (uint8_t)((red[x] + 128) / 257);
+                row[x].green = (uint8_t)((green[x] + 128) / 257);
+                row[x].blue = (uint8_t)((blue[x] + 128) / 257);
+            }
+        }
+    }
+}
+
+/**
+ * Writes a planar image back into a 24-bit image of the same size.
+ * @param src Pointer to the t_planar16 structure.
+ * @param dst Pointer to the t_bmp24 structure (same width and height).
+ */
+void planar_store(const t_planar16 * src, t_bmp24 * dst) {
+    if (!src || !dst || !dst->data || src->width != dst->width || src->height != dst->height) {
+        printf("Error: Planar image and destination sizes differ\n");
+        return;
+    }
+    pthread_once(&tablesOnce, initTables);
+
+    t_convertState state = {dst, NULL, src};
+    parallel_for(0, src->height, 16, storeRows, &state);
+}
+
+/**
+ * Converts a planar image into a new 24-bit image.
+ * @param img Pointer to the t_planar16 structure.
+ * @return Pointer to the new t_bmp24 structure, or NULL on failure.
+ */
+t_bmp24 * planar_toBmp24(const t_planar16 * img) {
+    if (!img) return NULL;
+    t_bmp24 * bmp = bmp24_allocate(img->width, img->height, 24);
+    if (!bmp) return NULL;
+    planar_store(img, bmp);
+    return bmp;
+}
+
+// --- Convolution --- //
+
+// Shared state of a planar convolution pass over one plane
+typedef struct {
+    const uint16_t * src;
+    uint16_t * dst;
+    int width;
+    int height;
+    float ** kernel;
+    int n;
+} t_planarFilterState;
+
+static void filterRows(int begin, int end, void * ctx) {
+    t_planarFilterState * s = (t_planarFilterState *)ctx;
+    for (int y = begin; y < end; y++) {
+        if (y < s->n || y >= s->height - s->n) continue;
+        for (int x = s->n; x < s->width - s->n; x++) {
+            float sum = 0.0f;
+            for (int ky = -s->n; ky <= s->n; ky++) {
+                const uint16_t * row = s->src + (size_t)(y + ky) * s->width + x;
+                for (int kx = -s->n; kx <= s->n; kx++) {
+                    sum += row[kx] * s->kernel[ky + s->n][kx + s->n];
+                }
+            }
+            s->dst[(size_t)y * s->width + x] = (uint16_t)(sum < 0.0f ? 0 : (sum > 65535.0f ? 65535 : sum + 0.5f));
+        }
+    }
+}
+
+/**
+ * Applies a convolution kernel to every plane. As in bmp24_applyFilter, pixels closer than
+ * kernelSize / 2 to the border are left unchanged.
+ * @param img Pointer to the t_planar16 structure.
+ * @param kernel The convolution kernel.
+ * @param kernelSize The size of the kernel (must be odd).
+ */
+void planar_applyFilter(t_planar16 * img, float ** kernel, int kernelSize) {
+    if (!img || !kernel || kernelSize % 2 == 0) {
+        printf("Error: Invalid parameters for filter application\n");
+        return;
+    }
+
+    size_t planeSize = (size_t)img->width * img->height;
+    uint16_t * source = (uint16_t *)malloc(planeSize * sizeof(uint16_t));
+    if (!source) {
+        printf("Error: Failed to allocate temporary buffer for filtering\n");
+        return;
+    }
+
+    // One plane-sized copy is reused for all three planes
+    for (int c = 0; c < 3; c++) {
+        memcpy(source, img->planes[c], planeSize * sizeof(uint16_t));
+        t_planarFilterState state = {source, img->planes[c], img->width, img->height, kernel, kernelSize / 2};
+        parallel_for(0, img->height, 16, filterRows, &state);
+    }
+    free(source);
+}
+
+// --- Resize --- //
+
+// Area-averaging weights of one axis: output i reads count[i] inputs from start[i]
+typedef struct {
+    int * start;
+    int * count;
+    float * weights;  // maxTaps weights per output sample
+    int maxTaps;
+} t_resampleAxis;
+
+/**
+ * Computes the area-averaging weights mapping inSize samples to outSize samples.
+ * Output sample i covers input interval [i * scale, (i + 1) * scale); each input sample
+ * contributes in proportion to its overlap.
+ * @return 0 on success, -1 on allocation failure.
+ */
+static int buildAxis(t_resampleAxis * axis, int inSize, int outSize) {
+    double scale = (double)inSize / outSize;
+    axis->maxTaps = (int)ceil(scale) + 1;
+    axis->start = (int *)malloc(outSize * sizeof(int));
+    axis->count = (int *)malloc(outSize * sizeof(int));
+    axis->weights = (float *)calloc((size_t)outSize * axis->maxTaps, sizeof(float));
+    if (!axis->start || !axis->count || !axis->weights) return -1;
+
+    for (int i = 0; i < outSize; i++) {
+        double lo = i * scale, hi = (i + 1) * scale;
+        int first = (int)floor(lo);
+        int last = (int)ceil(hi) - 1;
+        if (last >= inSize) last = inSize - 1;
+        if (last - first + 1 > axis->maxTaps) last = first + axis->maxTaps - 1;
+        axis->start[i] = first;
+        axis->count[i] = last - first + 1;
+        for (int k = 0; k < axis->count[i]; k++) {
+            double a = first + k > lo ? first + k : lo;
+            double b = first + k + 1 < hi ? first + k + 1 : hi;
+            axis->weights[(size_t)i * axis->maxTaps + k] = (float)((b - a) / scale);
+        }
+    }
+    return 0;
+}
+
+static void freeAxis(t_resampleAxis * axis) {
+    free(axis->start);
+    free(axis->count);
+    free(axis->weights);
+}
+
+// Shared state of a resize pass
+typedef struct {
+    const t_planar16 * src;
+    t_planar16 * dst;
+    float * temp;            // Horizontally resampled plane (dst width x src height)
+    int plane;
+    const t_resampleAxis * horizontal;
+    const t_resampleAxis * vertical;
+} t_resizeState;
+
+static void resizeRowsHorizontal(int begin, int end, void * ctx) {
+    t_resizeState * s = (t_resizeState *)ctx;
+    const t_resampleAxis * ax = s->horizontal;
+    for (int y = begin; y < end; y++) {
+        const uint16_t * in = s->src->planes[s->plane] + (size_t)y * s->src->width;
+        float * out = s->temp + (size_t)y * s->dst->width;
+        for (int x = 0; x < s->dst->width; x++) {
+            const float * w = ax->weights + (size_t)x * ax->maxTaps;
+            float sum = 0.0f;
+            for (int k = 0; k < ax->count[x]; k++) {
+                sum += in[ax->start[x] + k] * w[k];
+            }
+            out[x] = sum;
+        }
+    }
+}
+
+static void resizeRowsVertical(int begin, int end, void * ctx) {
+    t_resizeState * s = (t_resizeState *)ctx;
+    const t_resampleAxis * ax = s->vertical;
+    int width = s->dst->width;
+    for (int y = begin; y < end; y++) {
+        uint16_t * out = s->dst->planes[s->plane] + (size_t)y * width;
+        const float * w = ax->weights + (size_t)y * ax->maxTaps;
+        for (int x = 0; x < width; x++) {
+            float sum = 0.0f;
+            for (int k = 0; k < ax->count[y]; k++) {
+                sum += s->temp[(size_t)(ax->start[y] + k) * width + x] * w[k];
+            }
+            out[x] = (uint16_t)(sum > 65535.0f ? 65535 : sum + 0.5f);
+        }
+    }
+}
+
+/**
+ * Resamples a planar image to a new size by separable area averaging: when shrinking, each
+ * output sample is the box-filtered mean of the input samples it covers; when enlarging, it
+ * copies the input sample it falls in (pixel replication, not interpolation), blending two
+ * samples by their overlap only where it straddles their boundary.
+ * The result keeps the linear-light flag of the source.
+ * @param img Pointer to the source t_planar16 structure.
+ * @param width The new width in pixels.
+ * @param height The new height in pixels.
+ * @return Pointer to the new t_planar16 structure, or NULL on failure.
+ */
+t_planar16 * planar_resize(const t_planar16 * img, int width, int height) {
+    if (!img || width <= 0 || height <= 0) return NULL;
+
+    t_planar16 * dst = planar_allocate(width, height, img->linearLight);
+    float * temp = (float *)malloc((size_t)width * img->height * sizeof(float));
+    t_resampleAxis horizontal = {0}, vertical = {0};
+    if (!dst || !temp || buildAxis(&horizontal, img->width, width) != 0 ||
+        buildAxis(&vertical, img->height, height) != 0) {
+        printf("Error: Memory allocation failed for resize\n");
+        planar_free(dst);
+        free(temp);
+        freeAxis(&horizontal);
+        freeAxis(&vertical);
+        return NULL;
+    }
+
+    for (int c = 0; c < 3; c++) {
+        t_resizeState state = {img, dst, temp, c, &horizontal, &vertical};
+        parallel_for(0, img->height, 16, resizeRowsHorizontal, &state);
+        parallel_for(0, height, 16, resizeRowsVertical, &state);
+    }
+
+    free(temp);
+    freeAxis(&horizontal);
+    freeAxis(&vertical);
+    return dst;
+}
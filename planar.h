@@ -0,0 +1,60 @@
+/*
+ * planar.h
+ * Author: Simon Hillel
+ * Description: Header for 16-bit planar images and linear-light processing.
+ * Declares sRGB <-> linear lookup tables, conversion between t_bmp24 and 16-bit planar
+ * buffers, and the convolution and resize operations that work on those buffers. Chained
+ * operations stay in the planar buffer, so the conversion is paid once per chain.
+ */
+#ifndef PLANAR_H
+#define PLANAR_H
+
+#include <stdint.h>
+#include "bmp24.h"
+
+// 16-bit planar image: one plane per channel, rows top-down like t_bmp24
+typedef struct {
+    int width;
+    int height;
+    int linearLight;       // 1: planes hold linear light, 0: gamma-encoded values scaled by 257
+    uint16_t * planes[3];  // red, green, blue, width * height samples each
+} t_planar16;
+
+/**
+ * Converts an sRGB-encoded 8-bit value to 16-bit linear light (table lookup).
+ */
+uint16_t planar_srgbToLinear(uint8_t value);
+/**
+ * Converts a 16-bit linear-light value to an sRGB-encoded 8-bit value (table lookup).
+ */
+uint8_t planar_linearToSrgb(uint16_t value);
+/**
+ * Allocates an uninitialised planar image.
+ */
+t_planar16 * planar_allocate(int width, int height, int linearLight);
+/**
+ * Frees a planar image and its planes.
+ */
+void planar_free(t_planar16 * img);
+/**
+ * Converts a 24-bit image to a 16-bit planar image, optionally decoding sRGB to linear light.
+ */
+t_planar16 * planar_fromBmp24(t_bmp24 * img, int linearLight);
+/**
+ * Writes a planar image back into a 24-bit image of the same size (re-encoding sRGB if needed).
+ */
+void planar_store(const t_planar16 * src, t_bmp24 * dst);
+/**
+ * Converts a planar image into a new 24-bit image.
+ */
+t_bmp24 * planar_toBmp24(const t_planar16 * img);
+/**
+ * Applies a convolution kernel to every plane (same border handling as bmp24_applyFilter).
+ */
+void planar_applyFilter(t_planar16 * img, float ** kernel, int kernelSize);
+/**
+ * Resamples a planar image to a new size by area averaging (enlarging replicates samples).
+ */
+t_planar16 * planar_resize(const t_planar16 * img, int width, int height);
+
+#endif // PLANAR_H
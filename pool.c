@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "pool.h"
+
+/*
+ * pool.c
+ * Author: Simon Hillel
+ * Description: Implementation of the scratch buffer pool.
+ * Each buffer is preceded by a header holding its capacity. Freed buffers go to a list,
+ * while the total stays under the configured limit; an allocation takes the smallest kept
+ * buffer that is large enough and not more than twice the request, so a small request does
+ * not pin a huge buffer. The pool is shared by all threads behind one mutex, which is only
+ * taken once per buffer, not per pixel.
+ */
+
+// Header in front of every buffer, padded to keep the payload aligned
+typedef union t_poolBlock {
+    struct {
+        size_t capacity;
+        union t_poolBlock * next;
+    } info;
+    max_align_t align;
+} t_poolBlock;
+
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static t_poolBlock * freeList = NULL;
+static size_t maxRetained = 0;
+static size_t retainedBytes = 0;
+static unsigned long hitCount = 0;
+static unsigned long missCount = 0;
+
+/**
+ * Sets the limit of bytes kept for reuse. Kept buffers beyond a lower limit are released.
+ * @param limit The limit in bytes (0 disables pooling).
+ */
+void pool_configure(size_t limit) {
+    pthread_mutex_lock(&poolLock);
+    maxRetained = limit;
+    while (freeList && retainedBytes > maxRetained) {
+        t_poolBlock * block = freeList;
+        freeList = block->info.next;
+        retainedBytes -= block->info.capacity;
+        free(block);
+    }
+    pthread_mutex_unlock(&poolLock);
+}
+
+/**
+ * Returns a buffer of at least size bytes, reusing a kept buffer when one fits.
+ * @param size The size in bytes.
+ * @return Pointer to the buffer, or NULL on failure.
+ */
+void * pool_alloc(size_t size) {
+    pthread_mutex_lock(&poolLock);
+    t_poolBlock ** best = NULL;
+    for (t_poolBlock ** link = &freeList; *link; link = &(*link)->info.next) {
+        size_t capacity = (*link)->info.capacity;
+        if (capacity >= size && capacity / 2 <= size &&
+            (!best || capacity < (*best)->info.capacity)) {
+            best = link;
+        }
+    }
+    if (best) {
+        t_poolBlock * block = *best;
+        *best = block->info.next;
+        retainedBytes -= block->info.capacity;
+        hitCount++;
+        pthread_mutex_unlock(&poolLock);
+        return block + 1;
+    }
+    missCount++;
+    pthread_mutex_unlock(&poolLock);
+
+    t_poolBlock * block = (t_poolBlock *)malloc(sizeof(t_poolBlock) + size);
+    if (!block) return NULL;
+    block->info.capacity = size;
+    return block + 1;
+}
+
+/**
+ * Releases a buffer; it is kept for reuse if the pool stays under its limit.
+ * @param buffer The buffer (may be NULL).
+ */
+void pool_free(void * buffer) {
+    if (!buffer) return;
+    t_poolBlock * block = (t_poolBlock *)buffer - 1;
+
+    pthread_mutex_lock(&poolLock);
+    if (retainedBytes + block->info.capacity <= maxRetained) {
+        block->info.next = freeList;
+        freeList = block;
+        retainedBytes += block->info.capacity;
+        block = NULL;
+    }
+    pthread_mutex_unlock(&poolLock);
+    free(block);
+}
+
+/**
+ * Reports the state of the pool.
+ * @param retained Receives the bytes kept for reuse (may be NULL).
+ * @param hits Receives the number of allocations served from the pool (may be NULL).
+ * @param misses Receives the number of allocations that needed new memory (may be NULL).
+ */
+void pool_stats(size_t * retained, unsigned long * hits, unsigned long * misses) {
+    pthread_mutex_lock(&poolLock);
+    if (retained) *retained = retainedBytes;
+    if (hits) *hits = hitCount;
+    if (misses) *misses = missCount;
+    pthread_mutex_unlock(&poolLock);
+}
@@ -0,0 +1,31 @@
+/*
+ * pool.h
+ * Author: Simon Hillel
+ * Description: Header for the pool of large scratch buffers.
+ * Loaders allocate a buffer the size of the whole file for every image. A long-running
+ * process (the daemon) keeps freed buffers for the next request instead of returning them
+ * to the system, so repeated requests do not page-fault fresh memory each time.
+ */
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/**
+ * Sets how many bytes of freed buffers are kept for reuse (0, the default, keeps none).
+ */
+void pool_configure(size_t limit);
+/**
+ * Returns a buffer of at least size bytes (free with pool_free), or NULL on failure.
+ */
+void * pool_alloc(size_t size);
+/**
+ * Releases a buffer from pool_alloc, keeping it for reuse if the pool has room.
+ */
+void pool_free(void * buffer);
+/**
+ * Reports the bytes kept and how many allocations were served from the pool (hits) or not.
+ */
+void pool_stats(size_t * retained, unsigned long * hits, unsigned long * misses);
+
+#endif // POOL_H
@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "preview.h"
+
+/*
+ * preview.c
+ * Author: Simon Hillel
+ * Description: Implementation of the proxy preview mode.
+ * The proxy is the original image downscaled so its longest side is PREVIEW_MAX_SIDE: colour
+ * images by area averaging (bmp24_resize), 8-bit images by sampling, since averaging palette
+ * indices would mix unrelated colours. Point operations and equalization act on the proxy as
+ * on the full image; 3x3 filters use kernels scaled to the proxy (kernel_scale), otherwise a
+ * blur would cover 1 / scale times more of the picture than it will at full resolution.
+ * Every step costs time proportional to the pixel count, so the full-resolution estimate is
+ * the proxy time multiplied by the pixel ratio.
+ * A background save copies the highest cached full-resolution result that ends a run of
+ * steps and the steps after it, so the user can keep editing while it runs. It applies the
+ * steps run by run, like the edit stack; cancellation is checked between runs.
+ */
+
+// --- Proxy --- //
+
+/**
+ * Downscales an 8-bit image by nearest sampling, keeping its palette.
+ */
+static t_bmp8 * downscale8(const t_bmp8 * src, unsigned int width, unsigned int height) {
+    t_bmp8 * dst = bmp8_allocate(width, height);
+    if (!dst) return NULL;
+
+    memcpy(dst->colorTable, src->colorTable, sizeof(dst->colorTable));
+    dst->numColors = src->numColors;
+    dst->paletteMode = src->paletteMode;
+    for (unsigned int y = 0; y < height; y++) {
+        const unsigned char * srcRow = src->data + (size_t)(y * src->height / height) * src->width;
+        unsigned char * dstRow = dst->data + (size_t)y * width;
+        for (unsigned int x = 0; x < width; x++) {
+            dstRow[x] = srcRow[(size_t)x * src->width / width];
+        }
+    }
+    return dst;
+}
+
+/**
+ * Creates a proxy preview of an edit stack. The proxy is built from the original image and
+ * replays the stack's steps; the stack itself switches to deferred rendering.
+ * @param full The full-resolution edit stack.
+ * @return Pointer to the preview, or NULL on failure.
+ */
+t_preview * preview_create(t_editStack * full) {
+    if (!full) return NULL;
+
+    const t_tileSnapshot * original = full->checkpoints[0].snap;
+    int width = original->width;
+    int height = original->height;
+    int longest = width > height ? width : height;
+    float scale = longest > PREVIEW_MAX_SIDE ? (float)PREVIEW_MAX_SIDE / longest : 1.0f;
+    int proxyWidth = (int)(width * scale + 0.5f);
+    int proxyHeight = (int)(height * scale + 0.5f);
+    if (proxyWidth < 1) proxyWidth = 1;
+    if (proxyHeight < 1) proxyHeight = 1;
+
+    t_editStack * proxy = NULL;
+    if (full->isColor) {
+        // Reuse the working image when it still holds the original
+        t_bmp24 * source = full->workIndex == 0 ? full->work24 : tiles_toBmp24(original);
+        if (!source) return NULL;
+        t_bmp24 * small = scale < 1.0f ? bmp24_resize(source, proxyWidth, proxyHeight, 0) : bmp24_copy(source);
+        if (source != full->work24) bmp24_free(source);
+        if (small) proxy = editStack_create24(small, 0);
+    } else {
+        t_bmp8 * source = full->workIndex == 0 ? full->work8 : tiles_toBmp8(original);
+        if (!source) return NULL;
+        t_bmp8 * small = downscale8(source, proxyWidth, proxyHeight);
+        if (source != full->work8) bmp8_free(source);
+        if (small) proxy = editStack_create8(small, 0);
+    }
+    if (!proxy) {
+        printf("Error: Failed to create the preview image\n");
+        return NULL;
+    }
+
+    t_preview * preview = (t_preview *)malloc(sizeof(t_preview));
+    if (!preview) {
+        editStack_free(proxy);
+        return NULL;
+    }
+    preview->proxy = proxy;
+    preview->scale = (float)proxyWidth / width;
+    preview->fullWidth = width;
+    preview->fullHeight = height;
+
+    editStack_setKernelScale(proxy, preview->scale);
+    for (int i = 0; i < full->numOps; i++) {
+        editStack_push(proxy, full->ops[i]);
+    }
+    editStack_setDeferred(full, 1);
+    return preview;
+}
+
+/**
+ * Frees a preview and switches the full-resolution stack back to rendering on every edit.
+ * @param preview Pointer to the preview.
+ * @param full The full-resolution edit stack (may be NULL).
+ */
+void preview_free(t_preview * preview, t_editStack * full) {
+    if (!preview) return;
+    editStack_free(preview->proxy);
+    free(preview);
+    editStack_setDeferred(full, 0);
+}
+
+/**
+ * Prints the time the proxy took for all steps and the estimated full-resolution time.
+ * @param preview Pointer to the preview.
+ */
+void preview_report(const t_preview * preview) {
+    double seconds = editStack_seconds(preview->proxy);
+    double ratio = 1.0 / ((double)preview->scale * preview->scale);
+    printf("Preview at %.0f%%: %.1f ms for %d step(s); full resolution (%dx%d) estimated at %.2f s\n",
+           preview->scale * 100.0, seconds * 1000.0, preview->proxy->numOps,
+           preview->fullWidth, preview->fullHeight, seconds * ratio);
+}
+
+/**
+ * Prints information about the proxy image, followed by the full-resolution estimate.
+ * @param preview Pointer to the preview.
+ */
+void preview_printInfo(t_preview * preview) {
+    printf("Preview of a %dx%d image (statistics below are from the proxy):\n",
+           preview->fullWidth, preview->fullHeight);
+    if (preview->proxy->isColor) {
+        bmp24_printInfo(editStack_current24(preview->proxy));
+    } else {
+        bmp8_printInfo(editStack_current8(preview->proxy));
+    }
+    preview_report(preview);
+}
+
+// --- Background Save --- //
+
+static void * saveThread(void * arg) {
+    t_saveJob * job = (t_saveJob *)arg;
+
+    // Steps are grouped into runs as the edit stack groups them, so the file matches the preview
+    for (int i = 0; i < job->numOps;) {
+        if (atomic_load(&job->cancel)) {
+            atomic_store(&job->state, SAVE_JOB_CANCELLED);
+            return NULL;
+        }
+        int run = job->img24 ? editStack_runLength(&job->ops[i], job->numOps - i) : 1;
+        if (job->img24) editStack_applyOps24(job->img24, &job->ops[i], run, 1.0f);
+        else editStack_applyOp8(job->img8, job->ops[i]);
+        atomic_fetch_add(&job->step, run);
+        i += run;
+    }
+    if (atomic_load(&job->cancel)) {
+        atomic_store(&job->state, SAVE_JOB_CANCELLED);
+        return NULL;
+    }
+
+    int status = job->img24 ? bmp24_saveImage(job->img24, job->filename)
+                            : bmp8_saveImage(job->filename, job->img8);
+    atomic_store(&job->state, status == 0 ? SAVE_JOB_DONE : SAVE_JOB_FAILED);
+    return NULL;
+}
+
+static void freeJob(t_saveJob * job) {
+    bmp24_free(job->img24);
+    bmp8_free(job->img8);
+    free(job->ops);
+    free(job);
+}
+
+/**
+ * Starts rendering an edit stack at full resolution and saving it, in a background thread.
+ * The job works on its own copy of the highest cached result and of the remaining steps.
+ * @param full The full-resolution edit stack.
+ * @param filename The path of the file to write.
+ * @return Pointer to the job, or NULL on failure.
+ */
+t_saveJob * preview_startSave(t_editStack * full, const char * filename) {
+    if (!full || !filename) return NULL;
+
+    t_saveJob * job = (t_saveJob *)calloc(1, sizeof(t_saveJob));
+    if (!job) return NULL;
+
+    int first = 0;
+    if (full->isColor) job->img24 = editStack_base24(full, &first);
+    else job->img8 = editStack_base8(full, &first);
+    job->numOps = full->numOps - first;
+    job->ops = (t_editOp *)malloc((job->numOps + 1) * sizeof(t_editOp));
+    if ((!job->img24 && !job->img8) || !job->ops) {
+        printf("Error: Failed to start the background save\n");
+        freeJob(job);
+        return NULL;
+    }
+    memcpy(job->ops, full->ops + first, job->numOps * sizeof(t_editOp));
+    snprintf(job->filename, sizeof(job->filename), "%s", filename);
+    atomic_init(&job->cancel, 0);
+    atomic_init(&job->state, SAVE_JOB_RUNNING);
+    atomic_init(&job->step, 0);
+
+    if (pthread_create(&job->thread, NULL, saveThread, job) != 0) {
+        printf("Error: Failed to start the background save\n");
+        freeJob(job);
+        return NULL;
+    }
+    return job;
+}
+
+/**
+ * Asks a background save to stop. Steps are not interrupted; the job stops before the next
+ * run of steps, or before writing the file.
+ * @param job Pointer to the job.
+ */
+void preview_cancelSave(t_saveJob * job) {
+    if (job) atomic_store(&job->cancel, 1);
+}
+
+/**
+ * Returns the state of a background save.
+ * @param job Pointer to the job.
+ * @return The state.
+ */
+t_saveJobState preview_saveState(t_saveJob * job) {
+    return job ? (t_saveJobState)atomic_load(&job->state) : SAVE_JOB_FAILED;
+}
+
+/**
+ * Waits for a background save to end and frees it.
+ * @param job Pointer to the job.
+ * @return The final state.
+ */
+t_saveJobState preview_finishSave(t_saveJob * job) {
+    if (!job) return SAVE_JOB_FAILED;
+    pthread_join(job->thread, NULL);
+    t_saveJobState state = (t_saveJobState)atomic_load(&job->state);
+    freeJob(job);
+    return state;
+}
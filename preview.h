@@ -0,0 +1,80 @@
+/*
+ * preview.h
+ * Author: Simon Hillel
+ * Description: Header for the proxy preview mode of the interactive menu.
+ * A preview keeps a downscaled copy (proxy) of the image with its own edit stack, so filters
+ * show up at once while the full-resolution stack only records them. The time measured on
+ * the proxy gives an estimate of the full-resolution cost. The full-resolution render runs
+ * on save, in a background thread that can be cancelled.
+ */
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "editstack.h"
+
+// Longest side of the proxy, in pixels
+#define PREVIEW_MAX_SIDE 1024
+
+typedef struct {
+    t_editStack * proxy;      // Edit stack over the downscaled image
+    float scale;              // Proxy size / full size
+    int fullWidth;
+    int fullHeight;
+} t_preview;
+
+// State of a background save
+typedef enum {
+    SAVE_JOB_RUNNING,
+    SAVE_JOB_DONE,
+    SAVE_JOB_CANCELLED,
+    SAVE_JOB_FAILED
+} t_saveJobState;
+
+typedef struct {
+    pthread_t thread;
+    t_bmp24 * img24;          // Image being rendered (colour)
+    t_bmp8 * img8;            // Image being rendered (8-bit)
+    t_editOp * ops;           // Steps still to apply
+    int numOps;
+    char filename[256];
+    atomic_int cancel;
+    atomic_int state;         // t_saveJobState
+    atomic_int step;          // Steps applied so far
+} t_saveJob;
+
+/**
+ * Creates a proxy preview of a stack; the stack is switched to deferred rendering.
+ */
+t_preview * preview_create(t_editStack * full);
+/**
+ * Frees a preview; the stack renders on every edit again.
+ */
+void preview_free(t_preview * preview, t_editStack * full);
+/**
+ * Prints the proxy render time and the estimated full-resolution cost of all steps.
+ */
+void preview_report(const t_preview * preview);
+/**
+ * Prints information about the proxy image and the full-resolution estimate.
+ */
+void preview_printInfo(t_preview * preview);
+/**
+ * Starts rendering a stack at full resolution and saving it in a background thread.
+ */
+t_saveJob * preview_startSave(t_editStack * full, const char * filename);
+/**
+ * Asks a background save to stop; it stops before the next run of steps.
+ */
+void preview_cancelSave(t_saveJob * job);
+/**
+ * Returns the state of a background save without waiting.
+ */
+t_saveJobState preview_saveState(t_saveJob * job);
+/**
+ * Waits for a background save, frees it and returns its final state.
+ */
+t_saveJobState preview_finishSave(t_saveJob * job);
+
+#endif // PREVIEW_H
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "quantize.h"
+#include "parallel.h"
+
+/*
+ * quantize.c
+ * Author: Simon Hillel
+ * Description: Implementation of colour quantisation from 24-bit to indexed 8-bit images.
+ * The palette is generated by median cut over a sampled 32x32x32 colour histogram. Pixels are
+ * then mapped through a precomputed inverse colour map (one nearest-colour search per histogram
+ * cell instead of per pixel), in parallel over rows.
+ */
+
+// Maximum number of pixels sampled into the colour histogram
+#define QUANTIZE_MAX_SAMPLES (1 << 20)
+
+// Histogram cell index of a colour
+#define CELL_INDEX(r, g, b) ((((r) >> (8 - QUANTIZE_BITS)) << (2 * QUANTIZE_BITS)) | \
+                             (((g) >> (8 - QUANTIZE_BITS)) << QUANTIZE_BITS) | \
+                             ((b) >> (8 - QUANTIZE_BITS)))
+
+// Number of cells along one axis of the histogram
+#define SIDE (1 << QUANTIZE_BITS)
+
+// Sampled colour histogram: pixel count and channel sums per cell
+typedef struct {
+    uint32_t count[QUANTIZE_CELLS];
+    uint32_t sumRed[QUANTIZE_CELLS];
+    uint32_t sumGreen[QUANTIZE_CELLS];
+    uint32_t sumBlue[QUANTIZE_CELLS];
+} t_colorHistogram;
+
+// Axis-aligned box of histogram cells (bounds inclusive)
+typedef struct {
+    int min[3];
+    int max[3];
+    uint32_t count;
+} t_colorBox;
+
+// --- Histogram and Median Cut --- //
+
+/**
+ * Returns the histogram index of cell (c[0], c[1], c[2]) = (red, green, blue).
+ */
+static int cellOf(const int * c) {
+    return (c[0] << (2 * QUANTIZE_BITS)) | (c[1] << QUANTIZE_BITS) | c[2];
+}
+
+/**
+ * Fills the histogram from at most QUANTIZE_MAX_SAMPLES evenly spaced pixels.
+ * @param img Pointer to the t_bmp24 structure.
+ * @param hist Pointer to the zeroed histogram.
+ */
+static void sampleHistogram(t_bmp24 * img, t_colorHistogram * hist) {
+    uint64_t numPixels = (uint64_t)img->width * img->height;
+    uint64_t step = numPixels / QUANTIZE_MAX_SAMPLES + 1;
+
+    for (uint64_t i = 0; i < numPixels; i += step) {
+        t_pixel p = img->data[i / img->width][i % img->width];
+        int cell = CELL_INDEX(p.red, p.green, p.blue);
+        hist->count[cell]++;
+        hist->sumRed[cell] += p.red;
+        hist->sumGreen[cell] += p.green;
+        hist->sumBlue[cell] += p.blue;
+    }
+}
+
+/**
+ * Shrinks a box to the bounds of its non-empty cells and recounts its population.
+ * @param hist Pointer to the histogram.
+ * @param box The box to shrink.
+ */
+static void shrinkBox(const t_colorHistogram * hist, t_colorBox * box) {
+    int lo[3] = {SIDE, SIDE, SIDE}, hi[3] = {-1, -1, -1};
+    int c[3];
+    box->count = 0;
+    for (c[0] = box->min[0]; c[0] <= box->max[0]; c[0]++) {
+        for (c[1] = box->min[1]; c[1] <= box->max[1]; c[1]++) {
+            for (c[2] = box->min[2]; c[2] <= box->max[2]; c[2]++) {
+                uint32_t n = hist->count[cellOf(c)];
+                if (!n) continue;
+                box->count += n;
+                for (int a = 0; a < 3; a++) {
+                    if (c[a] < lo[a]) lo[a] = c[a];
+                    if (c[a] > hi[a]) hi[a] = c[a];
+                }
+            }
+        }
+    }
+    if (box->count) {
+        memcpy(box->min, lo, sizeof(lo));
+        memcpy(box->max, hi, sizeof(hi));
+    }
+}
+
+/**
+ * Splits a box at the population median of its longest axis.
+ * @param hist Pointer to the histogram.
+ * @param box The box to split; keeps the lower half.
+ * @param other Receives the upper half.
+ */
+static void splitBox(const t_colorHistogram * hist, t_colorBox * box, t_colorBox * other) {
+    int axis = 0;
+    for (int a = 1; a < 3; a++) {
+        if (box->max[a] - box->min[a] > box->max[axis] - box->min[axis]) axis = a;
+    }
+
+    // Population of each slice along the axis
+    uint32_t slice[SIDE] = {0};
+    int c[3];
+    for (c[0] = box->min[0]; c[0] <= box->max[0]; c[0]++) {
+        for (c[1] = box->min[1]; c[1] <= box->max[1]; c[1]++) {
+            for (c[2] = box->min[2]; c[2] <= box->max[2]; c[2]++) {
+                slice[c[axis]] += hist->count[cellOf(c)];
+            }
+        }
+    }
+
+    // Cut after the slice where the running count reaches half (both halves stay non-empty)
+    int cut = box->min[axis];
+    uint32_t running = slice[cut];
+    while (cut + 1 < box->max[axis] && running * 2 < box->count) {
+        cut++;
+        running += slice[cut];
+    }
+
+    *other = *box;
+    box->max[axis] = cut;
+    other->min[axis] = cut + 1;
+    shrinkBox(hist, box);
+    shrinkBox(hist, other);
+}
+
+/**
+ * Builds a palette by median cut over a sampled colour histogram.
+ * The most populated splittable box is split until numColors boxes exist (or nothing
+ * can be split); each palette entry is the mean colour of its box.
+ * @param img Pointer to the t_bmp24 structure.
+ * @param numColors The maximum number of palette entries (1-256).
+ * @param colorTable Receives the palette as BGR0 entries (1024 bytes).
+ * @return The number of palette entries generated, or 0 on failure.
+ */
+int quantize_buildPalette(t_bmp24 * img, int numColors, unsigned char * colorTable) {
+    if (!img || !img->data || !colorTable || numColors < 1 || numColors > BMP8_PALETTE_SIZE) return 0;
+
+    t_colorHistogram * hist = (t_colorHistogram *)calloc(1, sizeof(t_colorHistogram));
+    if (!hist) {
+        printf("Error: Memory allocation failed for colour histogram\n");
+        return 0;
+    }
+    sampleHistogram(img, hist);
+
+    t_colorBox boxes[BMP8_PALETTE_SIZE];
+    int numBoxes = 1;
+    for (int a = 0; a < 3; a++) {
+        boxes[0].min[a] = 0;
+        boxes[0].max[a] = SIDE - 1;
+    }
+    shrinkBox(hist, &boxes[0]);
+
+    while (numBoxes < numColors) {
+        int best = -1;
+        for (int i = 0; i < numBoxes; i++) {
+            int splittable = boxes[i].max[0] > boxes[i].min[0] || boxes[i].max[1] > boxes[i].min[1] ||
+                             boxes[i].max[2] > boxes[i].min[2];
+            if (splittable && (best < 0 || boxes[i].count > boxes[best].count)) best = i;
+        }
+        if (best < 0) break;
+        splitBox(hist, &boxes[best], &boxes[numBoxes]);
+        numBoxes++;
+    }
+
+    memset(colorTable, 0, BMP8_PALETTE_SIZE * 4);
+    for (int i = 0; i < numBoxes; i++) {
+        uint64_t n = 0, r = 0, g = 0, b = 0;
+        int c[3];
+        for (c[0] = boxes[i].min[0]; c[0] <= boxes[i].max[0]; c[0]++) {
+            for (c[1] = boxes[i].min[1]; c[1] <= boxes[i].max[1]; c[1]++) {
+                for (c[2] = boxes[i].min[2]; c[2] <= boxes[i].max[2]; c[2]++) {
+                    int cell = cellOf(c);
+                    n += hist->count[cell];
+                    r += hist->sumRed[cell];
+                    g += hist->sumGreen[cell];
+                    b += hist->sumBlue[cell];
+                }
+            }
+        }
+        if (n == 0) n = 1;
+        colorTable[i * 4] = (unsigned char)((b + n / 2) / n);
+        colorTable[i * 4 + 1] = (unsigned char)((g + n / 2) / n);
+        colorTable[i * 4 + 2] = (unsigned char)((r + n / 2) / n);
+    }
+
+    free(hist);
+    return numBoxes;
+}
+
+// --- Inverse Colour Map --- //
+
+// Shared state for building the inverse colour map
+typedef struct {
+    const unsigned char * colorTable;
+    int numColors;
+    unsigned char * inverseMap;
+} t_inverseMapState;
+
+static void inverseMapSlices(int begin, int end, void * ctx) {
+    t_inverseMapState * s = (t_inverseMapState *)ctx;
+    int half = 1 << (7 - QUANTIZE_BITS);
+
+    for (int r5 = begin; r5 < end; r5++) {
+        for (int g5 = 0; g5 < SIDE; g5++) {
+            for (int b5 = 0; b5 < SIDE; b5++) {
+                // Compare against the centre of the cell
+                int r = (r5 << (8 - QUANTIZE_BITS)) + half;
+                int g = (g5 << (8 - QUANTIZE_BITS)) + half;
+                int b = (b5 << (8 - QUANTIZE_BITS)) + half;
+                int best = 0, bestDist = 1 << 30;
+                for (int i = 0; i < s->numColors; i++) {
+                    const unsigned char * entry = &s->colorTable[i * 4];
+                    int db = b - entry[0], dg = g - entry[1], dr = r - entry[2];
+                    int dist = dr * dr + dg * dg + db * db;
+                    if (dist < bestDist) {
+                        bestDist = dist;
+                        best = i;
+                    }
+                }
+                s->inverseMap[(r5 << (2 * QUANTIZE_BITS)) | (g5 << QUANTIZE_BITS) | b5] = (unsigned char)best;
+            }
+        }
+    }
+}
+
+/**
+ * Builds the inverse colour map: the nearest palette index for the centre of every cell.
+ * @param colorTable The palette as BGR0 entries.
+ * @param numColors The number of palette entries.
+ * @param inverseMap Receives QUANTIZE_CELLS palette indices.
+ */
+void quantize_buildInverseMap(const unsigned char * colorTable, int numColors, unsigned char * inverseMap) {
+    t_inverseMapState state = {colorTable, numColors, inverseMap};
+    parallel_for(0, SIDE, 1, inverseMapSlices, &state);
+}
+
+// --- Mapping --- //
+
+// Shared state for the pixel mapping pass
+typedef struct {
+    t_bmp24 * src;
+    t_bmp8 * dst;
+    const unsigned char * inverseMap;
+} t_mapState;
+
+static void mapRows(int begin, int end, void * ctx) {
+    t_mapState * s = (t_mapState *)ctx;
+    for (int y = begin; y < end; y++) {
+        const t_pixel * src = s->src->data[y];
+        // t_bmp8 keeps rows in file (bottom-up) order
+        unsigned char * dst = &s->dst->data[(s->src->height - 1 - y) * s->src->width];
+        for (int x = 0; x < s->src->width; x++) {
+            dst[x] = s->inverseMap[CELL_INDEX(src[x].red, src[x].green, src[x].blue)];
+        }
+    }
+}
+
+/**
+ * Converts a 24-bit image into an indexed 8-bit image.
+ * @param img Pointer to the t_bmp24 structure (not modified).
+ * @param numColors The maximum number of palette entries (1-256).
+ * @return Pointer to the new t_bmp8 structure with a real colour table, or NULL on failure.
+ */
+t_bmp8 * quantize_toIndexed(t_bmp24 * img, int numColors) {
+    if (!img || !img->data) return NULL;
+
+    t_bmp8 * out = bmp8_allocate(img->width, img->height);
+    unsigned char * inverseMap = (unsigned char *)malloc(QUANTIZE_CELLS);
+    if (!out || !inverseMap) {
+        printf("Error: Memory allocation failed for quantisation\n");
+        bmp8_free(out);
+        free(inverseMap);
+        return NULL;
+    }
+
+    int paletteSize = quantize_buildPalette(img, numColors, out->colorTable);
+    if (paletteSize == 0) {
+        bmp8_free(out);
+        free(inverseMap);
+        return NULL;
+    }
+    out->numColors = paletteSize;
+    quantize_buildInverseMap(out->colorTable, paletteSize, inverseMap);
+
+    t_mapState state = {img, out, inverseMap};
+    parallel_for(0, img->height, 16, mapRows, &state);
+
+    free(inverseMap);
+    return out;
+}
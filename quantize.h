@@ -0,0 +1,30 @@
+/*
+ * quantize.h
+ * Author: Simon Hillel
+ * Description: Header for colour quantisation functions.
+ * Declares conversion of 24-bit images into indexed 8-bit images with a generated palette.
+ */
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include "bmp8.h"
+#include "bmp24.h"
+
+// Bits kept per channel in the colour histogram and the inverse colour map (32 x 32 x 32 cells)
+#define QUANTIZE_BITS 5
+#define QUANTIZE_CELLS (1 << (3 * QUANTIZE_BITS))
+
+/**
+ * Builds a palette of at most numColors entries by median cut over a sampled colour histogram.
+ */
+int quantize_buildPalette(t_bmp24 * img, int numColors, unsigned char * colorTable);
+/**
+ * Builds the 32x32x32 inverse colour map: the nearest palette index for every histogram cell.
+ */
+void quantize_buildInverseMap(const unsigned char * colorTable, int numColors, unsigned char * inverseMap);
+/**
+ * Converts a 24-bit image into an indexed 8-bit image with at most numColors palette entries.
+ */
+t_bmp8 * quantize_toIndexed(t_bmp24 * img, int numColors);
+
+#endif // QUANTIZE_H
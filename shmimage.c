@@ -0,0 +1,266 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shmimage.h"
+
+/*
+ * shmimage.c
+ * Author: Simon Hillel
+ * Description: Implementation of shared-memory image exchange.
+ * A BGR24 segment is always used in place: t_bmp24 keeps one pointer per row, so the view's
+ * rows simply point into the mapping, whatever the stride. t_bmp8 keeps one contiguous buffer
+ * of unpadded bottom-up rows, so a GRAY8 segment is used in place only when its stride is
+ * -width; other layouts are copied into a t_bmp8 and written back by shmImage_sync.
+ * The descriptor is validated against the segment size before any row is touched.
+ */
+
+// --- Views --- //
+
+static uint8_t * topRow(const t_shmImage * shm) {
+    return shm->base + shm->descriptor.dataOffset;
+}
+
+/**
+ * Copies the rows of a GRAY8 segment into an 8-bit image (or back), flipping to bottom-up order.
+ */
+static void copyRows8(t_shmImage * shm, t_bmp8 * img, int toImage) {
+    unsigned int width = shm->descriptor.width;
+    unsigned int height = shm->descriptor.height;
+    for (unsigned int y = 0; y < height; y++) {
+        uint8_t * row = topRow(shm) + (ptrdiff_t)y * shm->descriptor.stride;
+        unsigned char * imgRow = img->data + (size_t)(height - 1 - y) * width;
+        if (toImage) memcpy(imgRow, row, width);
+        else memcpy(row, imgRow, width);
+    }
+}
+
+/**
+ * Validates the descriptor of a mapped segment and creates its image view.
+ * @return 0 on success, -1 on failure.
+ */
+static int createView(t_shmImage * shm) {
+    const t_shmDescriptor * d = &shm->descriptor;
+    if (d->magic != SHM_IMAGE_MAGIC || (d->format != SHM_FORMAT_GRAY8 && d->format != SHM_FORMAT_BGR24) ||
+        d->width == 0 || d->height == 0) {
+        printf("Error: Invalid shared image descriptor\n");
+        return -1;
+    }
+
+    // Every row must lie inside the segment, after the descriptor
+    long long rowBytes = (long long)d->width * (d->format / 8);
+    long long first = d->dataOffset;
+    long long last = first + (long long)(d->height - 1) * d->stride;
+    long long lowest = first < last ? first : last;
+    long long highest = first < last ? last : first;
+    if ((d->stride >= 0 ? d->stride : -(long long)d->stride) < rowBytes ||
+        lowest < (long long)sizeof(t_shmDescriptor) || highest + rowBytes > (long long)shm->size) {
+        printf("Error: Shared image rows do not fit in the segment\n");
+        return -1;
+    }
+
+    if (d->format == SHM_FORMAT_BGR24) {
+        shm->img24 = bmp24_wrap(topRow(shm), d->width, d->height, d->stride);
+        return shm->img24 ? 0 : -1;
+    }
+
+    if (d->stride == -(int32_t)d->width) {
+        // Same layout as t_bmp8: the bottom row is the lowest in memory
+        shm->img8 = bmp8_wrap(shm->base + lowest, d->width, d->height);
+        return shm->img8 ? 0 : -1;
+    }
+    shm->img8 = bmp8_allocate(d->width, d->height);
+    if (!shm->img8) return -1;
+    shm->copied8 = 1;
+    copyRows8(shm, shm->img8, 1);
+    return 0;
+}
+
+/**
+ * Maps a segment file descriptor and creates its view.
+ */
+static t_shmImage * mapSegment(int fd, const char * handle) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(t_shmDescriptor)) {
+        printf("Error: Shared image segment %s is too small\n", handle);
+        close(fd);
+        return NULL;
+    }
+
+    t_shmImage * shm = (t_shmImage *)calloc(1, sizeof(t_shmImage));
+    if (!shm) {
+        close(fd);
+        return NULL;
+    }
+    shm->fd = fd;
+    shm->size = info.st_size;
+    snprintf(shm->handle, sizeof(shm->handle), "%s", handle);
+    shm->base = (uint8_t *)mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shm->base == MAP_FAILED) {
+        printf("Error: Cannot map shared image segment %s\n", handle);
+        close(fd);
+        free(shm);
+        return NULL;
+    }
+    memcpy(&shm->descriptor, shm->base, sizeof(t_shmDescriptor));
+
+    if (createView(shm) != 0) {
+        munmap(shm->base, shm->size);
+        close(fd);
+        free(shm);
+        return NULL;
+    }
+    return shm;
+}
+
+// --- Segments --- //
+
+/**
+ * Creates a segment holding an image of the given format and size, with unpadded rows at
+ * SHM_IMAGE_DATA_OFFSET (top-down for BGR24, bottom-up for GRAY8), and maps it.
+ * @param name POSIX shm name ("/name", created exclusively), or NULL for an anonymous memfd
+ *             (its handle is /proc/<pid>/fd/<n>, valid while this process keeps it open).
+ * @param format The pixel format.
+ * @param width The width in pixels.
+ * @param height The height in pixels.
+ * @return Pointer to the mapped segment, or NULL on failure.
+ */
+t_shmImage * shmImage_create(const char * name, t_shmFormat format, int width, int height) {
+    if (width <= 0 || height <= 0 || (format != SHM_FORMAT_GRAY8 && format != SHM_FORMAT_BGR24)) return NULL;
+
+    char handle[64];
+    int fd;
+    if (name) {
+        snprintf(handle, sizeof(handle), "%s", name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    } else {
+        fd = memfd_create("image", MFD_CLOEXEC);
+        snprintf(handle, sizeof(handle), "/proc/%d/fd/%d", (int)getpid(), fd);
+    }
+    if (fd < 0) {
+        printf("Error: Cannot create shared image segment %s\n", name ? name : "(memfd)");
+        return NULL;
+    }
+
+    t_shmDescriptor descriptor = {0};
+    descriptor.magic = SHM_IMAGE_MAGIC;
+    descriptor.format = format;
+    descriptor.width = width;
+    descriptor.height = height;
+    descriptor.stride = width * (format / 8);
+    descriptor.dataOffset = SHM_IMAGE_DATA_OFFSET;
+    size_t size = SHM_IMAGE_DATA_OFFSET + (size_t)descriptor.stride * height;
+    if (format == SHM_FORMAT_GRAY8) {
+        // Bottom-up, as t_bmp8 stores its rows, so the segment is used in place
+        descriptor.dataOffset += (uint32_t)(height - 1) * width;
+        descriptor.stride = -width;
+    }
+    if (ftruncate(fd, size) != 0 || pwrite(fd, &descriptor, sizeof(descriptor), 0) != sizeof(descriptor)) {
+        printf("Error: Cannot size shared image segment %s\n", handle);
+        close(fd);
+        if (name) shm_unlink(name);
+        return NULL;
+    }
+    return mapSegment(fd, handle);
+}
+
+/**
+ * Maps an existing segment.
+ * @param handle A POSIX shm name ("/name", a single path component) or a file path such as
+ *               /proc/<pid>/fd/<n> (memfd of another process) or a file in /dev/shm.
+ * @return Pointer to the mapped segment, or NULL on failure.
+ */
+t_shmImage * shmImage_open(const char * handle) {
+    if (!handle) return NULL;
+    int isShmName = handle[0] == '/' && !strchr(handle + 1, '/');
+    int fd = isShmName ? shm_open(handle, O_RDWR, 0) : open(handle, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        printf("Error: Cannot open shared image segment %s\n", handle);
+        return NULL;
+    }
+    return mapSegment(fd, handle);
+}
+
+/**
+ * Copies a colour image into a BGR24 segment.
+ * @param shm The segment.
+ * @param img The image (same size as the segment).
+ * @return 0 on success, -1 on failure.
+ */
+int shmImage_store24(t_shmImage * shm, const t_bmp24 * img) {
+    if (!shm || !shm->img24 || !img || !img->data ||
+        img->width != shm->img24->width || img->height != shm->img24->height) {
+        printf("Error: Image does not match the shared image segment\n");
+        return -1;
+    }
+    if (img == shm->img24) return 0;
+    for (int y = 0; y < img->height; y++) {
+        memcpy(shm->img24->data[y], img->data[y], (size_t)img->width * sizeof(t_pixel));
+    }
+    return 0;
+}
+
+/**
+ * Copies an 8-bit image into a GRAY8 segment. Indexed images are converted through their
+ * palette (luminance), since the segment holds intensities.
+ * @param shm The segment.
+ * @param img The image (same size as the segment).
+ * @return 0 on success, -1 on failure.
+ */
+int shmImage_store8(t_shmImage * shm, const t_bmp8 * img) {
+    if (!shm || !shm->img8 || !img || !img->data ||
+        img->width != shm->img8->width || img->height != shm->img8->height) {
+        printf("Error: Image does not match the shared image segment\n");
+        return -1;
+    }
+    if (img == shm->img8) return 0;
+
+    size_t numPixels = (size_t)img->width * img->height;
+    memcpy(shm->img8->data, img->data, numPixels);
+    if (!bmp8_isGrayscalePalette(img)) {
+        memcpy(shm->img8->colorTable, img->colorTable, sizeof(img->colorTable));
+        shm->img8->numColors = img->numColors;
+        bmp8_bakePalette(shm->img8);
+    }
+    if (!shm->copied8) return 0;
+    copyRows8(shm, shm->img8, 0);
+    return 0;
+}
+
+/**
+ * Writes the pixels of a copied 8-bit view back to the segment. Palette changes made by
+ * point operations on indexed views are baked into the intensities first.
+ * @param shm The segment.
+ */
+void shmImage_sync(t_shmImage * shm) {
+    if (!shm || !shm->img8) return;
+    if (!bmp8_isGrayscalePalette(shm->img8)) bmp8_bakePalette(shm->img8);
+    if (shm->copied8) copyRows8(shm, shm->img8, 0);
+}
+
+/**
+ * Syncs and unmaps a segment and closes its descriptor.
+ * @param shm The segment.
+ */
+void shmImage_close(t_shmImage * shm) {
+    if (!shm) return;
+    shmImage_sync(shm);
+    bmp24_freeView(shm->img24);
+    if (shm->copied8) bmp8_free(shm->img8);
+    else bmp8_freeView(shm->img8);
+    munmap(shm->base, shm->size);
+    close(shm->fd);
+    free(shm);
+}
+
+/**
+ * Removes the name of a POSIX shared-memory segment.
+ * @param name The segment name ("/name").
+ */
+void shmImage_unlink(const char * name) {
+    if (name && shm_unlink(name) != 0) printf("Error: Cannot remove shared image segment %s\n", name);
+}
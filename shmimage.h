@@ -0,0 +1,78 @@
+/*
+ * shmimage.h
+ * Author: Simon Hillel
+ * Description: Header for images exchanged through shared memory (memfd or POSIX shm).
+ * A segment starts with a small descriptor (format, size, row stride, offset of the pixels)
+ * followed by the pixel rows, so a producer that already holds decoded frames can hand them
+ * over without writing a BMP file. Mapped segments are exposed as t_bmp24/t_bmp8 views whose
+ * rows point into the segment, so filters run in place on the shared pixels.
+ */
+#ifndef SHMIMAGE_H
+#define SHMIMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bmp8.h"
+#include "bmp24.h"
+
+// "SIMG", first field of every segment
+#define SHM_IMAGE_MAGIC 0x474D4953u
+// Offset of the pixels in segments created by shmImage_create
+#define SHM_IMAGE_DATA_OFFSET 64
+
+typedef enum {
+    SHM_FORMAT_GRAY8 = 8,     // 1 byte per pixel
+    SHM_FORMAT_BGR24 = 24     // 3 bytes per pixel, blue first (as t_pixel)
+} t_shmFormat;
+
+// Descriptor at the start of a segment
+typedef struct {
+    uint32_t magic;           // SHM_IMAGE_MAGIC
+    uint32_t format;          // t_shmFormat
+    uint32_t width;
+    uint32_t height;
+    int32_t stride;           // Bytes from one row to the next; negative if rows are stored bottom-up
+    uint32_t dataOffset;      // Offset of the top row from the start of the segment
+} t_shmDescriptor;
+
+typedef struct {
+    int fd;
+    uint8_t * base;           // Mapping of the whole segment
+    size_t size;
+    t_shmDescriptor descriptor;
+    char handle[64];          // Name to open the segment from another process
+    t_bmp24 * img24;          // View of a BGR24 segment (rows in the segment)
+    t_bmp8 * img8;            // View of a GRAY8 segment
+    int copied8;              // img8 is a copy (rows not bottom-up and unpadded), written back on sync
+} t_shmImage;
+
+/**
+ * Creates a segment (POSIX shm if name is set, memfd otherwise) and maps it.
+ */
+t_shmImage * shmImage_create(const char * name, t_shmFormat format, int width, int height);
+/**
+ * Maps a segment by handle: a POSIX shm name ("/name") or a file path, e.g. /proc/<pid>/fd/<n> for a memfd.
+ */
+t_shmImage * shmImage_open(const char * handle);
+/**
+ * Copies a colour image into a BGR24 segment of the same size. Returns 0 on success, -1 otherwise.
+ */
+int shmImage_store24(t_shmImage * shm, const t_bmp24 * img);
+/**
+ * Copies an 8-bit image (through its palette) into a GRAY8 segment of the same size. Returns 0 or -1.
+ */
+int shmImage_store8(t_shmImage * shm, const t_bmp8 * img);
+/**
+ * Writes a copied 8-bit view back to the segment (nothing to do for in-place views).
+ */
+void shmImage_sync(t_shmImage * shm);
+/**
+ * Syncs, unmaps and closes a segment (a POSIX segment is not unlinked).
+ */
+void shmImage_close(t_shmImage * shm);
+/**
+ * Removes the name of a POSIX segment; it is freed once every mapping is closed.
+ */
+void shmImage_unlink(const char * name);
+
+#endif // SHMIMAGE_H
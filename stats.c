@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <math.h>
+#include "stats.h"
+#include "parallel.h"
+#include "dispatch.h"
+
+/*
+ * stats.c
+ * Author: Simon Hillel
+ * Description: Implementation of single-pass image statistics.
+ * The only per-pixel work is one histogram increment per channel; min, max, mean and standard
+ * deviation are then derived exactly from the 256-bin integer histograms. Row bands are counted
+ * in parallel and merged with integer additions, so the result does not depend on the thread
+ * count or scheduling.
+ */
+
+// Rows per parallel band
+#define STATS_BAND_ROWS 32
+
+// Shared state of a statistics pass
+typedef struct {
+    t_bmp24 * img24;
+    t_bmp8 * img8;
+    unsigned char intensity[256];   // Palette luminance per index (8-bit images)
+    _Atomic uint64_t histogram[3][256];
+} t_statsState;
+
+/**
+ * Adds a band's local histograms to the shared totals.
+ */
+static void mergeHistograms(t_statsState * s, int numChannels, uint32_t local[][256]) {
+    for (int c = 0; c < numChannels; c++) {
+        for (int v = 0; v < 256; v++) {
+            if (local[c][v]) atomic_fetch_add_explicit(&s->histogram[c][v], local[c][v], memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Counts a band of a 24-bit image with the dispatched histogram kernel.
+ */
+static void countRows24(int begin, int end, void * ctx) {
+    t_statsState * s = (t_statsState *)ctx;
+    const uint8_t * rows[STATS_BAND_ROWS];
+    uint32_t local[3][256];
+    memset(local, 0, sizeof(local));
+
+    for (int y = begin; y < end; y++) {
+        rows[y - begin] = (const uint8_t *)s->img24->data[y];
+    }
+    dispatch_get()->histogram24(rows, end - begin, s->img24->width, local);
+
+    // The kernel counts in pixel byte order (blue, green, red)
+    uint32_t rgb[3][256];
+    memcpy(rgb[0], local[2], sizeof(rgb[0]));
+    memcpy(rgb[1], local[1], sizeof(rgb[1]));
+    memcpy(rgb[2], local[0], sizeof(rgb[2]));
+    mergeHistograms(s, 3, rgb);
+}
+
+/**
+ * Counts a band of an 8-bit image.
+ */
+static void countRows8(int begin, int end, void * ctx) {
+    t_statsState * s = (t_statsState *)ctx;
+    uint32_t local[256];
+    memset(local, 0, sizeof(local));
+
+    size_t width = s->img8->width;
+    dispatch_get()->histogram8(&s->img8->data[begin * width], (end - begin) * width, local);
+
+    // Bins are counted per palette index and folded into intensities once per band
+    uint32_t folded[1][256];
+    memset(folded, 0, sizeof(folded));
+    for (int v = 0; v < 256; v++) {
+        folded[0][s->intensity[v]] += local[v];
+    }
+
+    mergeHistograms(s, 1, folded);
+}
+
+/**
+ * Derives min, max, mean and standard deviation of every channel from the histograms.
+ */
+static void finishStats(t_statsState * s, t_imageStats * stats, int numChannels, uint64_t numPixels) {
+    stats->numChannels = numChannels;
+    stats->numPixels = numPixels;
+    for (int c = 0; c < numChannels; c++) {
+        t_channelStats * ch = &stats->channels[c];
+        uint64_t sum = 0, sumSquares = 0;
+        int min = -1, max = 0;
+        for (int v = 0; v < 256; v++) {
+            uint64_t n = atomic_load(&s->histogram[c][v]);
+            ch->histogram[v] = n;
+            if (!n) continue;
+            if (min < 0) min = v;
+            max = v;
+            sum += n * v;
+            sumSquares += n * v * v;
+        }
+        ch->min = (uint8_t)(min < 0 ? 0 : min);
+        ch->max = (uint8_t)max;
+        ch->mean = numPixels ? (double)sum / numPixels : 0.0;
+        double variance = numPixels ? (double)sumSquares / numPixels - ch->mean * ch->mean : 0.0;
+        ch->stddev = variance > 0.0 ? sqrt(variance) : 0.0;
+    }
+}
+
+/**
+ * Computes the statistics of every channel of a 24-bit image in one pass.
+ * @param img Pointer to the t_bmp24 structure.
+ * @param stats Receives the statistics (channels: red, green, blue).
+ * @return 0 on success, -1 on failure.
+ */
+int stats_computeBmp24(t_bmp24 * img, t_imageStats * stats) {
+    if (!img || !img->data || !stats) return -1;
+
+    t_statsState * s = (t_statsState *)calloc(1, sizeof(t_statsState));
+    if (!s) return -1;
+    s->img24 = img;
+    parallel_for(0, img->height, STATS_BAND_ROWS, countRows24, s);
+    finishStats(s, stats, 3, (uint64_t)img->width * img->height);
+    free(s);
+    return 0;
+}
+
+/**
+ * Computes the intensity statistics of an 8-bit image in one pass.
+ * Indexed images are measured through the luminance of their palette entries.
+ * @param img Pointer to the t_bmp8 structure.
+ * @param stats Receives the statistics (one channel).
+ * @return 0 on success, -1 on failure.
+ */
+int stats_computeBmp8(t_bmp8 * img, t_imageStats * stats) {
+    if (!img || !img->data || !stats) return -1;
+
+    t_statsState * s = (t_statsState *)calloc(1, sizeof(t_statsState));
+    if (!s) return -1;
+    s->img8 = img;
+    for (int i = 0; i < 256; i++) {
+        const unsigned char * entry = &img->colorTable[i * 4];
+        s->intensity[i] = (unsigned char)((114 * entry[0] + 587 * entry[1] + 299 * entry[2] + 500) / 1000);
+    }
+    parallel_for(0, img->height, STATS_BAND_ROWS, countRows8, s);
+    finishStats(s, stats, 1, (uint64_t)img->width * img->height);
+    free(s);
+    return 0;
+}
+
+/**
+ * Returns the display name of a channel.
+ */
+static const char * channelName(const t_imageStats * stats, int c) {
+    static const char * names[3] = {"red", "green", "blue"};
+    return stats->numChannels == 1 ? "gray" : names[c];
+}
+
+/**
+ * Prints the statistics as indented text lines.
+ * @param stats Pointer to the statistics.
+ */
+void stats_print(const t_imageStats * stats) {
+    for (int c = 0; c < stats->numChannels; c++) {
+        const t_channelStats * ch = &stats->channels[c];
+        printf("  %-5s min %3u  max %3u  mean %7.2f  stddev %6.2f\n",
+               channelName(stats, c), ch->min, ch->max, ch->mean, ch->stddev);
+    }
+}
+
+/**
+ * Writes the statistics as a JSON object:
+ * {"pixels": N, "channels": {"red": {"min": .., "max": .., "mean": .., "stddev": .., "histogram": [..]}, ...}}
+ * @param stats Pointer to the statistics.
+ * @param out The output stream.
+ */
+void stats_printJSON(const t_imageStats * stats, FILE * out) {
+    fprintf(out, "{\"pixels\": %llu, \"channels\": {", (unsigned long long)stats->numPixels);
+    for (int c = 0; c < stats->numChannels; c++) {
+        const t_channelStats * ch = &stats->channels[c];
+        fprintf(out, "%s\"%s\": {\"min\": %u, \"max\": %u, \"mean\": %.4f, \"stddev\": %.4f, \"histogram\": [",
+                c ? ", " : "", channelName(stats, c), ch->min, ch->max, ch->mean, ch->stddev);
+        for (int v = 0; v < 256; v++) {
+            fprintf(out, "%s%llu", v ? ", " : "", (unsigned long long)ch->histogram[v]);
+        }
+        fprintf(out, "]}");
+    }
+    fprintf(out, "}}");
+}
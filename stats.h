@@ -0,0 +1,49 @@
+/*
+ * stats.h
+ * Author: Simon Hillel
+ * Description: Header for image statistics functions.
+ * Declares the per-channel statistics (min, max, mean, standard deviation, histogram) gathered
+ * in one pass over an 8-bit or 24-bit image, and their text and JSON output.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "bmp8.h"
+#include "bmp24.h"
+
+// Statistics of one channel
+typedef struct {
+    uint8_t min;
+    uint8_t max;
+    double mean;
+    double stddev;
+    uint64_t histogram[256];
+} t_channelStats;
+
+// Statistics of a whole image
+typedef struct {
+    int numChannels;            // 1 for 8-bit images (intensity), 3 for 24-bit images (red, green, blue)
+    uint64_t numPixels;
+    t_channelStats channels[3];
+} t_imageStats;
+
+/**
+ * Computes the statistics of every channel of a 24-bit image in one pass.
+ */
+int stats_computeBmp24(t_bmp24 * img, t_imageStats * stats);
+/**
+ * Computes the intensity statistics of an 8-bit image in one pass (through the palette).
+ */
+int stats_computeBmp8(t_bmp8 * img, t_imageStats * stats);
+/**
+ * Prints the statistics as indented text lines (used by the printInfo functions).
+ */
+void stats_print(const t_imageStats * stats);
+/**
+ * Writes the statistics as a JSON object.
+ */
+void stats_printJSON(const t_imageStats * stats, FILE * out);
+
+#endif // STATS_H
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "batch.h"
+#include "bmp24.h"
+#include "test_util.h"
+
+/*
+ * test_batch.c
+ * Author: Simon Hillel
+ * Description: Tests of the batch mode.
+ * A manifest of several units run by several workers must run every job once and record
+ * every unit; a second run must only run the units without a record; and a run must refuse
+ * to resume against a manifest that changed. A unit claimed by a process that dies must be
+ * run by the workers in the same run.
+ */
+
+#define NUM_JOBS (2 * BATCH_UNIT_LINES + 88)   // Three units, the last one partial
+
+static char directory[64];
+static char manifest[128];
+
+static void outputPath(int job, char * path, size_t size) {
+    snprintf(path, size, "%s/out_%d.bmp", directory, job);
+}
+
+static int exists(const char * path) {
+    return access(path, F_OK) == 0;
+}
+
+/**
+ * Writes a manifest of NUM_JOBS negative jobs on one small input, with a comment and a blank line.
+ */
+static void writeManifest(void) {
+    char input[128];
+    snprintf(input, sizeof(input), "%s/in.bmp", directory);
+    t_bmp24 * img = createImage24(24, 16, PATTERN_MID_RANGE);
+    bmp24_saveImage(img, input);
+    bmp24_free(img);
+
+    FILE * file = fopen(manifest, "w");
+    fprintf(file, "# test manifest\n\n");
+    for (int job = 2; job < NUM_JOBS; job++) {
+        char output[128];
+        outputPath(job, output, sizeof(output));
+        fprintf(file, "%s %s negative\n", input, output);
+    }
+    fclose(file);
+}
+
+/**
+ * Returns the number of jobs recorded as done in the state directory, or -1 if a unit has no record.
+ */
+static int recordedJobs(void) {
+    int total = 0;
+    for (int unit = 0; unit < 3; unit++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s.state/unit-%d.done", manifest, unit);
+        FILE * file = fopen(path, "r");
+        unsigned long jobs = 0, failed = 0;
+        if (!file) return -1;
+        if (fscanf(file, "jobs %lu failed %lu", &jobs, &failed) != 2 || failed != 0) total = -1000000;
+        fclose(file);
+        total += (int)jobs;
+    }
+    return total;
+}
+
+static void testRunAndResume(void) {
+    writeManifest();
+    check(batch_run(manifest, 3) == 0, "a manifest of three units runs with three workers");
+    check(recordedJobs() == NUM_JOBS - 2, "every job is recorded once, comments and blank lines skipped");
+    int allOutputs = 1;
+    for (int job = 2; job < NUM_JOBS; job++) {
+        char output[128];
+        outputPath(job, output, sizeof(output));
+        allOutputs &= exists(output);
+    }
+    check(allOutputs, "every job wrote its output");
+
+    char input[128], first[128];
+    snprintf(input, sizeof(input), "%s/in.bmp", directory);
+    outputPath(2, first, sizeof(first));
+    t_bmp24 * original = bmp24_loadImage(input);
+    t_bmp24 * negative = bmp24_loadImage(first);
+    bmp24_negative(original);
+    check(samePixels24(original, negative), "the job output is the negative of the input");
+    bmp24_free(original);
+    bmp24_free(negative);
+
+    // Resume: only the unit without a record runs again
+    char record[256], output[128];
+    snprintf(record, sizeof(record), "%s.state/unit-1.done", manifest);
+    unlink(record);
+    unlink(first);
+    outputPath(BATCH_UNIT_LINES + 10, output, sizeof(output));
+    unlink(output);
+    check(batch_run(manifest, 2) == 0, "a resumed run completes");
+    check(exists(output), "the unit without a record runs again");
+    check(!exists(first), "units with a record are not run again");
+    check(recordedJobs() == NUM_JOBS - 2, "the resumed unit is recorded again");
+
+    // A changed manifest no longer matches the recorded units
+    FILE * file = fopen(manifest, "a");
+    fprintf(file, "%s %s negative\n", input, first);
+    fclose(file);
+    check(batch_run(manifest, 2) != 0, "a run refuses to resume against a changed manifest");
+}
+
+static void testStaleClaim(void) {
+    writeManifest();
+    char stateDir[160], claims[192];
+    snprintf(stateDir, sizeof(stateDir), "%s.state", manifest);
+    snprintf(claims, sizeof(claims), "%s/claims", stateDir);
+    mkdir(stateDir, 0755);
+
+    // A process claims unit 1 like a worker, then dies while the run is going
+    int ready[2];
+    if (pipe(ready) != 0) return;
+    pid_t holder = fork();
+    if (holder == 0) {
+        int fd = open(claims, O_RDWR | O_CREAT, 0644);
+        struct flock claim;
+        memset(&claim, 0, sizeof(claim));
+        claim.l_type = F_WRLCK;
+        claim.l_whence = SEEK_SET;
+        claim.l_start = 1;
+        claim.l_len = 1;
+        char byte = fd >= 0 && fcntl(fd, F_SETLK, &claim) == 0 ? 1 : 0;
+        if (write(ready[1], &byte, 1) != 1) _exit(1);
+        usleep(300000);
+        _exit(0);
+    }
+    char locked = 0;
+    if (read(ready[0], &locked, 1) != 1) locked = 0;
+    close(ready[0]);
+    close(ready[1]);
+    check(locked, "unit 1 is claimed by another process");
+
+    check(batch_run(manifest, 2) == 0, "a run completes when a claim holder dies");
+    check(recordedJobs() == NUM_JOBS - 2, "the unit of the dead claim holder is run in the same run");
+    waitpid(holder, NULL, 0);
+}
+
+/**
+ * Removes the files of the test.
+ */
+static void cleanUp(void) {
+    char path[256];
+    for (int job = 0; job < NUM_JOBS; job++) {
+        outputPath(job, path, sizeof(path));
+        unlink(path);
+    }
+    const char * stateFiles[] = {"manifest", "claims"};
+    for (int i = 0; i < 2; i++) {
+        snprintf(path, sizeof(path), "%s.state/%s", manifest, stateFiles[i]);
+        unlink(path);
+    }
+    for (int unit = 0; unit < 3; unit++) {
+        snprintf(path, sizeof(path), "%s.state/unit-%d.done", manifest, unit);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s.state", manifest);
+    rmdir(path);
+    snprintf(path, sizeof(path), "%s/in.bmp", directory);
+    unlink(path);
+    unlink(manifest);
+    rmdir(directory);
+}
+
+int main(void) {
+    snprintf(directory, sizeof(directory), "/tmp/test_batch_%d", (int)getpid());
+    snprintf(manifest, sizeof(manifest), "%s/manifest.txt", directory);
+    mkdir(directory, 0755);
+    testRunAndResume();
+    cleanUp();
+    mkdir(directory, 0755);
+    testStaleClaim();
+    cleanUp();
+    return testResult("batch");
+}
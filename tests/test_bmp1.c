@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "bmp1.h"
+#include "bmp8.h"
+#include "test_util.h"
+
+/*
+ * test_bmp1.c
+ * Author: Simon Hillel
+ * Description: Tests of 1-bit images.
+ * Thresholding, morphology and labelling work on packed bits a byte (or 16 pixels) at a time;
+ * each is compared with a pixel-by-pixel reference on random images whose widths are not
+ * multiples of 8 or 16, so the partial bytes at the end of the rows are covered.
+ */
+
+/**
+ * Creates an 8-bit image of pseudo-random levels.
+ */
+static t_bmp8 * createRandom8(int width, int height, unsigned int seed) {
+    t_bmp8 * img = bmp8_allocate(width, height);
+    for (size_t i = 0; i < (size_t)width * height; i++) {
+        seed = seed * 1103515245u + 12345u;
+        img->data[i] = (uint8_t)(seed >> 16);
+    }
+    return img;
+}
+
+/**
+ * Returns the bit at (x, y), 0 outside the image for dilation and 1 for erosion.
+ */
+static int bitOrOutside(const t_bmp1 * img, int x, int y, int outside) {
+    if (x < 0 || y < 0 || x >= (int)img->width || y >= (int)img->height) return outside;
+    return bmp1_getPixel(img, x, y);
+}
+
+static void testThreshold(int width, int height) {
+    char what[128];
+    t_bmp8 * gray = createRandom8(width, height, 99u + width);
+    t_bmp1 * bits = bmp1_threshold(gray, 128);
+    int same = 1;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (bmp1_getPixel(bits, x, y) != (gray->data[(size_t)y * width + x] >= 128)) same = 0;
+        }
+    }
+    snprintf(what, sizeof(what), "%dx%d threshold packs value >= threshold", width, height);
+    check(same, what);
+
+    t_bmp8 * expanded = bmp1_toBmp8(bits);
+    same = 1;
+    for (size_t i = 0; i < (size_t)width * height; i++) {
+        if (expanded->data[i] != (gray->data[i] >= 128 ? 255 : 0)) same = 0;
+    }
+    snprintf(what, sizeof(what), "%dx%d expansion maps bits through the black/white palette", width, height);
+    check(same, what);
+    bmp8_free(expanded);
+    bmp1_free(bits);
+    bmp8_free(gray);
+}
+
+static void testMorphology(int width, int height, int dilate) {
+    char what[128];
+    t_bmp8 * gray = createRandom8(width, height, 7u + width);
+    t_bmp1 * bits = bmp1_threshold(gray, dilate ? 224 : 32);
+    t_bmp1 * result = bmp1_threshold(gray, dilate ? 224 : 32);
+    if (dilate) bmp1_dilate(result);
+    else bmp1_erode(result);
+
+    int same = 1;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int expected = !dilate;
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    int bit = bitOrOutside(bits, x + dx, y + dy, !dilate);
+                    expected = dilate ? (expected | bit) : (expected & bit);
+                }
+            }
+            if (bmp1_getPixel(result, x, y) != expected) same = 0;
+        }
+    }
+    snprintf(what, sizeof(what), "%dx%d %s matches the 3x3 reference", width, height, dilate ? "dilation" : "erosion");
+    check(same, what);
+    bmp1_free(result);
+    bmp1_free(bits);
+    bmp8_free(gray);
+}
+
+/**
+ * Labels the 8-connected component at (x, y) with a flood fill, updating its statistics.
+ */
+static void floodFill(const t_bmp1 * img, int * labels, int x, int y, int label, t_bmp1_component * c) {
+    int * stack = (int *)malloc((size_t)img->width * img->height * 2 * sizeof(int));
+    int top = 0;
+    stack[top++] = x;
+    stack[top++] = y;
+    labels[(size_t)y * img->width + x] = label;
+    while (top > 0) {
+        int py = stack[--top], px = stack[--top];
+        c->area++;
+        if ((unsigned int)px < c->minX) c->minX = px;
+        if ((unsigned int)px > c->maxX) c->maxX = px;
+        if ((unsigned int)py < c->minY) c->minY = py;
+        if ((unsigned int)py > c->maxY) c->maxY = py;
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                int nx = px + dx, ny = py + dy;
+                if (!bitOrOutside(img, nx, ny, 0) || labels[(size_t)ny * img->width + nx] >= 0) continue;
+                labels[(size_t)ny * img->width + nx] = label;
+                stack[top++] = nx;
+                stack[top++] = ny;
+            }
+        }
+    }
+    free(stack);
+}
+
+static void testComponents(int width, int height, int threshold) {
+    char what[128];
+    t_bmp8 * gray = createRandom8(width, height, 31u + threshold);
+    t_bmp1 * bits = bmp1_threshold(gray, threshold);
+    t_bmp1_component * components = NULL;
+    int count = bmp1_connectedComponents(bits, &components);
+
+    // Components are numbered in the order of their first pixel in scan order
+    int * labels = (int *)malloc((size_t)width * height * sizeof(int));
+    t_bmp1_component * expected = (t_bmp1_component *)malloc((size_t)width * height * sizeof(t_bmp1_component));
+    for (size_t i = 0; i < (size_t)width * height; i++) labels[i] = -1;
+    int numExpected = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (!bmp1_getPixel(bits, x, y) || labels[(size_t)y * width + x] >= 0) continue;
+            t_bmp1_component c = {0, (unsigned int)width, (unsigned int)height, 0, 0};
+            floodFill(bits, labels, x, y, numExpected, &c);
+            expected[numExpected++] = c;
+        }
+    }
+
+    snprintf(what, sizeof(what), "%dx%d components at threshold %d: same count as a flood fill", width, height, threshold);
+    check(count == numExpected, what);
+    int same = count == numExpected;
+    for (int i = 0; same && i < count; i++) {
+        same = components[i].area == expected[i].area && components[i].minX == expected[i].minX &&
+               components[i].maxX == expected[i].maxX && components[i].minY == expected[i].minY &&
+               components[i].maxY == expected[i].maxY;
+    }
+    snprintf(what, sizeof(what), "%dx%d components at threshold %d: same areas and bounds", width, height, threshold);
+    check(same, what);
+    free(components);
+    free(expected);
+    free(labels);
+    bmp1_free(bits);
+    bmp8_free(gray);
+}
+
+static void testRoundTrip(int width, int height) {
+    char filename[64], what[128];
+    snprintf(filename, sizeof(filename), "/tmp/test_bmp1_%d.bmp", (int)getpid());
+    t_bmp8 * gray = createRandom8(width, height, 5u);
+    t_bmp1 * bits = bmp1_threshold(gray, 100);
+    bmp1_saveImage(filename, bits);
+    t_bmp1 * loaded = bmp1_loadImage(filename);
+    int same = loaded && loaded->width == bits->width && loaded->height == bits->height;
+    for (int y = 0; same && y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (bmp1_getPixel(loaded, x, y) != bmp1_getPixel(bits, x, y)) same = 0;
+        }
+    }
+    snprintf(what, sizeof(what), "%dx%d 1-bit image round-trips through a file", width, height);
+    check(same, what);
+    bmp1_free(loaded);
+    bmp1_free(bits);
+    bmp8_free(gray);
+    unlink(filename);
+}
+
+int main(void) {
+    int widths[4] = {1, 13, 37, 100};
+    for (int i = 0; i < 4; i++) {
+        testThreshold(widths[i], 23);
+        testMorphology(widths[i], 23, 1);
+        testMorphology(widths[i], 23, 0);
+        testComponents(widths[i], 23, 160);
+        testComponents(widths[i], 23, 96);
+        testRoundTrip(widths[i], 23);
+    }
+    return testResult("1-bit image");
+}
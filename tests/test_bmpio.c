@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "bmp8.h"
+#include "bmp24.h"
+#include "bmpio.h"
+#include "test_util.h"
+
+/*
+ * test_bmpio.c
+ * Author: Simon Hillel
+ * Description: Tests of BMP file I/O.
+ * An image saved and loaded again must come back unchanged in every I/O mode, for widths
+ * with and without row padding, and when written through a shared mapping. (Where the file
+ * system has no O_DIRECT, direct mode falls back to nocache.) The range-split loader must
+ * give the same rows for any number of reading threads, in either row order, and leave the
+ * rows missing from a truncated file black. A top-down file (negative height) must load as
+ * the same image as its bottom-up counterpart, whether saved whole or through the row writer.
+ */
+
+static void testRoundTrip24(t_ioMode mode, int width, int height) {
+    char filename[64], what[128];
+    snprintf(filename, sizeof(filename), "/tmp/test_bmpio_%d.bmp", (int)getpid());
+    t_bmp24 * img = createImage24(width, height, PATTERN_NOISE);
+    bmpio_setMode(mode);
+    check(bmp24_saveImage(img, filename) == 0, "colour image is saved");
+    t_bmp24 * loaded = bmp24_loadImage(filename);
+    bmpio_setMode(BMPIO_MODE_BUFFERED);
+    snprintf(what, sizeof(what), "%dx%d colour image round-trips in %s mode", width, height, bmpio_modeName(mode));
+    check(samePixels24(img, loaded), what);
+    bmp24_free(img);
+    bmp24_free(loaded);
+    unlink(filename);
+}
+
+static void testMappedSave(int width, int height, int topDown) {
+    char filename[64], what[128];
+    snprintf(filename, sizeof(filename), "/tmp/test_bmpio_%d.bmp", (int)getpid());
+    t_bmp24 * img = createImage24(width, height, PATTERN_NOISE);
+    bmp24_setTopDown(img, topDown);
+    check(bmpio_save24(img, filename, BMPIO_MMAP) == 0, "colour image is saved through a mapping");
+    t_bmp24 * loaded = bmp24_loadImage(filename);
+    snprintf(what, sizeof(what), "%dx%d %s colour image round-trips through a mapping", width, height,
+             topDown ? "top-down" : "bottom-up");
+    check(samePixels24(img, loaded), what);
+    bmp24_free(loaded);
+
+    // bmp24_saveImage takes the mapped path for large images when IMAGE_SAVE_MMAP=1
+    setenv("IMAGE_SAVE_MMAP", "1", 1);
+    check(bmp24_saveImage(img, filename) == 0, "colour image is saved with IMAGE_SAVE_MMAP=1");
+    unsetenv("IMAGE_SAVE_MMAP");
+    loaded = bmp24_loadImage(filename);
+    snprintf(what, sizeof(what), "%dx%d colour image round-trips with IMAGE_SAVE_MMAP=1", width, height);
+    check(samePixels24(img, loaded), what);
+    bmp24_free(img);
+    bmp24_free(loaded);
+    unlink(filename);
+}
+
+/**
+ * Returns 1 if the image rows [begin, end) are black.
+ */
+static int blackRows(const t_bmp24 * img, int begin, int end) {
+    for (int y = begin; y < end; y++) {
+        for (int x = 0; x < img->width; x++) {
+            if (img->data[y][x].blue || img->data[y][x].green || img->data[y][x].red) return 0;
+        }
+    }
+    return 1;
+}
+
+static void testThreadedLoad(int width, int height, int topDown) {
+    char filename[64], what[128];
+    snprintf(filename, sizeof(filename), "/tmp/test_bmpio_%d.bmp", (int)getpid());
+    t_bmp24 * img = createImage24(width, height, PATTERN_NOISE);
+    bmp24_setTopDown(img, topDown);
+    check(bmp24_saveImage(img, filename) == 0, "colour image is saved");
+    const char * order = topDown ? "top-down" : "bottom-up";
+
+    int threadCounts[5] = {1, 2, 3, 7, 16};
+    for (int i = 0; i < 5; i++) {
+        t_bmp24 * loaded = bmp24_allocate(width, height, 24);
+        loaded->header.offset = BMP_HEADER_SIZE + BMP_INFOHEADER_SIZE;
+        loaded->header_info.height = topDown ? -height : height;
+        int fd = open(filename, O_RDONLY);
+        snprintf(what, sizeof(what), "%dx%d %s rows read with %d thread(s)", width, height, order, threadCounts[i]);
+        check(bmpio_readPixels24(loaded, fd, threadCounts[i]) == 0 && samePixels24(img, loaded), what);
+        close(fd);
+        bmp24_free(loaded);
+    }
+
+    // Only the first half of the file rows is left
+    size_t padded = ((size_t)width * 3 + 3) & ~(size_t)3;
+    check(truncate(filename, BMP_HEADER_SIZE + BMP_INFOHEADER_SIZE + padded * (height / 2)) == 0, "file is truncated");
+    t_bmp24 * loaded = bmp24_allocate(width, height, 24);
+    loaded->header.offset = BMP_HEADER_SIZE + BMP_INFOHEADER_SIZE;
+    loaded->header_info.height = topDown ? -height : height;
+    int fd = open(filename, O_RDONLY);
+    check(bmpio_readPixels24(loaded, fd, 4) == -1, "a truncated file is reported short");
+    close(fd);
+    int kept = 1;
+    int keptBegin = topDown ? 0 : height - height / 2, keptEnd = topDown ? height / 2 : height;
+    for (int y = keptBegin; y < keptEnd; y++) {
+        if (memcmp(loaded->data[y], img->data[y], width * sizeof(t_pixel)) != 0) kept = 0;
+    }
+    snprintf(what, sizeof(what), "%dx%d %s truncated file: rows present are read, the others are black",
+             width, height, order);
+    check(kept && blackRows(loaded, topDown ? height / 2 : 0, topDown ? height : height - height / 2), what);
+    bmp24_free(loaded);
+    bmp24_free(img);
+    unlink(filename);
+}
+
+static void testTopDown(t_ioMode mode, int width, int height) {
+    char bottomUpName[64], topDownName[64], what[128];
+    snprintf(bottomUpName, sizeof(bottomUpName), "/tmp/test_bmpio_%d.bmp", (int)getpid());
+    snprintf(topDownName, sizeof(topDownName), "/tmp/test_bmpio_%d_top.bmp", (int)getpid());
+    t_bmp24 * img = createImage24(width, height, PATTERN_NOISE);
+    bmpio_setMode(mode);
+    check(bmp24_saveImage(img, bottomUpName) == 0, "bottom-up image is saved");
+    bmp24_setTopDown(img, 1);
+    check(bmp24_saveImage(img, topDownName) == 0, "top-down image is saved");
+
+    t_bmpFields fields;
+    check(bmpio_probe(topDownName, &fields) == 0 && fields.height == -height, "top-down file has a negative height");
+    t_bmp24 * bottomUp = bmp24_loadImage(bottomUpName);
+    t_bmp24 * topDown = bmp24_loadImage(topDownName);
+    bmpio_setMode(BMPIO_MODE_BUFFERED);
+    snprintf(what, sizeof(what), "%dx%d top-down file loads like the bottom-up one in %s mode", width, height,
+             bmpio_modeName(mode));
+    check(samePixels24(bottomUp, topDown) && samePixels24(img, topDown), what);
+    check(bmp24_isTopDown(topDown) && !bmp24_isTopDown(bottomUp), "loaded images keep their row order");
+    bmp24_free(bottomUp);
+    bmp24_free(topDown);
+
+    // The row writer takes the rows top row first in either order
+    for (int order = 0; order <= 1; order++) {
+        t_bmpWriter * writer = bmpio_openWriter(topDownName, width, height, order);
+        int status = writer ? 0 : -1;
+        for (int y = 0; writer && y < height; y++) status |= bmpio_writeRow(writer, img->data[y]);
+        status |= writer ? bmpio_closeWriter(writer, 0) : -1;
+        t_bmp24 * written = bmp24_loadImage(topDownName);
+        snprintf(what, sizeof(what), "%dx%d image written row by row (%s) loads unchanged", width, height,
+                 order ? "top-down" : "bottom-up");
+        check(status == 0 && samePixels24(img, written), what);
+        bmp24_free(written);
+    }
+    t_bmpWriter * partial = bmpio_openWriter(topDownName, width, height, 1);
+    if (partial) bmpio_writeRow(partial, img->data[0]);
+    check(partial && bmpio_closeWriter(partial, 0) == -1, "closing a writer with rows missing fails");
+
+    bmp24_free(img);
+    unlink(bottomUpName);
+    unlink(topDownName);
+}
+
+static void testRoundTrip8(t_ioMode mode, int width, int height) {
+    char filename[64], what[128];
+    snprintf(filename, sizeof(filename), "/tmp/test_bmpio_%d.bmp", (int)getpid());
+    t_bmp8 * img = createImage8(width, height, PATTERN_NOISE);
+    bmpio_setMode(mode);
+    check(bmp8_saveImage(filename, img) == 0, "8-bit image is saved");
+    t_bmp8 * loaded = bmp8_loadImage(filename);
+    bmpio_setMode(BMPIO_MODE_BUFFERED);
+    snprintf(what, sizeof(what), "%dx%d 8-bit image round-trips in %s mode", width, height, bmpio_modeName(mode));
+    check(samePixels8(img, loaded), what);
+    bmp8_free(img);
+    bmp8_free(loaded);
+    unlink(filename);
+}
+
+int main(void) {
+    t_ioMode modes[3] = {BMPIO_MODE_BUFFERED, BMPIO_MODE_NOCACHE, BMPIO_MODE_DIRECT};
+    for (int i = 0; i < 3; i++) {
+        testRoundTrip24(modes[i], 64, 48);
+        testRoundTrip24(modes[i], 1365, 1031);     // Padded rows, over one direct chunk
+        testRoundTrip8(modes[i], 63, 47);
+        testRoundTrip8(modes[i], 4099, 1030);
+        testTopDown(modes[i], 37, 29);
+        testTopDown(modes[i], 1365, 1031);
+    }
+    testThreadedLoad(1365, 1031, 0);
+    testThreadedLoad(1365, 1031, 1);
+    testThreadedLoad(33, 5, 0);
+    testMappedSave(63, 47, 0);
+    testMappedSave(1365, 1031, 0);
+    testMappedSave(1365, 1031, 1);
+    return testResult("BMP I/O");
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bmp8.h"
+#include "bmp24.h"
+#include "catalog.h"
+#include "test_util.h"
+
+/*
+ * test_catalog.c
+ * Author: Simon Hillel
+ * Description: Tests of the image catalog.
+ * A scan must list the .bmp files of a directory tree with their header fields, mark files
+ * that are not valid BMPs, and skip other files. A second scan must reuse every unchanged
+ * entry and only read the headers of changed files; removed files must leave the catalog.
+ */
+
+static char directory[64];
+
+static void pathOf(const char * name, char * path, size_t size) {
+    snprintf(path, size, "%s/%s", directory, name);
+}
+
+static void saveColour(const char * name, int width, int height, int topDown) {
+    char path[128];
+    pathOf(name, path, sizeof(path));
+    t_bmp24 * img = createImage24(width, height, PATTERN_STRIPES);
+    bmp24_setTopDown(img, topDown);
+    bmp24_saveImage(img, path);
+    bmp24_free(img);
+}
+
+static void writeText(const char * name, const char * text) {
+    char path[128];
+    pathOf(name, path, sizeof(path));
+    FILE * file = fopen(path, "w");
+    fputs(text, file);
+    fclose(file);
+}
+
+static const t_catalogEntry * entryOf(const t_catalog * catalog, const char * name) {
+    char path[128];
+    pathOf(name, path, sizeof(path));
+    return catalog_find(catalog, path);
+}
+
+static void testScan(void) {
+    char path[128];
+    saveColour("a.bmp", 30, 20, 0);
+    pathOf("sub", path, sizeof(path));
+    mkdir(path, 0755);
+    t_bmp8 * gray = createImage8(17, 9, PATTERN_GRADIENT);
+    pathOf("sub/b.bmp", path, sizeof(path));
+    bmp8_saveImage(path, gray);
+    bmp8_free(gray);
+    saveColour("sub/c.BMP", 12, 7, 1);
+    writeText("bad.bmp", "not a bitmap");
+    writeText("notes.txt", "skipped");
+
+    t_catalog * catalog = catalog_scan(directory, NULL);
+    check(catalog && catalog->count == 4, "scan lists the four .bmp files only");
+    check(catalog && catalog->rescanned == 4 && catalog->reused == 0, "first scan reads every header");
+    int sorted = catalog != NULL;
+    for (int i = 1; catalog && i < catalog->count; i++) {
+        if (strcmp(catalog->entries[i - 1].path, catalog->entries[i].path) >= 0) sorted = 0;
+    }
+    check(sorted, "entries are sorted by path");
+
+    const t_catalogEntry * a = catalog ? entryOf(catalog, "a.bmp") : NULL;
+    const t_catalogEntry * b = catalog ? entryOf(catalog, "sub/b.bmp") : NULL;
+    const t_catalogEntry * c = catalog ? entryOf(catalog, "sub/c.BMP") : NULL;
+    const t_catalogEntry * bad = catalog ? entryOf(catalog, "bad.bmp") : NULL;
+    check(a && a->valid && a->width == 30 && a->height == 20 && a->depth == 24, "colour header fields");
+    check(b && b->valid && b->width == 17 && b->height == 9 && b->depth == 8, "8-bit header fields");
+    check(c && c->valid && c->width == 12 && c->height == -7, "top-down file has a negative height");
+    check(bad && !bad->valid, "a file that is not a BMP is listed as invalid");
+    catalog_free(catalog);
+
+    // Second scan: only the changed file is read again, the removed one leaves
+    saveColour("a.bmp", 40, 10, 0);
+    pathOf("sub/b.bmp", path, sizeof(path));
+    unlink(path);
+    catalog = catalog_scan(directory, NULL);
+    check(catalog && catalog->count == 3, "a removed file leaves the catalog");
+    check(catalog && catalog->rescanned == 1 && catalog->reused == 2, "rescan reads only the changed file");
+    a = catalog ? entryOf(catalog, "a.bmp") : NULL;
+    check(a && a->width == 40 && a->height == 10, "the changed file has its new header fields");
+
+    // The index written by the scan loads as the same catalog
+    pathOf(CATALOG_DEFAULT_INDEX, path, sizeof(path));
+    t_catalog * loaded = catalog_load(path);
+    int same = catalog && loaded && loaded->count == catalog->count;
+    for (int i = 0; same && i < catalog->count; i++) {
+        const t_catalogEntry * x = &catalog->entries[i], * y = &loaded->entries[i];
+        same = strcmp(x->path, y->path) == 0 && x->size == y->size && x->mtimeNs == y->mtimeNs &&
+               x->width == y->width && x->height == y->height && x->depth == y->depth && x->valid == y->valid;
+    }
+    check(same, "the saved index loads as the scanned catalog");
+    catalog_free(loaded);
+    catalog_free(catalog);
+
+    writeText(CATALOG_DEFAULT_INDEX, "garbage");
+    check(catalog_load(path) == NULL, "an invalid index is rejected");
+}
+
+/**
+ * Removes the files of the test.
+ */
+static void cleanUp(void) {
+    const char * names[] = {"a.bmp", "sub/b.bmp", "sub/c.BMP", "bad.bmp", "notes.txt", CATALOG_DEFAULT_INDEX, "sub"};
+    char path[128];
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        pathOf(names[i], path, sizeof(path));
+        if (unlink(path) != 0) rmdir(path);
+    }
+    rmdir(directory);
+}
+
+int main(void) {
+    snprintf(directory, sizeof(directory), "/tmp/test_catalog_%d", (int)getpid());
+    mkdir(directory, 0755);
+    testScan();
+    cleanUp();
+    return testResult("catalog");
+}
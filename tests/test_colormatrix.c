@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bmp24.h"
+#include "editstack.h"
+#include "job.h"
+#include "colormatrix.h"
+#include "test_util.h"
+
+/*
+ * test_colormatrix.c
+ * Author: Simon Hillel
+ * Description: Tests of the colour-matrix steps.
+ * The job syntax of the colour-matrix ops must parse, and a composed run of them must match
+ * applying them one by one (up to rounding) when no intermediate value leaves 0-255. Large
+ * coefficients are applied exactly, and matrices beyond the documented limits are rejected.
+ */
+
+static void testParse(void) {
+    t_editOp op;
+    check(job_parseOp("swap=brg", &op) == 0 && op.type == EDIT_CHANNEL_SWAP &&
+          op.values[0] == 2 && op.values[1] == 0 && op.values[2] == 1, "swap=brg parses");
+    check(job_parseOp("swap", &op) == 0 && op.values[0] == 2 && op.values[2] == 0, "swap defaults to bgr");
+    check(job_parseOp("swap=rgx", &op) != 0, "swap rejects unknown channels");
+    check(job_parseOp("saturation=150", &op) == 0 && op.type == EDIT_SATURATION && op.param == 150,
+          "saturation=150 parses");
+    check(job_parseOp("saturation", &op) != 0, "saturation needs a value");
+    check(job_parseOp("wb=110:100:90", &op) == 0 && op.type == EDIT_WHITE_BALANCE &&
+          op.values[0] == 110 && op.values[1] == 100 && op.values[2] == 90, "wb=110:100:90 parses");
+    check(job_parseOp("wb=110:100", &op) != 0, "wb needs three gains");
+    check(job_parseOp("wb=-10:100:100", &op) != 0, "wb rejects a negative gain");
+    check(job_parseOp("wb=100:100:1001", &op) != 0, "wb rejects a gain above COLORMATRIX_MAX_GAIN");
+    check(job_parseOp("wb=1000:0:100", &op) == 0, "wb accepts gains of 0 to COLORMATRIX_MAX_GAIN");
+    check(job_parseOp("sepia", &op) == 0 && op.type == EDIT_SEPIA, "sepia parses");
+}
+
+static void testComposedRun(void) {
+    const char * chain[] = {"saturation=80", "wb=90:100:110", "swap=gbr", "brightness=-20"};
+    int count = (int)(sizeof(chain) / sizeof(chain[0]));
+    t_editOp ops[4];
+    for (int i = 0; i < count; i++) job_parseOp(chain[i], &ops[i]);
+
+    // Mid-range colours, so no step of the chain saturates
+    t_bmp24 * composed = createImage24(16, 16, PATTERN_MID_RANGE);
+    t_bmp24 * stepwise = createImage24(16, 16, PATTERN_MID_RANGE);
+    editStack_applyOps24(composed, ops, count, 1.0f);
+    for (int i = 0; i < count; i++) editStack_applyOp24(stepwise, ops[i], 1.0f);
+
+    int maxDiff = 0;
+    for (int y = 0; y < composed->height; y++) {
+        for (int x = 0; x < composed->width; x++) {
+            const uint8_t * a = (const uint8_t *)&composed->data[y][x];
+            const uint8_t * b = (const uint8_t *)&stepwise->data[y][x];
+            for (int c = 0; c < 3; c++) {
+                int diff = abs(a[c] - b[c]);
+                if (diff > maxDiff) maxDiff = diff;
+            }
+        }
+    }
+    check(maxDiff <= 2, "composed run matches the steps applied one by one");
+    bmp24_free(composed);
+    bmp24_free(stepwise);
+}
+
+static void testLargeCoefficients(void) {
+    t_bmp24 * img = bmp24_allocate(4, 1, 24);
+    for (int x = 0; x < img->width; x++) {
+        t_pixel pixel = {(uint8_t)x, (uint8_t)x, (uint8_t)x};
+        img->data[0][x] = pixel;
+    }
+    // Gains beyond 16-bit fixed point go through the 32-bit kernel instead of being clamped
+    t_colorMatrix gain = colorMatrix_whiteBalance(100.0f, 100.0f, 100.0f);
+    check(colorMatrix_apply(img, &gain) == 0, "gain of 100 is accepted");
+    check(img->data[0][1].red == 100 && img->data[0][2].red == 200 && img->data[0][3].red == 255,
+          "gain of 100 is applied exactly");
+
+    t_colorMatrix tooLarge = colorMatrix_whiteBalance(1000.0f, 1.0f, 1.0f);
+    check(colorMatrix_apply(img, &tooLarge) != 0 && img->data[0][1].red == 100,
+          "out-of-range matrix is rejected and leaves the image unchanged");
+    bmp24_free(img);
+}
+
+int main(void) {
+    testParse();
+    testComposedRun();
+    testLargeCoefficients();
+    return testResult("colour-matrix");
+}
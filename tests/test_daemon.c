@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "daemon.h"
+#include "test_util.h"
+
+/*
+ * test_daemon.c
+ * Author: Simon Hillel
+ * Description: Tests of the daemon mode.
+ * The daemon runs in a child process; a shutdown request must stop it even while another
+ * client is connected and idle.
+ */
+
+// Seconds the daemon is given to exit after the shutdown request
+#define TEST_EXIT_TIMEOUT 5
+
+/**
+ * Connects to the daemon, retrying while it starts.
+ * @return The socket, or -1 on failure.
+ */
+static int connectTo(const char * socketPath) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+    for (int attempt = 0; attempt < 100; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0) return fd;
+        close(fd);
+        usleep(50000);
+    }
+    return -1;
+}
+
+/**
+ * Sends a request line and reads the reply line.
+ * @return 0 on success, -1 on failure.
+ */
+static int request(int fd, const char * line, char * replyLine, size_t size) {
+    if (send(fd, line, strlen(line), MSG_NOSIGNAL) < 0) return -1;
+    size_t length = 0;
+    while (length + 1 < size) {
+        ssize_t received = recv(fd, replyLine + length, 1, 0);
+        if (received <= 0) return -1;
+        if (replyLine[length] == '\n') break;
+        length++;
+    }
+    replyLine[length] = '\0';
+    return 0;
+}
+
+/**
+ * Waits for a child process to exit.
+ * @return Its exit status, or -1 if it is still running after the timeout.
+ */
+static int waitExit(pid_t pid, int seconds) {
+    for (int i = 0; i < seconds * 20; i++) {
+        int status;
+        if (waitpid(pid, &status, WNOHANG) == pid) return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        usleep(50000);
+    }
+    return -1;
+}
+
+static void testShutdownWithIdleClient(void) {
+    char socketPath[64];
+    snprintf(socketPath, sizeof(socketPath), "/tmp/test_daemon_%d.sock", (int)getpid());
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (!freopen("/dev/null", "w", stdout)) _exit(1);
+        _exit(daemon_run(socketPath));
+    }
+    check(pid > 0, "daemon process starts");
+    if (pid <= 0) return;
+
+    char line[256];
+    int idle = connectTo(socketPath);
+    check(idle >= 0 && request(idle, "ping\n", line, sizeof(line)) == 0 && strcmp(line, "ok pong") == 0,
+          "idle client is served");
+
+    int control = connectTo(socketPath);
+    check(control >= 0 && request(control, "shutdown\n", line, sizeof(line)) == 0 &&
+          strcmp(line, "ok shutting down") == 0, "shutdown request is acknowledged");
+
+    int status = waitExit(pid, TEST_EXIT_TIMEOUT);
+    check(status == 0, "daemon exits while a client is connected and idle");
+    if (status < 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    }
+    if (idle >= 0) close(idle);
+    if (control >= 0) close(control);
+    unlink(socketPath);
+}
+
+int main(void) {
+    testShutdownWithIdleClient();
+    return testResult("daemon");
+}
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bmp1.h"
+#include "bmp8.h"
+#include "dither.h"
+#include "test_util.h"
+
+/*
+ * test_dither.c
+ * Author: Simon Hillel
+ * Description: Tests of dithering.
+ * The wavefront-parallel error diffusion must give the result of a serial run, pixel for
+ * pixel; the packed ordered dither must match the 8-bit one; and both must keep the mean
+ * level of a flat gray image.
+ */
+
+/**
+ * Creates an 8-bit image of pseudo-random levels.
+ */
+static t_bmp8 * createRandom8(int width, int height, unsigned int seed) {
+    t_bmp8 * img = bmp8_allocate(width, height);
+    for (size_t i = 0; i < (size_t)width * height; i++) {
+        seed = seed * 1103515245u + 12345u;
+        img->data[i] = (uint8_t)(seed >> 16);
+    }
+    return img;
+}
+
+static int quantizeLevel(int value, int levels) {
+    if (value < 0) value = 0;
+    if (value > 255) value = 255;
+    return (value * (levels - 1) + 127) / 255 * 255 / (levels - 1);
+}
+
+static void addError(int * work, int width, int height, int x, int r, int amount) {
+    if (x < 0 || x >= width || r >= height) return;
+    work[(size_t)(height - 1 - r) * width + x] += amount;
+}
+
+/**
+ * Serial error diffusion of a grayscale image, top row (as displayed) first.
+ */
+static t_bmp8 * serialDiffusion(const t_bmp8 * img, t_dither_kernel kernel, int levels) {
+    int w = img->width, h = img->height;
+    t_bmp8 * dst = bmp8_allocate(w, h);
+    int * work = (int *)malloc((size_t)w * h * sizeof(int));
+    for (size_t i = 0; i < (size_t)w * h; i++) work[i] = img->data[i] * 16;
+    for (int r = 0; r < h; r++) {
+        for (int x = 0; x < w; x++) {
+            size_t i = (size_t)(h - 1 - r) * w + x;
+            int q = quantizeLevel((work[i] + 8) >> 4, levels);
+            int err = work[i] - q * 16;
+            dst->data[i] = (uint8_t)q;
+            if (kernel == DITHER_FLOYD_STEINBERG) {
+                addError(work, w, h, x + 1, r, err * 7 / 16);
+                addError(work, w, h, x - 1, r + 1, err * 3 / 16);
+                addError(work, w, h, x, r + 1, err * 5 / 16);
+                addError(work, w, h, x + 1, r + 1, err / 16);
+            } else {
+                int share = err / 8;
+                addError(work, w, h, x + 1, r, share);
+                addError(work, w, h, x + 2, r, share);
+                addError(work, w, h, x - 1, r + 1, share);
+                addError(work, w, h, x, r + 1, share);
+                addError(work, w, h, x + 1, r + 1, share);
+                addError(work, w, h, x, r + 2, share);
+            }
+        }
+    }
+    free(work);
+    return dst;
+}
+
+static double meanLevel(const t_bmp8 * img) {
+    double sum = 0.0;
+    for (size_t i = 0; i < (size_t)img->width * img->height; i++) sum += img->data[i];
+    return sum / ((double)img->width * img->height);
+}
+
+static void testErrorDiffusion(t_dither_kernel kernel, int levels) {
+    char what[128];
+    const char * name = kernel == DITHER_FLOYD_STEINBERG ? "Floyd-Steinberg" : "Atkinson";
+    t_bmp8 * img = createRandom8(301, 97, 11u + levels);
+    t_bmp8 * parallel = dither_errorDiffusion(img, kernel, levels);
+    t_bmp8 * serial = serialDiffusion(img, kernel, levels);
+    snprintf(what, sizeof(what), "%s to %d levels: wavefront result equals a serial run", name, levels);
+    check(samePixels8(parallel, serial), what);
+    bmp8_free(serial);
+    bmp8_free(parallel);
+    bmp8_free(img);
+
+    // A flat gray keeps its mean level (Atkinson drops a quarter of the error)
+    t_bmp8 * flat = bmp8_allocate(200, 120);
+    for (size_t i = 0; i < (size_t)200 * 120; i++) flat->data[i] = 100;
+    t_bmp8 * dithered = dither_errorDiffusion(flat, kernel, levels);
+    double mean = meanLevel(dithered);
+    snprintf(what, sizeof(what), "%s to %d levels keeps the mean of a flat gray (%.1f)", name, levels, mean);
+    check(mean > 92.0 && mean < 108.0, what);
+    bmp8_free(dithered);
+    bmp8_free(flat);
+}
+
+static void testOrdered(int width) {
+    char what[128];
+    t_bmp8 * img = createRandom8(width, 45, 3u + width);
+    t_bmp8 * ordered = dither_ordered(img, 2);
+    t_bmp1 * packed = dither_orderedBmp1(img);
+    int same = 1, bilevel = 1;
+    for (int y = 0; y < img->height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t v = ordered->data[(size_t)y * width + x];
+            if (v != 0 && v != 255) bilevel = 0;
+            if (bmp1_getPixel(packed, x, y) != (v == 255)) same = 0;
+        }
+    }
+    snprintf(what, sizeof(what), "%d wide: 2-level ordered dither is black and white", width);
+    check(bilevel, what);
+    snprintf(what, sizeof(what), "%d wide: packed ordered dither matches the 8-bit one", width);
+    check(same, what);
+    bmp1_free(packed);
+    bmp8_free(ordered);
+    bmp8_free(img);
+}
+
+static void testOrderedMean(int levels) {
+    char what[128];
+    t_bmp8 * flat = bmp8_allocate(64, 64);
+    for (size_t i = 0; i < (size_t)64 * 64; i++) flat->data[i] = 100;
+    t_bmp8 * dithered = dither_ordered(flat, levels);
+    double mean = meanLevel(dithered);
+    snprintf(what, sizeof(what), "ordered dither to %d levels keeps the mean of a flat gray (%.1f)", levels, mean);
+    check(mean > 94.0 && mean < 106.0, what);
+    bmp8_free(dithered);
+    bmp8_free(flat);
+}
+
+int main(void) {
+    int levels[2] = {2, 4};
+    for (int i = 0; i < 2; i++) {
+        testErrorDiffusion(DITHER_FLOYD_STEINBERG, levels[i]);
+        testErrorDiffusion(DITHER_ATKINSON, levels[i]);
+        testOrderedMean(levels[i]);
+    }
+    testOrdered(7);
+    testOrdered(37);
+    testOrdered(160);
+    return testResult("dither");
+}
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bmp24.h"
+#include "editstack.h"
+#include "test_util.h"
+
+/*
+ * test_editstack.c
+ * Author: Simon Hillel
+ * Description: Tests of the edit stack.
+ * Whatever the edit history, the result shown must be that of a replay of all steps on the
+ * original (editStack_applyOps24), including for runs of colour-matrix steps that clamp
+ * differently when composed. Random edit sequences are replayed under budgets that keep every
+ * result and under budgets that evict all but the original and the current one; once every
+ * step is removed, the cache must hold the original's tiles only.
+ */
+
+#define WIDTH 150             // 3x2 tiles, the last ones partial
+#define HEIGHT 100
+#define NUM_EDITS 120
+#define MAX_STEPS 10
+
+/**
+ * Checks the stack's result against a replay of its steps on the original.
+ */
+static void checkReplay(t_editStack * stack, const char * what) {
+    t_bmp24 * expected = createImage24(WIDTH, HEIGHT, PATTERN_NOISE);
+    editStack_applyOps24(expected, stack->ops, stack->numOps, 1.0f);
+    check(samePixels24(editStack_current24(stack), expected), what);
+    bmp24_free(expected);
+}
+
+/**
+ * Checks an 8-bit stack's result against a replay of its steps on the original.
+ */
+static void checkReplay8(t_editStack * stack, const char * what) {
+    t_bmp8 * expected = createImage8(WIDTH, HEIGHT, PATTERN_NOISE);
+    for (int i = 0; i < stack->numOps; i++) editStack_applyOp8(expected, stack->ops[i]);
+    check(samePixels8(editStack_current8(stack), expected), what);
+    bmp8_free(expected);
+}
+
+/**
+ * Returns the next value of a fixed-seed pseudo-random sequence, below limit.
+ */
+static int nextRandom(unsigned int * seed, int limit) {
+    *seed = *seed * 1103515245u + 12345u;
+    return (int)((*seed >> 16) % (unsigned int)limit);
+}
+
+/**
+ * Returns a random step that applies to the image type, mixing colour-matrix, convolution
+ * and other steps so that runs form and break.
+ */
+static t_editOp randomOp(unsigned int * seed, int isColor) {
+    static const t_editOpType colourTypes[] = {
+        EDIT_NEGATIVE, EDIT_BRIGHTNESS, EDIT_BLACK_WHITE, EDIT_BOX_BLUR, EDIT_GAUSSIAN_BLUR, EDIT_SHARPEN,
+        EDIT_EMBOSS, EDIT_EQUALIZE, EDIT_SEPIA, EDIT_SATURATION, EDIT_WHITE_BALANCE, EDIT_AUTO_LEVELS
+    };
+    static const t_editOpType grayTypes[] = {
+        EDIT_NEGATIVE, EDIT_BRIGHTNESS, EDIT_BLACK_WHITE, EDIT_BOX_BLUR, EDIT_SHARPEN, EDIT_EQUALIZE
+    };
+    t_editOp op = {0};
+    op.type = isColor ? colourTypes[nextRandom(seed, sizeof(colourTypes) / sizeof(colourTypes[0]))]
+                      : grayTypes[nextRandom(seed, sizeof(grayTypes) / sizeof(grayTypes[0]))];
+    switch (op.type) {
+        case EDIT_BRIGHTNESS: op.param = nextRandom(seed, 241) - 120; break;
+        case EDIT_BLACK_WHITE: op.param = 64 + nextRandom(seed, 128); break;
+        case EDIT_SATURATION: op.param = nextRandom(seed, 201); break;
+        case EDIT_WHITE_BALANCE:
+            for (int c = 0; c < 3; c++) op.values[c] = 50 + nextRandom(seed, 101);
+            break;
+        default: break;
+    }
+    return op;
+}
+
+/**
+ * Applies random pushes, replaces, removes, undos and redos, checking the result against a
+ * replay after each, then removes every step.
+ */
+static void testRandomEdits(int isColor, size_t budget, unsigned int seed) {
+    char what[128];
+    t_editStack * stack = isColor ? editStack_create24(createImage24(WIDTH, HEIGHT, PATTERN_NOISE), budget)
+                                  : editStack_create8(createImage8(WIDTH, HEIGHT, PATTERN_NOISE), budget);
+    size_t originalBytes = stack->cacheBytes;
+
+    for (int edit = 0; edit < NUM_EDITS; edit++) {
+        int action = nextRandom(&seed, 5);
+        const char * name;
+        if (action == 0 || stack->numOps == 0) {
+            if (stack->numOps == MAX_STEPS) editStack_undo(stack);
+            editStack_push(stack, randomOp(&seed, isColor));
+            name = "push";
+        } else if (action == 1) {
+            editStack_replace(stack, nextRandom(&seed, stack->numOps), randomOp(&seed, isColor));
+            name = "replace";
+        } else if (action == 2) {
+            editStack_remove(stack, nextRandom(&seed, stack->numOps));
+            name = "remove";
+        } else if (action == 3) {
+            editStack_undo(stack);
+            name = "undo";
+        } else {
+            editStack_redo(stack);
+            name = "redo";
+        }
+        snprintf(what, sizeof(what), "%s stack, budget %zu: %s (edit %d) matches a replay",
+                 isColor ? "colour" : "8-bit", budget, name, edit);
+        if (isColor) checkReplay(stack, what);
+        else checkReplay8(stack, what);
+    }
+
+    // Removing the last step also drops the undone ones, leaving only the original
+    if (stack->numOps == 0) editStack_push(stack, randomOp(&seed, isColor));
+    while (stack->numOps > 0) editStack_remove(stack, stack->numOps - 1);
+    snprintf(what, sizeof(what), "%s stack, budget %zu: cache back to the original's tiles once steps are removed",
+             isColor ? "colour" : "8-bit", budget);
+    check(stack->cacheBytes == originalBytes, what);
+    editStack_free(stack);
+}
+
+static void testHistoryIndependent(void) {
+    t_editStack * stack = editStack_create24(createImage24(WIDTH, HEIGHT, PATTERN_NOISE), 0);
+    t_editOp up = {.type = EDIT_BRIGHTNESS, .param = 100};
+    t_editOp down = {.type = EDIT_BRIGHTNESS, .param = -100};
+    t_editOp sepia = {.type = EDIT_SEPIA};
+    t_editOp blur = {.type = EDIT_BOX_BLUR};
+
+    editStack_push(stack, up);
+    editStack_push(stack, down);
+    checkReplay(stack, "push: a colour-matrix run is composed as in a replay");
+    editStack_replace(stack, 0, up);
+    checkReplay(stack, "replace: same result as before the replace");
+    editStack_push(stack, blur);
+    editStack_push(stack, sepia);
+    checkReplay(stack, "push after a convolution starts a new run");
+    editStack_undo(stack);
+    editStack_undo(stack);
+    checkReplay(stack, "undo back into a composed run");
+    editStack_redo(stack);
+    checkReplay(stack, "redo");
+    editStack_undo(stack);
+    editStack_push(stack, down);
+    checkReplay(stack, "push extends the run ended by an undo");
+    editStack_remove(stack, 0);
+    checkReplay(stack, "remove");
+    editStack_free(stack);
+}
+
+int main(void) {
+    testHistoryIndependent();
+    size_t budgets[3] = {1, (size_t)3 * 64 * 64 * sizeof(t_pixel), (size_t)64 << 20};
+    for (int i = 0; i < 3; i++) {
+        testRandomEdits(1, budgets[i], 2024u + i);
+        testRandomEdits(0, budgets[i], 7u + i);
+    }
+    return testResult("edit-stack");
+}
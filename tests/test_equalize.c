@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bmp8.h"
+#include "bmp24.h"
+#include "editstack.h"
+#include "test_util.h"
+
+/*
+ * test_equalize.c
+ * Author: Simon Hillel
+ * Description: Tests of histogram equalization.
+ * A gradient covering levels 40-166 must be stretched to the full 0-255 range, for grayscale
+ * and indexed 8-bit images and for colour images; a flat image must be left unchanged. The
+ * parallel histogram and lookup passes must cover every pixel when the pixel count is not a
+ * multiple of their task size.
+ */
+
+static void range8(const t_bmp8 * img, int * low, int * high) {
+    *low = 255;
+    *high = 0;
+    for (unsigned int i = 0; i < img->width * img->height; i++) {
+        if (img->data[i] < *low) *low = img->data[i];
+        if (img->data[i] > *high) *high = img->data[i];
+    }
+}
+
+static void testGrayscale(void) {
+    t_bmp8 * img = createImage8(127, 4, PATTERN_GRADIENT);
+    t_editOp op = {.type = EDIT_EQUALIZE};
+    editStack_applyOp8(img, op);
+
+    int low, high;
+    range8(img, &low, &high);
+    check(low == 0 && high == 255, "grayscale gradient 40-166 is stretched to 0-255");
+    int increasing = 1;
+    for (unsigned int x = 1; x < img->width; x++) increasing &= img->data[x] > img->data[x - 1];
+    check(increasing, "grayscale gradient stays strictly increasing");
+    bmp8_free(img);
+}
+
+static void testIndexed(void) {
+    // Indices 0-126 point at a reversed palette holding levels 166 down to 40
+    t_bmp8 * img = bmp8_allocate(127, 4);
+    for (unsigned int i = 0; i < img->width * img->height; i++) img->data[i] = i % img->width;
+    for (int i = 0; i < 256; i++) {
+        unsigned char level = i < 127 ? 166 - i : 0;
+        img->colorTable[i * 4] = level;
+        img->colorTable[i * 4 + 1] = level;
+        img->colorTable[i * 4 + 2] = level;
+    }
+    t_editOp op = {.type = EDIT_EQUALIZE};
+    editStack_applyOp8(img, op);
+
+    check(bmp8_isGrayscalePalette(img), "indexed image is baked to a grayscale palette");
+    check(img->data[0] == 255 && img->data[126] == 0, "indexed gradient 40-166 is stretched to 0-255");
+    bmp8_free(img);
+}
+
+static void testFlat(void) {
+    t_bmp8 * img = bmp8_allocate(8, 8);
+    for (unsigned int i = 0; i < 64; i++) img->data[i] = 90;
+    t_editOp op = {.type = EDIT_EQUALIZE};
+    editStack_applyOp8(img, op);
+
+    int low, high;
+    range8(img, &low, &high);
+    check(low == 90 && high == 90, "flat image is left unchanged");
+    bmp8_free(img);
+}
+
+static void testColour(void) {
+    t_bmp24 * img = createImage24(127, 4, PATTERN_GRADIENT);
+    t_editOp op = {.type = EDIT_EQUALIZE};
+    editStack_applyOp24(img, op, 1.0f);
+
+    check(img->data[0][0].green == 0 && img->data[0][126].green == 255,
+          "colour gradient 40-166 is stretched to 0-255");
+    bmp24_free(img);
+}
+
+static void testPartialTasks(void) {
+    t_bmp8 * img = bmp8_allocate(1001, 263);
+    t_bmp8 * original = bmp8_allocate(1001, 263);
+    size_t numPixels = (size_t)img->width * img->height;
+    unsigned int seed = 4321, expected[256] = {0};
+    for (size_t i = 0; i < numPixels; i++) {
+        seed = seed * 1103515245u + 12345u;
+        img->data[i] = original->data[i] = (uint8_t)(seed >> 16);
+        expected[img->data[i]]++;
+    }
+
+    unsigned int * hist = bmp8_computeHistogram(img);
+    int same = hist != NULL;
+    for (int v = 0; same && v < 256; v++) same = hist[v] == expected[v];
+    check(same, "histogram counts every pixel of a partial last task");
+    free(hist);
+
+    bmp8_negative(img);
+    same = 1;
+    for (size_t i = 0; i < numPixels; i++) same &= img->data[i] == 255 - original->data[i];
+    check(same, "lookup pass maps every pixel of a partial last task");
+    bmp8_free(original);
+    bmp8_free(img);
+}
+
+int main(void) {
+    testGrayscale();
+    testIndexed();
+    testFlat();
+    testColour();
+    testPartialTasks();
+    return testResult("equalization");
+}
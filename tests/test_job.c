@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bmp24.h"
+#include "planar.h"
+#include "job.h"
+#include "test_util.h"
+
+/*
+ * test_job.c
+ * Author: Simon Hillel
+ * Description: Tests of the job runner's memory model.
+ * The temporaries predicted for an op must cover what it allocates: a copy of the image for
+ * a convolution, three 16-bit planes and a plane copy in linear-light mode.
+ */
+
+static void testConvolutionBytes(void) {
+    t_editOp blur = {.type = EDIT_GAUSSIAN_BLUR};
+    size_t pixels = 1000 * 800;
+    size_t encoded = job_opBytes(blur, 1000, 800, 24);
+    check(encoded >= pixels * sizeof(t_pixel), "a convolution predicts a copy of the image");
+
+    bmp24_setLinearLight(1);
+    size_t linear = job_opBytes(blur, 1000, 800, 24);
+    bmp24_setLinearLight(0);
+    check(linear >= pixels * 4 * sizeof(uint16_t), "a linear-light convolution predicts its planes");
+    check(job_opBytes((t_editOp){.type = EDIT_NEGATIVE}, 1000, 800, 24) == 0, "a point op works in place");
+}
+
+int main(void) {
+    testConvolutionBytes();
+    return testResult("job");
+}
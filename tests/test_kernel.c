@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bmp24.h"
+#include "kernel.h"
+#include "editstack.h"
+#include "test_util.h"
+
+/*
+ * test_kernel.c
+ * Author: Simon Hillel
+ * Description: Tests of convolution kernel composition.
+ * A run of blurs in the edit stack is applied as one composed kernel: away from the border
+ * it matches the kernels applied in sequence up to rounding, and the composed kernel's wider
+ * border is left unchanged. A run that clamps before its last step is not composed.
+ */
+
+/**
+ * Returns the largest channel difference between two images over pixels at least margin
+ * away from the border.
+ */
+static int maxDiff(const t_bmp24 * a, const t_bmp24 * b, int margin) {
+    int worst = 0;
+    for (int y = margin; y < a->height - margin; y++) {
+        for (int x = margin; x < a->width - margin; x++) {
+            const t_pixel * p = &a->data[y][x];
+            const t_pixel * q = &b->data[y][x];
+            int d[3] = {abs(p->red - q->red), abs(p->green - q->green), abs(p->blue - q->blue)};
+            for (int c = 0; c < 3; c++) worst = d[c] > worst ? d[c] : worst;
+        }
+    }
+    return worst;
+}
+
+static void testComposedBlurs(void) {
+    t_editOp ops[3] = {{.type = EDIT_GAUSSIAN_BLUR}, {.type = EDIT_BOX_BLUR}, {.type = EDIT_GAUSSIAN_BLUR}};
+    t_bmp24 * original = createImage24(60, 50, PATTERN_NOISE);
+    t_bmp24 * composed = createImage24(60, 50, PATTERN_NOISE);
+    t_bmp24 * sequence = createImage24(60, 50, PATTERN_NOISE);
+    check(editStack_runLength(ops, 3) == 3, "adjacent blurs form one run");
+    editStack_applyOps24(composed, ops, 3, 1.0f);
+    for (int i = 0; i < 3; i++) editStack_applyOp24(sequence, ops[i], 1.0f);
+
+    check(maxDiff(composed, sequence, 3) <= 1, "composed blurs match the blurs in sequence up to rounding");
+    check(!samePixels24(composed, sequence), "blurs are composed rather than applied in sequence");
+    int borderKept = 1;
+    for (int x = 0; x < composed->width; x++) {
+        for (int y = 0; y < 3; y++) {
+            borderKept &= composed->data[y][x].red == original->data[y][x].red;
+        }
+    }
+    check(borderKept, "the composed kernel's border is left unchanged");
+    bmp24_free(original);
+    bmp24_free(composed);
+    bmp24_free(sequence);
+}
+
+static void testClampingChain(void) {
+    t_editOp ops[2] = {{.type = EDIT_SHARPEN}, {.type = EDIT_BOX_BLUR}};
+    float ** kernels[2] = {createSharpenKernel(), createBoxBlurKernel()};
+    int sizes[2] = {3, 3};
+    check(!kernel_chainIsExact(kernels, sizes, 2), "sharpen then blur clamps between steps");
+
+    t_bmp24 * chained = createImage24(60, 50, PATTERN_NOISE);
+    t_bmp24 * sequence = createImage24(60, 50, PATTERN_NOISE);
+    editStack_applyOps24(chained, ops, 2, 1.0f);
+    for (int i = 0; i < 2; i++) editStack_applyOp24(sequence, ops[i], 1.0f);
+    check(samePixels24(chained, sequence), "a clamping chain is applied step by step");
+    freeKernel(kernels[0], 3);
+    freeKernel(kernels[1], 3);
+    bmp24_free(chained);
+    bmp24_free(sequence);
+}
+
+int main(void) {
+    testComposedBlurs();
+    testClampingChain();
+    return testResult("kernel");
+}
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bmp8.h"
+#include "bmp24.h"
+#include "editstack.h"
+#include "test_util.h"
+
+/*
+ * test_levels.c
+ * Author: Simon Hillel
+ * Description: Tests of the auto-levels and auto white balance steps.
+ * A low-contrast image spanning 50 to 150 must be stretched to the full 0 to 255 range, and
+ * a tinted gray image must come out with equal channel means.
+ */
+
+#define WIDTH 101
+#define HEIGHT 40
+
+/**
+ * Creates a colour image whose columns run through the levels 50 to 150.
+ */
+static t_bmp24 * createLowContrast24(void) {
+    t_bmp24 * img = bmp24_allocate(WIDTH, HEIGHT, 24);
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            uint8_t v = (uint8_t)(50 + x);
+            img->data[y][x] = (t_pixel){v, (uint8_t)(150 - x), v};
+        }
+    }
+    return img;
+}
+
+static void testAutoLevels24(void) {
+    t_bmp24 * img = createLowContrast24();
+    editStack_applyOp24(img, (t_editOp){.type = EDIT_AUTO_LEVELS}, 1.0f);
+    int low[3] = {255, 255, 255}, high[3] = {0, 0, 0};
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            uint8_t v[3] = {img->data[y][x].blue, img->data[y][x].green, img->data[y][x].red};
+            for (int c = 0; c < 3; c++) {
+                if (v[c] < low[c]) low[c] = v[c];
+                if (v[c] > high[c]) high[c] = v[c];
+            }
+        }
+    }
+    for (int c = 0; c < 3; c++) check(low[c] == 0 && high[c] == 255, "colour auto levels stretch 50-150 to 0-255");
+    check(img->data[0][0].blue < img->data[0][WIDTH / 2].blue &&
+          img->data[0][WIDTH / 2].blue < img->data[0][WIDTH - 1].blue, "colour auto levels keep the order of levels");
+    bmp24_free(img);
+}
+
+static void testAutoLevels8(void) {
+    t_bmp8 * img = bmp8_allocate(WIDTH, HEIGHT);
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) img->data[(size_t)y * WIDTH + x] = (uint8_t)(50 + x);
+    }
+    check(editStack_supportsType(0, (t_editOp){.type = EDIT_AUTO_LEVELS}), "auto levels apply to 8-bit images");
+    editStack_applyOp8(img, (t_editOp){.type = EDIT_AUTO_LEVELS});
+    int low = 255, high = 0;
+    for (size_t i = 0; i < (size_t)WIDTH * HEIGHT; i++) {
+        if (img->data[i] < low) low = img->data[i];
+        if (img->data[i] > high) high = img->data[i];
+    }
+    check(low == 0 && high == 255, "8-bit auto levels stretch 50-150 to 0-255");
+    bmp8_free(img);
+}
+
+static void testAutoWhiteBalance(void) {
+    t_bmp24 * img = createImage24(64, 48, PATTERN_GRADIENT);
+    for (int y = 0; y < img->height; y++) {
+        for (int x = 0; x < img->width; x++) {
+            img->data[y][x].red = (uint8_t)(img->data[y][x].red * 5 / 4);
+            img->data[y][x].blue = (uint8_t)(img->data[y][x].blue * 3 / 4);
+        }
+    }
+    check(!editStack_supportsType(0, (t_editOp){.type = EDIT_AUTO_WHITE_BALANCE}),
+          "auto white balance is for colour images only");
+    editStack_applyOp24(img, (t_editOp){.type = EDIT_AUTO_WHITE_BALANCE}, 1.0f);
+    double sum[3] = {0, 0, 0};
+    for (int y = 0; y < img->height; y++) {
+        for (int x = 0; x < img->width; x++) {
+            sum[0] += img->data[y][x].blue;
+            sum[1] += img->data[y][x].green;
+            sum[2] += img->data[y][x].red;
+        }
+    }
+    double n = (double)img->width * img->height;
+    check(abs((int)(sum[0] / n) - (int)(sum[1] / n)) <= 1 && abs((int)(sum[2] / n) - (int)(sum[1] / n)) <= 1,
+          "auto white balance equalizes the channel means");
+    bmp24_free(img);
+}
+
+int main(void) {
+    testAutoLevels24();
+    testAutoLevels8();
+    testAutoWhiteBalance();
+    return testResult("levels");
+}
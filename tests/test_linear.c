@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bmp24.h"
+#include "planar.h"
+#include "kernel.h"
+#include "editstack.h"
+#include "test_util.h"
+
+/*
+ * test_linear.c
+ * Author: Simon Hillel
+ * Description: Tests of linear-light convolution.
+ * A chain of convolution steps must be converted to linear light once (the result of the
+ * planar chain, not of a round trip per step), and kernel_apply must not bypass the mode
+ * through its separable path. Hard-edged stripes are where linear and gamma-encoded blurs
+ * differ most.
+ */
+
+static void testChainConvertsOnce(void) {
+    t_editOp ops[3] = {{.type = EDIT_GAUSSIAN_BLUR}, {.type = EDIT_BOX_BLUR}, {.type = EDIT_SHARPEN}};
+    float ** (*create[3])(void) = {createGaussianBlurKernel, createBoxBlurKernel, createSharpenKernel};
+
+    t_bmp24 * chained = createImage24(40, 30, PATTERN_STRIPES);
+    editStack_applyOps24(chained, ops, 3, 1.0f);
+
+    t_bmp24 * expected = createImage24(40, 30, PATTERN_STRIPES);
+    t_planar16 * planar = planar_fromBmp24(expected, 1);
+    for (int i = 0; i < 3; i++) {
+        float ** kernel = create[i]();
+        planar_applyFilter(planar, kernel, 3);
+        freeKernel(kernel, 3);
+    }
+    planar_store(planar, expected);
+    planar_free(planar);
+
+    t_bmp24 * stepwise = createImage24(40, 30, PATTERN_STRIPES);
+    for (int i = 0; i < 3; i++) editStack_applyOp24(stepwise, ops[i], 1.0f);
+
+    check(samePixels24(chained, expected), "linear-light chain matches one planar conversion");
+    check(!samePixels24(chained, stepwise), "linear-light chain skips the per-step re-encoding");
+    bmp24_free(chained);
+    bmp24_free(expected);
+    bmp24_free(stepwise);
+}
+
+static void testSeparablePath(void) {
+    float ** kernel = createGaussianBlurKernel();
+    t_bmp24 * separable = createImage24(40, 30, PATTERN_STRIPES);
+    t_bmp24 * direct = createImage24(40, 30, PATTERN_STRIPES);
+    kernel_apply(separable, kernel, 3);
+    bmp24_applyFilter(direct, kernel, 3);
+    check(samePixels24(separable, direct), "kernel_apply convolves in linear light");
+    freeKernel(kernel, 3);
+    bmp24_free(separable);
+    bmp24_free(direct);
+}
+
+int main(void) {
+    bmp24_setLinearLight(1);
+    testChainConvertsOnce();
+    testSeparablePath();
+    return testResult("linear-light");
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bmp24.h"
+#include "phash.h"
+#include "test_util.h"
+
+/*
+ * test_phash.c
+ * Author: Simon Hillel
+ * Description: Tests of perceptual hashing and the BK-tree.
+ * A radius query on the BK-tree must find exactly the hashes that a linear scan finds, while
+ * comparing fewer nodes for small radii. The hashes of a file read row by row must equal
+ * those of the loaded image, a slightly changed image must stay near its original, and an
+ * unrelated image must be far from it.
+ */
+
+#define NUM_HASHES 3000
+#define NUM_QUERIES 40
+
+static uint64_t nextHash(uint64_t * seed) {
+    *seed = *seed * 6364136223846793005ull + 1442695040888963407ull;
+    uint64_t high = *seed >> 32;
+    *seed = *seed * 6364136223846793005ull + 1442695040888963407ull;
+    return (high << 32) | (*seed >> 32);
+}
+
+static void markFound(int item, int distance, void * ctx) {
+    (void)distance;
+    ((int *)ctx)[item]++;
+}
+
+static void testBkTree(void) {
+    uint64_t seed = 42;
+    uint64_t * hashes = (uint64_t *)malloc(NUM_HASHES * sizeof(uint64_t));
+    t_bkTree tree = {NULL, 0, 0};
+    for (int i = 0; i < NUM_HASHES; i++) {
+        // Clusters of near-duplicates: every fourth hash is a few bits away from the one before
+        hashes[i] = i % 4 == 3 ? hashes[i - 1] ^ (1ull << (i % 64)) ^ (1ull << ((i * 7) % 64)) : nextHash(&seed);
+        check(bktree_insert(&tree, hashes[i], i) == 0, "hash is inserted");
+    }
+
+    int radii[4] = {0, 3, PHASH_DEFAULT_DISTANCE, 20};
+    int * found = (int *)malloc(NUM_HASHES * sizeof(int));
+    for (int r = 0; r < 4; r++) {
+        int same = 1, pruned = 1;
+        for (int q = 0; q < NUM_QUERIES; q++) {
+            uint64_t query = q % 2 ? hashes[(q * 97) % NUM_HASHES] ^ (1ull << q) : nextHash(&seed);
+            memset(found, 0, NUM_HASHES * sizeof(int));
+            int compared = bktree_search(&tree, query, radii[r], markFound, found);
+            for (int i = 0; i < NUM_HASHES; i++) {
+                if (found[i] != (phash_distance(hashes[i], query) <= radii[r])) same = 0;
+            }
+            if (compared >= NUM_HASHES) pruned = 0;
+        }
+        char what[128];
+        snprintf(what, sizeof(what), "radius %d: BK-tree finds each hash of a linear scan once", radii[r]);
+        check(same, what);
+        if (radii[r] <= PHASH_DEFAULT_DISTANCE) {
+            snprintf(what, sizeof(what), "radius %d: BK-tree compares fewer nodes than a linear scan", radii[r]);
+            check(pruned, what);
+        }
+    }
+    free(found);
+    free(hashes);
+    bktree_free(&tree);
+}
+
+static void testHashes(void) {
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/tmp/test_phash_%d.bmp", (int)getpid());
+    t_bmp24 * img = createImage24(211, 143, PATTERN_MID_RANGE);
+    t_imageHash original, fromFile, brighter, other;
+    check(phash_image24(img, &original) == 0, "image is hashed");
+
+    for (int topDown = 0; topDown <= 1; topDown++) {
+        bmp24_setTopDown(img, topDown);
+        bmp24_saveImage(img, filename);
+        check(phash_file(filename, &fromFile) == 0 && fromFile.dhash == original.dhash &&
+              fromFile.phash == original.phash, topDown ? "top-down file hashes like the image"
+                                                        : "bottom-up file hashes like the image");
+    }
+    unlink(filename);
+
+    bmp24_brightness(img, 12);
+    phash_image24(img, &brighter);
+    check(phash_distance(brighter.phash, original.phash) <= PHASH_DEFAULT_DISTANCE,
+          "a slightly brighter image is a near-duplicate");
+    bmp24_free(img);
+
+    img = createImage24(211, 143, PATTERN_STRIPES);
+    phash_image24(img, &other);
+    check(phash_distance(other.phash, original.phash) > PHASH_DEFAULT_DISTANCE, "an unrelated image is not");
+    bmp24_free(img);
+
+    check(phash_distance(0, ~0ull) == 64 && phash_distance(5, 6) == 2, "Hamming distance counts differing bits");
+}
+
+int main(void) {
+    testBkTree();
+    testHashes();
+    return testResult("phash");
+}
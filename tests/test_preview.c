@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "bmp24.h"
+#include "editstack.h"
+#include "preview.h"
+#include "test_util.h"
+
+/*
+ * test_preview.c
+ * Author: Simon Hillel
+ * Description: Tests of the proxy preview mode.
+ * The file written by a background save must hold the same pixels as the full-resolution
+ * stack's own result, including when the steps still to apply continue a run of colour-matrix
+ * steps whose start is already cached.
+ */
+
+static void testBackgroundSaveMatchesStack(void) {
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/tmp/test_preview_%d.bmp", (int)getpid());
+
+    t_editStack * full = editStack_create24(createImage24(48, 40, PATTERN_NOISE), 0);
+    t_editOp up = {.type = EDIT_BRIGHTNESS, .param = 100};
+    t_editOp down = {.type = EDIT_BRIGHTNESS, .param = -100};
+    t_editOp blur = {.type = EDIT_GAUSSIAN_BLUR};
+    editStack_push(full, up);
+
+    // With a preview, the full stack only records the steps until they are saved
+    t_preview * preview = preview_create(full);
+    check(preview != NULL, "preview is created");
+    editStack_push(full, down);
+    editStack_push(full, blur);
+
+    t_saveJob * job = preview_startSave(full, filename);
+    check(job != NULL, "background save starts");
+    check(job && preview_finishSave(job) == SAVE_JOB_DONE, "background save finishes");
+
+    t_bmp24 * saved = bmp24_loadImage(filename);
+    check(samePixels24(saved, editStack_current24(full)), "saved file matches the stack's result");
+    bmp24_free(saved);
+    unlink(filename);
+    preview_free(preview, full);
+    editStack_free(full);
+}
+
+int main(void) {
+    testBackgroundSaveMatchesStack();
+    return testResult("preview");
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bmp8.h"
+#include "bmp24.h"
+#include "quantize.h"
+#include "test_util.h"
+
+/*
+ * test_quantize.c
+ * Author: Simon Hillel
+ * Description: Tests of colour quantisation.
+ * An image with fewer colours than the palette must come back exactly; the inverse colour map
+ * must hold the nearest palette entry of every cell; and a smooth image must be mapped with a
+ * small error.
+ */
+
+/**
+ * Returns the palette colour of the pixel at image row y (top row first), column x.
+ */
+static t_pixel indexedColour(const t_bmp8 * img, int x, int y) {
+    const unsigned char * entry = &img->colorTable[img->data[(size_t)(img->height - 1 - y) * img->width + x] * 4];
+    return (t_pixel){entry[0], entry[1], entry[2]};
+}
+
+static void testFewColours(void) {
+    t_bmp24 * img = bmp24_allocate(40, 30, 24);
+    for (int y = 0; y < img->height; y++) {
+        for (int x = 0; x < img->width; x++) {
+            int corner = (x / 5 + y / 10) % 8;
+            img->data[y][x] = (t_pixel){(corner & 1) ? 240 : 16, (corner & 2) ? 200 : 40, (corner & 4) ? 224 : 8};
+        }
+    }
+    t_bmp8 * indexed = quantize_toIndexed(img, 16);
+    check(indexed && indexed->numColors <= 16, "palette has at most the requested entries");
+    int same = indexed != NULL;
+    for (int y = 0; same && y < img->height; y++) {
+        for (int x = 0; x < img->width; x++) {
+            t_pixel p = indexedColour(indexed, x, y);
+            if (p.blue != img->data[y][x].blue || p.green != img->data[y][x].green || p.red != img->data[y][x].red) {
+                same = 0;
+            }
+        }
+    }
+    check(same, "an image with 8 colours round-trips exactly through a 16-colour palette");
+    bmp8_free(indexed);
+    bmp24_free(img);
+}
+
+static void testInverseMap(void) {
+    unsigned char colorTable[BMP8_PALETTE_SIZE * 4] = {0};
+    unsigned int seed = 77;
+    int numColors = 37;
+    for (int i = 0; i < numColors * 4; i++) {
+        seed = seed * 1103515245u + 12345u;
+        colorTable[i] = i % 4 == 3 ? 0 : (unsigned char)(seed >> 16);
+    }
+    unsigned char * inverseMap = (unsigned char *)malloc(QUANTIZE_CELLS);
+    quantize_buildInverseMap(colorTable, numColors, inverseMap);
+
+    int side = 1 << QUANTIZE_BITS, half = 1 << (7 - QUANTIZE_BITS), same = 1;
+    for (int cell = 0; cell < QUANTIZE_CELLS; cell++) {
+        int r = ((cell >> (2 * QUANTIZE_BITS)) << (8 - QUANTIZE_BITS)) + half;
+        int g = (((cell >> QUANTIZE_BITS) % side) << (8 - QUANTIZE_BITS)) + half;
+        int b = ((cell % side) << (8 - QUANTIZE_BITS)) + half;
+        int bestDist = 1 << 30;
+        for (int i = 0; i < numColors; i++) {
+            int db = b - colorTable[i * 4], dg = g - colorTable[i * 4 + 1], dr = r - colorTable[i * 4 + 2];
+            if (dr * dr + dg * dg + db * db < bestDist) bestDist = dr * dr + dg * dg + db * db;
+        }
+        const unsigned char * entry = &colorTable[inverseMap[cell] * 4];
+        int db = b - entry[0], dg = g - entry[1], dr = r - entry[2];
+        if (inverseMap[cell] >= numColors || dr * dr + dg * dg + db * db != bestDist) same = 0;
+    }
+    check(same, "inverse map holds the nearest palette entry of every cell centre");
+    free(inverseMap);
+}
+
+static void testSmoothImage(void) {
+    t_bmp24 * img = createImage24(120, 90, PATTERN_MID_RANGE);
+    t_bmp8 * indexed = quantize_toIndexed(img, 64);
+    check(indexed && indexed->numColors >= 2 && indexed->numColors <= 64, "64-colour palette is generated");
+    double error = 0.0;
+    for (int y = 0; indexed && y < img->height; y++) {
+        for (int x = 0; x < img->width; x++) {
+            t_pixel p = indexedColour(indexed, x, y), q = img->data[y][x];
+            error += abs(p.blue - q.blue) + abs(p.green - q.green) + abs(p.red - q.red);
+        }
+    }
+    error /= 3.0 * img->width * img->height;
+    char what[128];
+    snprintf(what, sizeof(what), "smooth image maps to 64 colours with a small mean error (%.2f)", error);
+    check(indexed && error < 8.0, what);
+    bmp8_free(indexed);
+    bmp24_free(img);
+}
+
+int main(void) {
+    testFewColours();
+    testInverseMap();
+    testSmoothImage();
+    return testResult("quantize");
+}
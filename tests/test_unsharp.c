@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "bmp24.h"
+#include "unsharp.h"
+#include "dispatch.h"
+#include "editstack.h"
+#include "job.h"
+#include "test_util.h"
+
+/*
+ * test_unsharp.c
+ * Author: Simon Hillel
+ * Description: Tests of the unsharp mask.
+ * The single-pass filter must match a direct two-pass reference bit for bit, whatever kernel
+ * variant is dispatched (IMAGE_CPU_LEVEL selects it), so every variant and the scalar tail
+ * have to round the same way: clamp, add 0.5 and truncate. The edit step and job op must
+ * parse and pass on their settings.
+ */
+
+static uint8_t channel(const t_pixel * p, int c) {
+    return c == 0 ? p->red : (c == 1 ? p->green : p->blue);
+}
+
+/**
+ * Unsharp mask computed the obvious way: horizontal blur of every row into a float image,
+ * then the vertical blur and the thresholded step, with edge rows and columns replicated.
+ * The sums run in the same order as the filter's.
+ */
+static uint8_t * reference(const t_bmp24 * img, float amount, float radius, float threshold) {
+    int width = img->width, height = img->height;
+    int n = (int)ceilf(3.0f * radius);
+    float * weights = (float *)malloc((2 * n + 1) * sizeof(float));
+    float sum = 0.0f;
+    for (int k = -n; k <= n; k++) {
+        weights[k + n] = expf(-(float)(k * k) / (2.0f * radius * radius));
+        sum += weights[k + n];
+    }
+    for (int k = 0; k <= 2 * n; k++) weights[k] /= sum;
+
+    float * horizontal = (float *)malloc((size_t)width * height * 3 * sizeof(float));
+    uint8_t * out = (uint8_t *)malloc((size_t)width * height * 3);
+    for (int y = 0; y < height; y++) {
+        for (int c = 0; c < 3; c++) {
+            for (int x = 0; x < width; x++) {
+                float acc = 0.0f;
+                for (int k = 0; k <= 2 * n; k++) {
+                    int sx = x + k - n;
+                    sx = sx < 0 ? 0 : (sx >= width ? width - 1 : sx);
+                    acc += channel(&img->data[y][sx], c) * weights[k];
+                }
+                horizontal[((size_t)y * 3 + c) * width + x] = acc;
+            }
+        }
+    }
+    for (int y = 0; y < height; y++) {
+        for (int c = 0; c < 3; c++) {
+            for (int x = 0; x < width; x++) {
+                float blur = 0.0f;
+                for (int k = 0; k <= 2 * n; k++) {
+                    int sy = y + k - n;
+                    sy = sy < 0 ? 0 : (sy >= height ? height - 1 : sy);
+                    blur += horizontal[((size_t)sy * 3 + c) * width + x] * weights[k];
+                }
+                float orig = channel(&img->data[y][x], c);
+                float diff = orig - blur;
+                float result = fabsf(diff) >= threshold ? orig + amount * diff : orig;
+                result = result < 0.0f ? 0.0f : (result > 255.0f ? 255.0f : result);
+                out[((size_t)y * width + x) * 3 + c] = (uint8_t)(result + 0.5f);
+            }
+        }
+    }
+    free(weights);
+    free(horizontal);
+    return out;
+}
+
+static void testMatchesReference(float amount, float radius, int threshold) {
+    // 75 columns: vector bodies of every width plus a scalar tail; 150 rows: several bands
+    t_bmp24 * img = createImage24(75, 150, PATTERN_NOISE);
+    uint8_t * expected = reference(img, amount, radius, (float)threshold);
+    unsharp_mask(img, amount, radius, threshold);
+
+    int mismatches = 0;
+    for (int y = 0; y < img->height; y++) {
+        for (int x = 0; x < img->width; x++) {
+            for (int c = 0; c < 3; c++) {
+                mismatches += channel(&img->data[y][x], c) != expected[((size_t)y * img->width + x) * 3 + c];
+            }
+        }
+    }
+    char what[128];
+    snprintf(what, sizeof(what), "amount %.2f, radius %.2f, threshold %d matches the reference (%s kernels)",
+             amount, radius, threshold, dispatch_levelName(dispatch_get()->level));
+    check(mismatches == 0, what);
+    free(expected);
+    bmp24_free(img);
+}
+
+static void testHalfwayRounding(void) {
+    // out = orig + 0.5 * (orig - blur) lands exactly on .5: it must round up in every lane
+    enum { SAMPLES = 29 };
+    float orig[SAMPLES], blur[SAMPLES];
+    uint8_t out[SAMPLES];
+    for (int i = 0; i < SAMPLES; i++) {
+        orig[i] = (float)(2 * i + 10);
+        blur[i] = orig[i] - 1.0f;
+    }
+    const float * rows[1] = {blur};
+    const float weights[1] = {1.0f};
+    dispatch_get()->unsharpRow(out, orig, rows, weights, 1, 0, SAMPLES, 0.5f, 0.0f);
+
+    int mismatches = 0;
+    for (int i = 0; i < SAMPLES; i++) mismatches += out[i] != 2 * i + 11;
+    check(mismatches == 0, "halfway results round up in the vector body and the tail");
+}
+
+static void testEditStep(void) {
+    t_editOp op;
+    check(job_parseOp("unsharp=150:1.5:4", &op) == 0 && op.type == EDIT_UNSHARP && op.values[0] == 150 &&
+          op.values[1] == 15 && op.values[2] == 4, "unsharp=150:1.5:4 parses");
+    check(job_parseOp("unsharp", &op) == 0 && op.values[0] == 100 && op.values[1] == 10 && op.values[2] == 0,
+          "unsharp defaults to 100:1.0:0");
+    check(job_parseOp("unsharp=150:0:4", &op) != 0 && job_parseOp("unsharp=150:1.0:300", &op) != 0,
+          "unsharp rejects a zero radius and a threshold above 255");
+
+    job_parseOp("unsharp=150:1.5:4", &op);
+    t_bmp24 * step = createImage24(75, 150, PATTERN_NOISE);
+    t_bmp24 * direct = createImage24(75, 150, PATTERN_NOISE);
+    editStack_applyOps24(step, &op, 1, 1.0f);
+    unsharp_mask(direct, 1.5f, 1.5f, 4);
+    check(samePixels24(step, direct), "the unsharp step applies unsharp_mask with its settings");
+    check(job_opBytes(op, 75, 150, 24) >= 3 * 2 * 5 * 75 * sizeof(t_pixel),
+          "the unsharp step predicts the rows copied around its bands");
+    bmp24_free(step);
+    bmp24_free(direct);
+}
+
+int main(void) {
+    testEditStep();
+    testHalfwayRounding();
+    testMatchesReference(1.0f, 1.0f, 0);
+    testMatchesReference(0.7f, 2.0f, 4);
+    testMatchesReference(3.0f, 0.5f, 10);
+    return testResult("unsharp-mask");
+}
@@ -0,0 +1,117 @@
+/*
+ * test_util.h
+ * Author: Simon Hillel
+ * Description: Helpers shared by the tests.
+ * A test program calls check() for every expectation and returns testResult() from main.
+ * The image factories build small synthetic images, so the tests need no files on disk.
+ */
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <stdio.h>
+#include <string.h>
+#include "bmp8.h"
+#include "bmp24.h"
+
+// Content of a synthetic image
+typedef enum {
+    PATTERN_MID_RANGE,    // Smooth colours between 60 and 200, far from clamping
+    PATTERN_STRIPES,      // Hard-edged stripes of 16 and 240
+    PATTERN_NOISE,        // Pseudo-random pixels (fixed seed)
+    PATTERN_GRADIENT      // Gray columns running through levels 40, 41, 42...
+} t_testPattern;
+
+static int failures = 0;
+
+/**
+ * Records a failed expectation.
+ */
+static inline void check(int condition, const char * what) {
+    if (!condition) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+/**
+ * Prints the outcome of a test program.
+ * @return The exit status: 0 if every check passed, 1 otherwise.
+ */
+static inline int testResult(const char * suite) {
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All %s tests passed\n", suite);
+    return 0;
+}
+
+/**
+ * Creates a colour image filled with a pattern.
+ */
+static inline t_bmp24 * createImage24(int width, int height, t_testPattern pattern) {
+    t_bmp24 * img = bmp24_allocate(width, height, 24);
+    if (!img) return NULL;
+    unsigned int seed = 12345;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            t_pixel pixel;
+            switch (pattern) {
+                case PATTERN_MID_RANGE:
+                    pixel = (t_pixel){(uint8_t)(60 + 4 * x % 140), (uint8_t)(70 + 3 * y % 130),
+                                      (uint8_t)(80 + 2 * (x + y) % 40)};
+                    break;
+                case PATTERN_STRIPES: {
+                    uint8_t v = ((x / 3 + y / 5) % 2) ? 240 : 16;
+                    pixel = (t_pixel){v, (uint8_t)(255 - v), (uint8_t)(x * 6)};
+                    break;
+                }
+                case PATTERN_NOISE:
+                    seed = seed * 1103515245u + 12345u;
+                    pixel = (t_pixel){(uint8_t)(seed >> 8), (uint8_t)(seed >> 16), (uint8_t)(x * 3 + y)};
+                    break;
+                default:
+                    pixel = (t_pixel){(uint8_t)(40 + x), (uint8_t)(40 + x), (uint8_t)(40 + x)};
+                    break;
+            }
+            img->data[y][x] = pixel;
+        }
+    }
+    return img;
+}
+
+/**
+ * Creates an 8-bit grayscale image filled with a pattern (the red channel of createImage24).
+ */
+static inline t_bmp8 * createImage8(int width, int height, t_testPattern pattern) {
+    t_bmp24 * colour = createImage24(width, height, pattern);
+    t_bmp8 * img = colour ? bmp8_allocate(width, height) : NULL;
+    if (img) {
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) img->data[(size_t)y * width + x] = colour->data[y][x].red;
+        }
+    }
+    bmp24_free(colour);
+    return img;
+}
+
+/**
+ * Returns 1 if two colour images have the same size and pixels.
+ */
+static inline int samePixels24(const t_bmp24 * a, const t_bmp24 * b) {
+    if (!a || !b || a->width != b->width || a->height != b->height) return 0;
+    for (int y = 0; y < a->height; y++) {
+        if (memcmp(a->data[y], b->data[y], a->width * sizeof(t_pixel)) != 0) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Returns 1 if two 8-bit images have the same size and pixels.
+ */
+static inline int samePixels8(const t_bmp8 * a, const t_bmp8 * b) {
+    if (!a || !b || a->width != b->width || a->height != b->height) return 0;
+    return memcmp(a->data, b->data, (size_t)a->width * a->height) == 0;
+}
+
+#endif // TEST_UTIL_H
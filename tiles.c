@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "tiles.h"
+#include "parallel.h"
+
+/*
+ * tiles.c
+ * Author: Simon Hillel
+ * Description: Implementation of copy-on-write tile snapshots.
+ * Images keep their usual row storage; snapshots are taken after an edit and compare each
+ * tile with the same tile of the previous snapshot. Unchanged tiles are shared (reference
+ * count + 1), so only the tiles the edit wrote are copied. Restoring compares tile pointers
+ * with the snapshot of the image's present content and copies only the tiles that differ.
+ * Tile rows are processed in parallel; a tile is only ever shared at its own index, so
+ * reference counts are never updated by two tasks at once.
+ */
+
+// Shared state of a parallel snapshot or restore
+typedef struct {
+    t_tileSnapshot * snap;
+    const t_tileSnapshot * other;   // Previous snapshot (snapshot) or current one (restore)
+    uint8_t * const * rows;
+    int bytesPerPixel;
+    atomic_size_t newBytes;
+    atomic_int failed;
+} t_tileState;
+
+/**
+ * Builds the row pointers of a colour image.
+ */
+static uint8_t ** rows24(const t_bmp24 * img) {
+    uint8_t ** rows = (uint8_t **)malloc(img->height * sizeof(uint8_t *));
+    if (!rows) return NULL;
+    for (int y = 0; y < img->height; y++) rows[y] = (uint8_t *)img->data[y];
+    return rows;
+}
+
+/**
+ * Builds the row pointers of an 8-bit image (rows are stored without padding).
+ */
+static uint8_t ** rows8(const t_bmp8 * img) {
+    uint8_t ** rows = (uint8_t **)malloc(img->height * sizeof(uint8_t *));
+    if (!rows) return NULL;
+    for (unsigned int y = 0; y < img->height; y++) rows[y] = img->data + (size_t)y * img->width;
+    return rows;
+}
+
+/**
+ * Returns 1 if two snapshots describe images of the same type and size.
+ */
+static int compatible(const t_tileSnapshot * a, const t_tileSnapshot * b) {
+    return a && b && a->isColor == b->isColor && a->width == b->width && a->height == b->height;
+}
+
+/**
+ * Returns the pixel bounds of tile (tx, ty).
+ */
+static void tileBounds(const t_tileSnapshot * snap, int tx, int ty, int * x0, int * y0, int * w, int * h) {
+    *x0 = tx * TILE_SIZE;
+    *y0 = ty * TILE_SIZE;
+    *w = snap->width - *x0 < TILE_SIZE ? snap->width - *x0 : TILE_SIZE;
+    *h = snap->height - *y0 < TILE_SIZE ? snap->height - *y0 : TILE_SIZE;
+}
+
+static void snapshotRows(int begin, int end, void * ctx) {
+    t_tileState * state = (t_tileState *)ctx;
+    t_tileSnapshot * snap = state->snap;
+    int bpp = state->bytesPerPixel;
+
+    for (int ty = begin; ty < end; ty++) {
+        for (int tx = 0; tx < snap->tilesX; tx++) {
+            int x0, y0, w, h;
+            tileBounds(snap, tx, ty, &x0, &y0, &w, &h);
+            size_t rowBytes = (size_t)w * bpp;
+            int index = ty * snap->tilesX + tx;
+
+            t_tile * old = state->other ? state->other->tiles[index] : NULL;
+            if (old) {
+                int same = 1;
+                for (int y = 0; y < h && same; y++) {
+                    same = memcmp(old->pixels + y * rowBytes, state->rows[y0 + y] + (size_t)x0 * bpp, rowBytes) == 0;
+                }
+                if (same) {
+                    old->refCount++;
+                    snap->tiles[index] = old;
+                    continue;
+                }
+            }
+
+            t_tile * tile = (t_tile *)malloc(sizeof(t_tile) + rowBytes * h);
+            if (!tile) {
+                atomic_store(&state->failed, 1);
+                return;
+            }
+            tile->refCount = 1;
+            tile->size = rowBytes * h;
+            for (int y = 0; y < h; y++) {
+                memcpy(tile->pixels + y * rowBytes, state->rows[y0 + y] + (size_t)x0 * bpp, rowBytes);
+            }
+            snap->tiles[index] = tile;
+            atomic_fetch_add(&state->newBytes, tile->size);
+        }
+    }
+}
+
+static void restoreRows(int begin, int end, void * ctx) {
+    t_tileState * state = (t_tileState *)ctx;
+    const t_tileSnapshot * snap = state->snap;
+    int bpp = state->bytesPerPixel;
+
+    for (int ty = begin; ty < end; ty++) {
+        for (int tx = 0; tx < snap->tilesX; tx++) {
+            int index = ty * snap->tilesX + tx;
+            if (state->other && state->other->tiles[index] == snap->tiles[index]) continue;
+
+            int x0, y0, w, h;
+            tileBounds(snap, tx, ty, &x0, &y0, &w, &h);
+            size_t rowBytes = (size_t)w * bpp;
+            const t_tile * tile = snap->tiles[index];
+            for (int y = 0; y < h; y++) {
+                memcpy(state->rows[y0 + y] + (size_t)x0 * bpp, tile->pixels + y * rowBytes, rowBytes);
+            }
+        }
+    }
+}
+
+/**
+ * Allocates an empty snapshot and fills its tiles from the image rows.
+ */
+static t_tileSnapshot * snapshot(int isColor, int width, int height, uint8_t * const * rows,
+                                 const t_tileSnapshot * prev, size_t * newBytes) {
+    t_tileSnapshot * snap = (t_tileSnapshot *)calloc(1, sizeof(t_tileSnapshot));
+    if (!snap) return NULL;
+    snap->isColor = isColor;
+    snap->width = width;
+    snap->height = height;
+    snap->tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    snap->tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    snap->tiles = (t_tile **)calloc((size_t)snap->tilesX * snap->tilesY, sizeof(t_tile *));
+    if (!snap->tiles) {
+        printf("Error: Failed to allocate snapshot\n");
+        free(snap);
+        return NULL;
+    }
+
+    t_tileState state;
+    state.snap = snap;
+    state.other = compatible(snap, prev) ? prev : NULL;
+    state.rows = rows;
+    state.bytesPerPixel = isColor ? 3 : 1;
+    atomic_init(&state.newBytes, 0);
+    atomic_init(&state.failed, 0);
+    parallel_for(0, snap->tilesY, 1, snapshotRows, &state);
+
+    if (atomic_load(&state.failed)) {
+        printf("Error: Failed to allocate snapshot tiles\n");
+        tiles_free(snap);
+        return NULL;
+    }
+    if (newBytes) *newBytes = atomic_load(&state.newBytes);
+    return snap;
+}
+
+/**
+ * Snapshots a colour image.
+ * @param img Pointer to the t_bmp24 structure.
+ * @param prev Previous snapshot to share unchanged tiles with, or NULL.
+ * @param newBytes Receives the bytes of the newly stored tiles (may be NULL).
+ * @return The snapshot, or NULL on failure.
+ */
+t_tileSnapshot * tiles_snapshot24(const t_bmp24 * img, const t_tileSnapshot * prev, size_t * newBytes) {
+    if (!img || !img->data) return NULL;
+
+    uint8_t ** rows = rows24(img);
+    if (!rows) return NULL;
+    t_tileSnapshot * snap = snapshot(1, img->width, img->height, rows, prev, newBytes);
+    free(rows);
+    if (snap) {
+        snap->meta24 = *img;
+        snap->meta24.data = NULL;
+    }
+    return snap;
+}
+
+/**
+ * Snapshots an 8-bit image, including its headers and palette.
+ * @param img Pointer to the t_bmp8 structure.
+ * @param prev Previous snapshot to share unchanged tiles with, or NULL.
+ * @param newBytes Receives the bytes of the newly stored tiles (may be NULL).
+ * @return The snapshot, or NULL on failure.
+ */
+t_tileSnapshot * tiles_snapshot8(const t_bmp8 * img, const t_tileSnapshot * prev, size_t * newBytes) {
+    if (!img || !img->data) return NULL;
+
+    uint8_t ** rows = rows8(img);
+    if (!rows) return NULL;
+    t_tileSnapshot * snap = snapshot(0, img->width, img->height, rows, prev, newBytes);
+    free(rows);
+    if (snap) {
+        snap->meta8 = *img;
+        snap->meta8.data = NULL;
+    }
+    return snap;
+}
+
+/**
+ * Copies the tiles of a snapshot into image rows, skipping the tiles shared with current.
+ */
+static void restore(const t_tileSnapshot * snap, uint8_t * const * rows, const t_tileSnapshot * current) {
+    t_tileState state;
+    state.snap = (t_tileSnapshot *)snap;
+    state.other = compatible(snap, current) ? current : NULL;
+    state.rows = rows;
+    state.bytesPerPixel = snap->isColor ? 3 : 1;
+    parallel_for(0, snap->tilesY, 1, restoreRows, &state);
+}
+
+/**
+ * Restores a snapshot into a colour image of the same size.
+ * @param snap The snapshot.
+ * @param img Pointer to the t_bmp24 structure.
+ * @param current Snapshot of the image's present content, or NULL to copy every tile.
+ */
+void tiles_restore24(const t_tileSnapshot * snap, t_bmp24 * img, const t_tileSnapshot * current) {
+    if (!snap || !img || !img->data) return;
+    if (!snap->isColor || snap->width != img->width || snap->height != img->height) {
+        printf("Error: Snapshot does not match the image\n");
+        return;
+    }
+
+    uint8_t ** rows = rows24(img);
+    if (!rows) return;
+    restore(snap, rows, current);
+    free(rows);
+
+    t_pixel ** data = img->data;
+    *img = snap->meta24;
+    img->data = data;
+}
+
+/**
+ * Restores a snapshot into an 8-bit image of the same size, including headers and palette.
+ * @param snap The snapshot.
+ * @param img Pointer to the t_bmp8 structure.
+ * @param current Snapshot of the image's present content, or NULL to copy every tile.
+ */
+void tiles_restore8(const t_tileSnapshot * snap, t_bmp8 * img, const t_tileSnapshot * current) {
+    if (!snap || !img || !img->data) return;
+    if (snap->isColor || snap->width != (int)img->width || snap->height != (int)img->height) {
+        printf("Error: Snapshot does not match the image\n");
+        return;
+    }
+
+    uint8_t ** rows = rows8(img);
+    if (!rows) return;
+    restore(snap, rows, current);
+    free(rows);
+
+    unsigned char * data = img->data;
+    *img = snap->meta8;
+    img->data = data;
+}
+
+/**
+ * Creates a colour image from a snapshot.
+ * @param snap The snapshot.
+ * @return Pointer to the new image, or NULL on failure.
+ */
+t_bmp24 * tiles_toBmp24(const t_tileSnapshot * snap) {
+    if (!snap || !snap->isColor) return NULL;
+    t_bmp24 * img = bmp24_allocate(snap->width, snap->height, 24);
+    if (img) tiles_restore24(snap, img, NULL);
+    return img;
+}
+
+/**
+ * Creates an 8-bit image from a snapshot.
+ * @param snap The snapshot.
+ * @return Pointer to the new image, or NULL on failure.
+ */
+t_bmp8 * tiles_toBmp8(const t_tileSnapshot * snap) {
+    if (!snap || snap->isColor) return NULL;
+    t_bmp8 * img = bmp8_allocate(snap->width, snap->height);
+    if (img) tiles_restore8(snap, img, NULL);
+    return img;
+}
+
+/**
+ * Frees a snapshot, releasing the tiles no other snapshot shares.
+ * @param snap The snapshot.
+ * @return The bytes of the released tiles.
+ */
+size_t tiles_free(t_tileSnapshot * snap) {
+    if (!snap) return 0;
+
+    size_t released = 0;
+    size_t numTiles = (size_t)snap->tilesX * snap->tilesY;
+    for (size_t i = 0; i < numTiles; i++) {
+        t_tile * tile = snap->tiles[i];
+        if (tile && --tile->refCount == 0) {
+            released += tile->size;
+            free(tile);
+        }
+    }
+    free(snap->tiles);
+    free(snap);
+    return released;
+}
@@ -0,0 +1,69 @@
+/*
+ * tiles.h
+ * Author: Simon Hillel
+ * Description: Header for copy-on-write tile snapshots of 8-bit and 24-bit images.
+ * A snapshot splits the pixels into TILE_SIZE x TILE_SIZE tiles held by reference count.
+ * Snapshots taken one after another share every tile that did not change, so a history of
+ * edits only stores the tiles each edit wrote, and moving between two snapshots only copies
+ * the tiles that differ between them.
+ */
+#ifndef TILES_H
+#define TILES_H
+
+#include <stddef.h>
+#include "bmp8.h"
+#include "bmp24.h"
+
+// Tile edge in pixels
+#define TILE_SIZE 64
+
+// Immutable block of pixels, shared between snapshots
+typedef struct {
+    unsigned int refCount;
+    size_t size;              // Bytes in pixels[]
+    unsigned char pixels[];   // Tile rows, packed (tile width * bytes per pixel each)
+} t_tile;
+
+typedef struct {
+    int isColor;
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+    t_tile ** tiles;          // tilesX * tilesY, row-major
+    t_bmp24 meta24;           // Headers of a colour image (data is NULL)
+    t_bmp8 meta8;             // Headers and palette of an 8-bit image (data is NULL)
+} t_tileSnapshot;
+
+/**
+ * Snapshots a colour image, sharing the tiles that are unchanged since prev (may be NULL).
+ * newBytes (may be NULL) receives the bytes of the tiles that had to be stored.
+ */
+t_tileSnapshot * tiles_snapshot24(const t_bmp24 * img, const t_tileSnapshot * prev, size_t * newBytes);
+/**
+ * Snapshots an 8-bit image, sharing the tiles that are unchanged since prev (may be NULL).
+ */
+t_tileSnapshot * tiles_snapshot8(const t_bmp8 * img, const t_tileSnapshot * prev, size_t * newBytes);
+/**
+ * Restores a snapshot into a colour image. If current (may be NULL) is a snapshot of the
+ * image's present content, only the tiles that differ from it are copied.
+ */
+void tiles_restore24(const t_tileSnapshot * snap, t_bmp24 * img, const t_tileSnapshot * current);
+/**
+ * Restores a snapshot into an 8-bit image (see tiles_restore24).
+ */
+void tiles_restore8(const t_tileSnapshot * snap, t_bmp8 * img, const t_tileSnapshot * current);
+/**
+ * Returns a new colour image with the content of a snapshot.
+ */
+t_bmp24 * tiles_toBmp24(const t_tileSnapshot * snap);
+/**
+ * Returns a new 8-bit image with the content of a snapshot.
+ */
+t_bmp8 * tiles_toBmp8(const t_tileSnapshot * snap);
+/**
+ * Frees a snapshot. Returns the bytes of the tiles that were released (no longer shared).
+ */
+size_t tiles_free(t_tileSnapshot * snap);
+
+#endif // TILES_H
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "unsharp.h"
+#include "parallel.h"
+#include "dispatch.h"
+
+/*
+ * unsharp.c
+ * Author: Simon Hillel
+ * Description: Implementation of the single-pass unsharp mask.
+ * The image is processed in bands of rows. Each band keeps a ring of horizontally blurred
+ * rows (one float plane per channel); as soon as the ring covers the vertical kernel, the
+ * blurred row is finished and combined with the original in the same loop, so there is no
+ * blurred copy of the image. Writes happen in place: a band only overwrites a row after every
+ * row that reads it has been blurred horizontally, and the rows it shares with neighbouring
+ * bands are copied before any band starts writing.
+ * The blur and combine step of each channel row is the dispatched unsharpRow kernel, whose
+ * variants all round by adding 0.5 and truncating.
+ */
+
+// Shared state of an unsharp-mask pass
+typedef struct {
+    t_bmp24 * img;
+    const float * weights;  // 2n + 1 normalised Gaussian weights
+    int n;
+    float amount;
+    float threshold;
+    t_pixel * halo;         // For each band: n rows above it, then n rows below it
+} t_unsharpState;
+
+/**
+ * Returns the halo copy of row y for the band starting at row begin, or NULL if y is
+ * inside the band (the live row is used then).
+ */
+static const t_pixel * haloRow(const t_unsharpState * s, int band, int begin, int end, int y) {
+    int width = s->img->width, n = s->n;
+    t_pixel * bandHalo = s->halo + (size_t)band * 2 * n * width;
+    if (y < begin) return bandHalo + (size_t)(y - (begin - n)) * width;
+    if (y >= end) return bandHalo + (size_t)(n + y - end) * width;
+    return NULL;
+}
+
+/**
+ * Copies the rows bordering each band before any band writes.
+ */
+static void copyHalos(int begin, int end, void * ctx) {
+    t_unsharpState * s = (t_unsharpState *)ctx;
+    int height = s->img->height;
+    for (int band = begin; band < end; band++) {
+        int rowBegin = band * UNSHARP_BAND_ROWS;
+        int rowEnd = rowBegin + UNSHARP_BAND_ROWS < height ? rowBegin + UNSHARP_BAND_ROWS : height;
+        for (int k = 0; k < s->n; k++) {
+            int above = rowBegin - s->n + k, below = rowEnd + k;
+            above = above < 0 ? 0 : above;
+            below = below >= height ? height - 1 : below;
+            memcpy((void *)haloRow(s, band, rowBegin, rowEnd, rowBegin - s->n + k), s->img->data[above],
+                   s->img->width * sizeof(t_pixel));
+            memcpy((void *)haloRow(s, band, rowBegin, rowEnd, rowEnd + k), s->img->data[below],
+                   s->img->width * sizeof(t_pixel));
+        }
+    }
+}
+
+/**
+ * Blurs one source row horizontally into three float planes (edge pixels are replicated).
+ */
+static void blurRow(const t_unsharpState * s, const t_pixel * src, float * padded, float * out) {
+    int width = s->img->width, n = s->n;
+    float * planes[3] = {out, out + width, out + 2 * width};
+
+    for (int c = 0; c < 3; c++) {
+        for (int x = -n; x < width + n; x++) {
+            const t_pixel * p = &src[x < 0 ? 0 : (x >= width ? width - 1 : x)];
+            padded[x + n] = (c == 0) ? p->red : (c == 1 ? p->green : p->blue);
+        }
+        float * dst = planes[c];
+        for (int x = 0; x < width; x++) {
+            dst[x] = 0.0f;
+        }
+        for (int k = 0; k <= 2 * n; k++) {
+            float w = s->weights[k];
+            const float * in = padded + k;
+            for (int x = 0; x < width; x++) {
+                dst[x] += in[x] * w;
+            }
+        }
+    }
+}
+
+static void unsharpBands(int bandBegin, int bandEnd, void * ctx) {
+    t_unsharpState * s = (t_unsharpState *)ctx;
+    int width = s->img->width, height = s->img->height, n = s->n, size = 2 * n + 1;
+    size_t rowFloats = (size_t)width * 3;
+    const t_dispatchTable * kernels = dispatch_get();
+
+    float * ring = (float *)malloc(size * rowFloats * sizeof(float));
+    float * padded = (float *)malloc((width + 2 * n) * sizeof(float));
+    float * orig = (float *)malloc(rowFloats * sizeof(float));
+    unsigned char * out = (unsigned char *)malloc(rowFloats);
+    const float ** rows = (const float **)malloc(size * sizeof(const float *));
+    if (!ring || !padded || !orig || !out || !rows) {
+        printf("Error: Failed to allocate row buffers for unsharp mask\n");
+        free(ring);
+        free(padded);
+        free(orig);
+        free(out);
+        free(rows);
+        return;
+    }
+
+    for (int band = bandBegin; band < bandEnd; band++) {
+        int begin = band * UNSHARP_BAND_ROWS;
+        int end = begin + UNSHARP_BAND_ROWS < height ? begin + UNSHARP_BAND_ROWS : height;
+
+        for (int y = begin - n; y < end + n; y++) {
+            const t_pixel * src = haloRow(s, band, begin, end, y);
+            if (!src) src = s->img->data[y];
+            blurRow(s, src, padded, ring + (size_t)((y - begin + n) % size) * rowFloats);
+
+            int row = y - n;
+            if (row < begin) continue;
+
+            // Rows row - n .. row + n are in the ring; row itself has not been written yet
+            int slot0 = (row - begin) % size;
+            t_pixel * dst = s->img->data[row];
+            for (int x = 0; x < width; x++) {
+                orig[x] = dst[x].red;
+                orig[width + x] = dst[x].green;
+                orig[2 * width + x] = dst[x].blue;
+            }
+            for (int c = 0; c < 3; c++) {
+                for (int k = 0; k < size; k++) {
+                    rows[k] = ring + (size_t)((slot0 + k) % size) * rowFloats + (size_t)c * width;
+                }
+                kernels->unsharpRow(out + (size_t)c * width, orig + (size_t)c * width, rows, s->weights,
+                                    size, 0, width, s->amount, s->threshold);
+            }
+            for (int x = 0; x < width; x++) {
+                dst[x].red = out[x];
+                dst[x].green = out[width + x];
+                dst[x].blue = out[2 * width + x];
+            }
+        }
+    }
+
+    free(ring);
+    free(padded);
+    free(orig);
+    free(out);
+    free(rows);
+}
+
+/**
+ * Sharpens a 24-bit image with an unsharp mask in a single pass.
+ * @param img Pointer to the t_bmp24 structure.
+ * @param amount Strength of the sharpening (e.g. 0.5 to 1.5).
+ * @param radius Standard deviation of the Gaussian blur in pixels (e.g. 1.0).
+ * @param threshold Minimum difference between a pixel and its blur for it to be sharpened (0-255).
+ */
+void unsharp_mask(t_bmp24 * img, float amount, float radius, int threshold) {
+    if (!img || !img->data || radius <= 0.0f) {
+        printf("Error: Invalid parameters for unsharp mask\n");
+        return;
+    }
+
+    int n = (int)ceilf(3.0f * radius);
+    float * weights = (float *)malloc((2 * n + 1) * sizeof(float));
+    int numBands = (img->height + UNSHARP_BAND_ROWS - 1) / UNSHARP_BAND_ROWS;
+    t_pixel * halo = (t_pixel *)malloc((size_t)numBands * 2 * n * img->width * sizeof(t_pixel));
+    if (!weights || !halo) {
+        printf("Error: Failed to allocate buffers for unsharp mask\n");
+        free(weights);
+        free(halo);
+        return;
+    }
+
+    float sum = 0.0f;
+    for (int k = -n; k <= n; k++) {
+        weights[k + n] = expf(-(float)(k * k) / (2.0f * radius * radius));
+        sum += weights[k + n];
+    }
+    for (int k = 0; k <= 2 * n; k++) {
+        weights[k] /= sum;
+    }
+
+    t_unsharpState state = {img, weights, n, amount, (float)threshold, halo};
+    parallel_for(0, numBands, 1, copyHalos, &state);
+    parallel_for(0, numBands, 1, unsharpBands, &state);
+
+    free(weights);
+    free(halo);
+}
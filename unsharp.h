@@ -0,0 +1,24 @@
+/*
+ * unsharp.h
+ * Author: Simon Hillel
+ * Description: Header for the single-pass unsharp mask.
+ * Declares an unsharp-mask filter (blur, subtract, scale, add, with a threshold) that computes
+ * the Gaussian blur in a rolling row buffer and writes the sharpened pixels in the same pass.
+ */
+#ifndef UNSHARP_H
+#define UNSHARP_H
+
+#include "bmp24.h"
+
+// Rows per band; each band copies the n rows above and below it
+#define UNSHARP_BAND_ROWS 64
+// Largest amount (percent) and radius (pixels) of the unsharp-mask step of jobs and the menu
+#define UNSHARP_MAX_AMOUNT 1000
+#define UNSHARP_MAX_RADIUS 20
+
+/**
+ * Sharpens a 24-bit image: out = in + amount * (in - blur) where |in - blur| >= threshold.
+ */
+void unsharp_mask(t_bmp24 * img, float amount, float radius, int threshold);
+
+#endif // UNSHARP_H